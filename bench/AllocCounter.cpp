@@ -0,0 +1,45 @@
+#include "AllocCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> newCalls(0);
+std::atomic<uint64_t> newBytes(0);
+
+} // namespace
+
+AllocCount AllocCount::now() {
+    return { newCalls.load(), newBytes.load() };
+}
+
+void* operator new(size_t size) {
+    newCalls.fetch_add(1, std::memory_order_relaxed);
+    newBytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
@@ -0,0 +1,25 @@
+// Counts heap allocations, for benchmarks that report or limit them.
+//
+// Linking AllocCounter.o into a program replaces the global operator new
+// and delete with versions that count every allocation (across all
+// threads) before going to malloc. Read the totals before and after the
+// code being measured and subtract.
+
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+#include <cstdint>
+
+struct AllocCount {
+    uint64_t allocations; // Calls to operator new
+    uint64_t bytes; // Bytes they asked for
+
+    // Totals since the program started
+    static AllocCount now();
+
+    AllocCount operator-(const AllocCount& other) const {
+        return { allocations - other.allocations, bytes - other.bytes };
+    }
+};
+
+#endif
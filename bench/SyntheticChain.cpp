@@ -0,0 +1,77 @@
+#include "SyntheticChain.h"
+#include "Target.h"
+
+SyntheticChain::SyntheticChain(int difficulty, size_t addresses, uint32_t seed)
+    : difficulty(difficulty), addresses(addresses), rng(seed) {
+    accounts.reserve(addresses);
+    for (size_t i = 0; i < addresses; i++) {
+        accounts.push_back(keys(i));
+    }
+}
+
+std::vector<Block> SyntheticChain::generate(size_t blocks, size_t txPerBlock) {
+    std::vector<Block> chain;
+    if (blocks == 0) {
+        return chain;
+    }
+    chain.reserve(blocks);
+
+    // Genesis funds every address
+    std::vector<Transaction> funding;
+    for (size_t i = 0; i < addresses; i++) {
+        Transaction tx("SYSTEM", accounts[i].address, 1000000);
+        tx.timestamp = START_TIME;
+        funding.push_back(tx);
+    }
+    Block genesis(0, "0", funding);
+    genesis.timestamp = START_TIME;
+    genesis.bits = bitsForLeadingZeros(difficulty);
+    genesis.mineBlock();
+    chain.push_back(genesis);
+
+    while (chain.size() < blocks) {
+        chain.push_back(nextBlock(chain.back(), txPerBlock));
+    }
+    return chain;
+}
+
+Block SyntheticChain::nextBlock(const Block& parent, size_t count) {
+    std::time_t timestamp = START_TIME + BLOCK_INTERVAL * (parent.index + 1);
+
+    Transaction reward("SYSTEM", "miner_" + std::to_string(parent.index + 1), 50);
+    reward.timestamp = timestamp;
+    std::vector<Transaction> txs { reward };
+    std::vector<Transaction> transfers = transactions(count, timestamp);
+    txs.insert(txs.end(), transfers.begin(), transfers.end());
+
+    Block block(parent.index + 1, parent.hash, txs);
+    block.timestamp = timestamp;
+    block.bits = parent.bits;
+    block.mineBlock();
+    return block;
+}
+
+std::vector<Transaction> SyntheticChain::transactions(size_t count, std::time_t timestamp) {
+    // Plain modulo rather than std::uniform_int_distribution, whose
+    // output differs between standard libraries
+    std::vector<Transaction> txs;
+    txs.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        size_t from = rng() % addresses;
+        size_t to = rng() % addresses;
+        double amount = (1 + rng() % 10000) / 100.0;
+        Transaction tx(accounts[from].address, accounts[to == from ? (to + 1) % addresses : to].address, amount);
+        tx.timestamp = timestamp;
+        tx.sign(accounts[from].privateKey);
+        txs.push_back(std::move(tx));
+    }
+    return txs;
+}
+
+KeyPair SyntheticChain::keys(size_t i) {
+    return keyPairFromSeed("addr_" + std::to_string(i));
+}
+
+std::string SyntheticChain::address(size_t i) {
+    return keys(i).address;
+}
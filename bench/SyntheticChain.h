@@ -0,0 +1,55 @@
+// Deterministic synthetic chains for benchmarks.
+//
+// The same arguments always give byte-identical blocks: timestamps are
+// fixed, addresses and amounts come from a seeded generator, and nonces
+// follow from the (fixed) block contents. Account keys are derived from
+// their names and Ed25519 signatures are deterministic, so transfers sign
+// the same every time. Genesis funds every address, so the generated
+// transfers keep positive balances and the chains validate at the
+// difficulty they were mined at.
+
+#ifndef SYNTHETICCHAIN_H
+#define SYNTHETICCHAIN_H
+
+#include "Block.h"
+#include "Signature.h"
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+class SyntheticChain {
+    public:
+        // First block timestamp; block n is stamped BLOCK_INTERVAL * n later
+        static constexpr std::time_t START_TIME = 1700000000;
+        static constexpr std::time_t BLOCK_INTERVAL = 60;
+
+        // Constructor: transfers between this many addresses
+        explicit SyntheticChain(int difficulty, size_t addresses = 1000, uint32_t seed = 1);
+
+        // A genesis block plus blocks - 1 blocks of txPerBlock transfers
+        // (each after a reward transaction)
+        std::vector<Block> generate(size_t blocks, size_t txPerBlock);
+
+        // A mined block of count transfers on top of parent
+        Block nextBlock(const Block& parent, size_t count);
+
+        // count signed transfers stamped with this time
+        std::vector<Transaction> transactions(size_t count, std::time_t timestamp);
+
+        // Keys of account i, derived from the name "addr_<i>"
+        static KeyPair keys(size_t i);
+
+        // Address of account i
+        static std::string address(size_t i);
+
+    private:
+        int difficulty;
+        size_t addresses;
+        std::vector<KeyPair> accounts; // keys(i) for each address, derived once
+        std::mt19937 rng;
+};
+
+#endif
@@ -0,0 +1,97 @@
+// bench_decode.cpp: allocations and throughput of decoding a long chain.
+//
+// 1. Builds a deterministic synthetic chain (see SyntheticChain.h)
+// 2. Decodes it the way a node takes in a CHAIN reply: the message is
+//    split into blocks, each block parsed, and the result handed to
+//    replaceChain() on an empty chain
+// 3. Saves the chain and times loadFromFile() on it
+// 4. For each, prints the heap allocations made (see AllocCounter.h),
+//    bytes allocated and blocks per second
+//
+// Usage: bench_decode [BLOCKS] [TX_PER_BLOCK]   (default 100000 and 4)
+
+#include "AllocCounter.h"
+#include "Blockchain.h"
+#include "Logger.h"
+#include "SyntheticChain.h"
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Usage {
+    AllocCount allocs;
+    std::chrono::steady_clock::time_point time;
+
+    static Usage now() {
+        return { AllocCount::now(), std::chrono::steady_clock::now() };
+    }
+};
+
+void report(const char* name, const Usage& start, size_t blocks) {
+    Usage end = Usage::now();
+    double seconds = std::chrono::duration<double>(end.time - start.time).count();
+    AllocCount used = end.allocs - start.allocs;
+    std::printf("%-22s %8.2f s %10.0f blocks/s %12llu allocs %8.1f allocs/block %9.1f MB\n", name, seconds,
+                blocks / seconds, static_cast<unsigned long long>(used.allocations),
+                static_cast<double>(used.allocations) / blocks, used.bytes / 1e6);
+    std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t blocks = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    size_t txPerBlock = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+    if (blocks < 2) {
+        std::fprintf(stderr, "usage: bench_decode [BLOCKS] [TX_PER_BLOCK]\n");
+        return 2;
+    }
+
+    // replaceChain() and loading log as they go
+    Logger::setLevel(LogLevel::Off);
+
+    // 1. The chain, and the CHAIN message a peer would send for it
+    Blockchain source(1, 50, false);
+    source.replaceChain(SyntheticChain(1).generate(blocks, txPerBlock));
+    std::string message = "{\"type\":\"CHAIN\",\"data\":" + source.toJSON() + "}";
+    std::printf("chain: %zu blocks, %zu tx per block, %.1f MB of JSON\n", blocks, txPerBlock, message.size() / 1e6);
+
+    // 2. CHAIN reply
+    {
+        Usage start = Usage::now();
+        std::vector<Block> decoded;
+        Block::fromJSONArray(message, "data", decoded);
+        Blockchain target(1, 50, false);
+        target.replaceChain(std::move(decoded));
+        report("CHAIN decode", start, blocks);
+        if (target.getChainLength() != blocks || target.snapshot()->tip().hash != source.snapshot()->tip().hash) {
+            std::fprintf(stderr, "decoded chain doesn't match\n");
+            return 1;
+        }
+    }
+
+    // 3. Chain file
+    std::string chainFile = "/tmp/bench_decode_" + std::to_string(getpid()) + ".json";
+    if (!source.saveToFile(chainFile)) {
+        std::fprintf(stderr, "can't write %s\n", chainFile.c_str());
+        return 1;
+    }
+    {
+        Usage start = Usage::now();
+        Blockchain target(1, 50, false);
+        bool loaded = target.loadFromFile(chainFile);
+        report("Blockchain::loadFromFile", start, blocks);
+        if (!loaded || target.snapshot()->tip().hash != source.snapshot()->tip().hash) {
+            std::fprintf(stderr, "loaded chain doesn't match\n");
+            std::remove(chainFile.c_str());
+            return 1;
+        }
+    }
+    std::remove(chainFile.c_str());
+    return 0;
+}
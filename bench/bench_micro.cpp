@@ -0,0 +1,312 @@
+// bench_micro.cpp: microbenchmarks for the core primitives.
+//
+// 1. Builds deterministic synthetic chains (see SyntheticChain.h)
+// 2. Times hashing, block JSON, chain save/load, getBalance, isValidChain
+//    and addBlock at several block and chain sizes. Each benchmark runs
+//    SAMPLES timed samples and reports the median ns per operation.
+// 3. Writes the results as JSON, one benchmark per line
+// 4. Compares them with a baseline from an earlier run, flagging anything
+//    more than --threshold percent slower; exits 1 if anything regressed
+//
+// Usage: bench_micro [--out FILE] [--baseline FILE] [--threshold PCT]
+//                    [--filter SUBSTRING] [--quick]
+
+#include "Blockchain.h"
+#include "Logger.h"
+#include "SyntheticChain.h"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int DIFFICULTY = 1;
+const int SAMPLES = 5;
+
+struct Result {
+    std::string name;
+    double nsPerOp;
+    uint64_t iterations; // Per sample
+};
+
+// Keeps results alive so the optimizer can't drop the work
+volatile size_t sink = 0;
+
+class Suite {
+    public:
+        Suite(double sampleSeconds, std::string filter) : sampleSeconds(sampleSeconds), filter(std::move(filter)) {}
+
+        // Time op() in batches, growing the batch until one fills a sample
+        template <typename Op>
+        void run(const std::string& name, Op op) {
+            if (!selected(name)) {
+                return;
+            }
+            op(); // Warm up
+
+            uint64_t iterations = 1;
+            while (true) {
+                double seconds = timeBatch(op, iterations);
+                if (seconds >= sampleSeconds || iterations >= (1ull << 40)) {
+                    break;
+                }
+                iterations = seconds <= 0 ? iterations * 10
+                    : std::max(iterations + 1, static_cast<uint64_t>(iterations * sampleSeconds / seconds * 1.1));
+            }
+
+            std::vector<double> samples;
+            for (int i = 0; i < SAMPLES; i++) {
+                samples.push_back(timeBatch(op, iterations) * 1e9 / iterations);
+            }
+            record(name, samples, iterations);
+        }
+
+        // Time op(state) alone, for operations that consume or change what
+        // setup() builds (setup is not timed)
+        template <typename Setup, typename Op>
+        void runWithSetup(const std::string& name, Setup setup, Op op) {
+            if (!selected(name)) {
+                return;
+            }
+
+            std::vector<double> samples;
+            uint64_t iterations = 0;
+            for (int i = 0; i < SAMPLES; i++) {
+                Clock::duration timed {};
+                iterations = 0;
+                while (iterations == 0 || std::chrono::duration<double>(timed).count() < sampleSeconds) {
+                    auto state = setup();
+                    auto start = Clock::now();
+                    op(state);
+                    timed += Clock::now() - start;
+                    iterations++;
+                }
+                samples.push_back(std::chrono::duration<double, std::nano>(timed).count() / iterations);
+            }
+            record(name, samples, iterations);
+        }
+
+        const std::vector<Result>& getResults() const { return results; }
+
+    private:
+        bool selected(const std::string& name) const {
+            return filter.empty() || name.find(filter) != std::string::npos;
+        }
+
+        template <typename Op>
+        static double timeBatch(Op& op, uint64_t iterations) {
+            auto start = Clock::now();
+            for (uint64_t i = 0; i < iterations; i++) {
+                op();
+            }
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        void record(const std::string& name, std::vector<double> samples, uint64_t iterations) {
+            std::sort(samples.begin(), samples.end());
+            Result result { name, samples[samples.size() / 2], iterations };
+            std::printf("%-50s %14.1f ns/op %12llu iters\n", name.c_str(), result.nsPerOp,
+                        static_cast<unsigned long long>(iterations));
+            std::fflush(stdout);
+            results.push_back(result);
+        }
+
+        double sampleSeconds;
+        std::string filter;
+        std::vector<Result> results;
+};
+
+// Blockchain holding a copy of chain
+std::unique_ptr<Blockchain> loadChain(const std::vector<Block>& chain) {
+    auto blockchain = std::make_unique<Blockchain>(DIFFICULTY, 50, false);
+    blockchain->replaceChain(chain);
+    return blockchain;
+}
+
+std::string toJSON(const std::vector<Result>& results) {
+    std::string json = "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"ns_per_op\": %.1f, \"iterations\": %llu}%s\n",
+                      results[i].name.c_str(), results[i].nsPerOp,
+                      static_cast<unsigned long long>(results[i].iterations), i + 1 < results.size() ? "," : "");
+        json += line;
+    }
+    json += "  ]\n}\n";
+    return json;
+}
+
+// name -> ns/op from a file toJSON() wrote; false if it can't be read
+bool readBaseline(const std::string& filename, std::map<std::string, double>& baseline) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    const std::string namePattern = "\"name\": \"";
+    const std::string nsPattern = "\"ns_per_op\": ";
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t name = line.find(namePattern);
+        size_t ns = line.find(nsPattern);
+        if (name == std::string::npos || ns == std::string::npos) {
+            continue;
+        }
+        name += namePattern.size();
+        baseline[line.substr(name, line.find('"', name) - name)] = std::atof(line.c_str() + ns + nsPattern.size());
+    }
+    return true;
+}
+
+// Print each result against the baseline; returns how many regressed
+int compare(const std::vector<Result>& results, const std::map<std::string, double>& baseline, double threshold) {
+    std::printf("\n%-50s %14s %14s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+    int regressions = 0;
+    for (const Result& result : results) {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end() || it->second <= 0) {
+            std::printf("%-50s %14s %14.1f %9s\n", result.name.c_str(), "-", result.nsPerOp, "new");
+            continue;
+        }
+
+        double change = (result.nsPerOp / it->second - 1) * 100;
+        const char* flag = "";
+        if (change > threshold) {
+            flag = "  REGRESSION";
+            regressions++;
+        } else if (change < -threshold) {
+            flag = "  improved";
+        }
+        std::printf("%-50s %14.1f %14.1f %+8.1f%%%s\n", result.name.c_str(), it->second, result.nsPerOp, change, flag);
+    }
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string outFile = "bench_results.json";
+    std::string baselineFile;
+    std::string filter;
+    double threshold = 15;
+    double sampleSeconds = 0.1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--out" && hasValue) {
+            outFile = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            baselineFile = argv[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            threshold = std::atof(argv[++i]);
+        } else if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "--quick") {
+            sampleSeconds = 0.02;
+        } else {
+            std::fprintf(stderr, "usage: bench_micro [--out FILE] [--baseline FILE] [--threshold PCT]\n"
+                                 "                   [--filter SUBSTRING] [--quick]\n");
+            return 2;
+        }
+    }
+
+    // addBlock() and validation log every block
+    Logger::setLevel(LogLevel::Off);
+
+    Suite suite(sampleSeconds, filter);
+
+    // 1. Hashing
+    SyntheticChain generator(DIFFICULTY);
+    Transaction tx = generator.transactions(1, SyntheticChain::START_TIME)[0];
+    suite.run("Transaction::calculateHash", [&]() { sink = sink + tx.calculateHash().size(); });
+
+    Block block = generator.generate(2, 10).back();
+    suite.run("Block::calculateHash", [&]() { sink = sink + block.calculateHash().size(); });
+
+    // 2. Per-block work at several block sizes
+    for (size_t txCount : { 10, 100, 1000 }) {
+        Block block = SyntheticChain(DIFFICULTY).generate(2, txCount).back();
+        std::string suffix = "/tx=" + std::to_string(txCount);
+        std::string json = block.toJSON();
+
+        suite.run("Transaction::calculateHashes" + suffix, [&]() {
+            sink = sink + Transaction::calculateHashes(block.transactions).size();
+        });
+        suite.run("Block::calculateMerkleRoot" + suffix, [&]() { sink = sink + block.calculateMerkleRoot().size(); });
+        suite.run("Block::toJSON" + suffix, [&]() { sink = sink + block.toJSON().size(); });
+        suite.run("Block::fromJSON" + suffix, [&]() { sink = sink + Block::fromJSON(json).transactions.size(); });
+    }
+
+    // 3. Whole-chain work at several chain sizes
+    const size_t TX_PER_BLOCK = 10;
+    std::string chainFile = "/tmp/bench_micro_" + std::to_string(getpid()) + ".json";
+    for (size_t length : { 100, 1000, 10000 }) {
+        std::vector<Block> chain = SyntheticChain(DIFFICULTY).generate(length, TX_PER_BLOCK);
+        std::unique_ptr<Blockchain> blockchain = loadChain(chain);
+        std::string suffix = "/blocks=" + std::to_string(length) + "/tx=" + std::to_string(TX_PER_BLOCK);
+
+        std::string address = SyntheticChain::address(7);
+        suite.run("Blockchain::getBalance" + suffix, [&]() {
+            sink = sink + static_cast<size_t>(blockchain->getBalance(address));
+        });
+        suite.run("Blockchain::isValidChain" + suffix, [&]() { sink = sink + blockchain->isValidChain(chain); });
+
+        if (length > 1000) {
+            continue; // Save/load and addBlock at 10,000 blocks take too long to sample
+        }
+
+        suite.run("Blockchain::saveToFile" + suffix, [&]() { sink = sink + blockchain->saveToFile(chainFile); });
+        blockchain->saveToFile(chainFile);
+        suite.runWithSetup("Blockchain::loadFromFile" + suffix,
+                           []() { return std::make_unique<Blockchain>(DIFFICULTY, 50, false); },
+                           [&](std::unique_ptr<Blockchain>& target) { sink = sink + target->loadFromFile(chainFile); });
+
+        for (size_t txCount : { 10, 100 }) {
+            std::vector<Transaction> pending = generator.transactions(txCount, SyntheticChain::START_TIME);
+            suite.runWithSetup("Blockchain::addBlock" + suffix + "/new_tx=" + std::to_string(txCount),
+                               [&]() { return loadChain(chain); },
+                               [&](std::unique_ptr<Blockchain>& target) {
+                                   target->addBlock(pending);
+                                   sink = sink + target->getChainLength();
+                               });
+        }
+    }
+    std::remove(chainFile.c_str());
+
+    // 4. Results, then the comparison
+    std::ofstream out(outFile);
+    out << toJSON(suite.getResults());
+    if (!out) {
+        std::fprintf(stderr, "can't write %s\n", outFile.c_str());
+        return 2;
+    }
+    std::printf("\nWrote %s\n", outFile.c_str());
+
+    if (baselineFile.empty()) {
+        return 0;
+    }
+    std::map<std::string, double> baseline;
+    if (!readBaseline(baselineFile, baseline)) {
+        std::printf("No baseline at %s (make bench_baseline saves one)\n", baselineFile.c_str());
+        return 0;
+    }
+
+    int regressions = compare(suite.getResults(), baseline, threshold);
+    if (regressions > 0) {
+        std::printf("\n%d benchmark(s) more than %.0f%% slower than %s\n", regressions, threshold, baselineFile.c_str());
+        return 1;
+    }
+    std::printf("\nNo regressions beyond %.0f%% against %s\n", threshold, baselineFile.c_str());
+    return 0;
+}
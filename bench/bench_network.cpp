@@ -0,0 +1,380 @@
+// bench_network.cpp:
+// 1. Starts N Nodes on loopback ports in this process and wires them
+//    into a topology (ring, line, star, random or full mesh)
+// 2. Each round gossips a batch of transactions from random nodes, then a
+//    random node mines them; records when every other node connected the
+//    block and how many bytes the network sent for it
+// 3. Provokes forks by handing two nodes competing blocks for the same
+//    height at the same moment, extends the branch the first of them
+//    ended up on, and times how long until every node has reorganized
+//    onto it
+// 4. Hands one node forgeries it must refuse: a block minting more than
+//    its reward, one with a second payout, and a longer chain from a
+//    genesis of its own
+// 5. Reports propagation percentiles, fork convergence and bytes per
+//    block per node; built with TRACING=1 it also writes every node's
+//    spans to bench_network.trace.json
+//
+// Usage: bench_network [nodes] [topology] [blocks] [tx per block] [forks]
+
+#include "Node.h"
+#include "Logger.h"
+#include "Signature.h"
+#include "Tracer.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int BASE_PORT = 19700;
+
+// Poll until cond() holds or the timeout passes
+template <typename Cond>
+bool waitFor(Cond cond, std::chrono::milliseconds timeout) {
+    auto deadline = Clock::now() + timeout;
+    while (!cond()) {
+        if (Clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return true;
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t idx = static_cast<size_t>(p * (samples.size() - 1));
+    return samples[idx];
+}
+
+void report(const char* label, const std::vector<double>& millis) {
+    std::printf("%-26s n=%-5zu p50=%7.2fms p90=%7.2fms p99=%7.2fms max=%7.2fms\n", label, millis.size(),
+                percentile(millis, 0.50), percentile(millis, 0.90), percentile(millis, 0.99),
+                percentile(millis, 1.0));
+}
+
+// Undirected edges (i dials j) for the requested topology
+std::vector<std::pair<int, int>> buildTopology(const std::string& topology, int n, std::mt19937& rng) {
+    std::set<std::pair<int, int>> edges;
+    auto addEdge = [&](int a, int b) {
+        if (a != b) {
+            edges.insert({ std::min(a, b), std::max(a, b) });
+        }
+    };
+
+    if (topology == "line" || topology == "ring") {
+        for (int i = 0; i + 1 < n; i++) {
+            addEdge(i, i + 1);
+        }
+        if (topology == "ring" && n > 2) {
+            addEdge(n - 1, 0);
+        }
+    } else if (topology == "star") {
+        for (int i = 1; i < n; i++) {
+            addEdge(0, i);
+        }
+    } else if (topology == "full") {
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                addEdge(i, j);
+            }
+        }
+    } else {
+        // Random: a ring for connectivity plus random chords, about 4 peers each
+        for (int i = 0; i < n; i++) {
+            addEdge(i, (i + 1) % n);
+        }
+        std::uniform_int_distribution<int> pick(0, n - 1);
+        for (int i = 0; i < n; i++) {
+            addEdge(i, pick(rng));
+        }
+    }
+
+    return std::vector<std::pair<int, int>>(edges.begin(), edges.end());
+}
+
+// A raw connection we push hand-made blocks through
+int connectLoopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void sendBlock(int fd, const Block& block) {
+    std::string frame = "{\"type\":\"NEW_BLOCK\",\"data\":" + block.toJSON() + "}\n";
+    send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+}
+
+// A block on top of parent carrying txs as they are
+Block mineWith(const Block& parent, const std::vector<Transaction>& txs) {
+    Block block(parent.index + 1, parent.hash, txs);
+    block.bits = parent.bits;
+    block.timestamp = std::max(block.timestamp, parent.timestamp + 1); // Past the median time
+    block.mineBlock();
+    return block;
+}
+
+// A block on top of parent paying its reward to miner
+Block mineOn(const Block& parent, const std::string& miner) {
+    return mineWith(parent, { Transaction("SYSTEM", miner, 50) });
+}
+
+std::string tipHash(Node& node) {
+    return node.getBlockchain().snapshot()->tip().hash;
+}
+
+bool allOnTip(std::vector<std::unique_ptr<Node>>& nodes, const std::string& hash) {
+    for (auto& node : nodes) {
+        if (tipHash(*node) != hash) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t totalBytesSent(std::vector<std::unique_ptr<Node>>& nodes) {
+    uint64_t total = 0;
+    for (auto& node : nodes) {
+        total += node->getBytesSent();
+    }
+    return total;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int nodeCount = argc > 1 ? std::atoi(argv[1]) : 16;
+    std::string topology = argc > 2 ? argv[2] : "random";
+    int blocks = argc > 3 ? std::atoi(argv[3]) : 20;
+    int txPerBlock = argc > 4 ? std::atoi(argv[4]) : 50;
+    int forks = argc > 5 ? std::atoi(argv[5]) : 5;
+
+    // Node chatter would swamp the report
+    Logger::setLevel(LogLevel::Off);
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pickNode(0, nodeCount - 1);
+
+    // 1. Start every node and wire the topology
+    std::vector<std::unique_ptr<Node>> nodes;
+    for (int i = 0; i < nodeCount; i++) {
+        nodes.push_back(std::make_unique<Node>(BASE_PORT + i, 1, 50, 1));
+        nodes.back()->getPeerManager().setLimits(nodeCount, nodeCount);
+        nodes.back()->start();
+    }
+
+    std::vector<std::pair<int, int>> edges = buildTopology(topology, nodeCount, rng);
+    for (const auto& edge : edges) {
+        nodes[edge.first]->connectToPeer("127.0.0.1", BASE_PORT + edge.second);
+    }
+
+    size_t connections = 0;
+    waitFor([&]() {
+        connections = 0;
+        for (auto& node : nodes) {
+            connections += node->getPeerCount();
+        }
+        return connections == 2 * edges.size();
+    }, std::chrono::seconds(10));
+
+    std::printf("nodes: %d, topology: %s, links: %zu, %d blocks of %d transactions, %d forks\n", nodeCount,
+                topology.c_str(), connections / 2, blocks, txPerBlock, forks);
+
+    // 2. Propagation rounds
+    std::vector<double> arrivals; // Every (node, block) pair
+    std::vector<double> fullCoverage; // Time until the last node had the block
+    uint64_t relayBytes = 0;
+    int txSerial = 0;
+    int lost = 0;
+    KeyPair alice = keyPairFromSeed("Alice"); // Funded by genesis
+
+    for (int round = 0; round < blocks; round++) {
+        // Transaction load from random nodes; let gossip settle so the
+        // block relays mostly as short IDs, like on a real network
+        int miner = pickNode(rng);
+        for (int t = 0; t < txPerBlock; t++) {
+            Transaction tx(alice.address, "addr_" + std::to_string(txSerial), 0.0001 * (1 + txSerial % 100));
+            tx.sign(alice.privateKey);
+            txSerial++;
+            nodes[pickNode(rng)]->submitTransaction(tx);
+        }
+        waitFor([&]() { return nodes[miner]->getMempool().size() >= static_cast<size_t>(txPerBlock); },
+                std::chrono::seconds(2));
+
+        uint64_t bytesBefore = totalBytesSent(nodes);
+        nodes[miner]->minePendingTransactions();
+        auto minedAt = Clock::now();
+        size_t height = nodes[miner]->getBlockchain().getChainLength();
+
+        // Time each node's arrival by polling its lock-free chain length
+        std::vector<bool> arrived(nodeCount, false);
+        arrived[miner] = true;
+        int remaining = nodeCount - 1;
+        double last = 0.0;
+        auto deadline = minedAt + std::chrono::seconds(10);
+        while (remaining > 0 && Clock::now() < deadline) {
+            for (int i = 0; i < nodeCount; i++) {
+                if (!arrived[i] && nodes[i]->getBlockchain().getChainLength() >= height) {
+                    arrived[i] = true;
+                    remaining--;
+                    last = std::chrono::duration<double, std::milli>(Clock::now() - minedAt).count();
+                    arrivals.push_back(last);
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        lost += remaining;
+        fullCoverage.push_back(last);
+
+        // Let trailing INV/GETBLOCKTXN traffic finish before counting
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        relayBytes += totalBytesSent(nodes) - bytesBefore;
+    }
+
+    // 3. Forks: two nodes get competing blocks for the same height at
+    //    once and each spreads its own; then one branch is extended
+    std::vector<double> convergence;
+    std::vector<int> reorged; // Nodes that had to switch branches
+    int unconverged = 0;
+    std::vector<int> injectors(nodeCount, -1);
+
+    for (int f = 0; f < forks && nodeCount > 1; f++) {
+        int a = pickNode(rng);
+        int b = pickNode(rng);
+        while (b == a) {
+            b = pickNode(rng);
+        }
+        for (int i : { a, b }) {
+            if (injectors[i] < 0) {
+                injectors[i] = connectLoopback(BASE_PORT + i);
+            }
+        }
+
+        Block tip = nodes[a]->getBlockchain().snapshot()->tip();
+        Block blockA = mineOn(tip, "MINER_A" + std::to_string(f));
+        Block blockB = mineOn(tip, "MINER_B" + std::to_string(f));
+        sendBlock(injectors[a], blockA);
+        sendBlock(injectors[b], blockB);
+
+        // Wait for the split to settle: every node on one of the two
+        waitFor([&]() {
+            for (auto& node : nodes) {
+                std::string hash = tipHash(*node);
+                if (hash != blockA.hash && hash != blockB.hash) {
+                    return false;
+                }
+            }
+            return true;
+        }, std::chrono::seconds(5));
+
+        // Extending whichever branch node a ended up on decides; the
+        // other side has to reorganize
+        Block parent = nodes[a]->getBlockchain().snapshot()->tip();
+        int losers = 0;
+        for (auto& node : nodes) {
+            losers += (tipHash(*node) != parent.hash) ? 1 : 0;
+        }
+        reorged.push_back(losers);
+
+        Block decider = mineOn(parent, "MINER_A" + std::to_string(f));
+        auto start = Clock::now();
+        sendBlock(injectors[a], decider);
+        if (waitFor([&]() { return allOnTip(nodes, decider.hash); }, std::chrono::seconds(20))) {
+            convergence.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        } else {
+            unconverged++;
+        }
+    }
+
+    // 4. Forgeries, each over a connection of its own (the first thing
+    //    refused drops it); any that moves the tip was taken
+    int forgeries = 0;
+    int forgeriesTaken = 0;
+    auto forge = [&](const std::string& message) {
+        std::string before = tipHash(*nodes[0]);
+        int fd = connectLoopback(BASE_PORT);
+        if (fd < 0) {
+            return;
+        }
+        std::string frame = message + "\n";
+        send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+        forgeries++;
+        if (waitFor([&]() { return tipHash(*nodes[0]) != before; }, std::chrono::seconds(1))) {
+            forgeriesTaken++;
+        }
+        close(fd);
+    };
+
+    Block inflated = mineWith(nodes[0]->getBlockchain().snapshot()->tip(), { Transaction("SYSTEM", "FORGER", 5000) });
+    forge("{\"type\":\"NEW_BLOCK\",\"data\":" + inflated.toJSON() + "}");
+    Block secondPayout = mineWith(nodes[0]->getBlockchain().snapshot()->tip(),
+                                  { Transaction("SYSTEM", "FORGER", 50), Transaction("SYSTEM", "FORGER", 50) });
+    forge("{\"type\":\"NEW_BLOCK\",\"data\":" + secondPayout.toJSON() + "}");
+
+    Transaction grant("SYSTEM", "FORGER", 1000000);
+    grant.timestamp = Blockchain::GENESIS_TIMESTAMP;
+    Block genesis(0, "0", { grant });
+    genesis.timestamp = Blockchain::GENESIS_TIMESTAMP;
+    genesis.bits = nodes[0]->getBlockchain().getInitialBits();
+    genesis.mineBlock();
+    std::string chainJson = "[" + genesis.toJSON();
+    Block forged = genesis;
+    for (size_t i = 0; i <= nodes[0]->getBlockchain().getChainLength(); i++) { // Longer than ours
+        forged = mineOn(forged, "FORGER");
+        chainJson += "," + forged.toJSON();
+    }
+    forge("{\"type\":\"CHAIN\",\"data\":" + chainJson + "]}");
+
+    // 5. Report
+    report("block arrival (per node)", arrivals);
+    report("block reached all nodes", fullCoverage);
+    report("fork convergence", convergence);
+    double avgReorged = reorged.empty() ? 0.0 : double(std::accumulate(reorged.begin(), reorged.end(), 0)) / reorged.size();
+    std::printf("fork reorgs:               %.1f of %d nodes per fork on average, %d failed to converge\n",
+                avgReorged, nodeCount, unconverged);
+    std::printf("blocks never arrived:      %d\n", lost);
+    std::printf("forgeries taken:           %d of %d\n", forgeriesTaken, forgeries);
+    std::printf("bytes per block per node:  %.0f\n",
+                blocks > 0 ? double(relayBytes) / blocks / nodeCount : 0.0);
+#ifdef BLOCKCHAIN_TRACING
+    if (Tracer::instance().writeFile("bench_network.trace.json")) {
+        std::printf("trace:                     bench_network.trace.json\n");
+    }
+#endif
+
+    for (int fd : injectors) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    for (auto& node : nodes) {
+        node->stop();
+    }
+    return (lost == 0 && unconverged == 0 && forgeriesTaken == 0 && forgeries == 3) ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+// bench_peers.cpp:
+// 1. Starts one Node on a loopback port
+// 2. Opens 1,000 peer connections to it from this process
+// 3. Reports memory and thread count before and after connecting
+// 4. Measures GET_LENGTH -> LENGTH round trips, one at a time and as a burst
+//
+// Usage: bench_peers [peers] [port]
+
+#include "Node.h"
+#include "Logger.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Read a "Key:   value kB" line from /proc/self/status
+long readStatus(const std::string& key) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, key.size(), key) == 0) {
+            return std::atol(line.c_str() + key.size() + 1);
+        }
+    }
+    return -1;
+}
+
+int connectLoopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return fd;
+}
+
+// Block until the LENGTH reply has arrived, skipping the node's own
+// VERSION and PING messages. Bytes after it stay in pending.
+bool readReply(int fd, std::string& pending) {
+    char buffer[256];
+    while (true) {
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos) {
+            bool isReply = pending.compare(0, 16, "{\"type\":\"LENGTH\"") == 0;
+            pending.erase(0, newline + 1);
+            if (isReply) {
+                return true;
+            }
+        }
+
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return false;
+        }
+        pending.append(buffer, n);
+    }
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t idx = static_cast<size_t>(p * (samples.size() - 1));
+    return samples[idx];
+}
+
+void report(const char* label, const std::vector<double>& micros) {
+    std::printf("%-22s n=%zu p50=%.1fus p90=%.1fus p99=%.1fus max=%.1fus\n", label, micros.size(),
+                percentile(micros, 0.50), percentile(micros, 0.90), percentile(micros, 0.99),
+                percentile(micros, 1.0));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int peers = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int port = argc > 2 ? std::atoi(argv[2]) : 18444;
+
+    // Node chatter would swamp the report
+    Logger::setLevel(LogLevel::Off);
+
+    Node node(port, 1, 50);
+    node.getPeerManager().setLimits(peers + 16, 8);
+    node.start();
+
+    long rssBefore = readStatus("VmRSS:");
+    long threadsBefore = readStatus("Threads:");
+
+    // 1. Connect every peer
+    std::vector<int> sockets;
+    sockets.reserve(peers);
+    auto connectStart = Clock::now();
+    for (int i = 0; i < peers; i++) {
+        int fd = connectLoopback(port);
+        if (fd < 0) {
+            std::fprintf(stderr, "connect %d failed\n", i);
+            return 1;
+        }
+        sockets.push_back(fd);
+    }
+    while (node.getPeerCount() < static_cast<size_t>(peers)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double connectMs = std::chrono::duration<double, std::milli>(Clock::now() - connectStart).count();
+
+    long rssAfter = readStatus("VmRSS:");
+    long threadsAfter = readStatus("Threads:");
+
+    const std::string request = "{\"type\":\"GET_LENGTH\"}\n";
+    std::vector<std::string> pending(sockets.size());
+
+    // 2. Sequential round trips: one request in flight at a time
+    std::vector<double> sequential;
+    for (size_t i = 0; i < sockets.size(); i++) {
+        int fd = sockets[i];
+        auto start = Clock::now();
+        send(fd, request.data(), request.size(), 0);
+        if (!readReply(fd, pending[i])) {
+            std::fprintf(stderr, "peer closed during sequential round\n");
+            return 1;
+        }
+        sequential.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+
+    // 3. Burst: every peer asks at once, replies collected with epoll
+    int ep = epoll_create1(0);
+    for (size_t i = 0; i < sockets.size(); i++) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, sockets[i], &ev);
+    }
+
+    std::vector<double> burst;
+    auto burstStart = Clock::now();
+    for (int fd : sockets) {
+        send(fd, request.data(), request.size(), 0);
+    }
+    std::vector<epoll_event> events(256);
+    while (burst.size() < sockets.size()) {
+        int n = epoll_wait(ep, events.data(), events.size(), 5000);
+        if (n <= 0) {
+            std::fprintf(stderr, "timed out waiting for burst replies\n");
+            return 1;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = sockets[events[i].data.u64];
+            readReply(fd, pending[events[i].data.u64]);
+            epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+            burst.push_back(std::chrono::duration<double, std::micro>(Clock::now() - burstStart).count());
+        }
+    }
+    double burstMs = std::chrono::duration<double, std::milli>(Clock::now() - burstStart).count();
+    close(ep);
+
+    std::printf("peers:                 %d\n", peers);
+    std::printf("connect time:          %.1f ms\n", connectMs);
+    std::printf("threads:               %ld before, %ld after\n", threadsBefore, threadsAfter);
+    std::printf("RSS:                   %ld kB before, %ld kB after (%.2f kB/peer, both ends)\n", rssBefore,
+                rssAfter, peers > 0 ? double(rssAfter - rssBefore) / peers : 0.0);
+    report("sequential round trip", sequential);
+    report("burst completion", burst);
+    std::printf("burst throughput:      %.0f req/s\n", sockets.size() / (burstMs / 1000.0));
+
+    for (int fd : sockets) {
+        close(fd);
+    }
+    node.stop();
+    return 0;
+}
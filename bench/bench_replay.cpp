@@ -0,0 +1,235 @@
+// bench_replay.cpp:
+// 1. Without a trace argument, records one: a fresh node syncs a chain
+//    from a seed node, then receives live transaction gossip and compact
+//    blocks, a run of NEW_BLOCK messages and finally a longer CHAIN, all
+//    while tracing its inbound traffic
+// 2. Replays the trace into fresh, never-started Nodes back to back,
+//    several times, and checks every replay ends on the recorded tip
+// 3. Replays once more at the recorded timing
+// 4. Reports messages/s and MB/s overall and time per message type, so
+//    receiveBlock/receiveChain processing can be compared between builds
+//
+// Usage: bench_replay [trace file] [runs] [--no-realtime]
+
+#include "Node.h"
+#include "Logger.h"
+#include "Signature.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int DIFFICULTY = 1;
+const double REWARD = 50;
+const int SEED_PORT = 19800;
+const int RECORDER_PORT = 19801;
+
+// Poll until cond() holds or the timeout passes
+template <typename Cond>
+bool waitFor(Cond cond, std::chrono::milliseconds timeout) {
+    auto deadline = Clock::now() + timeout;
+    while (!cond()) {
+        if (Clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return true;
+}
+
+int connectLoopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void sendRaw(int fd, const std::string& message) {
+    std::string frame = message + "\n";
+    send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+}
+
+// A block on top of parent with its reward and a few transfers from
+// Alice (funded by genesis)
+Block mineOn(const Block& parent, int serial, int txCount) {
+    static const KeyPair alice = keyPairFromSeed("Alice");
+    std::vector<Transaction> txs { Transaction("SYSTEM", "miner_" + std::to_string(serial), REWARD) };
+    for (int t = 1; t < txCount; t++) {
+        txs.push_back(Transaction(alice.address, "addr_" + std::to_string(serial) + "_" + std::to_string(t), 0.0001));
+        txs.back().sign(alice.privateKey);
+    }
+    Block block(parent.index + 1, parent.hash, txs);
+    block.bits = parent.bits;
+    block.timestamp = std::max(block.timestamp, parent.timestamp + 1); // Past the median time
+    block.mineBlock();
+    return block;
+}
+
+// Record a representative trace; returns the tip the recorder ended on
+std::string recordTrace(const std::string& filename) {
+    const int SYNC_BLOCKS = 500;
+    const int LIVE_BLOCKS = 40;
+    const int LIVE_TXS = 25;
+    const int PUSHED_BLOCKS = 20;
+
+    // Seed with a ready-made chain to sync from
+    Node seed(SEED_PORT, DIFFICULTY, REWARD, 1);
+    std::vector<Block> mined;
+    Block parent = seed.getBlockchain().snapshot()->tip();
+    for (int i = 0; i < SYNC_BLOCKS; i++) {
+        mined.push_back(mineOn(parent, i, 2)); // Each transfer is a verify when synced
+        parent = mined.back();
+    }
+    seed.getBlockchain().addExistingBlocks(mined);
+    seed.start();
+
+    Node recorder(RECORDER_PORT, DIFFICULTY, REWARD, 1);
+    recorder.startTrace(filename);
+    recorder.start();
+
+    // 1. Headers-first sync
+    recorder.connectToPeer("127.0.0.1", SEED_PORT);
+    waitFor([&]() { return recorder.getBlockchain().getChainLength() == seed.getBlockchain().getChainLength(); },
+            std::chrono::seconds(60));
+
+    // 2. Live relay: INV/GET_TX/TX gossip, then compact blocks
+    int serial = 0;
+    KeyPair alice = keyPairFromSeed("Alice"); // Funded by genesis
+    for (int b = 0; b < LIVE_BLOCKS; b++) {
+        for (int t = 0; t < LIVE_TXS; t++) {
+            Transaction tx(alice.address, "live_" + std::to_string(serial++), 0.0001);
+            tx.sign(alice.privateKey);
+            seed.submitTransaction(tx);
+        }
+        waitFor([&]() { return recorder.getMempool().size() >= static_cast<size_t>(LIVE_TXS); },
+                std::chrono::seconds(2));
+
+        size_t height = seed.getBlockchain().getChainLength() + 1;
+        seed.minePendingTransactions();
+        waitFor([&]() { return recorder.getBlockchain().getChainLength() >= height; }, std::chrono::seconds(5));
+    }
+
+    // 3. Full blocks pushed one at a time, then a longer chain in one go
+    int injector = connectLoopback(RECORDER_PORT);
+    Block tip = recorder.getBlockchain().snapshot()->tip();
+    for (int i = 0; i < PUSHED_BLOCKS; i++) {
+        tip = mineOn(tip, SYNC_BLOCKS + i, 10);
+        sendRaw(injector, "{\"type\":\"NEW_BLOCK\",\"data\":" + tip.toJSON() + "}");
+        size_t height = tip.index + 1;
+        waitFor([&]() { return recorder.getBlockchain().getChainLength() >= height; }, std::chrono::seconds(5));
+    }
+
+    ChainSnapshot chain = recorder.getBlockchain().snapshot();
+    Block extra = mineOn(chain->tip(), SYNC_BLOCKS + PUSHED_BLOCKS, 10);
+    std::string chainJson = "[";
+    for (const auto& block : chain->blocks) {
+        chainJson += block->toJSON() + ",";
+    }
+    chainJson += extra.toJSON() + "]";
+    sendRaw(injector, "{\"type\":\"CHAIN\",\"data\":" + chainJson + "}");
+    waitFor([&]() { return recorder.getBlockchain().snapshot()->tip().hash == extra.hash; },
+            std::chrono::seconds(10));
+
+    close(injector);
+    recorder.stopTrace();
+
+    std::string recordedTip = recorder.getBlockchain().snapshot()->tip().hash;
+    recorder.stop();
+    seed.stop();
+    return recordedTip;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string traceFile;
+    int runs = 3;
+    bool realTime = true;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-realtime") == 0) {
+            realTime = false;
+        } else if (traceFile.empty() && std::atoi(argv[i]) == 0) {
+            traceFile = argv[i];
+        } else {
+            runs = std::max(1, std::atoi(argv[i]));
+        }
+    }
+
+    // Node chatter would swamp the report
+    Logger::setLevel(LogLevel::Off);
+
+    // 1. Record a trace unless we were given one
+    std::string expectedTip;
+    if (traceFile.empty()) {
+        traceFile = "bench_replay.trace";
+        expectedTip = recordTrace(traceFile);
+        std::printf("recorded %s, final tip %.16s\n", traceFile.c_str(), expectedTip.c_str());
+    }
+
+    // 2. Back-to-back replays
+    bool consistent = true;
+    Node::ReplayStats best;
+    for (int run = 0; run < runs; run++) {
+        Node node(0, DIFFICULTY, REWARD, 1);
+        Node::ReplayStats stats = node.replayTrace(traceFile);
+        if (!stats.loaded) {
+            std::fprintf(stderr, "could not read %s\n", traceFile.c_str());
+            return 1;
+        }
+
+        ChainSnapshot chain = node.getBlockchain().snapshot();
+        bool match = expectedTip.empty() || chain->tip().hash == expectedTip;
+        consistent = consistent && match;
+        if (expectedTip.empty()) {
+            expectedTip = chain->tip().hash; // Later runs must agree with the first
+        }
+
+        std::printf("replay %d: %llu messages, %.1f MB in %.3fs (%.0f msg/s, %.1f MB/s), %zu blocks, tip %s\n",
+                    run + 1, (unsigned long long)stats.messages, stats.bytes / 1e6, stats.seconds,
+                    stats.messages / stats.seconds, stats.bytes / 1e6 / stats.seconds, chain->size(),
+                    match ? "matches" : "DIFFERS");
+
+        if (run == 0 || stats.busySeconds < best.busySeconds) {
+            best = stats;
+        }
+    }
+
+    // Per-type breakdown of the fastest run
+    std::printf("\n%-12s %8s %10s %10s %12s\n", "type", "count", "MB", "ms", "us/message");
+    for (const auto& entry : best.byType) {
+        const Node::ReplayStats::TypeStats& type = entry.second;
+        std::printf("%-12s %8llu %10.2f %10.2f %12.1f\n", entry.first.c_str(), (unsigned long long)type.count,
+                    type.bytes / 1e6, type.seconds * 1e3, type.seconds * 1e6 / type.count);
+    }
+
+    // 3. Once more at the recorded pace
+    if (realTime) {
+        Node node(0, DIFFICULTY, REWARD, 1);
+        Node::ReplayStats stats = node.replayTrace(traceFile, true);
+        bool match = node.getBlockchain().snapshot()->tip().hash == expectedTip;
+        consistent = consistent && match;
+        std::printf("\nreal-time replay: trace spans %.3fs, replay took %.3fs (%.1f%% busy), tip %s\n",
+                    stats.traceSeconds, stats.seconds, 100.0 * stats.busySeconds / stats.seconds,
+                    match ? "matches" : "DIFFERS");
+    }
+
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+// bench_sync.cpp:
+// 1. Builds a chain of N blocks once
+// 2. Serves it from K in-process "seed" peers, each limited to a fixed
+//    upload rate (default 1 MB/s) to stand in for real peers' bandwidth
+// 3. Starts a fresh Node, connects it to all K seeds and times the sync
+// 4. Repeats for K = 1, 2, 4, 8 to show throughput scaling with peer count
+//
+// Usage: bench_sync [blocks] [upload bytes/s per peer]
+
+#include "Node.h"
+#include "Logger.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const int DIFFICULTY = 1;
+const double REWARD = 50;
+
+// Hashes of the "locator":[...] array
+std::vector<std::string> parseLocator(const std::string& message) {
+    std::vector<std::string> hashes;
+    size_t pos = message.find("\"locator\":[");
+    if (pos == std::string::npos) {
+        return hashes;
+    }
+    size_t end = message.find(']', pos);
+    pos += 11;
+    while (true) {
+        size_t open = message.find('"', pos);
+        if (open == std::string::npos || open > end) {
+            break;
+        }
+        size_t close = message.find('"', open + 1);
+        hashes.push_back(message.substr(open + 1, close - open - 1));
+        pos = close + 1;
+    }
+    return hashes;
+}
+
+long parseNumber(const std::string& message, const std::string& key) {
+    size_t pos = message.find("\"" + key + "\":");
+    return pos == std::string::npos ? -1 : std::atol(message.c_str() + pos + key.size() + 3);
+}
+
+// Serves a fixed chain to one connection at a limited upload rate
+class SeedPeer {
+    public:
+        SeedPeer(const Blockchain& chain, const std::vector<std::string>& blockJson, int port, double rate)
+            : chain(chain), blockJson(blockJson), rate(rate) {
+            listenFd = socket(AF_INET, SOCK_STREAM, 0);
+            int opt = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(listenFd, (sockaddr*)&addr, sizeof(addr));
+            listen(listenFd, 1);
+            thread = std::thread(&SeedPeer::serve, this);
+        }
+
+        ~SeedPeer() {
+            shutdown(listenFd, SHUT_RDWR);
+            close(listenFd);
+            if (peerFd >= 0) {
+                shutdown(peerFd, SHUT_RDWR);
+            }
+            thread.join();
+            if (peerFd >= 0) {
+                close(peerFd);
+            }
+        }
+
+    private:
+        void reply(const std::string& message) {
+            std::string frame = message + "\n";
+            size_t sent = 0;
+            while (sent < frame.size()) {
+                ssize_t n = send(peerFd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    return;
+                }
+                sent += n;
+            }
+            // Pay for the bytes at our upload rate
+            std::this_thread::sleep_for(std::chrono::duration<double>(frame.size() / rate));
+        }
+
+        void handle(const std::string& message) {
+            if (message.find("\"type\":\"GET_HEADERS\"") != std::string::npos) {
+                ChainSnapshot snapshot = chain.snapshot();
+                int fork = snapshot->findForkPoint(parseLocator(message));
+                std::vector<BlockHeader> headers = snapshot->getHeaders(fork + 1, Node::MAX_HEADERS_PER_MESSAGE);
+                std::string out = "{\"type\":\"HEADERS\",\"data\":[";
+                for (size_t i = 0; i < headers.size(); i++) {
+                    out += headers[i].toJSON();
+                    out += (i + 1 < headers.size()) ? "," : "";
+                }
+                reply(out + "]}");
+            }
+            else if (message.find("\"type\":\"GET_BLOCKS\"") != std::string::npos) {
+                long from = parseNumber(message, "from");
+                long count = parseNumber(message, "count");
+                std::string out = "{\"type\":\"BLOCKS\",\"from\":" + std::to_string(from) + ",\"data\":[";
+                for (long i = from; i < from + count && i < static_cast<long>(blockJson.size()); i++) {
+                    out += (i > from) ? "," : "";
+                    out += blockJson[i];
+                }
+                reply(out + "]}");
+            }
+            else if (message.find("\"type\":\"GET_LENGTH\"") != std::string::npos) {
+                reply("{\"type\":\"LENGTH\",\"value\":" + std::to_string(chain.getChainLength()) + "}");
+            }
+        }
+
+        void serve() {
+            peerFd = accept(listenFd, nullptr, nullptr);
+            if (peerFd < 0) {
+                return;
+            }
+
+            std::string inbound;
+            char buffer[16384];
+            while (true) {
+                ssize_t n = recv(peerFd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    return;
+                }
+                inbound.append(buffer, n);
+
+                size_t newline;
+                while ((newline = inbound.find('\n')) != std::string::npos) {
+                    handle(inbound.substr(0, newline));
+                    inbound.erase(0, newline + 1);
+                }
+            }
+        }
+
+        const Blockchain& chain;
+        const std::vector<std::string>& blockJson;
+        double rate;
+        int listenFd;
+        std::atomic<int> peerFd { -1 };
+        std::thread thread;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int blocks = argc > 1 ? std::atoi(argv[1]) : 10000;
+    double rate = argc > 2 ? std::atof(argv[2]) : 1e6;
+
+    // Node chatter would swamp the report
+    Logger::setLevel(LogLevel::Off);
+
+    // 1. Build the chain the seeds will serve
+    Blockchain chain(DIFFICULTY, REWARD);
+    std::vector<Block> mined;
+    std::string prevHash = chain.snapshot()->tip().hash;
+    for (int i = 1; i <= blocks; i++) {
+        // The reward is all a block may mint
+        Block block(i, prevHash, { Transaction("SYSTEM", "addr" + std::to_string(i % 4), REWARD) });
+        block.bits = chain.getInitialBits();
+        block.timestamp = Blockchain::GENESIS_TIMESTAMP + i; // Climbing, and never in the future
+        block.mineBlock();
+        prevHash = block.hash;
+        mined.push_back(block);
+    }
+    chain.addExistingBlocks(mined);
+
+    std::vector<std::string> blockJson;
+    size_t totalBytes = 0;
+    for (const auto& block : chain.snapshot()->blocks) {
+        blockJson.push_back(block->toJSON());
+        totalBytes += blockJson.back().size();
+    }
+
+    std::printf("chain: %d blocks, %.1f MB of block JSON, seed upload %.2f MB/s each\n", blocks,
+                totalBytes / 1e6, rate / 1e6);
+    std::printf("%6s %10s %12s %10s\n", "peers", "seconds", "blocks/s", "MB/s");
+
+    int basePort = 19500;
+    for (int peers : { 1, 2, 4, 8 }) {
+        // 2. Start the seeds
+        std::vector<std::unique_ptr<SeedPeer>> seeds;
+        for (int i = 0; i < peers; i++) {
+            seeds.push_back(std::make_unique<SeedPeer>(chain, blockJson, basePort + i, rate));
+        }
+
+        // 3. A fresh node syncs from all of them
+        Node node(basePort + 100, DIFFICULTY, REWARD);
+        node.start();
+
+        auto start = Clock::now();
+        for (int i = 0; i < peers; i++) {
+            node.connectToPeer("127.0.0.1", basePort + i);
+        }
+
+        bool synced = false;
+        while (Clock::now() - start < std::chrono::seconds(120)) {
+            if (node.getBlockchain().getChainLength() == chain.getChainLength()) {
+                synced = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (!synced) {
+            std::printf("%6d   did not finish (reached %zu blocks)\n", peers, node.getBlockchain().getChainLength());
+        } else {
+            std::printf("%6d %10.2f %12.0f %10.2f\n", peers, seconds, blocks / seconds, totalBytes / seconds / 1e6);
+        }
+
+        node.stop();
+        seeds.clear();
+        basePort += 200; // Fresh ports so TIME_WAIT never gets in the way
+    }
+
+    return 0;
+}
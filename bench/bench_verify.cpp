@@ -0,0 +1,107 @@
+// bench_verify.cpp: signature verification throughput per core.
+//
+// 1. Signs COUNT transfers from 1000 accounts, timing the signing
+// 2. For 1, 2, 4, ... threads up to MAX_THREADS, verifies them all
+//    through a fresh SignatureVerifier (empty cache) and prints
+//    verifies/s in total and per thread, and the speedup over one thread
+// 3. Verifies them once more with the cache warm: what a block pays for
+//    transactions that were checked at mempool entry
+//
+// Usage: bench_verify [COUNT] [MAX_THREADS]   (default 20000 and the core
+//        count)
+
+#include "Logger.h"
+#include "Signature.h"
+#include "SignatureVerifier.h"
+#include "Transaction.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t ACCOUNTS = 1000;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Thread counts to try: powers of two, then most itself
+std::vector<size_t> threadCounts(size_t most) {
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < most; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(most);
+    return counts;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    size_t most = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    if (count == 0 || most == 0) {
+        std::fprintf(stderr, "usage: bench_verify [COUNT] [MAX_THREADS]\n");
+        return 2;
+    }
+    Logger::setLevel(LogLevel::Off);
+
+    // 1. Transactions to check
+    std::vector<KeyPair> accounts;
+    for (size_t i = 0; i < ACCOUNTS; i++) {
+        accounts.push_back(keyPairFromSeed("verify_" + std::to_string(i)));
+    }
+    std::vector<Transaction> txs;
+    txs.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const KeyPair& from = accounts[i % ACCOUNTS];
+        txs.emplace_back(from.address, accounts[(i + 1) % ACCOUNTS].address, 0.01 + i * 0.000001);
+    }
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; i++) {
+        txs[i].sign(accounts[i % ACCOUNTS].privateKey);
+    }
+    double signSeconds = secondsSince(start);
+
+    std::vector<const Transaction*> pointers;
+    for (const Transaction& tx : txs) {
+        pointers.push_back(&tx);
+    }
+    std::printf("%zu Ed25519 signatures, %u cores; signing %.0f/s on one thread\n", count,
+                std::thread::hardware_concurrency(), count / signSeconds);
+    std::printf("%8s %14s %16s %9s\n", "threads", "verifies/s", "per thread/s", "speedup");
+
+    // 2. Cold: every signature verified
+    double single = 0;
+    for (size_t threads : threadCounts(most)) {
+        SignatureVerifier::setThreads(threads);
+        SignatureVerifier verifier(count);
+        start = Clock::now();
+        bool ok = verifier.verifyAll(pointers);
+        double rate = count / secondsSince(start);
+        if (!ok) {
+            std::fprintf(stderr, "a signature failed to verify\n");
+            return 1;
+        }
+        if (threads == 1) {
+            single = rate;
+        }
+        std::printf("%8zu %14.0f %16.0f %8.2fx\n", threads, rate, rate / threads, rate / single);
+        std::fflush(stdout);
+    }
+
+    // 3. Warm: every txid cached
+    SignatureVerifier verifier(count);
+    verifier.verifyAll(pointers);
+    start = Clock::now();
+    bool ok = verifier.verifyAll(pointers);
+    std::printf("cached   %14.0f checks/s (txid hash and cache lookup only)\n", count / secondsSince(start));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,504 @@
+// loadgen.cpp: end-to-end transaction throughput of one node.
+//
+// 1. Starts a node whose genesis gives Alice enough for every load
+//    address, mines a block of her transfers funding them, and starts a
+//    miner that keeps mining the mempool
+// 2. Submitter threads send transactions between those addresses, at a
+//    target rate or as fast as they can, either:
+//    - inprocess: straight into Node::submitTransaction (mempool, then
+//      the miner's Blockchain::addBlock)
+//    - network: as TX messages over loopback peer connections, through
+//      framing, the worker pool and relay like any peer's transactions
+//      (at most --window of them unhandled at a time, so "max" measures
+//      what the node keeps up with rather than how much it can buffer)
+// 3. A watcher polls chain snapshots for the transactions as they are
+//    mined
+// 4. Reports offered and accepted tx/s, confirmed tx/s, submit-to-confirm
+//    latency percentiles and why transactions were rejected
+//
+// Usage: loadgen [--mode inprocess|network] [--rate TX_PER_SEC (0 = max)]
+//                [--duration SEC] [--addresses N] [--funding COINS] [--threads N]
+//                [--batch TX_PER_MESSAGE] [--window N] [--difficulty N]
+//                [--miner-threads N] [--port N]
+
+#include "Logger.h"
+#include "Metrics.h"
+#include "Miner.h"
+#include "Node.h"
+#include "Signature.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const std::chrono::seconds DRAIN_TIMEOUT { 30 };
+
+struct Options {
+    bool network = false;
+    double rate = 0; // tx/s over all threads; 0 = as fast as possible
+    double duration = 10;
+    int addresses = 100;
+    double funding = 1000000; // Coins given to each load address
+    int threads = 4;
+    int batch = 1;
+    uint64_t window = 20000; // Most transactions sent but not yet handled (network)
+    int difficulty = 2;
+    unsigned minerThreads = 1;
+    int port = 19900;
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        const char* value = argv[i + 1];
+        if (key == "--mode") {
+            options.network = std::strcmp(value, "network") == 0;
+            if (!options.network && std::strcmp(value, "inprocess") != 0) {
+                return false;
+            }
+        } else if (key == "--rate") {
+            options.rate = std::atof(value);
+        } else if (key == "--duration") {
+            options.duration = std::atof(value);
+        } else if (key == "--addresses") {
+            options.addresses = std::atoi(value);
+        } else if (key == "--funding") {
+            options.funding = std::atof(value);
+        } else if (key == "--threads") {
+            options.threads = std::atoi(value);
+        } else if (key == "--batch") {
+            options.batch = std::atoi(value);
+        } else if (key == "--window") {
+            options.window = std::strtoull(value, nullptr, 10);
+        } else if (key == "--difficulty") {
+            options.difficulty = std::atoi(value);
+        } else if (key == "--miner-threads") {
+            options.minerThreads = static_cast<unsigned>(std::atoi(value));
+        } else if (key == "--port") {
+            options.port = std::atoi(value);
+        } else {
+            return false;
+        }
+    }
+    return argc % 2 == 1 && options.duration > 0 && options.rate >= 0 && options.addresses >= 2 &&
+        options.threads >= 1 && options.threads <= options.addresses && options.batch >= 1 &&
+        options.window >= 1 && options.minerThreads >= 1;
+}
+
+// Transactions submitted but not yet seen in a block
+class ConfirmTracker {
+    public:
+        void submitted(const std::string& txid, Clock::time_point at) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.emplace(txid, at);
+        }
+
+        void forget(const std::string& txid) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.erase(txid);
+        }
+
+        // Match the blocks mined since the last call
+        void poll(const Blockchain& chain) {
+            ChainSnapshot snapshot = chain.snapshot();
+            auto now = Clock::now();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (; seenHeight < snapshot->size(); seenHeight++) {
+                for (const Transaction& tx : (*snapshot)[seenHeight].transactions) {
+                    auto it = pending.find(tx.calculateHash());
+                    if (it == pending.end()) {
+                        continue;
+                    }
+                    latencies.push_back(std::chrono::duration<double, std::milli>(now - it->second).count());
+                    pending.erase(it);
+                }
+                lastConfirm = now;
+            }
+        }
+
+        // Ignore blocks below this height
+        void skipTo(size_t height) { seenHeight = height; }
+
+        size_t confirmed() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return latencies.size();
+        }
+
+        std::vector<double> latencies; // Milliseconds; read after the watcher stops
+        Clock::time_point lastConfirm;
+
+    private:
+        std::mutex mutex;
+        std::unordered_map<std::string, Clock::time_point> pending;
+        size_t seenHeight = 0;
+};
+
+// One loopback peer connection (network mode)
+struct PeerSocket {
+    int fd = -1;
+    std::mutex sendMutex; // Submitter and PONG replies share the socket
+};
+
+int connectLoopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return fd;
+}
+
+// Send one message; false if the node dropped us or stopped reading
+// until the deadline passed
+bool sendFrame(PeerSocket& peer, const std::string& message, Clock::time_point deadline) {
+    std::string frame = message + "\n";
+    std::lock_guard<std::mutex> lock(peer.sendMutex);
+    size_t sent = 0;
+    while (sent < frame.size()) {
+        ssize_t n = send(peer.fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+
+        // The node is behind on reading; wait for room, but not forever
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        pollfd writable { peer.fd, POLLOUT, 0 };
+        if (left <= 0 || poll(&writable, 1, static_cast<int>(std::min<long long>(left, 50))) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Discard what the node relays to us, answering its PINGs so it keeps us
+void drainPeers(std::vector<PeerSocket>& peers, const std::atomic<bool>& running) {
+    std::vector<pollfd> fds;
+    for (PeerSocket& peer : peers) {
+        fds.push_back({ peer.fd, POLLIN, 0 });
+    }
+    std::vector<std::string> inbound(peers.size());
+    char buffer[65536];
+
+    while (running) {
+        if (poll(fds.data(), fds.size(), 50) <= 0) {
+            continue;
+        }
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (!(fds[i].revents & POLLIN)) {
+                continue;
+            }
+            ssize_t n = recv(fds[i].fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                fds[i].fd = -1; // Node dropped us; poll() ignores negative fds
+                continue;
+            }
+            inbound[i].append(buffer, n);
+
+            size_t newline;
+            while ((newline = inbound[i].find('\n')) != std::string::npos) {
+                std::string message = inbound[i].substr(0, newline);
+                inbound[i].erase(0, newline + 1);
+                if (message.compare(0, 14, "{\"type\":\"PING\"") == 0) {
+                    size_t nonce = message.find("\"nonce\":");
+                    std::string value = nonce == std::string::npos ? "0" : message.substr(nonce + 8);
+                    sendFrame(peers[i], "{\"type\":\"PONG\",\"nonce\":" + std::to_string(std::atol(value.c_str())) + "}",
+                              Clock::now() + std::chrono::seconds(1));
+                }
+            }
+        }
+    }
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t idx = static_cast<size_t>(p * (samples.size() - 1));
+    return samples[idx];
+}
+
+uint64_t counterValue(const char* name) {
+    return Metrics::instance().counter(name, "").value();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: loadgen [--mode inprocess|network] [--rate TX_PER_SEC] [--duration SEC]\n"
+                             "               [--addresses N] [--funding COINS] [--threads N] [--batch N] [--window N]\n"
+                             "               [--difficulty N] [--miner-threads N] [--port N]\n");
+        return 2;
+    }
+
+    // Rejections are counted below; the log would only slow things down
+    Logger::setLevel(LogLevel::Off);
+
+    // Genesis pays each demo account the reward, so Alice holds it all
+    Node node(options.port, options.difficulty, options.funding * options.addresses);
+    if (!node.start()) {
+        std::fprintf(stderr, "can't listen on port %d\n", options.port);
+        return 1;
+    }
+
+    // 1. Fund the load addresses from Alice in one block
+    KeyPair alice = keyPairFromSeed("Alice");
+    std::vector<KeyPair> addresses;
+    std::vector<Transaction> funding;
+    for (int i = 0; i < options.addresses; i++) {
+        addresses.push_back(keyPairFromSeed("load_" + std::to_string(i)));
+        funding.push_back(Transaction(alice.address, addresses.back().address, options.funding));
+        funding.back().sign(alice.privateKey);
+    }
+    node.mineAndBroadcast(funding);
+
+    ConfirmTracker tracker;
+    tracker.skipTo(node.getBlockchain().getChainLength());
+
+    std::vector<PeerSocket> peers(options.network ? options.threads : 0);
+    for (PeerSocket& peer : peers) {
+        peer.fd = connectLoopback(options.port);
+        if (peer.fd < 0) {
+            std::fprintf(stderr, "can't connect to the node\n");
+            return 1;
+        }
+    }
+
+    const char* REJECT_COUNTERS[][2] = {
+        { "invalid", "node_tx_rejected_invalid_total" },
+        { "insufficient balance", "node_tx_rejected_balance_total" },
+        { "duplicate", "node_tx_rejected_duplicate_total" },
+        { "mempool full", "node_tx_rejected_mempool_full_total" },
+    };
+    uint64_t acceptedBefore = counterValue("node_tx_accepted_total");
+    std::map<std::string, uint64_t> rejectedBefore;
+    for (const auto& reject : REJECT_COUNTERS) {
+        rejectedBefore[reject[0]] = counterValue(reject[1]);
+    }
+
+    std::printf("loadgen: mode=%s rate=%s duration=%.0fs addresses=%d threads=%d batch=%d difficulty=%d miner_threads=%u\n",
+                options.network ? "network" : "inprocess",
+                options.rate > 0 ? std::to_string(static_cast<long>(options.rate)).c_str() : "max",
+                options.duration, options.addresses, options.threads, options.batch, options.difficulty,
+                options.minerThreads);
+
+    // 2. Mine whatever reaches the mempool, and watch for it in blocks
+    Miner miner(node);
+    miner.start(options.minerThreads);
+
+    std::atomic<bool> watching { true };
+    std::thread watcher([&]() {
+        while (watching) {
+            tracker.poll(node.getBlockchain());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::atomic<bool> draining { true };
+    std::thread drainer;
+    if (options.network) {
+        drainer = std::thread(drainPeers, std::ref(peers), std::cref(draining));
+    }
+
+    // Transactions the node has accepted or rejected so far
+    auto handled = [&]() {
+        uint64_t total = counterValue("node_tx_accepted_total") - acceptedBefore;
+        for (const auto& reject : REJECT_COUNTERS) {
+            total += counterValue(reject[1]) - rejectedBefore[reject[0]];
+        }
+        return total;
+    };
+
+    // 3. Submit: thread t sends from addresses t, t + threads, ...
+    std::atomic<uint64_t> submitted { 0 };
+    std::vector<std::map<std::string, uint64_t>> threadRejects(options.threads);
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < options.threads; t++) {
+        submitters.emplace_back([&, t]() {
+            std::vector<int> senders;
+            for (int a = t; a < options.addresses; a += options.threads) {
+                senders.push_back(a);
+            }
+
+            // Each thread paces its share of the rate in messages
+            double perThread = options.rate / options.threads;
+            int perMessage = options.network ? options.batch : 1;
+            Clock::duration interval = perThread > 0
+                ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(perMessage / perThread))
+                : Clock::duration::zero();
+
+            uint64_t sequence = 0;
+            auto next = start;
+            while (Clock::now() < end) {
+                // Past the window, let the node catch up rather than
+                // piling messages up in socket buffers
+                while (options.network && submitted - handled() >= options.window && Clock::now() < end) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                if (interval > Clock::duration::zero()) {
+                    std::this_thread::sleep_until(next);
+                    next += interval;
+                }
+
+                std::string message = "{\"type\":\"TX\",\"data\":[";
+                for (int b = 0; b < perMessage; b++, sequence++) {
+                    int sender = senders[sequence % senders.size()];
+                    int receiver = (sender + 1) % options.addresses;
+
+                    // Txids hash the amount to 6 decimals and the time to
+                    // the second, so vary the amount to keep them unique
+                    Transaction tx(addresses[sender].address, addresses[receiver].address,
+                                   0.01 + (sequence % 1000000) * 0.000001);
+                    tx.sign(addresses[sender].privateKey);
+                    std::string txid = tx.calculateHash();
+                    tracker.submitted(txid, Clock::now());
+
+                    if (!options.network) {
+                        std::string reason;
+                        if (!node.submitTransaction(tx, &reason)) {
+                            tracker.forget(txid);
+                            threadRejects[t][reason]++;
+                        }
+                        continue;
+                    }
+                    message += (b > 0 ? "," : "") + tx.toJSON();
+                }
+
+                if (options.network) {
+                    message += "]}";
+                    if (!sendFrame(peers[t], message, end)) {
+                        break; // Dropped, or the run ended while the node was behind
+                    }
+                }
+                submitted += perMessage;
+            }
+        });
+    }
+
+    auto nextProgress = start + std::chrono::seconds(1);
+    auto progress = [&]() {
+        if (Clock::now() < nextProgress) {
+            return;
+        }
+        nextProgress += std::chrono::seconds(1);
+        std::printf("  %5.1fs  submitted=%llu handled=%llu confirmed=%zu mempool=%zu height=%zu\n",
+                    std::chrono::duration<double>(Clock::now() - start).count(),
+                    static_cast<unsigned long long>(submitted.load()), static_cast<unsigned long long>(handled()),
+                    tracker.confirmed(), node.getMempool().size(), node.getBlockchain().getChainLength() - 1);
+        std::fflush(stdout);
+    };
+
+    while (Clock::now() < end) {
+        progress();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    for (std::thread& submitter : submitters) {
+        submitter.join();
+    }
+    double submitSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // 4. Wait until the node has handled everything we sent and mined it
+    // (the mempool empties only after the block holding it is published)
+    auto deadline = Clock::now() + DRAIN_TIMEOUT;
+    auto handledAt = Clock::now();
+    while (Clock::now() < deadline && (handled() < submitted || node.getMempool().size() > 0)) {
+        progress();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (handled() < submitted) {
+            handledAt = Clock::now();
+        }
+    }
+    double handleSeconds = std::chrono::duration<double>(handledAt - start).count();
+
+    miner.stop();
+    watching = false;
+    watcher.join();
+    tracker.poll(node.getBlockchain());
+    draining = false;
+    if (drainer.joinable()) {
+        drainer.join();
+    }
+    for (PeerSocket& peer : peers) {
+        close(peer.fd);
+    }
+
+    // 5. Report
+    uint64_t accepted = counterValue("node_tx_accepted_total") - acceptedBefore;
+    std::map<std::string, uint64_t> rejects;
+    for (const auto& perThread : threadRejects) {
+        for (const auto& entry : perThread) {
+            rejects[entry.first] += entry.second;
+        }
+    }
+    if (options.network) {
+        for (const auto& reject : REJECT_COUNTERS) {
+            uint64_t count = counterValue(reject[1]) - rejectedBefore[reject[0]];
+            if (count > 0) {
+                rejects[reject[0]] = count;
+            }
+        }
+    }
+
+    size_t confirmed = tracker.latencies.size();
+    double confirmSeconds = std::chrono::duration<double>(tracker.lastConfirm - start).count();
+    uint64_t sent = submitted;
+
+    std::printf("\n%-22s %10llu  (%.0f tx/s offered)\n", "submitted", static_cast<unsigned long long>(sent),
+                sent / submitSeconds);
+    std::printf("%-22s %10llu  (%.0f tx/s)\n", "accepted", static_cast<unsigned long long>(accepted),
+                accepted / handleSeconds);
+    std::printf("%-22s %10zu  (%.0f tx/s, %llu blocks)\n", "confirmed", confirmed,
+                confirmed > 0 && confirmSeconds > 0 ? confirmed / confirmSeconds : 0.0,
+                static_cast<unsigned long long>(miner.getBlocksMined()));
+    std::printf("%-22s p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms\n", "submit-to-confirm",
+                percentile(tracker.latencies, 0.50), percentile(tracker.latencies, 0.90),
+                percentile(tracker.latencies, 0.99), percentile(tracker.latencies, 1.0));
+    if (handled() < sent) {
+        std::printf("%-22s %10llu  (not handled within %llds)\n", "unaccounted",
+                    static_cast<unsigned long long>(sent - handled()), static_cast<long long>(DRAIN_TIMEOUT.count()));
+    }
+    for (const auto& reject : rejects) {
+        std::printf("%-22s %10llu\n", ("rejected: " + reject.first).c_str(), static_cast<unsigned long long>(reject.second));
+    }
+    if (rejects.empty()) {
+        std::printf("rejected: none\n");
+    }
+
+    node.stop();
+    return 0;
+}
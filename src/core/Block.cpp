@@ -1,72 +1,183 @@
 #include "Block.h"
-#include <iostream>
-#include <sstream>
-#include <iomanip>
+#include "Hash.h" // Bitcoin uses SHA-256
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Target.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
 #include <vector>
-#include <openssl/sha.h> // Bitcoin uses SHA-256
 
-Block::Block(int idx, std::string prevHash, std::vector<Transaction> txs) {
-    index = idx;
-    previousHash = prevHash;
-    transactions = txs;
+namespace {
+
+// Hash the fields shared by Block and BlockHeader into hash, building the
+// input in buffer (both reused, so repeated calls don't allocate)
+void hashHeaderFields(int index, std::time_t timestamp, uint32_t bits, uint32_t nonce, const std::string& merkleRoot,
+                      const std::string& previousHash, std::string& buffer, std::string& hash) {
+    // Fixed-width integers, then each hash behind its length, so no two
+    // headers share a preimage (as decimal text run together, index 1 at
+    // time 23 read the same as index 12 at time 3)
+    buffer.clear();
+    appendBigEndian(buffer, static_cast<uint32_t>(index), 4);
+    appendBigEndian(buffer, static_cast<uint64_t>(timestamp), 8);
+    appendBigEndian(buffer, bits, 4);
+    appendBigEndian(buffer, nonce, 4);
+    appendField(buffer, merkleRoot);
+    appendField(buffer, previousHash);
+    sha256Hex(buffer, hash);
+}
+
+std::string hashHeaderFields(int index, std::time_t timestamp, uint32_t bits, uint32_t nonce,
+                             const std::string& merkleRoot, const std::string& previousHash) {
+    std::string buffer;
+    buffer.reserve(28 + merkleRoot.size() + previousHash.size());
+    std::string hash;
+    hashHeaderFields(index, timestamp, bits, nonce, merkleRoot, previousHash, buffer, hash);
+    return hash;
+}
+
+} // namespace
+
+std::string BlockHeader::calculateHash() const {
+    return hashHeaderFields(index, timestamp, bits, nonce, merkleRoot, previousHash);
+}
+
+void BlockHeader::calculateHash(std::string& buffer, std::string& hash) const {
+    hashHeaderFields(index, timestamp, bits, nonce, merkleRoot, previousHash, buffer, hash);
+}
+
+std::string BlockHeader::toJSON() const {
+    std::string out;
+    out.reserve(256);
+    JsonWriter json(out);
+    writeJSON(json);
+    return out;
+}
+
+void BlockHeader::writeJSON(JsonWriter& json) const {
+    json.raw("{\"index\":").number(index);
+    json.raw(",\"previousHash\":").string(previousHash);
+    json.raw(",\"merkleRoot\":").string(merkleRoot);
+    json.raw(",\"hash\":").string(hash);
+    json.raw(",\"timestamp\":").number(timestamp);
+    json.raw(",\"bits\":").number(bits);
+    json.raw(",\"nonce\":").number(nonce);
+    json.raw('}');
+}
+
+BlockHeader BlockHeader::fromJSON(std::string_view json) {
+    // Missing or malformed fields stay zero/empty and fail the hash check
+    BlockHeader header {};
+    jsonNumber(json, "index", header.index);
+    header.previousHash = jsonString(json, "previousHash");
+    header.merkleRoot = jsonString(json, "merkleRoot");
+    header.hash = jsonString(json, "hash");
+    jsonNumber(json, "timestamp", header.timestamp);
+    jsonNumber(json, "bits", header.bits);
+    jsonNumber(json, "nonce", header.nonce);
+    return header;
+}
+
+Block::Block(int idx, std::string prevHash, std::vector<Transaction> txs)
+    : index(idx), previousHash(std::move(prevHash)), transactions(std::move(txs)) {
+    merkleRoot = calculateMerkleRoot();
     timestamp = time(nullptr);
+    bits = MAX_TARGET_BITS;
     nonce = 0;
-    // hash = calculateHash();
-};
+}
 
 std::string Block::calculateHash() const {
-    // Concatenate
-    std::string toHash = 
-        std::to_string(index) + 
-        std::to_string(timestamp) + 
-        std::to_string(nonce) +
-        getTransactionsAsString() +
-        previousHash;
-    
-    // SHA256 Function
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, toHash.c_str(), toHash.size());
-    SHA256_Final(hash, &sha256);
-    std::stringstream ss;
-    for(int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-    {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    }
+    // Transactions are committed to through the Merkle root
+    return hashHeaderFields(index, timestamp, bits, nonce, merkleRoot, previousHash);
+}
 
-    return ss.str();
+std::string Block::calculateMerkleRoot() const {
+    return ::merkleRoot(Transaction::calculateHashes(transactions));
 }
 
-void Block::mineBlock(int diff) {
-    std::cout << "\nMining block..." << std::endl;
+void Block::mineBlock(unsigned threads) {
+    TRACE_SPAN_ARG("Block::mineBlock", "height", index);
+    LOG_INFO(Mining, "Mining block").kv("height", index).kv("bits", bits).kv("difficulty", bitsDifficulty(bits))
+        .kv("threads", threads);
 
-    std::string target = "";
-    for (int i = 0; i < diff; i++) {
-        target += "0";
+    TargetBytes target;
+    if (!expandBits(bits, target)) {
+        LOG_ERROR(Mining, "Malformed target, not mining").kv("height", index).kv("bits", bits);
+        return;
     }
 
-    hash = calculateHash();
+    static Counter& hashCounter = Metrics::instance().counter("blockchain_hashes_total", "Block hashes computed while mining");
+    static Gauge& hashRate = Metrics::instance().gauge("blockchain_hash_rate", "Hashes per second while mining the last block");
 
-    while (true) {
-      if (hash.substr(0, diff) == target) {
-            std::cout << "Block mined! Hash: " << hash << std::endl;
-            break;
-        }
-        else {
-            nonce++;
-            if (nonce % 100000 == 0) {
-                std::cout << "Current nonce: " << nonce << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    merkleRoot = calculateMerkleRoot();
+    threads = std::max(threads, 1u);
+
+    // Searcher k tries nonce + k, nonce + k + threads, ...; the first hit wins
+    std::atomic<bool> found(false);
+    std::atomic<uint64_t> hashes(0);
+    std::mutex winnerMutex;
+    uint32_t winningNonce = nonce;
+    std::string winningHash;
+
+    auto search = [&](unsigned k) {
+        uint64_t tried = 0; // Counted locally, published in batches
+        uint64_t published = 0;
+        std::string buffer; // Reused for every attempt
+        std::string candidateHash;
+        for (uint32_t candidate = nonce + k; !found.load(std::memory_order_relaxed); candidate += threads) {
+            hashHeaderFields(index, timestamp, bits, candidate, merkleRoot, previousHash, buffer, candidateHash);
+            tried++;
+            if (hashBelowTarget(candidateHash, target)) {
+                std::lock_guard<std::mutex> lock(winnerMutex);
+                if (!found.exchange(true)) {
+                    winningNonce = candidate;
+                    winningHash = std::move(candidateHash);
+                }
+                break;
+            }
+            if (tried % 100000 == 0) {
+                LOG_DEBUG(Mining, "Still mining").kv("height", index).kv("nonce", candidate);
+                hashCounter.inc(tried - published);
+                published = tried;
             }
-            hash = calculateHash();
+        }
+        hashCounter.inc(tried - published);
+        hashes.fetch_add(tried, std::memory_order_relaxed);
+    };
+
+    if (threads == 1) {
+        search(0);
+    } else {
+        std::vector<std::thread> searchers;
+        for (unsigned k = 0; k < threads; k++) {
+            searchers.emplace_back(search, k);
+        }
+        for (std::thread& searcher : searchers) {
+            searcher.join();
         }
     }
 
-    return;
+    nonce = winningNonce;
+    hash = winningHash;
+    LOG_INFO(Mining, "Block mined").kv("height", index).kv("nonce", nonce).kv("hash", hash);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds > 0) {
+        hashRate.set(hashes.load() / seconds);
+    }
 }
 
 void Block::addTransaction(Transaction tx) {
-    transactions.push_back(tx);
+    transactions.push_back(std::move(tx));
+    merkleRoot = calculateMerkleRoot();
 }
 
 std::string Block::getTransactionsAsString() const {
@@ -77,93 +188,119 @@ std::string Block::getTransactionsAsString() const {
     return txString;
 }
 
-std::string Block::toJSON() const {
-    std::string json = "";
-
-    // Opening brace
-    json += "{";
+BlockHeader Block::getHeader() const {
+    BlockHeader header;
+    header.index = index;
+    header.previousHash = previousHash;
+    header.merkleRoot = merkleRoot;
+    header.hash = hash;
+    header.timestamp = timestamp;
+    header.bits = bits;
+    header.nonce = nonce;
+    return header;
+}
 
-    // Add index field
-    json += "\"index\":" + std::to_string(index) + ",";
+std::string Block::toJSON() const {
+    std::string out;
+    out.reserve(estimateJSONSize());
+    JsonWriter json(out);
+    writeJSON(json);
+    return out;
+}
 
-    // Add previousHash field
-    json += "\"previousHash\":\"" + previousHash + "\",";
+void Block::writeJSON(JsonWriter& json) const {
+    json.raw("{\"index\":").number(index);
+    json.raw(",\"previousHash\":").string(previousHash);
+    json.raw(",\"merkleRoot\":").string(merkleRoot);
+    json.raw(",\"hash\":").string(hash);
+    json.raw(",\"timestamp\":").number(timestamp);
+    json.raw(",\"bits\":").number(bits);
+    json.raw(",\"nonce\":").number(nonce);
 
-    // Add hash field
-    json += "\"hash\":\"" + hash + "\",";
+    json.raw(",\"transactions\":[");
+    for (size_t i = 0; i < transactions.size(); i++) {
+        if (i > 0) {
+            json.raw(',');
+        }
+        transactions[i].writeJSON(json);
+    }
+    json.raw("]}");
+}
 
-    // Add timestamp field
-    json += "\"timestamp\":" + std::to_string(timestamp) + ",";
+size_t Block::estimateJSONSize() const {
+    // Header fields, then field names and numbers (~70 bytes, ~15 more
+    // when signed) per transaction
+    size_t size = 256 + previousHash.size() + merkleRoot.size() + hash.size();
+    for (const Transaction& tx : transactions) {
+        size += 88 + tx.sender.size() + tx.receiver.size() + tx.signature.size();
+    }
+    return size;
+}
 
-    // Add nonce field
-    json += "\"nonce\":" + std::to_string(nonce) + ",";
+Block Block::fromJSON(std::string_view json) {
+    static Histogram& parseSeconds = Metrics::instance().histogram("block_parse_seconds", "Time to parse one block from JSON");
+    ScopedTimer timer(parseSeconds);
+    TRACE_SPAN("Block::fromJSON");
 
-    // Add transactions field
-    json += "\"transactions\":[";
-    for (size_t i = 0; i < transactions.size(); i++) {
-        json += transactions[i].toJSON();
-        if (i < transactions.size() - 1) {
-            json += ",";
-        }
+    // Header fields come before the transactions, which have a timestamp
+    // of their own. Missing or malformed fields stay zero/empty and the
+    // block then fails validation.
+    Block block;
+    block.index = 0;
+    block.timestamp = 0;
+    block.bits = 0;
+    block.nonce = 0;
+    size_t txStart = findJsonField(json, "transactions");
+    std::string_view header = json.substr(0, txStart);
+    jsonNumber(header, "index", block.index);
+    block.previousHash = jsonString(header, "previousHash");
+    block.merkleRoot = jsonString(header, "merkleRoot"); // Kept as sent, so validation can compare
+    block.hash = jsonString(header, "hash");
+    jsonNumber(header, "timestamp", block.timestamp);
+    jsonNumber(header, "bits", block.bits);
+    jsonNumber(header, "nonce", block.nonce);
+    if (txStart == std::string_view::npos) {
+        return block;
     }
-    json += "]";
-
-    // Closing brace
-    json += "}";
-
-    return json;
-}
-
-Block Block::fromJSON(const std::string& json) { 
-    // Extract index
-    size_t pos = json.find("\"index\":") + 8;
-    size_t end = json.find(",", pos);
-    int idx = std::stoi(json.substr(pos, end - pos));
-    
-    // Extract previousHash
-    pos = json.find("\"previousHash\":\"") + 16;
-    end = json.find("\"", pos);
-    std::string prevHash = json.substr(pos, end - pos);
-    
-    // Extract hash
-    pos = json.find("\"hash\":\"") + 8;
-    end = json.find("\"", pos);
-    std::string hash = json.substr(pos, end - pos);
-    
-    // Extract timestamp
-    pos = json.find("\"timestamp\":") + 12;
-    end = json.find(",", pos);
-    std::time_t timestamp = std::stol(json.substr(pos, end - pos));
-    
-    // Extract nonce
-    pos = json.find("\"nonce\":") + 8;
-    end = json.find(",", pos);
-    int nonce = std::stoi(json.substr(pos, end - pos));
-    
-    // Extract transactions array
-    std::vector<Transaction> transactions;
-    pos = json.find("\"transactions\":[") + 16;  // Find start of array
-    end = json.find("]", pos);  // Find end of array
-    std::string transactionsStr = json.substr(pos, end - pos);  // Extract array content
-    
-    // Parse individual transactions
-    std::vector<Transaction> parsedTransactions;
-    size_t txPos = 0;
-    while ((txPos = transactionsStr.find("{", txPos)) != std::string::npos) {
-        size_t txStart = txPos;
-        size_t txEnd = transactionsStr.find("}", txPos);
-        
-        std::string txJson = transactionsStr.substr(txStart, txEnd - txStart + 1);
-        parsedTransactions.push_back(Transaction::fromJSON(txJson));
-        
-        txPos = txEnd + 1;
+
+    // The index of the transactions lives in an arena on the stack
+    std::byte initial[4 * 1024];
+    std::pmr::monotonic_buffer_resource arena(initial, sizeof(initial));
+    std::pmr::vector<std::string_view> objects(&arena);
+    jsonObjects(json.substr(txStart), "", objects);
+    block.transactions.reserve(objects.size());
+    for (std::string_view object : objects) {
+        block.transactions.push_back(Transaction::fromJSON(object));
     }
-    
-    // Create and return the Block
-    Block block(idx, prevHash, parsedTransactions);
-    block.hash = hash;
-    block.timestamp = timestamp;
-    block.nonce = nonce;
-    
+
+    return block;
+}
+
+Block Block::fromHeader(const BlockHeader& header) {
+    Block block;
+    block.index = header.index;
+    block.previousHash = header.previousHash;
+    block.merkleRoot = header.merkleRoot;
+    block.hash = header.hash;
+    block.timestamp = header.timestamp;
+    block.bits = header.bits;
+    block.nonce = header.nonce;
     return block;
-}
\ No newline at end of file
+}
+
+bool Block::fromJSONArray(std::string_view json, std::string_view key, std::vector<Block>& out) {
+    TRACE_SPAN("Block::fromJSONArray");
+
+    // Index the batch first so out grows once. The index lives in an arena
+    // that starts on the stack and is dropped as a whole on return.
+    std::byte initial[16 * 1024];
+    std::pmr::monotonic_buffer_resource arena(initial, sizeof(initial));
+    std::pmr::vector<std::string_view> objects(&arena);
+    bool complete = jsonObjects(json, key, objects);
+
+    out.reserve(out.size() + objects.size());
+    for (std::string_view object : objects) {
+        out.push_back(fromJSON(object));
+    }
+    return complete;
+}
@@ -2,18 +2,53 @@
 #define BLOCK_H
 
 #include "Transaction.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <ctime>
 #include <vector>
 
+class JsonWriter;
+
+// The part of a block that proof-of-work commits to. Transactions are
+// covered through merkleRoot, so a header chain can be checked without
+// downloading any block bodies.
+struct BlockHeader {
+    int index;
+    std::string previousHash;
+    std::string merkleRoot;
+    std::string hash;
+    std::time_t timestamp;
+    uint32_t bits;
+    uint32_t nonce;
+
+    // Hash of the header fields
+    std::string calculateHash() const;
+
+    // The same, building the input in buffer and writing over hash (no
+    // allocation once both have the capacity)
+    void calculateHash(std::string& buffer, std::string& hash) const;
+
+    // Convert header to JSON format
+    std::string toJSON() const;
+
+    // Append the same JSON to a writer
+    void writeJSON(JsonWriter& json) const;
+
+    // Parse header from JSON format
+    static BlockHeader fromJSON(std::string_view json);
+};
+
 class Block {
     public: 
         int index;
         std::string previousHash; // link to previous block
+        std::string merkleRoot; // commitment to the transactions
         std::string hash; // unique identifier
         std::vector<Transaction> transactions;
         std::time_t timestamp; // time of creation
-        int nonce; // used for proof-of-work
+        uint32_t bits; // proof-of-work target, compact (see Target.h)
+        uint32_t nonce; // used for proof-of-work
 
         // Constructor
         Block(int idx, std::string prevHash, std::vector<Transaction> txs);
@@ -21,8 +56,12 @@ class Block {
         // Calculate the hash of the block
         std::string calculateHash() const;
 
-        // Mine the block by finding a valid hash
-        void mineBlock(int difficulty);
+        // Merkle root of the current transactions
+        std::string calculateMerkleRoot() const;
+
+        // Mine the block by finding a hash below its bits target,
+        // searching the nonce space on this many threads
+        void mineBlock(unsigned threads = 1);
 
         // Add a transaction to the block
         void addTransaction(Transaction tx);
@@ -30,11 +69,33 @@ class Block {
         // Combine all transactions for hashing
         std::string getTransactionsAsString() const;
 
+        // Header fields only
+        BlockHeader getHeader() const;
+
         // Convert block to JSON format
         std::string toJSON() const;
 
+        // Append the same JSON to a writer
+        void writeJSON(JsonWriter& json) const;
+
+        // Rough size of toJSON(), for reserving buffers
+        size_t estimateJSONSize() const;
+
         // Parse block from JSON format
-        static Block fromJSON(const std::string& json);
+        static Block fromJSON(std::string_view json);
+
+        // Parse the blocks of the array after "key":[ (the first array if
+        // key is empty) onto the end of out; false if the array is missing
+        // or cut short
+        static bool fromJSONArray(std::string_view json, std::string_view key, std::vector<Block>& out);
+
+        // Header-only block, as a light client keeps them: no transactions,
+        // merkleRoot as given
+        static Block fromHeader(const BlockHeader& header);
+
+    private:
+        // Empty, for fromJSON() to fill in without recomputing the Merkle root
+        Block() = default;
 };
 
-#endif 
\ No newline at end of file
+#endif 
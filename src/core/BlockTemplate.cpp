@@ -0,0 +1,197 @@
+#include "BlockTemplate.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <ctime>
+#include <unordered_set>
+
+Block BlockTemplate::Work::toBlock(const BlockHeader& solved) const {
+    Block block = Block::fromHeader(header);
+    block.timestamp = solved.timestamp;
+    block.nonce = solved.nonce;
+    block.hash = solved.hash;
+    block.transactions.reserve(transactions.size());
+    for (const auto& tx : transactions) {
+        block.transactions.push_back(*tx);
+    }
+    return block;
+}
+
+BlockTemplate::BlockTemplate(const Blockchain& chain, Mempool& mempool)
+    : chain(chain), mempool(mempool), header {}, version(0) {
+    // Leaf 0 is the reward from the start; rebase() renews it
+    transactions.push_back(std::make_shared<const Transaction>("SYSTEM", "MINER", chain.getMiningReward()));
+    tree.push(transactions[0]->calculateHash());
+
+    mempool.setListeners([this](const Transaction& tx, const std::string& txid) { add(tx, txid); },
+                         [this](const std::string& txid) { remove(txid); });
+}
+
+BlockTemplate::~BlockTemplate() {
+    mempool.setListeners(nullptr, nullptr);
+}
+
+std::shared_ptr<const BlockTemplate::Work> BlockTemplate::current() {
+    std::vector<std::string> invalid;
+    std::shared_ptr<const Work> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ChainSnapshot latest = chain.snapshot();
+        if (latest->empty()) {
+            return nullptr;
+        }
+        if (!base || latest->blocks.back() != base->blocks.back()) {
+            rebase(latest, invalid);
+        }
+
+        if (!work || work->version != version) {
+            auto next = std::make_shared<Work>();
+            next->version = version;
+            next->parent = base->blocks.back();
+            next->header = header;
+            next->header.merkleRoot = tree.root();
+            next->header.timestamp = std::max(time(nullptr), chain.nextMinTimestamp(*base));
+            next->transactions = transactions;
+            work = std::move(next);
+        }
+        result = work;
+    }
+
+    // Out of our lock: the mempool's comes first
+    if (!invalid.empty()) {
+        LOG_INFO(Mining, "Dropped transactions the new tip made unaffordable").kv("count", invalid.size());
+        mempool.removeTxids(invalid);
+    }
+    return result;
+}
+
+bool BlockTemplate::isCurrent(const Work& work) const {
+    return work.version == version.load() && chain.snapshot()->blocks.back() == work.parent;
+}
+
+size_t BlockTemplate::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return transactions.size() - 1;
+}
+
+void BlockTemplate::add(const Transaction& tx, const std::string& txid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (positions.count(txid)) {
+        return;
+    }
+    positions.emplace(txid, transactions.size());
+    transactions.push_back(std::make_shared<const Transaction>(tx));
+    tree.push(txid);
+    version++;
+}
+
+void BlockTemplate::remove(const std::string& txid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = positions.find(txid);
+    if (it == positions.end()) {
+        return;
+    }
+    removeAt(it->second);
+    version++;
+}
+
+void BlockTemplate::removeAt(size_t index) {
+    size_t last = transactions.size() - 1;
+    positions.erase(tree.leaf(index));
+    if (index != last) {
+        transactions[index] = std::move(transactions[last]);
+        tree.set(index, tree.leaf(last));
+        positions[tree.leaf(index)] = index;
+    }
+    transactions.pop_back();
+    tree.pop();
+}
+
+void BlockTemplate::rebase(const ChainSnapshot& latest, std::vector<std::string>& invalid) {
+    // Blocks we haven't seen: past the fork point with the chain we built on
+    size_t fork = 0;
+    if (base) {
+        fork = std::min(base->size(), latest->size());
+        while (fork > 0 && (*base)[fork - 1].hash != (*latest)[fork - 1].hash) {
+            fork--;
+        }
+    }
+    TRACE_SPAN_ARG("BlockTemplate::rebase", "blocks", latest->size() - fork);
+
+    // What they included is no longer pending; who they spent from may
+    // no longer afford what is, and neither may senders whose transactions
+    // a reorg dropped (they come back through the mempool)
+    std::unordered_set<std::string> spenders;
+    for (size_t i = base ? fork : latest->size(); i < latest->size(); i++) {
+        const std::vector<Transaction>& included = (*latest)[i].transactions;
+        std::vector<std::string> txids = Transaction::calculateHashes(included);
+        for (size_t j = 0; j < included.size(); j++) {
+            auto it = positions.find(txids[j]);
+            if (it != positions.end()) {
+                removeAt(it->second);
+            }
+            if (included[j].sender != "SYSTEM") {
+                spenders.insert(included[j].sender);
+            }
+        }
+    }
+    for (size_t i = fork; base && i < base->size(); i++) {
+        for (const Transaction& tx : (*base)[i].transactions) {
+            if (tx.sender != "SYSTEM") {
+                spenders.insert(tx.sender);
+            }
+        }
+    }
+
+    // One pass over the chain for the balances of spenders we hold
+    // transactions from
+    std::unordered_map<std::string, double> balances;
+    for (size_t i = 1; i < transactions.size(); i++) {
+        if (spenders.count(transactions[i]->sender)) {
+            balances.emplace(transactions[i]->sender, 0.0);
+        }
+    }
+    if (!balances.empty()) {
+        for (const auto& block : latest->blocks) {
+            for (const Transaction& tx : block->transactions) {
+                auto sender = balances.find(tx.sender);
+                if (sender != balances.end()) {
+                    sender->second -= tx.amount;
+                }
+                auto receiver = balances.find(tx.receiver);
+                if (receiver != balances.end()) {
+                    receiver->second += tx.amount;
+                }
+            }
+        }
+
+        // Each sender's transactions in turn against what is left, as
+        // validateSpends() takes them; the ones that don't fit go, from
+        // the end so whatever removeAt() moves down is one that stays
+        std::vector<size_t> unaffordable;
+        for (size_t i = 1; i < transactions.size(); i++) {
+            auto balance = balances.find(transactions[i]->sender);
+            if (balance == balances.end()) {
+                continue;
+            }
+            if (balance->second < transactions[i]->amount) {
+                unaffordable.push_back(i);
+            } else {
+                balance->second -= transactions[i]->amount;
+            }
+        }
+        for (auto it = unaffordable.rbegin(); it != unaffordable.rend(); ++it) {
+            invalid.push_back(tree.leaf(*it));
+            removeAt(*it);
+        }
+    }
+
+    const Block& tip = latest->tip();
+    header.index = tip.index + 1;
+    header.previousHash = tip.hash;
+    header.bits = chain.nextBits(*latest);
+    transactions[0] = std::make_shared<const Transaction>("SYSTEM", "MINER", chain.getMiningReward());
+    tree.set(0, transactions[0]->calculateHash());
+    base = latest;
+    version++;
+}
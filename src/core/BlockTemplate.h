@@ -0,0 +1,103 @@
+// The next block to mine, kept ready on top of our tip.
+//
+// The template listens to the mempool (Mempool::setListeners) and applies
+// each change as it happens: a new transaction becomes the last leaf, and a
+// dropped one is overwritten by the last leaf, so either way a MerkleTree
+// rehashes one path to the root. Block order follows from that rather than
+// from arrival. The reward transaction is always leaf 0.
+//
+// A new tip is picked up by current(). If it extends the tip the template
+// was built on, only the connected blocks are looked at: transactions they
+// included are dropped, and each sender who spent in them has their
+// transactions taken in turn against their new balance, dropping those it
+// no longer covers. The rest need no check: the mempool admits a sender's
+// transactions only while together they spend no more than the sender
+// has, and no block since has taken from them. After a reorg the same is
+// done for every block past the fork, and for the senders in the blocks
+// it dropped. Transactions that no longer pass are dropped from the
+// mempool as well. Node::submitMinedBlock() checks every spend again
+// before a block connects.
+//
+// Miners poll isCurrent() between nonce batches and take a fresh current()
+// when it goes false; each version's Work is built once and shared.
+//
+// Thread-safe. Locks after the mempool's lock, never before it.
+
+#ifndef BLOCKTEMPLATE_H
+#define BLOCKTEMPLATE_H
+
+#include "Block.h"
+#include "Blockchain.h"
+#include "Mempool.h"
+#include "MerkleTree.h"
+#include "Transaction.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class BlockTemplate {
+    public:
+        // One version of the template: everything a miner needs
+        struct Work {
+            uint64_t version;
+            std::shared_ptr<const Block> parent; // Tip it builds on
+            BlockHeader header; // All but nonce and hash
+            std::vector<std::shared_ptr<const Transaction>> transactions; // Reward first
+
+            // The block, given a header solved from ours: its timestamp,
+            // nonce and hash, which meets the target
+            Block toBlock(const BlockHeader& solved) const;
+        };
+
+        // Constructor: starts listening to mempool
+        BlockTemplate(const Blockchain& chain, Mempool& mempool);
+
+        // Destructor (stops listening)
+        ~BlockTemplate();
+
+        BlockTemplate(const BlockTemplate&) = delete;
+        BlockTemplate& operator=(const BlockTemplate&) = delete;
+
+        // Work on the current tip and transactions (nullptr while the chain
+        // is empty)
+        std::shared_ptr<const Work> current();
+
+        // Is work still what current() would return? Lock-free; cheap
+        // enough to ask between nonce batches.
+        bool isCurrent(const Work& work) const;
+
+        // Transactions waiting in the template, reward not counted
+        size_t size() const;
+
+    private:
+        // Mempool gained a transaction
+        void add(const Transaction& tx, const std::string& txid);
+
+        // Mempool dropped a txid
+        void remove(const std::string& txid);
+
+        // Drop the transaction at index >= 1 by moving the last one into
+        // its place (mutex held)
+        void removeAt(size_t index);
+
+        // Build on latest's tip, collecting the txids of transactions that
+        // stopped passing (mutex held)
+        void rebase(const ChainSnapshot& latest, std::vector<std::string>& invalid);
+
+        const Blockchain& chain;
+        Mempool& mempool;
+        mutable std::mutex mutex; // Guards everything below but version
+        ChainSnapshot base; // Chain the template builds on (nullptr until the first current())
+        BlockHeader header; // Index, previousHash and bits for base
+        MerkleTree tree; // Leaves are txids, in transactions order
+        std::vector<std::shared_ptr<const Transaction>> transactions; // Reward first
+        std::unordered_map<std::string, size_t> positions; // Txid -> index in transactions
+        std::shared_ptr<const Work> work; // Built for the version it carries
+        std::atomic<uint64_t> version; // Bumped on every change
+};
+
+#endif
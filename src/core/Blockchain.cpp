@@ -1,52 +1,266 @@
 #include "Blockchain.h"
+#include "JsonWriter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Signature.h"
+#include "Target.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <functional>
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <unordered_set>
+
+namespace {
+
+// An amount in millionths, the precision blocks carry amounts in, so sums
+// and their undoing are exact
+int64_t units(double amount) {
+    return std::llround(amount * 1e6);
+}
+
+// The first fork blocks of base followed by suffix, indexable by height
+// without copying either
+struct SplicedChain {
+    const ChainState& base;
+    size_t fork;
+    const std::vector<Block>& suffix;
+
+    const Block& operator[](size_t height) const { return height < fork ? base[height] : suffix[height - fork]; }
+};
+
+}
 
 Blockchain::Blockchain(int diff, double reward, bool createGenesis) {
     difficulty = diff;
+    initialBits = bitsForLeadingZeros(diff);
     miningReward = reward;
 
+    // Initial rewards to the demo accounts
     std::vector<Transaction> genesisTx;
-    genesisTx.push_back(Transaction("SYSTEM", "Alice", miningReward)); // Initial reward to Alice
-    genesisTx.push_back(Transaction("SYSTEM", "Bob", miningReward));   // Initial reward to Bob
-    genesisTx.push_back(Transaction("SYSTEM", "Charlie", miningReward)); // Initial reward to Charlie
+    for (const std::string& name : demoAccounts()) {
+        genesisTx.push_back(Transaction("SYSTEM", keyPairFromSeed(name).address, miningReward));
+    }
 
+    // Genesis must be identical on every node, so pin its timestamps
+    for (Transaction& tx : genesisTx) {
+        tx.timestamp = GENESIS_TIMESTAMP;
+    }
+
+    auto initial = std::make_shared<ChainState>();
     if (createGenesis) {
         Block genesisBlock(0, "0", genesisTx);
-        genesisBlock.mineBlock(difficulty);
-        chain.push_back(genesisBlock);
+        genesisBlock.timestamp = GENESIS_TIMESTAMP;
+        genesisBlock.bits = initialBits;
+        genesisBlock.mineBlock();
+        initial->blocks.push_back(std::make_shared<const Block>(std::move(genesisBlock)));
+    }
+    reindex(ChainState(), *initial);
+    state = std::move(initial);
+}
+
+const std::vector<std::string>& Blockchain::demoAccounts() {
+    static const std::vector<std::string> names { "Alice", "Bob", "Charlie" };
+    return names;
+}
+
+void Blockchain::setRetarget(int seconds, int interval) {
+    blockTime = seconds;
+    retargetInterval = interval;
+}
+
+int Blockchain::retargetWindowStart(int height) const {
+    if (retargetInterval <= 0 || blockTime <= 0 || height <= 0 || height % retargetInterval != 0) {
+        return -1;
+    }
+    // Genesis has a pinned timestamp, so never measure from it
+    return std::max(height - retargetInterval, 1);
+}
+
+uint32_t Blockchain::expectedBits(int height, uint32_t parentBits, std::time_t parentTime,
+                                  std::time_t windowTime) const {
+    if (retargetInterval <= 0 || blockTime <= 0) {
+        return initialBits;
+    }
+    int start = retargetWindowStart(height);
+    if (start < 0 || start >= height - 1) {
+        return parentBits;
+    }
+
+    // The window covers blocks start..height-1, so height-1-start gaps
+    int64_t expected = static_cast<int64_t>(blockTime) * (height - 1 - start);
+    int64_t actual = static_cast<int64_t>(parentTime) - static_cast<int64_t>(windowTime);
+    uint32_t bits = retargetBits(parentBits, actual, expected);
+    LOG_DEBUG(Chain, "Retarget").kv("height", height).kv("actual", actual).kv("expected", expected)
+        .kv("bits", bits).kv("difficulty", bitsDifficulty(bits));
+    return bits;
+}
+
+uint32_t Blockchain::nextBits(const ChainState& chain) const {
+    int height = static_cast<int>(chain.size());
+    int start = retargetWindowStart(height);
+    return expectedBits(height, chain.tip().bits, chain.tip().timestamp, start >= 0 ? chain[start].timestamp : 0);
+}
+
+template <typename Chain>
+bool Blockchain::meetsTarget(const Chain& chain, int height) const {
+    const auto& block = chain[height];
+    uint32_t expected = initialBits;
+    if (height > 0) {
+        const auto& parent = chain[height - 1];
+        int start = retargetWindowStart(height);
+        expected = expectedBits(height, parent.bits, parent.timestamp, start >= 0 ? chain[start].timestamp : 0);
+    }
+    return block.bits == expected && hashMeetsBits(block.hash, block.bits);
+}
+
+template <typename TimeAt>
+std::time_t Blockchain::medianTimePast(int height, TimeAt timeAt) {
+    // On the stack: this runs for every block connected
+    std::array<std::time_t, MEDIAN_TIME_SPAN> times;
+    size_t count = 0;
+    for (int h = height - 1; h >= 0 && count < times.size(); h--) {
+        times[count++] = timeAt(h);
+    }
+    if (count == 0) {
+        return 0;
+    }
+    std::nth_element(times.begin(), times.begin() + count / 2, times.begin() + count);
+    return times[count / 2];
+}
+
+bool Blockchain::timestampInRange(std::time_t timestamp, std::time_t medianTime) {
+    return timestamp > medianTime && timestamp <= time(nullptr) + MAX_FUTURE_BLOCK_TIME;
+}
+
+std::time_t Blockchain::nextMinTimestamp(const ChainState& chain) const {
+    return medianTimePast(static_cast<int>(chain.size()), [&chain](int h) { return chain[h].timestamp; }) + 1;
+}
+
+bool Blockchain::timestampAllowed(const ChainState& chain, std::time_t timestamp) const {
+    return timestampInRange(timestamp, nextMinTimestamp(chain) - 1);
+}
+
+void Blockchain::publish(std::shared_ptr<ChainState> next) {
+    reindex(*snapshot(), *next);
+    std::atomic_store(&state, ChainSnapshot(std::move(next)));
+}
+
+void Blockchain::reindex(const ChainState& from, const ChainState& to) {
+    // Where the two part ways: blocks both hold are shared, not copied
+    size_t fork = std::min(from.size(), to.size());
+    while (fork > 0 && from.blocks[fork - 1] != to.blocks[fork - 1]) {
+        fork--;
+    }
+
+    std::lock_guard<std::mutex> lock(indexMutex);
+    auto credit = [this](const std::string& address, int64_t amount) {
+        auto it = balances.find(address);
+        if (it == balances.end()) {
+            balances.emplace(address, amount);
+        } else if ((it->second += amount) == 0) {
+            balances.erase(it);
+        }
+    };
+
+    // Newest first, so each undo sees what it did
+    for (size_t i = from.size(); i-- > fork;) {
+        const std::vector<Transaction>& txs = from[i].transactions;
+        for (auto tx = txs.rbegin(); tx != txs.rend(); ++tx) {
+            credit(tx->sender, units(tx->amount));
+            credit(tx->receiver, -units(tx->amount));
+            auto it = tx->sender == "SYSTEM" ? confirmed.end() : confirmed.find(tx->signature);
+            if (it != confirmed.end() && it->second == &*tx) {
+                confirmed.erase(it);
+            }
+        }
+    }
+    for (size_t i = fork; i < to.size(); i++) {
+        for (const Transaction& tx : to[i].transactions) {
+            credit(tx.sender, -units(tx.amount));
+            credit(tx.receiver, units(tx.amount));
+            if (tx.sender != "SYSTEM") {
+                confirmed.emplace(tx.signature, &tx);
+            }
+        }
     }
 }
 
 
 void Blockchain::addBlock(std::vector<Transaction> tx) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    ChainSnapshot current = snapshot();
+
+    // Reward first, then the rest, moved rather than copied
     std::vector<Transaction> validTransactions;
-    for (const Transaction& transaction : tx) {
-        if (validateTransaction(transaction)) {
-            validTransactions.push_back(transaction);
-        } else {
-            std::cout << "Invalid transaction skipped:  From: " << transaction.sender 
-                      << "  To: " << transaction.receiver 
-                      << "  Amount: " << transaction.amount << std::endl;
+    validTransactions.reserve(tx.size() + 1);
+    validTransactions.emplace_back("SYSTEM", "MINER", miningReward);
+    for (Transaction& transaction : tx) {
+        if (transaction.sender == "SYSTEM") {
+            LOG_INFO(Chain, "Only the block reward may come from SYSTEM, skipped").kv("to", transaction.receiver)
+                .kv("amount", transaction.amount);
+            continue;
         }
+        validTransactions.push_back(std::move(transaction));
     }
 
-    Transaction rewardTx("SYSTEM", "MINER", miningReward);
-    validTransactions.insert(validTransactions.begin(), rewardTx);
+    // Readers keep seeing the old tip while we mine
+    const Block& lastBlock = current->tip();
+    Block newBlock { (lastBlock.index + 1), lastBlock.hash, std::move(validTransactions) };
+
+    // One pass over the chain finds the repeats and the transfers their
+    // senders can't cover, taking earlier ones first; dropping them leaves
+    // what is left able to pay. Signatures are verified in parallel, and
+    // only if one fails does each need checking on its own.
+    std::vector<size_t> invalid;
+    checkSpends(*current, current->size(), &newBlock, 1, &invalid);
+    if (!verifySignatures(newBlock)) {
+        for (size_t i = 1; i < newBlock.transactions.size(); i++) {
+            if (!signatures.verify(newBlock.transactions[i])) {
+                invalid.push_back(i);
+            }
+        }
+        std::sort(invalid.begin(), invalid.end());
+        invalid.erase(std::unique(invalid.begin(), invalid.end()), invalid.end());
+    }
+    if (!invalid.empty()) {
+        LOG_INFO(Chain, "Invalid, repeated or unaffordable transactions skipped").kv("count", invalid.size());
+        std::vector<Transaction>& txs = newBlock.transactions;
+        size_t kept = 0;
+        for (size_t i = 0, next = 0; i < txs.size(); i++) {
+            if (next < invalid.size() && invalid[next] == i) {
+                next++;
+            } else if (kept++ != i) {
+                txs[kept - 1] = std::move(txs[i]);
+            }
+        }
+        txs.erase(txs.begin() + kept, txs.end());
+        newBlock.merkleRoot = newBlock.calculateMerkleRoot();
+    }
 
-    if (validTransactions.size() == 1) {  // Only reward, no actual transactions
-        std::cout << "\nNo valid transactions to add (only mining reward)..." << std::endl;
+    if (newBlock.transactions.size() == 1) {  // Only reward, no actual transactions
+        LOG_INFO(Chain, "No valid transactions to add (only mining reward)");
     }
 
-    const Block& lastBlock = chain.back();
-    Block newBlock { (lastBlock.index + 1), lastBlock.hash, validTransactions };
-    newBlock.mineBlock(difficulty);
-    chain.push_back(newBlock);
+    newBlock.bits = nextBits(*current);
+    newBlock.timestamp = std::max(newBlock.timestamp, nextMinTimestamp(*current));
+    newBlock.mineBlock(minerThreads);
+
+    auto next = extend(1);
+    next->blocks.push_back(std::make_shared<const Block>(std::move(newBlock)));
+    publish(std::move(next));
+
+    static Counter& blocksMined = Metrics::instance().counter("blockchain_blocks_mined_total", "Blocks mined by this process");
+    blocksMined.inc();
 }
 
-void Blockchain::printChain() {
-    for (const Block& block : chain) {
+void Blockchain::printChain() const {
+    ChainSnapshot chain = snapshot();
+    for (const auto& entry : chain->blocks) {
+        const Block& block = *entry;
         std::cout << "\n==================== Block " << block.index << " ====================" << std::endl;
         std::cout << "Block Index: " << block.index << std::endl;
         std::cout << "Transactions: " << std::endl;
@@ -61,104 +275,362 @@ void Blockchain::printChain() {
     }
 }
 
-Block& Blockchain::getBlock(int idx) {
-    return chain[idx];
+std::shared_ptr<const Block> Blockchain::getBlock(int idx) const {
+    ChainSnapshot chain = snapshot();
+    if (idx < 0 || static_cast<size_t>(idx) >= chain->size()) {
+        return nullptr;
+    }
+    return chain->blocks[idx];
 }
 
-bool Blockchain::isChainValid() {
+bool Blockchain::isChainValid(bool checkBodies) const {
+    ChainSnapshot snap = snapshot();
+    const ChainState& chain = *snap;
     for (size_t i = 1; i < chain.size(); i++) {
-        Block block = chain[i];
-        Block prevBlock = chain[i-1];
+        const Block& block = chain[i];
+        const Block& prevBlock = chain[i-1];
+
+        if (block.hash != block.calculateHash() || (checkBodies && block.merkleRoot != block.calculateMerkleRoot())) {
+            LOG_WARN(Chain, "Block data has been tampered with").kv("height", i);
+            return false;
+        }
 
-        std::string originalHash = block.hash;
-        std::string freshHash = block.calculateHash();
-        if (originalHash != freshHash) {
-            std::cout << "\nBlock " << i << "'s data has been tampered with!" << std::endl;
+        if (block.previousHash != prevBlock.hash) {
+            LOG_WARN(Chain, "Block has invalid previous hash link").kv("height", i);
             return false;
         }
 
-        std::string curPrevHash = block.previousHash;
-        std::string prevHash = prevBlock.hash;
-        if (curPrevHash != prevHash) {
-            std::cout << "Block " << i << " has invalid previous hash link!" << std::endl;
+        if (!meetsTarget(chain, static_cast<int>(i))) {
+            LOG_WARN(Chain, "Block doesn't meet its target").kv("height", i).kv("bits", block.bits);
             return false;
         }
+    }
 
-        std::string target = "";
-        for (int j = 0; j < difficulty; j++) {
-            target += "0";
+    if (checkBodies) {
+        std::vector<const Transaction*> txs;
+        for (const auto& block : chain.blocks) {
+            for (const Transaction& tx : block->transactions) {
+                txs.push_back(&tx);
+            }
         }
-        if (originalHash.substr(0, difficulty) != target) {
-             std::cout << "Block " << i << " doesn't meet difficulty requirements!" << std::endl;
+        if (!signatures.verifyAll(txs)) {
+            LOG_WARN(Chain, "Chain has a transaction with a bad signature");
             return false;
         }
     }
     return true;
 }
 
-bool Blockchain::isValidChain(const std::vector<Block>& testChain) const {
-    if (testChain.empty()) {
-        return false;
-    }
-    
-    for (size_t i = 1; i < testChain.size(); i++) {
-        Block block = testChain[i];
-        Block prevBlock = testChain[i-1];
+template <typename Chain>
+bool Blockchain::linksValid(const Chain& chain, size_t from, size_t to) const {
+    for (size_t i = from; i < to; i++) {
+        const Block& block = chain[i];
+        const Block& prevBlock = chain[i-1];
 
-        std::string originalHash = block.hash;
-        std::string freshHash = block.calculateHash();
-        if (originalHash != freshHash) {
+        // Cheapest checks first; no copies of either block
+        if (block.previousHash != prevBlock.hash || !meetsTarget(chain, static_cast<int>(i))) {
             return false;
         }
 
-        std::string curPrevHash = block.previousHash;
-        std::string prevHash = prevBlock.hash;
-        if (curPrevHash != prevHash) {
+        std::time_t medianTime = medianTimePast(static_cast<int>(i), [&chain](int h) { return chain[h].timestamp; });
+        if (!timestampInRange(block.timestamp, medianTime)) {
             return false;
         }
 
-        std::string target = "";
-        for (int j = 0; j < difficulty; j++) {
-            target += "0";
+        if (block.hash != block.calculateHash()) {
+            return false;
         }
-        if (originalHash.substr(0, difficulty) != target) {
+
+        if (block.merkleRoot != block.calculateMerkleRoot()) {
             return false;
         }
     }
     return true;
 }
 
-double Blockchain::getBalance(std::string address) {
-    double balance = 0.0;
+bool Blockchain::isValidChain(const std::vector<Block>& testChain) const {
+    // Genesis is pinned: a chain from another one could pay anyone anything
+    ChainSnapshot ours = snapshot();
+    if (testChain.empty() || testChain[0].bits != initialBits ||
+        (!ours->empty() && testChain[0].hash != (*ours)[0].hash)) {
+        return false;
+    }
 
-    for (const Block& block : chain) {
-        for (const Transaction& tx : block.transactions) {
-            if (tx.sender == address) {
-                balance -= tx.amount;
+    if (!linksValid(testChain, 1, testChain.size())) {
+        return false;
+    }
+
+    // Blocks we already hold were checked when they connected
+    size_t shared = 0;
+    while (shared < testChain.size() && shared < ours->size() && (*ours)[shared].hash == testChain[shared].hash) {
+        shared++;
+    }
+
+    // Spends of the rest, against what the blocks before them hold
+    if (!checkSpends(*ours, shared, testChain.data() + shared, testChain.size() - shared, nullptr)) {
+        return false;
+    }
+
+    // Signatures last: they cost the most, and are checked all at once
+    return verifySignatures(testChain, shared);
+}
+
+bool Blockchain::isValidFork(const ChainState& base, size_t fork, const std::vector<Block>& blocks) const {
+    // Genesis stays; the blocks must number on from the fork
+    if (fork == 0 || fork > base.size() || blocks.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].index != static_cast<int>(fork + i)) {
+            return false;
+        }
+    }
+
+    SplicedChain chain { base, fork, blocks };
+    return linksValid(chain, fork, fork + blocks.size()) &&
+        checkSpends(base, fork, blocks.data(), blocks.size(), nullptr) &&
+        verifySignatures(blocks);
+}
+
+bool Blockchain::isConfirmed(const Transaction& tx) const {
+    if (tx.sender == "SYSTEM") {
+        return false; // Unsigned; rewards may repeat
+    }
+    std::lock_guard<std::mutex> lock(indexMutex);
+    auto it = confirmed.find(tx.signature);
+    return it != confirmed.end() && it->second->sender == tx.sender;
+}
+
+bool Blockchain::validateSpends(const ChainState& chain, const Block& block, std::vector<size_t>* invalid) const {
+    return checkSpends(chain, chain.size(), &block, 1, invalid);
+}
+
+bool Blockchain::validateSpends(const ChainState& chain, const std::vector<Block>& blocks) const {
+    return checkSpends(chain, chain.size(), blocks.data(), blocks.size(), nullptr);
+}
+
+bool Blockchain::validateReward(const Block& block) const {
+    if (block.index == 0) {
+        return true; // Genesis is pinned by hash instead
+    }
+    const std::vector<Transaction>& txs = block.transactions;
+    if (txs.empty() || txs[0].sender != "SYSTEM" || units(txs[0].amount) != units(miningReward)) {
+        return false;
+    }
+    return std::none_of(txs.begin() + 1, txs.end(), [](const Transaction& tx) { return tx.sender == "SYSTEM"; });
+}
+
+bool Blockchain::checkSpends(const ChainState& chain, size_t prefix, const Block* blocks, size_t count,
+                             std::vector<size_t>* invalid) const {
+    size_t failures = 0;
+    std::vector<size_t> failed; // Indexes into blocks[0]
+    auto fail = [&](size_t block, size_t index) {
+        failures++;
+        if (invalid != nullptr && block == 0) {
+            failed.push_back(index);
+        }
+    };
+
+    // Nothing minted but rewards; no single transaction is to blame
+    for (size_t b = 0; b < count; b++) {
+        if (!validateReward(blocks[b])) {
+            failures++;
+        }
+    }
+
+    // Every transfer in blocks, ordered by sender and then signature
+    struct Transfer {
+        const Transaction* tx;
+        size_t block;
+        size_t index;
+    };
+    std::vector<Transfer> transfers;
+    size_t total = 0;
+    for (size_t b = 0; b < count; b++) {
+        total += blocks[b].transactions.size();
+    }
+    transfers.reserve(total);
+    for (size_t b = 0; b < count; b++) {
+        const std::vector<Transaction>& txs = blocks[b].transactions;
+        for (size_t i = 0; i < txs.size(); i++) {
+            if (txs[i].sender != "SYSTEM") {
+                transfers.push_back({ &txs[i], b, i });
+            }
+        }
+    }
+    if (transfers.empty() && failures == 0) {
+        return true;
+    }
+    std::sort(transfers.begin(), transfers.end(), [](const Transfer& x, const Transfer& y) {
+        int order = x.tx->sender.compare(y.tx->sender);
+        return order != 0 ? order < 0 : x.tx->signature < y.tx->signature;
+    });
+
+    // Each sender's run of transfers, and what they hold as the check
+    // goes along
+    struct Sender {
+        const std::string* address;
+        size_t begin;
+        size_t end;
+        int64_t balance; // In millionths, like getBalance()'s index
+        int64_t spent; // In the block being checked
+    };
+    std::vector<Sender> senders;
+    for (size_t k = 0; k < transfers.size(); k++) {
+        if (senders.empty() || *senders.back().address != transfers[k].tx->sender) {
+            senders.push_back({ &transfers[k].tx->sender, k, k, 0, 0 });
+        }
+        senders.back().end = k + 1;
+    }
+    auto find = [&senders](const std::string& address) -> Sender* {
+        auto it = std::lower_bound(senders.begin(), senders.end(), address,
+                                   [](const Sender& s, const std::string& a) { return *s.address < a; });
+        return it != senders.end() && *it->address == address ? &*it : nullptr;
+    };
+
+    // The transfers again, by signature hash in an open-addressed table,
+    // so a chain transaction costs one probe to rule out as a repeat
+    static constexpr size_t EMPTY = static_cast<size_t>(-1);
+    size_t slots = 1;
+    while (slots < transfers.size() * 2) {
+        slots <<= 1;
+    }
+    std::vector<size_t> bySignature(slots, EMPTY);
+    std::hash<std::string> hashOf;
+    for (size_t k = 0; k < transfers.size(); k++) {
+        size_t slot = hashOf(transfers[k].tx->signature) & (slots - 1);
+        while (bySignature[slot] != EMPTY) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        bySignature[slot] = k;
+    }
+
+    // The same transaction twice
+    for (const Sender& sender : senders) {
+        for (size_t k = sender.begin + 1; k < sender.end; k++) {
+            if (transfers[k - 1].tx->signature == transfers[k].tx->signature) {
+                fail(transfers[k].block, transfers[k].index);
+            }
+        }
+    }
+
+    // One already on the chain, and what each sender holds before blocks
+    for (size_t b = 0; b < prefix; b++) {
+        for (const Transaction& tx : chain[b].transactions) {
+            if (Sender* sender = find(tx.sender)) {
+                sender->balance -= units(tx.amount);
+                size_t slot = hashOf(tx.signature) & (slots - 1);
+                for (; bySignature[slot] != EMPTY; slot = (slot + 1) & (slots - 1)) {
+                    const Transfer& transfer = transfers[bySignature[slot]];
+                    if (transfer.tx->signature == tx.signature && transfer.tx->sender == tx.sender) {
+                        fail(transfer.block, transfer.index);
+                    }
+                }
+            }
+            if (Sender* receiver = find(tx.receiver)) {
+                receiver->balance += units(tx.amount);
+            }
+        }
+    }
+
+    // Block by block, nobody spends more than they held before it; within
+    // one, earlier transfers come first
+    for (size_t b = 0; b < count; b++) {
+        const std::vector<Transaction>& txs = blocks[b].transactions;
+        for (size_t i = 0; i < txs.size(); i++) {
+            if (txs[i].sender == "SYSTEM") {
+                continue;
             }
-            if (tx.receiver == address) {
-                balance += tx.amount;
+            Sender* sender = find(txs[i].sender);
+            int64_t amount = units(txs[i].amount);
+            if (amount <= 0 || sender->spent + amount > sender->balance) {
+                fail(b, i);
+            } else {
+                sender->spent += amount;
             }
         }
+        for (const Transaction& tx : txs) {
+            if (Sender* sender = tx.sender == "SYSTEM" ? nullptr : find(tx.sender)) {
+                sender->balance -= units(tx.amount);
+                sender->spent = 0;
+            }
+            if (Sender* receiver = find(tx.receiver)) {
+                receiver->balance += units(tx.amount);
+            }
+        }
+    }
+
+    if (failures == 0) {
+        return true;
+    }
+    LOG_RATE_LIMITED(Info, Chain, 10, "Blocks mint more than their reward, overspend or repeat confirmed transactions")
+        .kv("height", blocks[0].index).kv("count", failures);
+    if (invalid != nullptr) {
+        std::sort(failed.begin(), failed.end());
+        failed.erase(std::unique(failed.begin(), failed.end()), failed.end());
+        *invalid = std::move(failed);
+    }
+    return false;
+}
+
+bool Blockchain::verifySignature(const Transaction& tx, const std::string& txid) const {
+    return signatures.verify(tx, txid);
+}
+
+bool Blockchain::verifySignatures(const Block& block) const {
+    std::vector<const Transaction*> txs;
+    txs.reserve(block.transactions.size());
+    for (const Transaction& tx : block.transactions) {
+        txs.push_back(&tx);
+    }
+    return signatures.verifyAll(txs);
+}
+
+bool Blockchain::verifySignatures(const std::vector<Block>& blocks, size_t from) const {
+    std::vector<const Transaction*> txs;
+    for (size_t i = from; i < blocks.size(); i++) {
+        for (const Transaction& tx : blocks[i].transactions) {
+            txs.push_back(&tx);
+        }
     }
+    return signatures.verifyAll(txs);
+}
 
-    return balance;
+double Blockchain::getBalance(std::string_view address) const {
+    // The key is built in a buffer each thread reuses
+    thread_local std::string key;
+    key.assign(address);
+    std::lock_guard<std::mutex> lock(indexMutex);
+    auto it = balances.find(key);
+    return it == balances.end() ? 0.0 : it->second / 1e6;
 }
 
-bool Blockchain::validateTransaction(Transaction tx) {
+bool Blockchain::validateTransaction(const Transaction& tx) const {
     if(tx.sender == "SYSTEM") {
         return true; // System transactions are always valid
     }
 
+    if (!signatures.verify(tx)) {
+        LOG_RATE_LIMITED(Info, Chain, 10, "Transaction rejected: bad signature").kv("from", tx.sender)
+            .kv("to", tx.receiver).kv("amount", tx.amount);
+        return false;
+    }
+    return hasBalance(tx);
+}
+
+bool Blockchain::hasBalance(const Transaction& tx) const {
+    if (tx.sender == "SYSTEM") {
+        return true;
+    }
+
     double senderBalance = getBalance(tx.sender);
 
     if (senderBalance >= tx.amount) {
         return true;
     } 
     else {
-        std::cout << "Transaction from " << tx.sender << " to " << tx.receiver 
-        << " for amount " << tx.amount 
-        << " is invalid due to insufficient balance." << std::endl;
+        LOG_RATE_LIMITED(Info, Chain, 10, "Transaction rejected: insufficient balance").kv("from", tx.sender)
+            .kv("to", tx.receiver).kv("amount", tx.amount).kv("balance", senderBalance);
         return false;
     }
 
@@ -166,112 +638,293 @@ bool Blockchain::validateTransaction(Transaction tx) {
 
 
 bool Blockchain::saveToFile(const std::string& filename) const {
-    // Open file for writing
-    std::ofstream file(filename);
+    TRACE_SPAN("Blockchain::saveToFile");
+    // Write a temporary file and rename it over the old one, so a crash
+    // mid-save never leaves a truncated chain behind
+    std::string tempFile = filename + ".tmp";
+    std::ofstream file(tempFile);
     if (!file.is_open()) {
         return false;
     }
 
-    // Save each block in chains data
-    file << "[\n";
+    // Write block by block through one reused buffer, so the whole
+    // document never sits in memory
+    ChainSnapshot snap = snapshot();
+    const ChainState& chain = *snap;
+    std::string buffer;
+    buffer.reserve(2 * SAVE_CHUNK_SIZE);
+    JsonWriter json(buffer);
+    json.raw("[\n");
 
     for (size_t i = 0; i < chain.size(); i++) {
-        file << " " << chain[i].toJSON();
+        json.raw(' ');
+        chain[i].writeJSON(json);
+        json.raw(i < chain.size() - 1 ? ",\n" : "\n");
 
-        if (i < chain.size() - 1) {
-            file << ",\n";
-        } else {
-            file << "\n";
+        if (buffer.size() >= SAVE_CHUNK_SIZE) {
+            file.write(buffer.data(), buffer.size());
+            json.clear();
         }
     }
 
-    file << "]";
+    json.raw(']');
+    file.write(buffer.data(), buffer.size());
     file.close();
+    if (!file) {
+        std::remove(tempFile.c_str());
+        return false;
+    }
 
-    return true;
+    return std::rename(tempFile.c_str(), filename.c_str()) == 0;
 }
 
 bool Blockchain::loadFromFile(const std::string& filename) {
+    TRACE_SPAN("Blockchain::loadFromFile");
     // Open file for reading
-    std::ifstream file(filename);
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
     if (!file.is_open()) {
         return false;
     }
 
-    // Read entire file into a string
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string content = buffer.str();
+    // Read entire file into one string, sized up front
+    std::string content(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if (!file.read(&content[0], content.size())) {
+        return false;
+    }
     file.close();
 
-    // Find the array boundaries - use rfind for last ] to handle nested arrays in transactions
-    size_t arrayStart = content.find("[");
-    size_t arrayEnd = content.rfind("]");
-
-    if (arrayStart == std::string::npos || arrayEnd == std::string::npos) {
+    // Parse the blocks straight out of it
+    std::vector<Block> loadedBlocks;
+    if (!Block::fromJSONArray(content, "", loadedBlocks)) {
         return false; // Invalid JSON
     }
+    ChainSnapshot current = snapshot();
+    if (!current->empty() && (loadedBlocks.empty() || loadedBlocks[0].hash != (*current)[0].hash)) {
+        LOG_WARN(Chain, "Saved chain starts from another genesis").kv("file", filename);
+        return false;
+    }
 
-    // Extract content between [ and ]
-    std::string blocksContent = content.substr(arrayStart + 1, arrayEnd - arrayStart - 1);
+    // Replace the current chain with loaded blocks
+    replaceChain(std::move(loadedBlocks));
 
-    // Parse individual block JSON objects
-    std::vector<Block> loadedBlocks;
+    return true;
+}
 
-    size_t blockStart = 0;
-    int braceCount = 0;
+std::string Blockchain::toJSON() const {
+    ChainSnapshot snap = snapshot();
+    const ChainState& chain = *snap;
 
-    // Iterate through content character by character
-    for (size_t i = 0; i < blocksContent.length(); i++) {
-        char c = blocksContent[i];
+    size_t size = 2;
+    for (const auto& block : chain.blocks) {
+        size += block->estimateJSONSize() + 1;
+    }
+    std::string out;
+    out.reserve(size);
+    JsonWriter json(out);
 
-        if (c == '{') {
-            if (braceCount == 0) {
-                // Mark the start of a block
-                blockStart = i;
-            }
-            braceCount++;
+    json.raw('[');
+    for (size_t i = 0; i < chain.size(); i++) {
+        if (i > 0) {
+            json.raw(',');
         }
-        else if (c == '}') {
-            braceCount--;
+        chain[i].writeJSON(json);
+    }
+    json.raw(']');
+    return out;
+}
 
-            if (braceCount == 0) {
-                // We've found a complete block
-                std::string blockJson = blocksContent.substr(blockStart, i - blockStart + 1);
+void Blockchain::replaceChain(std::vector<Block> newChain) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    ChainSnapshot current = snapshot();
 
-                // Convert JSON to Block and add to loaded blocks
-                Block block = Block::fromJSON(blockJson);
-                loadedBlocks.push_back(block);
-            }
+    // Keep sharing the blocks both chains have in common
+    auto next = std::make_shared<ChainState>();
+    next->blocks.reserve(newChain.size());
+    for (size_t i = 0; i < newChain.size(); i++) {
+        if (i < current->size() && (*current)[i].hash == newChain[i].hash) {
+            next->blocks.push_back(current->blocks[i]);
+        } else {
+            next->blocks.push_back(std::make_shared<const Block>(std::move(newChain[i])));
         }
     }
+    publish(std::move(next));
+}
 
-    // Replace the current chain with loaded blocks
-    chain.clear();
-    chain = loadedBlocks;
+bool Blockchain::replaceFrom(const ChainState& base, size_t fork, std::vector<Block> blocks) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    ChainSnapshot current = snapshot();
+    if (fork > base.size() || fork > current->size() || (fork > 0 && current->blocks[fork - 1] != base.blocks[fork - 1])) {
+        return false; // The chain moved off base's prefix
+    }
 
+    auto next = std::make_shared<ChainState>();
+    next->blocks.reserve(fork + blocks.size());
+    next->blocks.assign(current->blocks.begin(), current->blocks.begin() + fork);
+    for (Block& block : blocks) {
+        next->blocks.push_back(std::make_shared<const Block>(std::move(block)));
+    }
+    publish(std::move(next));
     return true;
 }
 
-std::string Blockchain::toJSON() const {
-    std::string json = "[";
-    
-    for (size_t i = 0; i < chain.size(); i++) {
-        json += chain[i].toJSON();
-        if (i < chain.size() - 1) {
-            json += ",";
+void Blockchain::addExistingBlock(std::shared_ptr<const Block> block) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+
+    auto next = extend(1);
+    next->blocks.push_back(std::move(block));
+    publish(std::move(next));
+}
+
+void Blockchain::addExistingBlocks(std::vector<Block> blocks) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+
+    auto next = extend(blocks.size());
+    for (Block& block : blocks) {
+        next->blocks.push_back(std::make_shared<const Block>(std::move(block)));
+    }
+    publish(std::move(next));
+}
+
+std::shared_ptr<ChainState> Blockchain::extend(size_t count) const {
+    ChainSnapshot current = snapshot();
+    auto next = std::make_shared<ChainState>();
+    next->blocks.reserve(current->size() + count);
+    next->blocks = current->blocks;
+    return next;
+}
+
+std::vector<std::string> ChainState::getLocator() const {
+    std::vector<std::string> locator;
+    if (empty()) {
+        return locator;
+    }
+
+    // The last 10 blocks one by one, then double the step back to genesis
+    long step = 1;
+    long idx = static_cast<long>(size()) - 1;
+    while (idx > 0) {
+        locator.push_back((*this)[idx].hash);
+        if (locator.size() >= 10) {
+            step *= 2;
+        }
+        idx -= step;
+    }
+    locator.push_back((*this)[0].hash);
+
+    return locator;
+}
+
+int ChainState::findForkPoint(const std::vector<std::string>& locator) const {
+    std::unordered_set<std::string> known(locator.begin(), locator.end());
+
+    // Walk down from our tip; the first hit is the highest common block
+    for (long i = static_cast<long>(size()) - 1; i >= 0; i--) {
+        if (known.count((*this)[i].hash)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+std::vector<BlockHeader> ChainState::getHeaders(int fromIndex, size_t maxCount) const {
+    std::vector<BlockHeader> headers;
+    if (fromIndex < 0) {
+        fromIndex = 0;
+    }
+
+    for (size_t i = fromIndex; i < size() && headers.size() < maxCount; i++) {
+        headers.push_back((*this)[i].getHeader());
+    }
+    return headers;
+}
+
+int ChainState::findBlockIndex(const std::string& hash) const {
+    for (long i = static_cast<long>(size()) - 1; i >= 0; i--) {
+        if ((*this)[i].hash == hash) {
+            return static_cast<int>(i);
         }
     }
-    
-    json += "]";
-    return json;
+    return -1;
 }
 
-void Blockchain::replaceChain(const std::vector<Block>& newChain) {
-    chain.clear();
-    chain = newChain;
+std::vector<Block> ChainState::getBlocks(int fromIndex, size_t maxCount) const {
+    std::vector<Block> blocks;
+    if (fromIndex < 0) {
+        fromIndex = 0;
+    }
+
+    for (size_t i = fromIndex; i < size() && blocks.size() < maxCount; i++) {
+        blocks.push_back((*this)[i]);
+    }
+    return blocks;
 }
 
-void Blockchain::addExistingBlock(const Block& block) {
-    chain.push_back(block);
+bool Blockchain::isValidHeaderChain(const std::vector<BlockHeader>& headers, const std::string& anchorHash,
+                                    const std::vector<BlockHeader>& earlier) const {
+    std::string prevHash = anchorHash;
+    int prevIndex = headers.empty() ? 0 : headers[0].index - 1;
+
+    // Bits and timestamp of an ancestor: ours up to the fork point, then
+    // earlier, then the headers checked so far
+    ChainSnapshot chain = snapshot();
+    int earlierStart = earlier.empty() ? prevIndex + 1 : earlier.front().index;
+    int headersStart = prevIndex + 1;
+    auto ancestor = [&](int height, uint32_t& bits, std::time_t& timestamp) {
+        if (height >= headersStart) {
+            bits = headers[height - headersStart].bits;
+            timestamp = headers[height - headersStart].timestamp;
+        } else if (height >= earlierStart) {
+            bits = earlier[height - earlierStart].bits;
+            timestamp = earlier[height - earlierStart].timestamp;
+        } else if (height >= 0 && height < static_cast<int>(chain->size())) {
+            bits = (*chain)[height].bits;
+            timestamp = (*chain)[height].timestamp;
+        } else {
+            return false;
+        }
+        return true;
+    };
+
+    for (const BlockHeader& header : headers) {
+        if (header.index != prevIndex + 1 || header.previousHash != prevHash) {
+            return false;
+        }
+        if (header.hash != header.calculateHash()) {
+            return false;
+        }
+
+        uint32_t expected = initialBits;
+        if (header.index > 0) {
+            uint32_t parentBits;
+            std::time_t parentTime;
+            uint32_t windowBits;
+            std::time_t windowTime = 0;
+            int start = retargetWindowStart(header.index);
+            if (!ancestor(header.index - 1, parentBits, parentTime) ||
+                (start >= 0 && !ancestor(start, windowBits, windowTime))) {
+                return false;
+            }
+            expected = expectedBits(header.index, parentBits, parentTime, windowTime);
+        }
+        if (header.bits != expected || !hashMeetsBits(header.hash, header.bits)) {
+            return false;
+        }
+
+        if (header.index > 0) {
+            std::time_t medianTime = medianTimePast(header.index, [&ancestor](int h) {
+                uint32_t bits;
+                std::time_t timestamp = 0;
+                ancestor(h, bits, timestamp);
+                return timestamp;
+            });
+            if (!timestampInRange(header.timestamp, medianTime)) {
+                return false;
+            }
+        }
+
+        prevHash = header.hash;
+        prevIndex = header.index;
+    }
+    return true;
 }
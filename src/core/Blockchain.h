@@ -2,62 +2,287 @@
 #define BLOCKCHAIN_H
 
 #include "Block.h"
+#include "SignatureVerifier.h"
+#include "Target.h"
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+// Immutable view of the chain at one point in time. Blocks are shared
+// between successive states, so publishing a new tip copies pointers,
+// not blocks.
+struct ChainState {
+    std::vector<std::shared_ptr<const Block>> blocks;
+
+    size_t size() const { return blocks.size(); }
+    bool empty() const { return blocks.empty(); }
+    const Block& operator[](size_t index) const { return *blocks[index]; }
+    const Block& tip() const { return *blocks.back(); }
+
+    // Block hashes from the tip back to genesis, densely near the tip
+    // and exponentially sparser further back
+    std::vector<std::string> getLocator() const;
+
+    // Highest index whose hash appears in the locator (-1 if none)
+    int findForkPoint(const std::vector<std::string>& locator) const;
+
+    // Up to maxCount headers starting at fromIndex
+    std::vector<BlockHeader> getHeaders(int fromIndex, size_t maxCount) const;
+
+    // Index of the block with this hash, searching from the tip (-1 if none)
+    int findBlockIndex(const std::string& hash) const;
+
+    // Up to maxCount full blocks starting at fromIndex
+    std::vector<Block> getBlocks(int fromIndex, size_t maxCount) const;
+};
+
+using ChainSnapshot = std::shared_ptr<const ChainState>;
+
+// Concurrency: the current ChainState is published through an atomically
+// swapped pointer (RCU-style). Readers load a snapshot and never block;
+// writers serialize on writeMutex, build the next state and publish it
+// with one pointer swap. A snapshot stays valid for as long as it is held.
 class Blockchain {
     public:
-        // Constructor to initialize blockchain with given difficulty
+        // Constructor to initialize blockchain with given difficulty (in
+        // leading hex zeros; the genesis target, and the only one unless
+        // retargeting is turned on)
         Blockchain(int diff, double reward = 100.0, bool createGenesis = true);
 
-        // Add a new block to the chain
+        // Retarget every interval blocks so blocks come blockTime seconds
+        // apart (interval 0 keeps the genesis target). Set before the chain
+        // is loaded or extended; every node on a network must agree.
+        void setRetarget(int blockTime, int interval);
+
+        // Mine a new block of the valid transactions in tx (moved from)
         void addBlock(std::vector<Transaction> tx);
 
-        // Validate the integrity of the blockchain
-        bool isChainValid();
+        // Validate the integrity of the blockchain; a light client's
+        // header-only blocks pass with checkBodies false
+        bool isChainValid(bool checkBodies = true) const;
 
         // Print the blockchain
-        void printChain();
+        void printChain() const;
+
+        // Get block by index (nullptr if out of range)
+        std::shared_ptr<const Block> getBlock(int index) const;
 
-        // Get block by index
-        Block& getBlock(int index);
+        // Balance of address on the current chain, from an index kept as
+        // blocks connect and disconnect
+        double getBalance(std::string_view address) const;
 
-        // Balance tracking
-        double getBalance(std::string address);
+        // Check the sender's signature and that they have enough balance
+        bool validateTransaction(const Transaction& tx) const;
 
-        // Check if sender has enough balance
-        bool validateTransaction(Transaction tx);
+        // Is tx already on the chain? A replay carries the very signature
+        // the original did (Ed25519 signatures can't be altered and still
+        // verify), so signatures are what is matched, through an index like
+        // getBalance()'s.
+        bool isConfirmed(const Transaction& tx) const;
 
-        // Save to file
+        // Can block's transactions follow chain's tip? None may already be
+        // on chain or appear twice, every amount must be positive, and no
+        // sender may spend more in the block than they held before it
+        // (earlier transfers in the block come first). Indexes of those
+        // that can't go to invalid if given.
+        bool validateSpends(const ChainState& chain, const Block& block, std::vector<size_t>* invalid = nullptr) const;
+
+        // The same for a run of blocks, in order, on chain's tip. Both check
+        // validateReward() too.
+        bool validateSpends(const ChainState& chain, const std::vector<Block>& blocks) const;
+
+        // Does block mint only its reward? Past genesis, its one SYSTEM
+        // transaction comes first and pays exactly getMiningReward().
+        bool validateReward(const Block& block) const;
+
+        // Check one transaction's signature (txid is its hash); once it
+        // passes, blocks carrying it skip it
+        bool verifySignature(const Transaction& tx, const std::string& txid) const;
+
+        // Check every transaction signature in a block, or in blocks from
+        // index from on, spread over the verify threads (see
+        // SignatureVerifier.h); signatures that verified before, at mempool
+        // entry say, are skipped
+        bool verifySignatures(const Block& block) const;
+        bool verifySignatures(const std::vector<Block>& blocks, size_t from = 0) const;
+
+        // Save to file (atomically replacing it)
         bool saveToFile(const std::string& filename) const;
 
-        // Load from file
+        // Load from file; false if it starts from another genesis than ours
         bool loadFromFile(const std::string& filename);
 
         // Convert to JSON
         std::string toJSON() const;
 
-        // Getter
-        std::vector<Block>& getChain() { return chain; }
+        // Current chain state; never blocks
+        ChainSnapshot snapshot() const { return std::atomic_load(&state); }
 
-        // Check validity of a given chain
+        // Check validity of a given chain: our genesis, links, targets and
+        // timestamps, then rewards and spends (see validateSpends()) and
+        // signatures past the blocks it shares with ours
         bool isValidChain(const std::vector<Block>& newChain) const;
 
-        // Replace chain if new one is valid and longer
-        void replaceChain(const std::vector<Block>& newChain);
+        // isValidChain() for blocks that follow the first fork blocks of
+        // base, checking only them: the prefix is read in place, not copied.
+        // Genesis (fork 0) is never replaced.
+        bool isValidFork(const ChainState& base, size_t fork, const std::vector<Block>& blocks) const;
+
+        // Keep the first fork blocks of base, sharing them, and put blocks
+        // (moved in) after them; false, changing nothing, if the chain has
+        // since moved off that prefix
+        bool replaceFrom(const ChainState& base, size_t fork, std::vector<Block> blocks);
+
+        // Replace chain with one the caller found valid and of more work
+        // (blocks not already ours are moved in, so pass an rvalue when
+        // done with it)
+        void replaceChain(std::vector<Block> newChain);
 
         // Get difficulty
         int getDifficulty() const { return difficulty; }
 
-        // Add existing block
-        void addExistingBlock(const Block& block);
+        // Reward paid to whoever mines a block
+        double getMiningReward() const { return miningReward; }
+
+        // Target of the genesis block
+        uint32_t getInitialBits() const { return initialBits; }
+
+        // Height of the block that opens the retarget window ending at
+        // height - 1, or -1 if the block at height keeps its parent's target
+        int retargetWindowStart(int height) const;
+
+        // Target the block at height must carry, given its parent's target
+        // and timestamp and the timestamp of the block at
+        // retargetWindowStart(height) (ignored if that is -1)
+        uint32_t expectedBits(int height, uint32_t parentBits, std::time_t parentTime, std::time_t windowTime) const;
+
+        // Target the next block on chain must carry
+        uint32_t nextBits(const ChainState& chain) const;
+
+        // Work of blocks from to to - 1 of chain (anything indexable by
+        // height whose entries carry bits); forks are chosen by it
+        template <typename Chain>
+        static ChainWork chainWork(const Chain& chain, size_t from, size_t to);
+
+        // Earliest timestamp the next block on chain may carry: a second
+        // past the median timestamp of the last MEDIAN_TIME_SPAN blocks
+        std::time_t nextMinTimestamp(const ChainState& chain) const;
+
+        // May the next block on chain carry timestamp? At least
+        // nextMinTimestamp(), and at most MAX_FUTURE_BLOCK_TIME ahead of
+        // our clock.
+        bool timestampAllowed(const ChainState& chain, std::time_t timestamp) const;
+
+        // Threads addBlock() searches nonces on (default 1)
+        void setMinerThreads(unsigned threads) { minerThreads = threads; }
+        unsigned getMinerThreads() const { return minerThreads; }
+
+        // Add existing block, sharing it rather than copying
+        void addExistingBlock(std::shared_ptr<const Block> block);
+
+        // Append a run of blocks (moved in), publishing once
+        void addExistingBlocks(std::vector<Block> blocks);
 
         // Get length of chain
-        size_t getChainLength() const { return chain.size(); } 
+        size_t getChainLength() const { return snapshot()->size(); }
+
+        // Check linkage, hashes, targets and proof-of-work of a run of
+        // headers that should follow the block whose hash is anchorHash.
+        // Targets are checked against the ancestors the rules look back at:
+        // our blocks up to the fork point, then earlier (headers already
+        // accepted after it, ending at the anchor).
+        bool isValidHeaderChain(const std::vector<BlockHeader>& headers, const std::string& anchorHash,
+                                const std::vector<BlockHeader>& earlier = {}) const;
+
+        // Names of the demo accounts genesis funds; their keys come from
+        // keyPairFromSeed(name), so anyone can spend from them
+        static const std::vector<std::string>& demoAccounts();
+
+        // Fixed genesis timestamp so every node starts from the same block
+        static constexpr std::time_t GENESIS_TIMESTAMP = 1700000000;
+
+        // Blocks whose median timestamp a new block's must exceed
+        static constexpr int MEDIAN_TIME_SPAN = 11;
+
+        // How far past our clock a block's timestamp may be
+        static constexpr std::time_t MAX_FUTURE_BLOCK_TIME = 2 * 60 * 60;
+
+        // saveToFile() writes whenever this much JSON has built up
+        static constexpr size_t SAVE_CHUNK_SIZE = 64 * 1024;
 
     private:
-        std::vector<Block> chain; // The blockchain itself
-        int difficulty; // Mining difficulty
+        // Make next the current state (caller holds writeMutex)
+        void publish(std::shared_ptr<ChainState> next);
+
+        // Bring the indexes from one state to the next: undo the blocks
+        // only from holds, then apply those only to holds
+        void reindex(const ChainState& from, const ChainState& to);
+
+        // validateSpends() for count blocks following the first prefix
+        // blocks of chain
+        bool checkSpends(const ChainState& chain, size_t prefix, const Block* blocks, size_t count,
+                         std::vector<size_t>* invalid) const;
+
+        // Can the sender afford tx? (signature not checked)
+        bool hasBalance(const Transaction& tx) const;
+
+        // Copy of the current state with room for count more blocks
+        std::shared_ptr<ChainState> extend(size_t count) const;
+
+        // Links, targets, timestamps, hashes and Merkle roots of blocks from
+        // to to - 1 of chain (anything indexable by height)
+        template <typename Chain>
+        bool linksValid(const Chain& chain, size_t from, size_t to) const;
+
+        // Does block height of chain (anything indexable by height) carry
+        // the expected target and a hash below it?
+        template <typename Chain>
+        bool meetsTarget(const Chain& chain, int height) const;
+
+        // Median timestamp of the (up to) MEDIAN_TIME_SPAN blocks below
+        // height, where timeAt(h) is block h's
+        template <typename TimeAt>
+        static std::time_t medianTimePast(int height, TimeAt timeAt);
+
+        // Is timestamp past medianTime and not too far ahead of our clock?
+        static bool timestampInRange(std::time_t timestamp, std::time_t medianTime);
+
+        ChainSnapshot state; // Current chain; accessed only via atomic_load/atomic_store
+        std::mutex writeMutex; // Serializes writers
+        int difficulty; // Genesis difficulty in leading hex zeros
+        uint32_t initialBits; // Genesis target
+        int blockTime = 0; // Seconds between blocks retargeting aims for
+        int retargetInterval = 0; // Blocks between retargets (0 = never)
+        std::atomic<unsigned> minerThreads { 1 };
+        mutable SignatureVerifier signatures; // Remembers what verified
         double miningReward; // Reward for mining a block
+        mutable std::mutex indexMutex; // Guards balances and confirmed
+        std::unordered_map<std::string, int64_t> balances; // By address, in millionths; zero ones dropped
+        // Confirmed transfers by signature; keys and values point into the
+        // current state's blocks
+        std::unordered_map<std::string_view, const Transaction*> confirmed;
 };
 
+template <typename Chain>
+ChainWork Blockchain::chainWork(const Chain& chain, size_t from, size_t to) {
+    ChainWork total {};
+    ChainWork work {};
+    uint32_t bits = 0;
+    for (size_t i = from; i < to; i++) {
+        // Targets change only at retargets
+        if (i == from || chain[i].bits != bits) {
+            bits = chain[i].bits;
+            work = blockWork(bits);
+        }
+        addWork(total, work);
+    }
+    return total;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+// The low-level SHA-256 calls skip the algorithm lookup that every
+// SHA256() or EVP_Digest() call does in OpenSSL 3, which costs more than
+// hashing a transaction. They are deprecated there, so ask for the 1.1.1
+// API, where they aren't.
+#define OPENSSL_API_COMPAT 10101
+
+#include "Hash.h"
+#include "ThreadPool.h"
+#include <openssl/sha.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+std::string sha256Hex(std::string_view data) {
+    std::string hex;
+    sha256Hex(data, hex);
+    return hex;
+}
+
+void sha256Hex(std::string_view data, std::string& out) {
+    static const char digits[] = "0123456789abcdef";
+
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_CTX context;
+    SHA256_Init(&context);
+    SHA256_Update(&context, data.data(), data.size());
+    SHA256_Final(hash, &context);
+
+    // Through a plain pointer: string::operator[] is a call per digit in
+    // an unoptimized build
+    out.resize(SHA256_DIGEST_LENGTH * 2);
+    char* hex = &out[0];
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        hex[2 * i] = digits[hash[i] >> 4];
+        hex[2 * i + 1] = digits[hash[i] & 0x0f];
+    }
+}
+
+void sha256HexEach(size_t count, const std::function<void(size_t index, std::string& input)>& write,
+                   std::vector<std::string>& out, ThreadPool* helpers) {
+    out.resize(count);
+    auto hashRange = [&](size_t begin, size_t end) {
+        std::string input; // Reused for every input in the range
+        for (size_t i = begin; i < end; i++) {
+            input.clear();
+            write(i, input);
+            sha256Hex(input, out[i]);
+        }
+    };
+
+    size_t batches = helpers ? std::min(helpers->size() + 1, count / PARALLEL_HASH_MIN) : 1;
+    if (batches <= 1) {
+        hashRange(0, count);
+        return;
+    }
+
+    // Batch b is [count * b / batches, count * (b + 1) / batches); we take
+    // the first ourselves
+    std::mutex doneMutex;
+    std::condition_variable done;
+    size_t remaining = batches - 1;
+    for (size_t b = 1; b < batches; b++) {
+        helpers->submit([&, b]() {
+            hashRange(count * b / batches, count * (b + 1) / batches);
+            // Notify under the lock: we may return (and destroy done) as
+            // soon as remaining hits zero
+            std::lock_guard<std::mutex> lock(doneMutex);
+            remaining--;
+            done.notify_one();
+        });
+    }
+    hashRange(0, count / batches);
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [&]() { return remaining == 0; });
+}
+
+void appendBigEndian(std::string& out, uint64_t value, size_t bytes) {
+    for (size_t i = bytes; i-- > 0;) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void appendField(std::string& out, std::string_view field) {
+    appendBigEndian(out, field.size(), 4);
+    out.append(field);
+}
+
+std::string merkleRoot(std::vector<std::string> leaves) {
+    if (leaves.empty()) {
+        return std::string(64, '0');
+    }
+
+    // Node i of the next level only depends on nodes 2i and 2i+1 of this
+    // one, so it can overwrite node i of this one
+    std::string pair;
+    size_t count = leaves.size();
+    while (count > 1) {
+        for (size_t i = 0; i < count; i += 2) {
+            pair.assign(leaves[i]);
+            pair.append(i + 1 < count ? leaves[i + 1] : leaves[i]);
+            sha256Hex(pair, leaves[i / 2]);
+        }
+        count = (count + 1) / 2;
+    }
+
+    return std::move(leaves[0]);
+}
+
+std::vector<std::string> merkleBranch(std::vector<std::string> leaves, size_t index) {
+    std::vector<std::string> branch;
+    if (index >= leaves.size()) {
+        return branch;
+    }
+
+    // Record each level's sibling, then hash the level in place as
+    // merkleRoot() does
+    std::string pair;
+    size_t count = leaves.size();
+    while (count > 1) {
+        size_t sibling = index ^ 1;
+        branch.push_back(sibling < count ? leaves[sibling] : leaves[index]);
+        for (size_t i = 0; i < count; i += 2) {
+            pair.assign(leaves[i]);
+            pair.append(i + 1 < count ? leaves[i + 1] : leaves[i]);
+            sha256Hex(pair, leaves[i / 2]);
+        }
+        count = (count + 1) / 2;
+        index /= 2;
+    }
+    return branch;
+}
+
+std::string merkleRootFromBranch(std::string leaf, size_t index, const std::vector<std::string>& branch) {
+    std::string pair;
+    for (const std::string& sibling : branch) {
+        // Even indexes are left children
+        pair.assign(index % 2 == 0 ? leaf : sibling);
+        pair.append(index % 2 == 0 ? sibling : leaf);
+        sha256Hex(pair, leaf);
+        index /= 2;
+    }
+    return leaf;
+}
@@ -0,0 +1,47 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ThreadPool;
+
+// Inputs per thread below which sha256HexEach() hashes on the caller alone
+constexpr size_t PARALLEL_HASH_MIN = 2048;
+
+// SHA-256 of arbitrary bytes, as 64 lowercase hex characters
+std::string sha256Hex(std::string_view data);
+
+// The same, written over out (no allocation once out has the capacity)
+void sha256Hex(std::string_view data, std::string& out);
+
+// SHA-256 of count inputs into out[0..count), input i being whatever
+// write(i, buffer) appends to an empty buffer. Given helpers, batches of at
+// least 2 * PARALLEL_HASH_MIN are split between the caller and the pool's
+// workers, so write must be safe to call concurrently, and the caller must
+// not be one of those workers.
+void sha256HexEach(size_t count, const std::function<void(size_t index, std::string& input)>& write,
+                   std::vector<std::string>& out, ThreadPool* helpers = nullptr);
+
+// Preimages are built from these, so fields can't run into each other:
+// integers in a fixed number of big-endian bytes, variable-length fields
+// behind a 4-byte big-endian length
+void appendBigEndian(std::string& out, uint64_t value, size_t bytes);
+void appendField(std::string& out, std::string_view field);
+
+// Merkle root over hex leaf hashes (last leaf is paired with itself on odd
+// levels). Each level is hashed in place over the leaves it was given.
+std::string merkleRoot(std::vector<std::string> leaves);
+
+// Sibling hashes on the path from leaf index up to the root (empty for a
+// single leaf), so one leaf can be checked against the root alone
+std::vector<std::string> merkleBranch(std::vector<std::string> leaves, size_t index);
+
+// Root implied by leaf sitting at index with this branch
+std::string merkleRootFromBranch(std::string leaf, size_t index, const std::vector<std::string>& branch);
+
+#endif
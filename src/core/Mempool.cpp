@@ -0,0 +1,142 @@
+#include "Mempool.h"
+#include <algorithm>
+#include <limits>
+
+Mempool::Mempool(size_t maxSize) : maxSize(maxSize), nextSequence(0) {
+}
+
+bool Mempool::add(Transaction tx) {
+    std::string txid = tx.calculateHash();
+    return add(std::move(tx), txid);
+}
+
+bool Mempool::add(Transaction tx, const std::string& txid) {
+    return add(std::move(tx), txid, std::numeric_limits<double>::infinity());
+}
+
+bool Mempool::add(Transaction tx, const std::string& txid, double balance) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.size() >= maxSize || entries.count(txid)) {
+        return false;
+    }
+    if (tx.sender != "SYSTEM") {
+        auto it = spends.find(tx.sender);
+        double spent = it == spends.end() ? 0.0 : it->second.amount;
+        if (spent + tx.amount > balance) {
+            return false;
+        }
+        Spends& sender = spends[tx.sender];
+        sender.count++;
+        sender.amount += tx.amount;
+    }
+
+    uint64_t sequence = nextSequence++;
+    auto added = entries.emplace(txid, Entry { std::move(tx), sequence }).first;
+    arrivalOrder.emplace(sequence, txid);
+    if (onAdded) {
+        onAdded(added->second.tx, txid);
+    }
+    return true;
+}
+
+double Mempool::pendingSpend(const std::string& sender) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = spends.find(sender);
+    return it == spends.end() ? 0.0 : it->second.amount;
+}
+
+bool Mempool::contains(const std::string& txid) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.count(txid) > 0;
+}
+
+bool Mempool::get(const std::string& txid, Transaction& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(txid);
+    if (it == entries.end()) {
+        return false;
+    }
+    out = it->second.tx;
+    return true;
+}
+
+std::vector<Transaction> Mempool::getTransactions(size_t maxCount) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<Transaction> txs;
+    txs.reserve(std::min(maxCount, entries.size()));
+    for (const auto& entry : arrivalOrder) {
+        if (txs.size() >= maxCount) {
+            break;
+        }
+        txs.push_back(entries.at(entry.second).tx);
+    }
+    return txs;
+}
+
+std::vector<std::string> Mempool::getTxids(size_t maxCount) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<std::string> txids;
+    txids.reserve(std::min(maxCount, entries.size()));
+    for (const auto& entry : arrivalOrder) {
+        if (txids.size() >= maxCount) {
+            break;
+        }
+        txids.push_back(entry.second);
+    }
+    return txids;
+}
+
+void Mempool::remove(const std::vector<Transaction>& txs) {
+    removeTxids(Transaction::calculateHashes(txs));
+}
+
+void Mempool::removeTxids(const std::vector<std::string>& txids) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const std::string& txid : txids) {
+        removeTxid(txid);
+    }
+}
+
+void Mempool::removeForBlock(const Block& block) {
+    remove(block.transactions);
+}
+
+void Mempool::setListeners(AddedHandler added, RemovedHandler removed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    onAdded = std::move(added);
+    onRemoved = std::move(removed);
+    if (onAdded) {
+        for (const auto& entry : arrivalOrder) {
+            onAdded(entries.at(entry.second).tx, entry.second);
+        }
+    }
+}
+
+size_t Mempool::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+void Mempool::removeTxid(const std::string& txid) {
+    auto it = entries.find(txid);
+    if (it == entries.end()) {
+        return;
+    }
+    const Transaction& tx = it->second.tx;
+    auto sender = spends.find(tx.sender);
+    if (sender != spends.end()) {
+        // Dropped with its last transaction, so rounding never builds up
+        if (--sender->second.count == 0) {
+            spends.erase(sender);
+        } else {
+            sender->second.amount -= tx.amount;
+        }
+    }
+    arrivalOrder.erase(it->second.sequence);
+    entries.erase(it);
+    if (onRemoved) {
+        onRemoved(txid);
+    }
+}
@@ -0,0 +1,101 @@
+// Transactions waiting to be mined, in arrival order.
+//
+// Each sender's waiting amounts are summed, so a transfer can be refused
+// when it and the ones already waiting would spend more than the sender
+// has (add() with a balance).
+//
+// Thread-safe: the network workers add to it while the miner reads it.
+// Listeners (see setListeners) hear of every change as it happens, under
+// the mempool's lock, so they must be quick and must not call back in.
+
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include "Block.h"
+#include "Transaction.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Mempool {
+    public:
+        // Told of each transaction added, with its txid
+        using AddedHandler = std::function<void(const Transaction& tx, const std::string& txid)>;
+
+        // Told of each txid removed
+        using RemovedHandler = std::function<void(const std::string& txid)>;
+
+        // Constructor
+        explicit Mempool(size_t maxSize = 50000);
+
+        // Add a transaction; false if already present or the pool is full
+        bool add(Transaction tx);
+
+        // The same, for a caller that already has the txid
+        bool add(Transaction tx, const std::string& txid);
+
+        // The same, also refusing it if the sender's waiting transactions
+        // and it would spend more than balance
+        bool add(Transaction tx, const std::string& txid, double balance);
+
+        // What a sender's waiting transactions spend in total
+        double pendingSpend(const std::string& sender) const;
+
+        // Is this txid waiting?
+        bool contains(const std::string& txid) const;
+
+        // Copy out a transaction by txid; false if unknown
+        bool get(const std::string& txid, Transaction& out) const;
+
+        // Oldest transactions first, at most maxCount
+        std::vector<Transaction> getTransactions(size_t maxCount = SIZE_MAX) const;
+
+        // Txids of the oldest transactions, at most maxCount
+        std::vector<std::string> getTxids(size_t maxCount = SIZE_MAX) const;
+
+        // Drop these transactions (mined, or found invalid)
+        void remove(const std::vector<Transaction>& txs);
+
+        // Drop these txids
+        void removeTxids(const std::vector<std::string>& txids);
+
+        // Drop everything a connected block included
+        void removeForBlock(const Block& block);
+
+        // Report every change from now on (empty handlers stop it), after
+        // first reporting what is already waiting as added, oldest first
+        void setListeners(AddedHandler added, RemovedHandler removed);
+
+        // Number of waiting transactions
+        size_t size() const;
+
+    private:
+        struct Entry {
+            Transaction tx;
+            uint64_t sequence;
+        };
+
+        // One sender's waiting transactions
+        struct Spends {
+            size_t count;
+            double amount;
+        };
+
+        // Drop one txid (mutex held)
+        void removeTxid(const std::string& txid);
+
+        size_t maxSize;
+        uint64_t nextSequence;
+        std::unordered_map<std::string, Entry> entries; // By txid
+        std::map<uint64_t, std::string> arrivalOrder; // Sequence -> txid
+        std::unordered_map<std::string, Spends> spends; // By sender, SYSTEM aside
+        AddedHandler onAdded;
+        RemovedHandler onRemoved;
+        mutable std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "MerkleTree.h"
+#include "Hash.h"
+
+MerkleTree::MerkleTree() : levels(1) {
+}
+
+std::string MerkleTree::root() const {
+    if (levels[0].empty()) {
+        return std::string(64, '0');
+    }
+    return levels.back()[0];
+}
+
+void MerkleTree::push(std::string leaf) {
+    levels[0].push_back(std::move(leaf));
+    rehash(levels[0].size() - 1);
+}
+
+void MerkleTree::set(size_t index, std::string leaf) {
+    levels[0][index] = std::move(leaf);
+    rehash(index);
+}
+
+void MerkleTree::pop() {
+    levels[0].pop_back();
+    if (levels[0].empty()) {
+        levels.resize(1);
+        return;
+    }
+    // The old last leaf's ancestors either go (their level shrank) or are
+    // also ancestors of the new last leaf
+    rehash(levels[0].size() - 1);
+}
+
+void MerkleTree::clear() {
+    levels.assign(1, {});
+}
+
+void MerkleTree::rehash(size_t index) {
+    size_t level = 0;
+    while (levels[level].size() > 1) {
+        const std::vector<std::string>& nodes = levels[level];
+        size_t count = nodes.size();
+        size_t left = index & ~static_cast<size_t>(1);
+        pair.assign(nodes[left]);
+        pair.append(left + 1 < count ? nodes[left + 1] : nodes[left]);
+
+        if (level + 1 == levels.size()) {
+            levels.emplace_back();
+        }
+        std::vector<std::string>& parents = levels[level + 1];
+        parents.resize((count + 1) / 2);
+        sha256Hex(pair, parents[index / 2]);
+
+        index /= 2;
+        level++;
+    }
+    // The level reached has one node, the root; anything above is stale
+    levels.resize(level + 1);
+}
@@ -0,0 +1,53 @@
+// A Merkle tree kept current one leaf at a time.
+//
+// Every level is stored, so changing, appending or dropping the last leaf
+// rehashes only the nodes on that leaf's path to the root: O(log n) hashes
+// per change instead of merkleRoot()'s O(n). Odd levels pair their last node
+// with itself, as merkleRoot() does, and root() always equals
+// merkleRoot() over the current leaves.
+//
+// Not thread-safe; the owner locks.
+
+#ifndef MERKLETREE_H
+#define MERKLETREE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class MerkleTree {
+    public:
+        // Constructor (no leaves)
+        MerkleTree();
+
+        // Number of leaves
+        size_t size() const { return levels[0].size(); }
+
+        // Leaf hash at index
+        const std::string& leaf(size_t index) const { return levels[0][index]; }
+
+        // Root over the current leaves (64 zeros if there are none)
+        std::string root() const;
+
+        // Append a leaf
+        void push(std::string leaf);
+
+        // Replace the leaf at index
+        void set(size_t index, std::string leaf);
+
+        // Drop the last leaf
+        void pop();
+
+        // Drop every leaf
+        void clear();
+
+    private:
+        // Recompute the ancestors of leaf index, resizing each level to fit
+        // the leaf count
+        void rehash(size_t index);
+
+        std::vector<std::vector<std::string>> levels; // Leaves first, root level last
+        std::string pair; // Reused hash input
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "Signature.h"
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <array>
+#include <memory>
+
+namespace {
+
+using Key = std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+using DigestContext = std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)>;
+using RawKey = std::array<unsigned char, KEY_HEX_LENGTH / 2>;
+
+// Value of a lowercase hex digit, or -1
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Decode exactly size bytes of lowercase hex into out
+bool fromHex(std::string_view hex, unsigned char* out, size_t size) {
+    if (hex.size() != 2 * size) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        int high = hexValue(hex[2 * i]);
+        int low = hexValue(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    return true;
+}
+
+std::string toHex(const unsigned char* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * size, '0');
+    for (size_t i = 0; i < size; i++) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0x0f];
+    }
+    return hex;
+}
+
+Key privateKeyFromRaw(const RawKey& raw) {
+    return Key(EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, raw.data(), raw.size()), EVP_PKEY_free);
+}
+
+// Both halves of key as hex; false if OpenSSL won't give them up
+bool exportKeyPair(EVP_PKEY* key, KeyPair& keys) {
+    RawKey privateRaw;
+    RawKey publicRaw;
+    size_t privateSize = privateRaw.size();
+    size_t publicSize = publicRaw.size();
+    if (EVP_PKEY_get_raw_private_key(key, privateRaw.data(), &privateSize) != 1 ||
+        EVP_PKEY_get_raw_public_key(key, publicRaw.data(), &publicSize) != 1 ||
+        privateSize != privateRaw.size() || publicSize != publicRaw.size()) {
+        return false;
+    }
+    keys.privateKey = toHex(privateRaw.data(), privateRaw.size());
+    keys.address = toHex(publicRaw.data(), publicRaw.size());
+    return true;
+}
+
+} // namespace
+
+KeyPair generateKeyPair() {
+    KeyPair keys;
+    EVP_PKEY* raw = nullptr;
+    EVP_PKEY_CTX* context = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+    if (context != nullptr && EVP_PKEY_keygen_init(context) == 1 && EVP_PKEY_keygen(context, &raw) == 1) {
+        Key key(raw, EVP_PKEY_free);
+        if (!exportKeyPair(key.get(), keys)) {
+            keys = KeyPair();
+        }
+    }
+    EVP_PKEY_CTX_free(context);
+    return keys;
+}
+
+KeyPair keyPairFromSeed(std::string_view seed) {
+    RawKey raw;
+    SHA256(reinterpret_cast<const unsigned char*>(seed.data()), seed.size(), raw.data());
+    KeyPair keys;
+    Key key = privateKeyFromRaw(raw);
+    if (!key || !exportKeyPair(key.get(), keys)) {
+        return KeyPair();
+    }
+    return keys;
+}
+
+bool keyPairFromPrivateKey(std::string_view privateKey, KeyPair& keys) {
+    RawKey raw;
+    if (!fromHex(privateKey, raw.data(), raw.size())) {
+        return false;
+    }
+    Key key = privateKeyFromRaw(raw);
+    return key && exportKeyPair(key.get(), keys);
+}
+
+bool isAddress(std::string_view address) {
+    RawKey raw;
+    return fromHex(address, raw.data(), raw.size());
+}
+
+std::string signMessage(std::string_view privateKey, std::string_view message) {
+    RawKey raw;
+    if (!fromHex(privateKey, raw.data(), raw.size())) {
+        return "";
+    }
+    Key key = privateKeyFromRaw(raw);
+    DigestContext context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    if (!key || !context) {
+        return "";
+    }
+
+    // Ed25519 hashes the message itself, so there is no digest to pick
+    std::array<unsigned char, SIGNATURE_HEX_LENGTH / 2> signature;
+    size_t size = signature.size();
+    if (EVP_DigestSignInit(context.get(), nullptr, nullptr, nullptr, key.get()) != 1 ||
+        EVP_DigestSign(context.get(), signature.data(), &size, reinterpret_cast<const unsigned char*>(message.data()),
+                       message.size()) != 1 ||
+        size != signature.size()) {
+        return "";
+    }
+    return toHex(signature.data(), signature.size());
+}
+
+bool verifySignature(std::string_view address, std::string_view message, std::string_view signature) {
+    RawKey publicRaw;
+    std::array<unsigned char, SIGNATURE_HEX_LENGTH / 2> signatureRaw;
+    if (!fromHex(address, publicRaw.data(), publicRaw.size()) ||
+        !fromHex(signature, signatureRaw.data(), signatureRaw.size())) {
+        return false;
+    }
+
+    Key key(EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, publicRaw.data(), publicRaw.size()), EVP_PKEY_free);
+    DigestContext context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    if (!key || !context) {
+        return false;
+    }
+    return EVP_DigestVerifyInit(context.get(), nullptr, nullptr, nullptr, key.get()) == 1 &&
+        EVP_DigestVerify(context.get(), signatureRaw.data(), signatureRaw.size(),
+                         reinterpret_cast<const unsigned char*>(message.data()), message.size()) == 1;
+}
@@ -0,0 +1,49 @@
+// Ed25519 keys and signatures (OpenSSL).
+//
+// An address is the sender's 32-byte public key as 64 lowercase hex
+// characters, so a signature can be checked against the address alone.
+// Private keys are 32 bytes, also passed around as hex, and signatures are
+// 64 bytes (128 hex characters). Ed25519 signatures are deterministic: the
+// same key and message always give the same signature.
+//
+// keyPairFromSeed() derives a key from a name (the private key is the
+// SHA-256 of it). Anyone who knows the name can spend from the address, so
+// it is only for the demo accounts, benchmarks and tests.
+
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+#include <string>
+#include <string_view>
+
+struct KeyPair {
+    std::string privateKey; // 64 hex characters; keep it secret
+    std::string address; // Public key, 64 hex characters
+};
+
+// Length of an address or private key in hex
+constexpr size_t KEY_HEX_LENGTH = 64;
+
+// Length of a signature in hex
+constexpr size_t SIGNATURE_HEX_LENGTH = 128;
+
+// A fresh random key pair (both fields empty if OpenSSL fails)
+KeyPair generateKeyPair();
+
+// The key pair derived from a name
+KeyPair keyPairFromSeed(std::string_view seed);
+
+// Key pair for a hex private key; false if it is malformed
+bool keyPairFromPrivateKey(std::string_view privateKey, KeyPair& keys);
+
+// Is this 64 lowercase hex characters?
+bool isAddress(std::string_view address);
+
+// Signature of message by a hex private key ("" if the key is malformed)
+std::string signMessage(std::string_view privateKey, std::string_view message);
+
+// Does signature verify for message under address? False if either is
+// malformed.
+bool verifySignature(std::string_view address, std::string_view message, std::string_view signature);
+
+#endif
@@ -0,0 +1,158 @@
+#include "SignatureVerifier.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+namespace {
+
+// Queued batches allowed per helper thread
+const size_t QUEUE_CAPACITY = 64;
+
+size_t resolveThreads(size_t threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return std::max<size_t>(threads, 1);
+}
+
+// The pool every verifier shares
+struct SharedPool {
+    std::mutex mutex; // Guards threads and pool
+    size_t threads = resolveThreads(0);
+    std::shared_ptr<ThreadPool> pool; // Also held by running batches
+};
+
+SharedPool& sharedPool() {
+    static SharedPool shared;
+    return shared;
+}
+
+Counter& verificationsCounter() {
+    static Counter& counter = Metrics::instance().counter("signature_verifications_total", "Transaction signatures verified");
+    return counter;
+}
+
+Counter& cacheHitsCounter() {
+    static Counter& counter = Metrics::instance().counter("signature_cache_hits_total", "Signature checks skipped because the txid had verified before");
+    return counter;
+}
+
+} // namespace
+
+SignatureVerifier::SignatureVerifier(size_t cacheCapacity) : cache(cacheCapacity) {
+}
+
+void SignatureVerifier::setThreads(size_t threads) {
+    SharedPool& shared = sharedPool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.threads = resolveThreads(threads);
+    shared.pool.reset();
+}
+
+size_t SignatureVerifier::getThreads() {
+    SharedPool& shared = sharedPool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    return shared.threads;
+}
+
+std::shared_ptr<ThreadPool> SignatureVerifier::helpers() {
+    SharedPool& shared = sharedPool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (!shared.pool && shared.threads > 1) {
+        shared.pool = std::make_shared<ThreadPool>(shared.threads - 1, QUEUE_CAPACITY);
+    }
+    return shared.pool;
+}
+
+bool SignatureVerifier::cached(const std::string& txid) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (!cache.contains(txid)) {
+        return false;
+    }
+    cacheHitsCounter().inc();
+    return true;
+}
+
+bool SignatureVerifier::check(const Transaction& tx, const std::string& txid) {
+    verificationsCounter().inc();
+    if (!tx.verifySignature()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.insert(txid);
+    return true;
+}
+
+bool SignatureVerifier::verify(const Transaction& tx, const std::string& txid) {
+    if (tx.sender == "SYSTEM") {
+        return tx.verifySignature(); // Nothing to verify, so nothing to cache
+    }
+    return cached(txid) || check(tx, txid);
+}
+
+bool SignatureVerifier::verify(const Transaction& tx) {
+    return verify(tx, tx.calculateHash());
+}
+
+bool SignatureVerifier::verifyAll(const std::vector<const Transaction*>& txs) {
+    TRACE_SPAN_ARG("SignatureVerifier::verifyAll", "transactions", txs.size());
+    std::vector<std::string> txids = Transaction::calculateHashes(txs);
+    std::vector<Pending> pending;
+    pending.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (txs[i]->sender == "SYSTEM") {
+            if (!txs[i]->verifySignature()) {
+                return false;
+            }
+            continue;
+        }
+        if (!cached(txids[i])) {
+            pending.push_back({ txs[i], std::move(txids[i]) });
+        }
+    }
+
+    std::shared_ptr<ThreadPool> workers = pending.size() >= 2 * MIN_BATCH ? helpers() : nullptr;
+    size_t batches = workers ? std::min(workers->size() + 1, pending.size() / MIN_BATCH) : 1;
+    if (batches <= 1) {
+        return std::all_of(pending.begin(), pending.end(), [this](const Pending& p) { return check(*p.tx, p.txid); });
+    }
+
+    // Batch b is pending[size * b / batches, size * (b + 1) / batches); the
+    // first to fail stops the rest early
+    std::atomic<bool> failed { false };
+    auto runBatch = [&](size_t b) {
+        size_t end = pending.size() * (b + 1) / batches;
+        for (size_t i = pending.size() * b / batches; i < end && !failed.load(std::memory_order_relaxed); i++) {
+            if (!check(*pending[i].tx, pending[i].txid)) {
+                failed = true;
+            }
+        }
+    };
+
+    std::mutex doneMutex;
+    std::condition_variable done;
+    size_t remaining = batches - 1;
+    for (size_t b = 1; b < batches; b++) {
+        workers->submit([&, b]() {
+            runBatch(b);
+            // Notify under the lock: we may return (and destroy done) as
+            // soon as remaining hits zero
+            std::lock_guard<std::mutex> lock(doneMutex);
+            remaining--;
+            done.notify_one();
+        });
+    }
+    runBatch(0);
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [&]() { return remaining == 0; });
+    return !failed;
+}
+
+void SignatureVerifier::clearCache() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.clear();
+}
@@ -0,0 +1,85 @@
+// Checks transaction signatures in parallel and remembers the ones that
+// passed.
+//
+// An Ed25519 verify costs far more than anything else done with a
+// transaction, and most transactions would be verified twice: on mempool
+// entry and again when the block carrying them connects. Txids that
+// verified go into a bounded cache (a SeenFilter), and later checks skip
+// them. A txid covers the signature, so a hit means this exact signature
+// passed before.
+//
+// verifyAll() splits whatever isn't cached into batches of at least
+// MIN_BATCH and runs them on a pool of verify threads, the calling thread
+// taking the first batch itself. Each chain has its own verifier (and
+// cache); the pool is shared by all of them, and by
+// Transaction::calculateHashes(), and started on first use.
+//
+// Thread-safe.
+
+#ifndef SIGNATUREVERIFIER_H
+#define SIGNATUREVERIFIER_H
+
+#include "SeenFilter.h"
+#include "ThreadPool.h"
+#include "Transaction.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SignatureVerifier {
+    public:
+        // Txids remembered per cache generation; covers a full mempool
+        static constexpr size_t DEFAULT_CACHE_CAPACITY = 50000;
+
+        // Fewest uncached signatures worth handing to another thread
+        static constexpr size_t MIN_BATCH = 8;
+
+        // Constructor
+        explicit SignatureVerifier(size_t cacheCapacity = DEFAULT_CACHE_CAPACITY);
+
+        SignatureVerifier(const SignatureVerifier&) = delete;
+        SignatureVerifier& operator=(const SignatureVerifier&) = delete;
+
+        // Threads every verifier splits batches over, counting the caller
+        // (0 = one per core); batches already running finish on the old
+        // pool
+        static void setThreads(size_t threads);
+        static size_t getThreads();
+
+        // The shared pool of getThreads() - 1 helpers, started if need be
+        // (nullptr for one thread); large batches of txids are hashed on
+        // it too
+        static std::shared_ptr<ThreadPool> helpers();
+
+        // Check one transaction whose txid is already known
+        bool verify(const Transaction& tx, const std::string& txid);
+
+        // Check one transaction
+        bool verify(const Transaction& tx);
+
+        // Check every transaction, in parallel; true only if all verify
+        bool verifyAll(const std::vector<const Transaction*>& txs);
+
+        // Forget every cached txid
+        void clearCache();
+
+    private:
+        // A transaction to verify, with its txid for the cache
+        struct Pending {
+            const Transaction* tx;
+            std::string txid;
+        };
+
+        // Is txid cached? Counts the hit.
+        bool cached(const std::string& txid);
+
+        // Verify one and cache it if it passes
+        bool check(const Transaction& tx, const std::string& txid);
+
+        std::mutex cacheMutex; // Guards cache
+        SeenFilter cache;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "Target.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Value of a lowercase hex digit, or -1
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Is target above 2^256?
+bool aboveMax(const TargetBytes& target) {
+    if (target[0] == 0) {
+        return false;
+    }
+    return target[0] > 1 || std::any_of(target.begin() + 1, target.end(), [](unsigned char b) { return b != 0; });
+}
+
+// Longest window retargetBits() accepts; keeps its arithmetic in 64 bits
+const int64_t MAX_EXPECTED_SECONDS = int64_t(1) << 40;
+
+} // namespace
+
+bool expandBits(uint32_t bits, TargetBytes& target) {
+    target.fill(0);
+    int exponent = static_cast<int>(bits >> 24);
+    uint32_t mantissa = bits & 0x007fffff;
+    if ((bits & 0x00800000) || mantissa == 0) {
+        return false;
+    }
+
+    // Mantissa byte k (most significant first) lands exponent - 1 - k bytes
+    // from the right; bytes that would fall below the units are dropped
+    for (int k = 0; k < 3; k++) {
+        unsigned char byte = (mantissa >> (8 * (2 - k))) & 0xff;
+        int significance = exponent - 1 - k;
+        if (significance < 0) {
+            continue;
+        }
+        int index = static_cast<int>(target.size()) - 1 - significance;
+        if (index < 0) {
+            if (byte != 0) {
+                return false;
+            }
+            continue;
+        }
+        target[index] = byte;
+    }
+
+    bool zero = std::all_of(target.begin(), target.end(), [](unsigned char b) { return b == 0; });
+    return !zero && !aboveMax(target);
+}
+
+uint32_t compactBits(const TargetBytes& target) {
+    size_t first = 0;
+    while (first < target.size() && target[first] == 0) {
+        first++;
+    }
+    if (first == target.size()) {
+        return 0;
+    }
+
+    uint32_t size = static_cast<uint32_t>(target.size() - first);
+    uint32_t mantissa = 0;
+    for (size_t k = 0; k < 3; k++) {
+        mantissa = (mantissa << 8) | (first + k < target.size() ? target[first + k] : 0);
+    }
+    // The top bit is a sign bit; shift it out rather than set it
+    if (mantissa & 0x00800000) {
+        mantissa >>= 8;
+        size++;
+    }
+    return (size << 24) | mantissa;
+}
+
+bool hashBelowTarget(std::string_view hexHash, const TargetBytes& target) {
+    if (hexHash.size() != 64) {
+        return false;
+    }
+
+    // Compare nibble by nibble against target[1..32]; the extra top byte
+    // is only set for 2^256, which every hash is below
+    bool decided = target[0] != 0;
+    bool below = decided;
+    for (size_t i = 0; i < hexHash.size(); i++) {
+        int digit = hexValue(hexHash[i]);
+        if (digit < 0) {
+            return false;
+        }
+        if (!decided) {
+            unsigned char byte = target[1 + i / 2];
+            int targetDigit = (i % 2 == 0) ? byte >> 4 : byte & 0x0f;
+            if (digit != targetDigit) {
+                below = digit < targetDigit;
+                decided = true;
+            }
+        }
+    }
+    return below;
+}
+
+bool hashMeetsBits(std::string_view hexHash, uint32_t bits) {
+    TargetBytes target;
+    return expandBits(bits, target) && hashBelowTarget(hexHash, target);
+}
+
+uint32_t bitsForLeadingZeros(int zeros) {
+    // n leading zeros means the hash is below 16^(64 - n) = 2^(256 - 4n)
+    zeros = std::clamp(zeros, 0, 64);
+    int bit = 256 - 4 * zeros;
+    TargetBytes target {};
+    target[target.size() - 1 - bit / 8] = static_cast<unsigned char>(1 << (bit % 8));
+    return compactBits(target);
+}
+
+uint32_t retargetBits(uint32_t bits, int64_t actualSeconds, int64_t expectedSeconds) {
+    TargetBytes target;
+    if (!expandBits(bits, target) || expectedSeconds <= 0 || expectedSeconds > MAX_EXPECTED_SECONDS) {
+        return bits;
+    }
+    int64_t actual = std::clamp(actualSeconds, expectedSeconds / 4, expectedSeconds * 4);
+    actual = std::max<int64_t>(actual, 1);
+
+    // target * actual needs at most 33 + 6 bytes; work big-endian in 40
+    std::array<unsigned char, 40> wide {};
+    size_t offset = wide.size() - target.size();
+    std::copy(target.begin(), target.end(), wide.begin() + offset);
+
+    uint64_t carry = 0;
+    for (size_t i = wide.size(); i-- > 0;) {
+        uint64_t value = wide[i] * static_cast<uint64_t>(actual) + carry;
+        wide[i] = value & 0xff;
+        carry = value >> 8;
+    }
+
+    uint64_t remainder = 0;
+    for (size_t i = 0; i < wide.size(); i++) {
+        uint64_t value = (remainder << 8) | wide[i];
+        wide[i] = static_cast<unsigned char>(value / expectedSeconds);
+        remainder = value % expectedSeconds;
+    }
+
+    bool overflow = std::any_of(wide.begin(), wide.begin() + offset, [](unsigned char b) { return b != 0; });
+    std::copy(wide.begin() + offset, wide.end(), target.begin());
+    if (overflow || aboveMax(target)) {
+        return MAX_TARGET_BITS;
+    }
+    if (std::all_of(target.begin(), target.end(), [](unsigned char b) { return b == 0; })) {
+        target.back() = 1; // Hardest target there is
+    }
+    return compactBits(target);
+}
+
+ChainWork blockWork(uint32_t bits) {
+    ChainWork work {};
+    TargetBytes target;
+    if (!expandBits(bits, target)) {
+        return work;
+    }
+
+    // A target is at most three significant bytes, then zero bytes:
+    // significand * 256^shift
+    size_t first = 0;
+    while (target[first] == 0) {
+        first++;
+    }
+    size_t last = std::min(first + 3, target.size());
+    uint64_t significand = 0;
+    for (size_t i = first; i < last; i++) {
+        significand = (significand << 8) | target[i];
+    }
+    size_t shift = target.size() - last;
+
+    // 2^256 / target = 256^(32 - shift) / significand, by long division
+    ChainWork dividend {};
+    dividend[dividend.size() - 1 - (32 - shift)] = 1;
+    uint64_t remainder = 0;
+    for (size_t i = 0; i < dividend.size(); i++) {
+        uint64_t value = (remainder << 8) | dividend[i];
+        work[i] = static_cast<unsigned char>(value / significand);
+        remainder = value % significand;
+    }
+    return work;
+}
+
+void addWork(ChainWork& total, const ChainWork& work) {
+    unsigned carry = 0;
+    for (size_t i = total.size(); i-- > 0;) {
+        unsigned value = total[i] + work[i] + carry;
+        total[i] = value & 0xff;
+        carry = value >> 8;
+    }
+}
+
+double bitsDifficulty(uint32_t bits) {
+    TargetBytes target;
+    if (!expandBits(bits, target)) {
+        return 0;
+    }
+    double value = 0;
+    for (unsigned char byte : target) {
+        value = value * 256 + byte;
+    }
+    return (256 - std::log2(value)) / 4;
+}
@@ -0,0 +1,66 @@
+// Proof-of-work targets in compact "bits" form.
+//
+// A block is valid if its hash, read as a 256-bit big-endian number, is
+// below its target. Counting leading hex zeros only allowed targets of
+// 16^(64 - n), so every step multiplied the work by 16; a target can now
+// be any number, which lets the chain retarget by small factors.
+//
+// Targets are stored per block as 32 bits, the way Bitcoin's nBits does:
+// the top byte is a length in bytes and the low three are the leading
+// bytes of the number, so
+//
+//     target = mantissa * 256^(exponent - 3)
+//
+// The mantissa's top bit must be clear. Targets are capped at 2^256 (every
+// hash meets it); the expanded form is therefore one byte wider than a hash.
+
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// A target as a 33-byte big-endian number
+using TargetBytes = std::array<unsigned char, 33>;
+
+// Bits of the easiest target, 2^256: any hash meets it
+constexpr uint32_t MAX_TARGET_BITS = 0x21010000;
+
+// Proof-of-work as a big-endian count of expected hashes, wide enough for
+// the sum over any chain; compare with <
+using ChainWork = std::array<unsigned char, 40>;
+
+// Expand bits into target; false if malformed (zero, negative or above
+// 2^256)
+bool expandBits(uint32_t bits, TargetBytes& target);
+
+// Compact form of target (truncated to three significant bytes)
+uint32_t compactBits(const TargetBytes& target);
+
+// Is a 64-character hex hash below target?
+bool hashBelowTarget(std::string_view hexHash, const TargetBytes& target);
+
+// Is a 64-character hex hash below the target bits encode?
+bool hashMeetsBits(std::string_view hexHash, uint32_t bits);
+
+// Bits equivalent to requiring this many leading hex zeros (0 to 64)
+uint32_t bitsForLeadingZeros(int zeros);
+
+// bits scaled by actual / expected seconds, with actual clamped to within
+// a factor of 4 of expected and the result capped at MAX_TARGET_BITS.
+// Returns bits unchanged if it is malformed or expected isn't positive.
+uint32_t retargetBits(uint32_t bits, int64_t actualSeconds, int64_t expectedSeconds);
+
+// Expected hashes to find a block meeting bits: 2^256 / target (zero if
+// bits is malformed)
+ChainWork blockWork(uint32_t bits);
+
+// total += work
+void addWork(ChainWork& total, const ChainWork& work);
+
+// Difficulty in leading hex zeros, the unit it used to be set in (2.5
+// means a block takes 16^2.5 hashes on average); 0 if malformed
+double bitsDifficulty(uint32_t bits);
+
+#endif
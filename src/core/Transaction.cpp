@@ -1,14 +1,33 @@
 #include "Transaction.h"
-#include <openssl/sha.h>
+#include "Hash.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Signature.h"
+#include "SignatureVerifier.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <sstream>
-#include <iomanip>
-
-Transaction::Transaction(std::string sdr, std::string rcv, double amt) {
-    sender = sdr;
-    receiver = rcv;
-    amount = amt;
-    timestamp = time(nullptr);
+
+namespace {
+
+// Writes a 4-byte big-endian length at out[at]
+void putLength(std::string& out, size_t at, size_t length) {
+    for (int i = 0; i < 4; i++) {
+        out[at + i] = static_cast<char>((length >> (8 * (3 - i))) & 0xff);
+    }
+}
+
+// The verify pool, for a batch big enough to split (held for the call, as
+// setThreads() may replace it)
+std::shared_ptr<ThreadPool> hashHelpers(size_t count) {
+    return count >= 2 * PARALLEL_HASH_MIN ? SignatureVerifier::helpers() : nullptr;
+}
+
+}
+
+Transaction::Transaction(std::string sdr, std::string rcv, double amt)
+    : sender(std::move(sdr)), receiver(std::move(rcv)), amount(amt), timestamp(time(nullptr)) {
 }
 
 std::string Transaction::toString() const {
@@ -16,75 +35,108 @@ std::string Transaction::toString() const {
     return stringAmount;
 }
 
-std::string Transaction::calculateHash() const {
-    // Concatenate
-    std::string toHash = 
-        std::to_string(amount) + 
-        std::to_string(timestamp) + 
-        sender + 
-        receiver;
-    
-    // SHA256 Function
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, toHash.c_str(), toHash.size());
-    SHA256_Final(hash, &sha256);
-    std::stringstream ss;
-    for(int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-    {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    }
+void Transaction::writeSigningData(std::string& out) const {
+    // Each variable-length field behind its length, so no two transactions
+    // share a preimage. The amount is the text toJSON() sends, which is
+    // what a receiver parses and has to rebuild the same bytes from.
+    size_t at = out.size();
+    out.resize(at + 4);
+    JsonWriter(out).fixed(amount);
+    putLength(out, at, out.size() - at - 4);
+    appendBigEndian(out, static_cast<uint64_t>(timestamp), 8);
+    appendField(out, sender);
+    appendField(out, receiver);
+}
 
-    return ss.str();
+void Transaction::writeHashData(std::string& out) const {
+    // The signed fields, then the signature, so a txid names one exact
+    // signature (Ed25519 signatures can't be altered and still verify)
+    writeSigningData(out);
+    appendField(out, signature);
 }
 
-std::string Transaction::toJSON() const {
-    std::string json = "";
+std::string Transaction::calculateHash() const {
+    std::string toHash;
+    toHash.reserve(48 + sender.size() + receiver.size() + signature.size());
+    writeHashData(toHash);
 
-    // Opening brace
-    json += "{";
+    return sha256Hex(toHash);
+}
 
-    // Add sender field
-    json += "\"sender\":\"" + sender + "\",";
+std::vector<std::string> Transaction::calculateHashes(const std::vector<Transaction>& txs) {
+    std::vector<std::string> hashes;
+    std::shared_ptr<ThreadPool> helpers = hashHelpers(txs.size());
+    sha256HexEach(txs.size(), [&txs](size_t i, std::string& input) { txs[i].writeHashData(input); }, hashes,
+                  helpers.get());
+    return hashes;
+}
 
-    // Add receiver field
-    json += "\"receiver\":\"" + receiver + "\",";
+std::vector<std::string> Transaction::calculateHashes(const std::vector<const Transaction*>& txs) {
+    std::vector<std::string> hashes;
+    std::shared_ptr<ThreadPool> helpers = hashHelpers(txs.size());
+    sha256HexEach(txs.size(), [&txs](size_t i, std::string& input) { txs[i]->writeHashData(input); }, hashes,
+                  helpers.get());
+    return hashes;
+}
 
-    // Add amount field
-    json += "\"amount\":" + std::to_string(amount) + ",";
+bool Transaction::sign(const std::string& privateKey) {
+    KeyPair keys;
+    if (!keyPairFromPrivateKey(privateKey, keys) || keys.address != sender) {
+        return false;
+    }
+    std::string data;
+    data.reserve(48 + sender.size() + receiver.size());
+    writeSigningData(data);
+    signature = signMessage(privateKey, data);
+    return !signature.empty();
+}
 
-    // Add timestamp field
-    json += "\"timestamp\":" + std::to_string(timestamp);
+bool Transaction::verifySignature() const {
+    if (sender == "SYSTEM") {
+        return signature.empty();
+    }
+    // Verify threads reuse one buffer each
+    thread_local std::string data;
+    data.clear();
+    writeSigningData(data);
+    return ::verifySignature(sender, data, signature);
+}
+
+std::string Transaction::toJSON() const {
+    std::string out;
+    out.reserve(112 + sender.size() + receiver.size() + signature.size());
+    JsonWriter json(out);
+    writeJSON(json);
+    return out;
+}
 
-    // Closing brace
-    json += "}";
+void Transaction::writeJSON(JsonWriter& json) const {
+    json.raw("{\"sender\":").string(sender);
+    json.raw(",\"receiver\":").string(receiver);
+    json.raw(",\"amount\":").fixed(amount);
+    json.raw(",\"timestamp\":").number(timestamp);
+    if (!signature.empty()) {
+        json.raw(",\"signature\":").string(signature);
+    }
+    json.raw('}');
+}
 
-    return json;
+bool Transaction::isPlainAddress(std::string_view address) {
+    return !address.empty() && std::all_of(address.begin(), address.end(), [](unsigned char c) {
+        return c >= 0x20 && c != '"' && c != '\\';
+    });
 }
 
-Transaction Transaction::fromJSON(const std::string& json) {
-    // Extract sender
-    size_t pos = json.find("\"sender\":\"") + 10;
-    size_t end = json.find("\"", pos);
-    std::string sender = json.substr(pos, end - pos);
-    
-    // Extract receiver
-    pos = json.find("\"receiver\":\"") + 12;
-    end = json.find("\"", pos);
-    std::string receiver = json.substr(pos, end - pos);
-    
-    // Extract amount
-    pos = json.find("\"amount\":") + 9;
-    end = json.find_first_of(",}", pos);
-    double amount = std::stod(json.substr(pos, end - pos));
-    
-    // Extract timestamp
-    pos = json.find("\"timestamp\":") + 12;
-    end = json.find_first_of(",}", pos);
-    time_t timestamp = std::stol(json.substr(pos, end - pos));
-    
-    Transaction tx(sender, receiver, amount);
-    tx.timestamp = timestamp;  // Set timestamp after construction
+Transaction Transaction::fromJSON(std::string_view json) {
+    // Read straight from the text; a missing or malformed field stays
+    // empty/zero, which the hash and balance checks then reject
+    Transaction tx;
+    tx.sender = jsonString(json, "sender");
+    tx.receiver = jsonString(json, "receiver");
+    tx.signature = jsonString(json, "signature");
+    tx.amount = 0;
+    tx.timestamp = 0;
+    jsonNumber(json, "amount", tx.amount);
+    jsonNumber(json, "timestamp", tx.timestamp);
     return tx;
 }
\ No newline at end of file
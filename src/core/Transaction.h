@@ -2,7 +2,11 @@
 #define TRANSACTION_H
 
 #include <string>
+#include <string_view>
 #include <ctime>
+#include <vector>
+
+class JsonWriter;
 
 class Transaction {
     public:
@@ -10,6 +14,7 @@ class Transaction {
         std::string receiver; // who is receiving
         double amount; // how much is being sent
         time_t timestamp; // when transaction was created
+        std::string signature; // sender's Ed25519 signature, hex (empty for SYSTEM)
 
         // Constructor
         Transaction(std::string sender, std::string receiver, double amount);
@@ -17,14 +22,47 @@ class Transaction {
         // Converts transaction to readable string
         std::string toString() const;
 
-        // Creates unique hash of the transaction
+        // Creates unique hash of the transaction (covering the signature)
         std::string calculateHash() const;
 
+        // calculateHash() of each transaction, in order; large batches are
+        // split over SignatureVerifier's shared pool (see sha256HexEach())
+        static std::vector<std::string> calculateHashes(const std::vector<Transaction>& txs);
+        static std::vector<std::string> calculateHashes(const std::vector<const Transaction*>& txs);
+
+        // Sign with the sender's private key (hex); false if the key is
+        // malformed or isn't the sender's
+        bool sign(const std::string& privateKey);
+
+        // Does the signature verify against the sender's address? Only
+        // SYSTEM transactions may go unsigned.
+        bool verifySignature() const;
+
+        // Can this be a receiver? Addresses travel unescaped inside peer
+        // messages, so no quotes, backslashes or control characters
+        static bool isPlainAddress(std::string_view address);
+
         // Converts transaction to JSON format
         std::string toJSON() const;
 
+        // Appends the same JSON to a writer
+        void writeJSON(JsonWriter& json) const;
+
         // Parses transaction from JSON format
-        static Transaction fromJSON(const std::string& json);
+        static Transaction fromJSON(std::string_view json);
+
+    private:
+        // Empty, for fromJSON() to fill in
+        Transaction() = default;
+
+        // Every field but the signature, as the signature covers them: the
+        // amount's text and each address behind a 4-byte big-endian length,
+        // the timestamp as 8 big-endian bytes
+        void writeSigningData(std::string& out) const;
+
+        // What the txid is the hash of: the signing data, then the
+        // signature behind its length
+        void writeHashData(std::string& out) const;
 };
 
 #endif
\ No newline at end of file
@@ -1,7 +1,17 @@
 #include "Block.h"
 #include "Blockchain.h"
+#include "Config.h"
+#include "Logger.h"
+#include "Miner.h"
 #include "Node.h"
+#include "Signature.h"
+#include "SignatureVerifier.h"
+#include "Target.h"
 #include "Transaction.h"
+#include <pthread.h>
+#include <csignal>
+#include <filesystem>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -26,37 +36,153 @@ void printMenu() {
     std::cout << "Choice: ";
 }
 
-int main() {
+// Address for a demo account name (see Blockchain::demoAccounts()), or
+// the input as given
+std::string resolveAddress(const std::string& input) {
+    const std::vector<std::string>& demo = Blockchain::demoAccounts();
+    if (std::find(demo.begin(), demo.end(), input) != demo.end()) {
+        return keyPairFromSeed(input).address;
+    }
+    return input;
+}
+
+// Keys for a demo account name or a hex private key; false if neither
+bool resolveKeys(const std::string& input, KeyPair& keys) {
+    const std::vector<std::string>& demo = Blockchain::demoAccounts();
+    if (std::find(demo.begin(), demo.end(), input) != demo.end()) {
+        keys = keyPairFromSeed(input);
+        return true;
+    }
+    return keyPairFromPrivateKey(input, keys);
+}
+
+// Dial the configured seed peers
+void connectSeeds(Node& node, const Config& config) {
+    for (const std::string& seed : config.seeds) {
+        std::string host;
+        int seedPort;
+        if (Config::parseAddress(seed, host, seedPort)) {
+            node.connectToPeer(host, seedPort);
+        }
+    }
+}
+
+// Headless node: runs until SIGTERM or SIGINT, then saves the chain and
+// shuts every thread down
+int runDaemon(const Config& config) {
+    // Block the signals before any thread exists, so every thread inherits
+    // the mask and only sigwait() below ever sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::error_code error;
+    std::filesystem::create_directories(config.dataDir, error);
+    if (error) {
+        LOG_ERROR(Chain, "Can't create data directory").kv("dir", config.dataDir).kv("error", error.message());
+        return 1;
+    }
+    std::string chainFile = config.dataDir + "/chain.json";
+
+    Node node(config.port, config.difficulty, config.reward);
+    node.getBlockchain().setRetarget(config.blockTime, config.retargetInterval);
+    SignatureVerifier::setThreads(config.verifyThreads);
+    node.setLightClient(config.light);
+    node.setAddressBook(config.dataDir + "/peers.txt");
+
+    // Pick up where we left off (a light client saved headers only)
+    if (std::filesystem::exists(chainFile)) {
+        if (!node.getBlockchain().loadFromFile(chainFile) || !node.getBlockchain().isChainValid(!config.light)) {
+            LOG_ERROR(Chain, "Stored chain is unreadable or invalid").kv("file", chainFile);
+            return 1;
+        }
+        LOG_INFO(Chain, "Loaded chain").kv("file", chainFile).kv("blocks", node.getBlockchain().getChainLength());
+    }
+
+    if (!node.start()) {
+        return 1;
+    }
+    if (config.resolvedMetricsPort() > 0) {
+        node.startMetrics(config.resolvedMetricsPort());
+    }
+    if (config.resolvedRpcPort() > 0) {
+        node.startRpc(config.resolvedRpcPort());
+    }
+    connectSeeds(node, config);
+
+    Miner miner(node);
+    if (config.minerThreads > 0 && config.light) {
+        LOG_WARN(Mining, "Light clients don't mine, ignoring --miner-threads");
+    } else if (config.minerThreads > 0) {
+        miner.start(config.minerThreads);
+    }
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+    LOG_INFO(Net, "Shutting down").kv("signal", signal == SIGTERM ? "SIGTERM" : "SIGINT");
+
+    // Quiesce everything that writes the chain, then persist it
+    miner.stop();
+    node.stop();
+    int status = 0;
+    if (node.getBlockchain().saveToFile(chainFile)) {
+        LOG_INFO(Chain, "Saved chain").kv("file", chainFile).kv("blocks", node.getBlockchain().getChainLength());
+    } else {
+        LOG_ERROR(Chain, "Failed to save chain").kv("file", chainFile);
+        status = 1;
+    }
+    Logger::instance().flush();
+    return status;
+}
+
+// The interactive menu; prompts for the basics unless they came from the
+// command line
+int runInteractive(Config config, bool prompt) {
     std::cout << "\n╔════════════════════════════════════════╗" << std::endl;
     std::cout << "║    DISTRIBUTED BLOCKCHAIN NODE         ║" << std::endl;
     std::cout << "║    C++ Implementation                  ║" << std::endl;
     std::cout << "╚════════════════════════════════════════╝\n" << std::endl;
     
     // Get node configuration
-    int port, difficulty;
-    double miningReward;
-    
-    std::cout << "Enter port for this node (e.g., 8080): ";
-    std::cin >> port;
-    
-    std::cout << "Enter mining difficulty (recommended: 2-4): ";
-    std::cin >> difficulty;
-    
-    std::cout << "Enter mining reward (e.g., 50): ";
-    std::cin >> miningReward;
+    if (prompt) {
+        std::cout << "Enter port for this node (e.g., 8080): ";
+        std::cin >> config.port;
+        
+        std::cout << "Enter mining difficulty (recommended: 2-4): ";
+        std::cin >> config.difficulty;
+        
+        std::cout << "Enter mining reward (e.g., 50): ";
+        std::cin >> config.reward;
+    }
+    int port = config.port;
     
     // Create and start node
-    Node node(port, difficulty, miningReward);
-    node.start();
+    Node node(port, config.difficulty, config.reward);
+    node.getBlockchain().setRetarget(config.blockTime, config.retargetInterval);
+    SignatureVerifier::setThreads(config.verifyThreads);
+    node.setLightClient(config.light);
+    node.setAddressBook("peers_" + std::to_string(port) + ".txt"); // Reconnect to known peers on restart
+    if (!node.start()) {
+        std::cout << "✗ Could not listen on port " << port << std::endl;
+        return 1;
+    }
+    if (config.resolvedMetricsPort() > 0) {
+        node.startMetrics(config.resolvedMetricsPort()); // Prometheus scrape endpoint on localhost
+    }
+    if (config.resolvedRpcPort() > 0) {
+        node.startRpc(config.resolvedRpcPort()); // JSON-RPC for scripts and tools
+    }
+    node.getBlockchain().setMinerThreads(std::max(config.minerThreads, 1u));
+    connectSeeds(node, config);
     
     std::cout << "\n✓ Node started on port " << port << std::endl;
     std::cout << "✓ Chain initialized with genesis block" << std::endl;
     
-    // Pending transactions
-    std::vector<Transaction> pendingTransactions;
-    
     bool running = true;
     while (running) {
+        Logger::instance().flush(); // Keep log lines from landing in the middle of the menu
         printMenu();
         
         int choice;
@@ -70,31 +196,38 @@ int main() {
                 double amount;
                 
                 std::cout << "\n--- Create Transaction ---" << std::endl;
-                std::cout << "From: ";
+                std::cout << "From (demo account or private key): ";
                 std::getline(std::cin, from);
-                std::cout << "To: ";
+                std::cout << "To (demo account or address): ";
                 std::getline(std::cin, to);
                 std::cout << "Amount: ";
                 std::cin >> amount;
                 
-                Transaction tx(from, to, amount);
-                pendingTransactions.push_back(tx);
-                
-                std::cout << "✓ Transaction added to pending pool (" 
-                          << pendingTransactions.size() << " pending)" << std::endl;
+                KeyPair keys;
+                if (!resolveKeys(from, keys)) {
+                    std::cout << "✗ Not a demo account or a private key" << std::endl;
+                    break;
+                }
+                Transaction tx(keys.address, resolveAddress(to), amount);
+                tx.sign(keys.privateKey);
+                if (node.submitTransaction(tx)) {
+                    std::cout << "✓ Transaction added to mempool and announced ("
+                              << node.getMempool().size() << " pending)" << std::endl;
+                } else {
+                    std::cout << "✗ Transaction rejected" << std::endl;
+                }
                 break;
             }
             
             case 2: {
                 // Mine block
-                if (pendingTransactions.empty()) {
+                if (node.getMempool().size() == 0) {
                     std::cout << "\n⚠ No pending transactions to mine!" << std::endl;
                 } else {
-                    std::cout << "\n⛏ Mining block with " << pendingTransactions.size() 
+                    std::cout << "\n⛏ Mining block with " << node.getMempool().size()
                               << " transactions..." << std::endl;
                     
-                    node.mineAndBroadcast(pendingTransactions);
-                    pendingTransactions.clear();
+                    node.minePendingTransactions();
                     
                     std::cout << "✓ Block mined and broadcast to network!" << std::endl;
                 }
@@ -111,10 +244,18 @@ int main() {
             case 4: {
                 // Check balance
                 std::string address;
-                std::cout << "\nEnter address: ";
+                std::cout << "\nEnter address (or demo account): ";
                 std::getline(std::cin, address);
+                address = resolveAddress(address);
                 
-                double balance = node.getBlockchain().getBalance(address);
+                double balance = 0;
+                std::string reason;
+                if (!config.light) {
+                    balance = node.getBlockchain().getBalance(address);
+                } else if (!node.provenBalance(address, balance, &reason)) {
+                    std::cout << "\n✗ Couldn't prove balance: " << reason << std::endl;
+                    break;
+                }
                 std::cout << "\n💰 Balance of " << address << ": " << balance << std::endl;
                 break;
             }
@@ -122,7 +263,7 @@ int main() {
             case 5: {
                 // Validate chain
                 std::cout << "\n--- Chain Validation ---" << std::endl;
-                bool valid = node.getBlockchain().isChainValid();
+                bool valid = node.getBlockchain().isChainValid(!config.light);
                 
                 if (valid) {
                     std::cout << "✓ Blockchain is VALID" << std::endl;
@@ -144,7 +285,7 @@ int main() {
                 std::cin >> peerPort;
                 
                 if (node.connectToPeer(address, peerPort)) {
-                    std::cout << "✓ Connected to peer!" << std::endl;
+                    std::cout << "✓ Connecting to peer (see View network info)" << std::endl;
                 } else {
                     std::cout << "✗ Failed to connect to peer" << std::endl;
                 }
@@ -156,9 +297,22 @@ int main() {
                 std::cout << "\n--- Network Information ---" << std::endl;
                 std::cout << "Port: " << port << std::endl;
                 std::cout << "Chain length: " << node.getBlockchain().getChainLength() << " blocks" << std::endl;
-                std::cout << "Difficulty: " << difficulty << std::endl;
-                std::cout << "Mining reward: " << miningReward << std::endl;
-                std::cout << "Pending transactions: " << pendingTransactions.size() << std::endl;
+                std::cout << "Difficulty: " << bitsDifficulty(node.getBlockchain().snapshot()->tip().bits) << std::endl;
+                std::cout << "Mining reward: " << config.reward << std::endl;
+                std::cout << "Connected peers: " << node.getPeerCount() << std::endl;
+                for (const PeerManager::PeerInfo& peer : node.getPeerManager().getPeers()) {
+                    std::cout << "  " << (peer.inbound ? "in  " : "out ") << peer.host << ":" << peer.port
+                              << "  height " << peer.bestHeight;
+                    if (peer.latencyMs >= 0) {
+                        std::cout << "  ping " << peer.latencyMs << " ms";
+                    }
+                    if (peer.misbehavior > 0) {
+                        std::cout << "  misbehavior " << peer.misbehavior;
+                    }
+                    std::cout << std::endl;
+                }
+                std::cout << "Known addresses: " << node.getPeerManager().getAddressCount() << std::endl;
+                std::cout << "Pending transactions: " << node.getMempool().size() << std::endl;
                 break;
             }
             
@@ -206,4 +360,26 @@ int main() {
     
     std::cout << "\n✓ Node stopped. Goodbye!" << std::endl;
     return 0;
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    std::string error;
+    if (!config.parseArgs(argc, argv, error)) {
+        std::cerr << error << "\n\n" << Config::usage();
+        return 2;
+    }
+    if (config.help) {
+        std::cout << Config::usage();
+        return 0;
+    }
+    if (!config.logLevel.empty() && !Logger::configure(config.logLevel)) {
+        std::cerr << "bad log level: " << config.logLevel << std::endl;
+        return 2;
+    }
+
+    if (config.daemon) {
+        return runDaemon(config);
+    }
+    return runInteractive(config, argc == 1);
 }
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "BlockDownloader.h"
+#include <algorithm>
+
+BlockDownloader::BlockDownloader(size_t rangeSize, size_t maxInFlightPerPeer, size_t windowSize,
+                                 std::chrono::milliseconds stallTimeout)
+    : rangeSize(rangeSize == 0 ? 1 : rangeSize), maxInFlightPerPeer(maxInFlightPerPeer),
+      windowSize(windowSize), stallTimeout(stallTimeout), active(false), firstIndex(0),
+      nextToConnect(0), stalls(0) {
+}
+
+void BlockDownloader::start(const std::vector<BlockHeader>& newHeaders) {
+    reset();
+    if (newHeaders.empty()) {
+        return;
+    }
+
+    active = true;
+    headers = newHeaders;
+    firstIndex = headers.front().index;
+    nextToConnect = firstIndex;
+
+    // Cut the heights into ranges
+    for (size_t offset = 0; offset < headers.size(); offset += rangeSize) {
+        Range range;
+        range.count = std::min(rangeSize, headers.size() - offset);
+        ranges.emplace(firstIndex + static_cast<int>(offset), range);
+    }
+}
+
+void BlockDownloader::reset() {
+    active = false;
+    headers.clear();
+    ranges.clear();
+    received.clear();
+    stalls = 0;
+
+    // Keep the peer list, but forget what they were doing
+    for (auto& entry : peers) {
+        entry.second = PeerState();
+    }
+}
+
+bool BlockDownloader::isComplete() const {
+    return active && nextToConnect == firstIndex + static_cast<int>(headers.size());
+}
+
+bool BlockDownloader::isStuck() const {
+    if (!active || ranges.empty()) {
+        return false;
+    }
+
+    for (const auto& entry : ranges) {
+        if (entry.second.inFlight) {
+            return false; // Something may still arrive
+        }
+        for (const auto& peer : peers) {
+            if (peer.second.maxIndex >= entry.first) {
+                return false; // Someone could still serve it
+            }
+        }
+    }
+    return true;
+}
+
+void BlockDownloader::addPeer(PeerId peer) {
+    peers.emplace(peer, PeerState());
+}
+
+void BlockDownloader::setPeerRank(PeerId peer, size_t rank) {
+    auto it = peers.find(peer);
+    if (it != peers.end()) {
+        it->second.rank = rank;
+    }
+}
+
+void BlockDownloader::removePeer(PeerId peer) {
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        if (it->second.inFlight && it->second.peer == peer) {
+            release(it);
+        }
+    }
+    peers.erase(peer);
+}
+
+std::vector<BlockDownloader::Request> BlockDownloader::schedule(Clock::time_point now) {
+    std::vector<Request> requests;
+    if (!active) {
+        return requests;
+    }
+
+    // 1. Take stalled ranges back
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        if (it->second.inFlight && now - it->second.sentAt > stallTimeout) {
+            release(it);
+            stalls++;
+        }
+    }
+
+    // 2. Hand out queued ranges, lowest heights first, within the window
+    int windowEnd = nextToConnect + static_cast<int>(windowSize);
+
+    for (auto it = ranges.begin(); it != ranges.end() && it->first < windowEnd; ++it) {
+        Range& range = it->second;
+        if (range.inFlight) {
+            continue;
+        }
+
+        // Least busy peer that has the blocks, avoiding whoever stalled on it;
+        // ties go to the better-ranked peer
+        PeerId best = 0;
+        size_t bestLoad = SIZE_MAX;
+        size_t bestRank = SIZE_MAX;
+        for (auto& entry : peers) {
+            const PeerState& state = entry.second;
+            if (state.inFlight >= maxInFlightPerPeer || state.maxIndex < it->first) {
+                continue;
+            }
+
+            size_t load = state.inFlight;
+            if (entry.first == range.peer && peers.size() > 1) {
+                load += maxInFlightPerPeer; // Only if nobody else is free
+            }
+            if (load < bestLoad || (load == bestLoad && state.rank < bestRank)) {
+                bestLoad = load;
+                bestRank = state.rank;
+                best = entry.first;
+            }
+        }
+
+        if (bestLoad == SIZE_MAX) {
+            continue; // Every capable peer is busy
+        }
+
+        range.inFlight = true;
+        range.peer = best;
+        range.sentAt = now;
+        peers[best].inFlight++;
+        requests.push_back(Request { best, it->first, range.count });
+    }
+
+    return requests;
+}
+
+bool BlockDownloader::receive(PeerId peer, int from, std::vector<Block> blocks) {
+    if (!active) {
+        return true;
+    }
+
+    auto peerIt = peers.find(peer);
+
+    // Free the slot this reply answers, if it is still ours
+    size_t requested = 0;
+    auto rangeIt = ranges.find(from);
+    if (rangeIt != ranges.end() && rangeIt->second.inFlight && rangeIt->second.peer == peer) {
+        requested = rangeIt->second.count;
+        rangeIt->second.inFlight = false;
+        if (peerIt != peers.end() && peerIt->second.inFlight > 0) {
+            peerIt->second.inFlight--;
+        }
+        ranges.erase(rangeIt);
+    }
+
+    // Check every body against its header
+    int expectedIndex = from;
+    for (Block& block : blocks) {
+        int offset = block.index - firstIndex;
+        if (block.index != expectedIndex || offset < 0 || offset >= static_cast<int>(headers.size()) ||
+            block.hash != headers[offset].hash) {
+            // Whatever we didn't get goes back in the queue
+            if (requested > 0) {
+                requeue(expectedIndex, from + requested - expectedIndex, peer);
+            }
+            return false;
+        }
+
+        if (block.index >= nextToConnect) {
+            received.emplace(block.index, std::move(block));
+        }
+        expectedIndex++;
+    }
+
+    // A short reply means the peer doesn't have the rest
+    if (requested > 0 && static_cast<size_t>(expectedIndex - from) < requested) {
+        if (peerIt != peers.end()) {
+            peerIt->second.maxIndex = expectedIndex - 1;
+        }
+        requeue(expectedIndex, from + requested - expectedIndex, peer);
+    }
+
+    // Late replies for ranges that were reassigned still count
+    if (requested == 0) {
+        for (auto it = ranges.begin(); it != ranges.end();) {
+            int end = it->first + static_cast<int>(it->second.count);
+            bool covered = true;
+            for (int idx = it->first; idx < end; idx++) {
+                if (idx >= nextToConnect && received.count(idx) == 0) {
+                    covered = false;
+                    break;
+                }
+            }
+            if (covered) {
+                if (it->second.inFlight) {
+                    auto owner = peers.find(it->second.peer);
+                    if (owner != peers.end() && owner->second.inFlight > 0) {
+                        owner->second.inFlight--;
+                    }
+                }
+                it = ranges.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    return true;
+}
+
+std::vector<Block> BlockDownloader::takeReady() {
+    std::vector<Block> ready;
+
+    auto it = received.begin();
+    while (it != received.end() && it->first == nextToConnect) {
+        ready.push_back(std::move(it->second));
+        it = received.erase(it);
+        nextToConnect++;
+    }
+
+    return ready;
+}
+
+void BlockDownloader::requeue(int from, size_t count, PeerId lastPeer) {
+    if (count == 0) {
+        return;
+    }
+
+    Range range;
+    range.count = count;
+    range.peer = lastPeer;
+    ranges[from] = range;
+}
+
+void BlockDownloader::release(std::map<int, Range>::iterator it) {
+    auto owner = peers.find(it->second.peer);
+    if (owner != peers.end() && owner->second.inFlight > 0) {
+        owner->second.inFlight--;
+    }
+    it->second.inFlight = false;
+}
@@ -0,0 +1,117 @@
+// Schedules block body downloads across every connected peer.
+//
+// After the header chain is validated, the missing heights are cut into
+// fixed-size ranges. Ranges are handed to peers with free request slots,
+// never more than windowSize blocks ahead of the next block we can connect,
+// so memory stays bounded even when one range is slow. A range that has
+// been in flight longer than stallTimeout goes back to the queue and is
+// offered to a different peer. Bodies are released strictly in height
+// order by takeReady().
+//
+// Not thread-safe; Node calls it with syncMutex held.
+
+#ifndef BLOCKDOWNLOADER_H
+#define BLOCKDOWNLOADER_H
+
+#include "Block.h"
+#include "PeerId.h"
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+class BlockDownloader {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // A GET_BLOCKS to send
+        struct Request {
+            PeerId peer;
+            int from;
+            size_t count;
+        };
+
+        // Constructor
+        BlockDownloader(size_t rangeSize = 64, size_t maxInFlightPerPeer = 4, size_t windowSize = 2048,
+                        std::chrono::milliseconds stallTimeout = std::chrono::milliseconds(5000));
+
+        // Begin downloading bodies for a validated, contiguous header chain
+        void start(const std::vector<BlockHeader>& headers);
+
+        // Drop all state
+        void reset();
+
+        // Is a download in progress?
+        bool isActive() const { return active; }
+
+        // Have all bodies been handed out by takeReady()?
+        bool isComplete() const;
+
+        // True when ranges remain but no peer can serve them
+        bool isStuck() const;
+
+        // A peer we may download from
+        void addPeer(PeerId peer);
+
+        // Preference among equally busy peers; lower ranks get ranges first
+        void setPeerRank(PeerId peer, size_t rank);
+
+        // A peer went away; its ranges go back to the queue
+        void removePeer(PeerId peer);
+
+        // Reassign stalled ranges and fill free request slots
+        std::vector<Request> schedule(Clock::time_point now);
+
+        // Accept a BLOCKS reply for the range starting at from. Each block's
+        // hash must already be recomputed by the caller. Returns false if
+        // the peer sent blocks that don't match our headers.
+        bool receive(PeerId peer, int from, std::vector<Block> blocks);
+
+        // Blocks that are next in height order, ready to connect
+        std::vector<Block> takeReady();
+
+        // Number of peers we are downloading from
+        size_t getPeerCount() const { return peers.size(); }
+
+        // Ranges reassigned because a peer stalled
+        size_t getStallCount() const { return stalls; }
+
+    private:
+        struct Range {
+            size_t count;
+            bool inFlight = false;
+            PeerId peer = 0; // Current (or last stalled) owner
+            Clock::time_point sentAt;
+        };
+
+        struct PeerState {
+            size_t inFlight = 0;
+            int maxIndex = INT_MAX; // Highest block this peer has shown it can serve
+            size_t rank = SIZE_MAX; // Lower is preferred (e.g. lower latency)
+        };
+
+        // Put [from, from + count) back in the queue
+        void requeue(int from, size_t count, PeerId lastPeer);
+
+        // Give an in-flight range back to the queue
+        void release(std::map<int, Range>::iterator it);
+
+        size_t rangeSize;
+        size_t maxInFlightPerPeer;
+        size_t windowSize;
+        std::chrono::milliseconds stallTimeout;
+
+        bool active;
+        std::vector<BlockHeader> headers;
+        int firstIndex; // Height of headers[0]
+        int nextToConnect; // Next height takeReady() will release
+        std::map<int, Range> ranges; // Outstanding ranges keyed by first height
+        std::map<int, Block> received; // Bodies waiting for earlier heights
+        std::unordered_map<PeerId, PeerState> peers;
+        size_t stalls;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Tracer.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+
+EventLoop::EventLoop() : quit(false), loopThread(std::thread::id()) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+}
+
+EventLoop::~EventLoop() {
+    for (int fd : timerFds) {
+        close(fd);
+    }
+    close(wakeFd);
+    close(epollFd);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return false;
+    }
+
+    handlers[fd] = std::make_shared<Handler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+}
+
+bool EventLoop::runEvery(std::chrono::milliseconds interval, std::function<void()> task) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    itimerspec spec{};
+    spec.it_interval.tv_sec = interval.count() / 1000;
+    spec.it_interval.tv_nsec = (interval.count() % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(fd, 0, &spec, nullptr);
+
+    timerFds.push_back(fd);
+    return add(fd, EPOLLIN, [fd, task = std::move(task)](uint32_t) {
+        uint64_t expirations;
+        ssize_t drained = read(fd, &expirations, sizeof(expirations));
+        (void)drained;
+        task();
+    });
+}
+
+void EventLoop::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        pendingTasks.push_back(std::move(task));
+    }
+
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written; // Counter overflow just means a wakeup is already pending
+}
+
+void EventLoop::run() {
+    loopThread = std::this_thread::get_id();
+    TRACE_THREAD_NAME("io");
+
+    std::vector<epoll_event> events(256);
+
+    while (!quit) {
+        int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), -1);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR(Net, "epoll_wait failed, event loop exiting").kv("errno", errno);
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == wakeFd) {
+                uint64_t value;
+                ssize_t drained = read(wakeFd, &value, sizeof(value));
+                (void)drained;
+                continue;
+            }
+
+            // Hold a reference so the handler survives removing itself
+            auto it = handlers.find(fd);
+            if (it == handlers.end()) {
+                continue;
+            }
+            std::shared_ptr<Handler> handler = it->second;
+            (*handler)(events[i].events);
+        }
+
+        runPendingTasks();
+
+        // Grow the batch if we filled it
+        if (count == static_cast<int>(events.size())) {
+            events.resize(events.size() * 2);
+        }
+    }
+
+    // Give queued tasks (e.g. final sends) a last chance to run
+    runPendingTasks();
+    loopThread = std::thread::id();
+}
+
+void EventLoop::stop() {
+    quit = true;
+
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+bool EventLoop::isInLoopThread() const {
+    return loopThread.load() == std::this_thread::get_id();
+}
+
+void EventLoop::runPendingTasks() {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        tasks.swap(pendingTasks);
+    }
+
+    for (auto& task : tasks) {
+        task();
+    }
+}
@@ -0,0 +1,72 @@
+// A small epoll reactor.
+//
+// One thread calls run() and from then on owns every registered file
+// descriptor: handlers are always invoked on that thread. Other threads
+// hand work to the loop with post(), which wakes it through an eventfd.
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class EventLoop {
+    public:
+        // Called with the epoll event mask that fired
+        using Handler = std::function<void(uint32_t events)>;
+
+        // Constructor
+        EventLoop();
+
+        // Destructor
+        ~EventLoop();
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        // Register a file descriptor (loop thread or before run())
+        bool add(int fd, uint32_t events, Handler handler);
+
+        // Change the event mask of a registered descriptor
+        bool modify(int fd, uint32_t events);
+
+        // Unregister a descriptor (does not close it)
+        void remove(int fd);
+
+        // Call task on the loop thread every interval (loop thread or before run())
+        bool runEvery(std::chrono::milliseconds interval, std::function<void()> task);
+
+        // Run a task on the loop thread (safe from any thread)
+        void post(std::function<void()> task);
+
+        // Dispatch events until stop() is called (a loop runs only once)
+        void run();
+
+        // Ask run() to return (safe from any thread)
+        void stop();
+
+        // True when called from the thread inside run()
+        bool isInLoopThread() const;
+
+    private:
+        // Run everything queued by post()
+        void runPendingTasks();
+
+        int epollFd;
+        int wakeFd; // eventfd used to interrupt epoll_wait
+        std::atomic<bool> quit; // Set by stop(), checked once per iteration
+        std::atomic<std::thread::id> loopThread;
+        std::unordered_map<int, std::shared_ptr<Handler>> handlers; // Loop thread only
+        std::vector<int> timerFds; // Closed in the destructor
+        std::mutex tasksMutex; // Protects pendingTasks
+        std::vector<std::function<void()>> pendingTasks;
+};
+
+#endif
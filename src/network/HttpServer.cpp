@@ -0,0 +1,190 @@
+#include "HttpServer.h"
+#include "Logger.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const char* reasonPhrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        default: return status < 500 ? "Error" : "Internal Server Error";
+    }
+}
+
+// Write all of data, retrying short writes
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+void sendResponse(int fd, const HttpServer::Response& response) {
+    std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + reasonPhrase(response.status) + "\r\n";
+    head += "Content-Type: " + response.contentType + "\r\n";
+    head += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+    head += "Connection: close\r\n\r\n";
+    sendAll(fd, head + response.body);
+}
+
+// Value of a header (case-insensitive name), "" if absent
+std::string headerValue(const std::string& headers, const std::string& name) {
+    std::string lower = headers;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    size_t pos = lower.find("\r\n" + name + ":");
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += name.size() + 3;
+    size_t end = headers.find("\r\n", pos);
+    std::string value = headers.substr(pos, end - pos);
+    value.erase(0, value.find_first_not_of(' '));
+    return value;
+}
+
+} // namespace
+
+HttpServer::HttpServer(int port, Handler handler)
+    : port(port), handler(std::move(handler)), listenFd(-1), running(false) {
+}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+bool HttpServer::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    // Local tooling only
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0) {
+        LOG_ERROR(Http, "HTTP server failed to bind").kv("port", port).kv("error", strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    running = true;
+    thread = std::thread(&HttpServer::serve, this);
+    return true;
+}
+
+void HttpServer::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    // Wakes the blocking accept()
+    shutdown(listenFd, SHUT_RDWR);
+    if (thread.joinable()) {
+        thread.join();
+    }
+    close(listenFd);
+    listenFd = -1;
+}
+
+void HttpServer::serve() {
+    while (running) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break; // Listener shut down
+        }
+
+        timeval timeout { 2, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        handleConnection(fd);
+        close(fd);
+    }
+}
+
+void HttpServer::handleConnection(int fd) {
+    // 1. Read the request line and headers
+    std::string data;
+    char buffer[4096];
+    size_t headerEnd;
+    while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+        if (data.size() > MAX_REQUEST_SIZE) {
+            sendResponse(fd, { 413, "text/plain; charset=utf-8", "request too large\n" });
+            return;
+        }
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return; // Closed or timed out
+        }
+        data.append(buffer, n);
+    }
+
+    // 2. "METHOD /path?query HTTP/1.1"
+    Request request;
+    size_t lineEnd = data.find("\r\n");
+    std::string line = data.substr(0, lineEnd);
+    size_t space1 = line.find(' ');
+    size_t space2 = line.find(' ', space1 + 1);
+    if (space1 == std::string::npos || space2 == std::string::npos) {
+        sendResponse(fd, { 400, "text/plain; charset=utf-8", "bad request line\n" });
+        return;
+    }
+    request.method = line.substr(0, space1);
+    request.path = line.substr(space1 + 1, space2 - space1 - 1);
+    request.path = request.path.substr(0, request.path.find('?'));
+
+    // 3. Body, if any
+    std::string headers = data.substr(lineEnd, headerEnd - lineEnd + 2);
+    size_t contentLength = std::strtoul(headerValue(headers, "content-length").c_str(), nullptr, 10);
+    if (contentLength > MAX_REQUEST_SIZE) {
+        sendResponse(fd, { 413, "text/plain; charset=utf-8", "request too large\n" });
+        return;
+    }
+
+    request.body = data.substr(headerEnd + 4);
+    while (request.body.size() < contentLength) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        request.body.append(buffer, n);
+    }
+    request.body.resize(contentLength);
+
+    // 4. Answer
+    sendResponse(fd, handler(request));
+}
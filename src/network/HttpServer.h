@@ -0,0 +1,70 @@
+// A minimal HTTP/1.1 server for local tooling (metrics scrapes and the like).
+//
+// Binds to 127.0.0.1 only and serves one connection at a time on its own
+// thread, closing each connection after the response. Requests are read
+// up to MAX_REQUEST_SIZE with a short receive timeout, so a stuck client
+// can't hold the server for long. It is not meant to face the internet.
+
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <thread>
+
+class HttpServer {
+    public:
+        // A parsed request
+        struct Request {
+            std::string method; // "GET", "POST", ...
+            std::string path; // Without the query string
+            std::string body;
+        };
+
+        // What to send back
+        struct Response {
+            int status = 200;
+            std::string contentType = "text/plain; charset=utf-8";
+            std::string body;
+        };
+
+        using Handler = std::function<Response(const Request& request)>;
+
+        // Largest request (headers + body) we read
+        static constexpr size_t MAX_REQUEST_SIZE = 1024 * 1024;
+
+        // Constructor
+        HttpServer(int port, Handler handler);
+
+        // Destructor (stops the server)
+        ~HttpServer();
+
+        HttpServer(const HttpServer&) = delete;
+        HttpServer& operator=(const HttpServer&) = delete;
+
+        // Bind and start serving; false if the port is unavailable
+        bool start();
+
+        // Stop accepting and join the thread
+        void stop();
+
+        // Port we listen on
+        int getPort() const { return port; }
+
+    private:
+        // Accept loop (server thread)
+        void serve();
+
+        // Read one request, answer it and close the socket
+        void handleConnection(int fd);
+
+        int port;
+        Handler handler;
+        int listenFd;
+        std::atomic<bool> running;
+        std::thread thread;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "MessageTrace.h"
+#include <algorithm>
+
+namespace {
+    const char MAGIC[] = "BCTRACE1";
+    const size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+    // Nothing bigger than a framed message is ever recorded
+    const uint64_t MAX_PAYLOAD = 64 * 1024 * 1024;
+
+    // Unsigned LEB128: 7 bits per byte, high bit set on all but the last
+    void writeVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+}
+
+TraceWriter::TraceWriter() : recording(false), lastMicros(0), records(0) {
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceWriter::open(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file.is_open()) {
+        file.close();
+    }
+
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        recording = false;
+        return false;
+    }
+
+    file.write(MAGIC, MAGIC_SIZE);
+    start = Clock::now();
+    lastMicros = 0;
+    records = 0;
+    recording = true;
+    return true;
+}
+
+void TraceWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    recording = false;
+    if (file.is_open()) {
+        file.close();
+    }
+}
+
+void TraceWriter::record(TraceRecord::Kind kind, PeerId peer, const std::string& payload) {
+    // Encode outside the lock; only the timestamp needs it
+    std::string header;
+    header.reserve(32);
+    header += static_cast<char>(kind);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) {
+        return;
+    }
+
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    micros = std::max(micros, lastMicros);
+    writeVarint(header, micros - lastMicros);
+    writeVarint(header, peer);
+    writeVarint(header, payload.size());
+    lastMicros = micros;
+
+    file.write(header.data(), header.size());
+    file.write(payload.data(), payload.size());
+    records++;
+}
+
+uint64_t TraceWriter::getRecordCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return records;
+}
+
+bool TraceReader::open(const std::string& filename) {
+    file.open(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char magic[MAGIC_SIZE];
+    if (!file.read(magic, MAGIC_SIZE) || std::string(magic, MAGIC_SIZE) != MAGIC) {
+        file.close();
+        return false;
+    }
+    micros = 0;
+    return true;
+}
+
+bool TraceReader::next(TraceRecord& record) {
+    char kind;
+    if (!file.get(kind) || static_cast<uint8_t>(kind) > TraceRecord::DISCONNECT) {
+        return false;
+    }
+
+    uint64_t delta, peer, length;
+    if (!readVarint(delta) || !readVarint(peer) || !readVarint(length) || length > MAX_PAYLOAD) {
+        return false;
+    }
+
+    record.kind = static_cast<TraceRecord::Kind>(kind);
+    micros += delta;
+    record.micros = micros;
+    record.peer = peer;
+    record.payload.resize(length);
+    return length == 0 || static_cast<bool>(file.read(&record.payload[0], length));
+}
+
+bool TraceReader::readVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        char c;
+        if (!file.get(c)) {
+            return false;
+        }
+        uint8_t byte = static_cast<uint8_t>(c);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false; // Longer than any uint64
+}
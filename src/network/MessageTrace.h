@@ -0,0 +1,92 @@
+// Records peer traffic to a file and reads it back.
+//
+// A trace is everything a node received, in arrival order: each complete
+// message with the peer it came from and when it arrived, plus the
+// connects and disconnects in between, so a replay can set up the same
+// peers. Feeding a trace into a fresh Node (Node::replayTrace) reproduces
+// the processing of real traffic without any sockets.
+//
+// File layout: the magic "BCTRACE1", then one record after another:
+//   kind (1 byte), microseconds since the previous record, peer id and
+//   payload length (unsigned LEB128 varints), then the payload bytes.
+// A message's payload is the message without its newline; a connect's is
+// "host port inbound"; a disconnect has none.
+//
+// TraceWriter is thread-safe. TraceReader is not.
+
+#ifndef MESSAGETRACE_H
+#define MESSAGETRACE_H
+
+#include "PeerId.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+// One entry in a trace
+struct TraceRecord {
+    enum Kind : uint8_t {
+        MESSAGE = 0,
+        CONNECT = 1,
+        DISCONNECT = 2
+    };
+
+    Kind kind = MESSAGE;
+    uint64_t micros = 0; // Since the first record
+    PeerId peer = 0;
+    std::string payload;
+};
+
+class TraceWriter {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // Constructor
+        TraceWriter();
+
+        // Destructor (closes the file)
+        ~TraceWriter();
+
+        // Start a new trace, replacing any file at this path
+        bool open(const std::string& filename);
+
+        // Flush and close; a no-op if not recording
+        void close();
+
+        // Are records being written? (cheap; checked on every message)
+        bool isOpen() const { return recording.load(std::memory_order_relaxed); }
+
+        // Append one record stamped with the current time
+        void record(TraceRecord::Kind kind, PeerId peer, const std::string& payload);
+
+        // Records written since open()
+        uint64_t getRecordCount() const;
+
+    private:
+        std::ofstream file;
+        std::atomic<bool> recording;
+        Clock::time_point start; // Time of open()
+        uint64_t lastMicros; // Timestamp of the previous record
+        uint64_t records;
+        mutable std::mutex mutex; // Protects everything above except recording
+};
+
+class TraceReader {
+    public:
+        // Open a trace; false if missing or not a trace
+        bool open(const std::string& filename);
+
+        // Read the next record; false at the end or on a truncated record
+        bool next(TraceRecord& record);
+
+    private:
+        // Read one varint from the file
+        bool readVarint(uint64_t& value);
+
+        std::ifstream file;
+        uint64_t micros = 0; // Running timestamp
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "Miner.h"
+#include "BlockTemplate.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Node.h"
+#include "Target.h"
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+
+Miner::Miner(Node& node) : node(node), running(false), blocksMined(0) {
+}
+
+Miner::~Miner() {
+    stop();
+}
+
+void Miner::start(unsigned count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return;
+    }
+    count = std::max(count, 1u);
+    node.getBlockchain().setMinerThreads(count);
+    running = true;
+    for (unsigned k = 0; k < count; k++) {
+        threads.emplace_back(&Miner::run, this, k, count);
+    }
+    LOG_INFO(Mining, "Miner started").kv("threads", count);
+}
+
+void Miner::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    LOG_INFO(Mining, "Miner stopped").kv("blocks", blocksMined.load());
+}
+
+bool Miner::idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    wake.wait_for(lock, IDLE_POLL, [this]() { return !running; });
+    return running;
+}
+
+void Miner::run(unsigned k, unsigned count) {
+    static Counter& hashCounter = Metrics::instance().counter("blockchain_hashes_total", "Block hashes computed while mining");
+    static Counter& swaps = Metrics::instance().counter("miner_template_swaps_total", "Times a miner thread moved to a newer block template");
+
+    BlockTemplate& blockTemplate = node.getBlockTemplate();
+    std::shared_ptr<const BlockTemplate::Work> work;
+    BlockHeader header; // Work's header with our nonce
+    TargetBytes target;
+    std::string buffer; // Reused for every attempt
+    std::string hash;
+
+    while (running) {
+        if (!work || !blockTemplate.isCurrent(*work)) {
+            if (work) {
+                swaps.inc();
+            }
+            work = blockTemplate.current();
+            if (!work || work->transactions.size() <= 1 || !expandBits(work->header.bits, target)) {
+                work.reset();
+                if (!idle()) {
+                    break;
+                }
+                continue;
+            }
+            header = work->header;
+            header.nonce = k;
+        }
+
+        // One batch on this template
+        int tried = 0;
+        bool found = false;
+        for (; tried < NONCE_BATCH; tried++) {
+            header.calculateHash(buffer, hash);
+            if (hashBelowTarget(hash, target)) {
+                found = true;
+                break;
+            }
+            if (header.nonce > UINT32_MAX - count) {
+                // Every nonce tried at this timestamp: a later one is a fresh
+                // search, and still past the template's nextMinTimestamp()
+                header.timestamp = std::max(header.timestamp + 1, std::time(nullptr));
+                header.nonce = k;
+            } else {
+                header.nonce += count;
+            }
+        }
+        hashCounter.inc(tried + (found ? 1 : 0));
+
+        if (found) {
+            header.hash = hash;
+            if (node.submitMinedBlock(work->toBlock(header))) {
+                blocksMined++;
+            }
+            work.reset();
+        }
+    }
+}
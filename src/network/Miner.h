@@ -0,0 +1,70 @@
+// Background mining for daemon mode.
+//
+// Each miner thread searches nonces on the node's block template (see
+// BlockTemplate.h), which the mempool and the chain keep current, so no
+// block is assembled or validated here. Thread k of n tries nonces k,
+// k + n, ... and after every NONCE_BATCH of them checks whether the
+// template has moved on (a transaction came or went, or the tip changed);
+// if so it takes the new one and starts its nonces over without stopping.
+// A thread that runs out of nonces moves its header's timestamp on a
+// second (or to the clock, if that is later) and starts them over.
+// A hit goes to Node::submitMinedBlock(), which connects and relays it.
+//
+// While the template holds nothing but the reward the threads wait rather
+// than mine empty blocks. stop() returns within one nonce batch.
+
+#ifndef MINER_H
+#define MINER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Node;
+
+class Miner {
+    public:
+        // How often an idle miner checks the block template
+        static constexpr std::chrono::milliseconds IDLE_POLL { 100 };
+
+        // Nonces tried between checks for a newer template
+        static constexpr int NONCE_BATCH = 10000;
+
+        // Constructor
+        explicit Miner(Node& node);
+
+        // Destructor (stops mining)
+        ~Miner();
+
+        Miner(const Miner&) = delete;
+        Miner& operator=(const Miner&) = delete;
+
+        // Start mining on this many threads
+        void start(unsigned count);
+
+        // Stop and join
+        void stop();
+
+        // Blocks mined since start()
+        uint64_t getBlocksMined() const { return blocksMined; }
+
+    private:
+        // Search loop of thread k of count (miner thread)
+        void run(unsigned k, unsigned count);
+
+        // Wait up to IDLE_POLL or until stop(); false once stopped
+        bool idle();
+
+        Node& node;
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake; // Signalled by stop()
+        std::atomic<bool> running;
+        std::atomic<uint64_t> blocksMined;
+};
+
+#endif
@@ -1,13 +1,154 @@
 #include "Node.h"
+#include "Hash.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Signature.h"
+#include "Target.h"
+#include "Tracer.h"
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include <iostream>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <future>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Node metrics shared by every Node in the process
+struct NodeMetrics {
+    Counter& messagesReceived;
+    Histogram& handleSeconds;
+    Counter& blocksReceived;
+    Counter& blocksRejected;
+    Histogram& validationSeconds;
+    Counter& txAccepted;
+    Counter& txRejectedInvalid;
+    Counter& txRejectedBalance;
+    Counter& txRejectedSignature;
+    Counter& txRejectedDuplicate;
+    Counter& txRejectedFull;
+};
+
+NodeMetrics& nodeMetrics() {
+    Metrics& registry = Metrics::instance();
+    static NodeMetrics metrics {
+        registry.counter("node_messages_received_total", "Peer messages handled"),
+        registry.histogram("node_message_handle_seconds", "Time to parse and handle one peer message"),
+        registry.counter("node_blocks_received_total", "Blocks from peers added to our chain"),
+        registry.counter("node_blocks_rejected_total", "Blocks or chains from peers that failed validation"),
+        registry.histogram("block_validation_seconds", "Time to validate a block or chain from a peer"),
+        registry.counter("node_tx_accepted_total", "Transactions added to the mempool"),
+        registry.counter("node_tx_rejected_invalid_total", "Transactions rejected as coin creation or a non-positive amount"),
+        registry.counter("node_tx_rejected_balance_total", "Transactions rejected for insufficient balance"),
+        registry.counter("node_tx_rejected_signature_total", "Transactions rejected for a missing or bad signature"),
+        registry.counter("node_tx_rejected_duplicate_total", "Transactions rejected as already in the mempool"),
+        registry.counter("node_tx_rejected_mempool_full_total", "Transactions rejected because the mempool was full"),
+    };
+    return metrics;
+}
+
+// Take the chain lock, tracing how long we waited for it
+void lockChain(std::mutex& chainMutex) {
+    TRACE_SPAN("chainMutex wait");
+    chainMutex.lock();
+}
+
+// Value of the "type" field; every message we send leads with it
+std::string messageType(const std::string& message) {
+    const std::string pattern = "\"type\":\"";
+    size_t pos = message.find(pattern);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += pattern.size();
+    size_t end = message.find('"', pos);
+    return message.substr(pos, end - pos);
+}
+
+// Integer value of a numeric field (-1 if absent)
+long extractNumber(std::string_view message, std::string_view key) {
+    long value = -1;
+    jsonNumber(message, key, value);
+    return value;
+}
+
+// The string value of "key":"..." ("" if absent)
+std::string extractString(std::string_view message, std::string_view key) {
+    return std::string(jsonString(message, key));
+}
+
+// Top-level objects of the array that follows "key":[, as views into message
+std::pmr::vector<std::string_view> extractObjects(std::string_view message, std::string_view key) {
+    std::pmr::vector<std::string_view> objects;
+    jsonObjects(message, key, objects);
+    return objects;
+}
+
+// The object that follows "key":{, as a view into message ("" if absent)
+std::string_view extractObject(std::string_view message, std::string_view key) {
+    return jsonObject(message, key);
+}
+
+// Strings of the array that follows "key":[ (none if it is malformed)
+std::vector<std::string> extractStrings(std::string_view message, std::string_view key) {
+    std::vector<std::string_view> views;
+    if (!jsonStrings(message, key, views)) {
+        return {};
+    }
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+// Short transaction ID for compact blocks: 6 bytes of a hash keyed by the
+// block, so nobody can precompute colliding transactions
+std::string shortTxId(const std::string& blockHash, const std::string& txid) {
+    return sha256Hex(blockHash + txid).substr(0, 12);
+}
+
+// Serialize a list of indexes as a JSON array
+std::string toJSONArray(const std::vector<size_t>& values) {
+    std::string json = "[";
+    for (size_t i = 0; i < values.size(); i++) {
+        json += std::to_string(values[i]);
+        if (i < values.size() - 1) {
+            json += ",";
+        }
+    }
+    json += "]";
+    return json;
+}
 
-Node::Node(int port, int difficulty, double miningReward)
-    : blockchain(difficulty, miningReward), port(port), running(false) {
+// Serialize a list of strings as a JSON array
+std::string toJSONArray(const std::vector<std::string>& strings) {
+    std::string json = "[";
+    for (size_t i = 0; i < strings.size(); i++) {
+        json += "\"" + strings[i] + "\"";
+        if (i < strings.size() - 1) {
+            json += ",";
+        }
+    }
+    json += "]";
+    return json;
+}
+
+} // namespace
+
+Node::Node(int port, int difficulty, double miningReward, size_t workerThreads)
+    : blockchain(difficulty, miningReward), port(port), workers(workerThreads, 1024),
+      nextPeerId(1), peerCount(0),
+      downloader(BLOCKS_PER_REQUEST, MAX_BLOCK_REQUESTS_PER_PEER, DOWNLOAD_WINDOW, SYNC_STALL_TIMEOUT),
+      blockTemplate(blockchain, mempool), bytesSent(0), bytesReceived(0), running(false), replaying(false) {
     serverSocket = -1;
 }
 
@@ -19,343 +160,2466 @@ Blockchain& Node::getBlockchain() {
     return blockchain;
 }
 
-void Node::start() {
-    // 1. Create a socket (like in simple_server)
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+bool Node::start() {
+    // 1. Create a non-blocking socket
+    serverSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
     // Allow port reuse (for testing)
     int opt = 1;
     setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
-    // 2. Setup address and bind (like in simple_server)
+    // 2. Setup address and bind
     sockaddr_in serverAddr;
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_port = htons(port);
     serverAddr.sin_addr.s_addr = INADDR_ANY;
-    bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr));
-
-    // 3. Start listening
-    listen(serverSocket, 5);
-    std::cout << "Node listening on port " << port << "..." << std::endl;
+    if (bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0 || listen(serverSocket, SOMAXCONN) < 0) {
+        LOG_ERROR(Net, "Failed to bind port").kv("port", port).kv("error", strerror(errno));
+        close(serverSocket);
+        serverSocket = -1;
+        return false;
+    }
 
-    // 4. Set running flag
+    // 3. Set running flag
     running = true;
 
-    // 5. Launch background thread
-    listenerThread = std::thread(&Node::listenForConnections, this);
-    
-    std::cout << "Node started on port " << port << std::endl;
+    // Pick up the peers we knew last time; maintainPeers() dials them
+    if (!addressBookFile.empty() && peers.loadAddresses(addressBookFile)) {
+        LOG_INFO(Peers, "Loaded address book").kv("addresses", peers.getAddressCount()).kv("file", addressBookFile);
+    }
+
+    // 4. Register the listener and launch the I/O thread
+    loop.add(serverSocket, EPOLLIN, [this](uint32_t) { acceptConnections(); });
+    loop.runEvery(std::chrono::milliseconds(1000), [this]() {
+        checkSendQueues();
+        expireDials();
+        // Skip a tick rather than stall the loop behind a busy worker
+        workers.trySubmit([this]() {
+            maintainPeers();
+            onSyncTick();
+            expireRelayRequests();
+        });
+    });
+    loop.runEvery(WORKER_RETRY_INTERVAL, [this]() { resumeReads(); });
+    ioThread = std::thread(&EventLoop::run, &loop);
+
+    LOG_INFO(Net, "Node started").kv("port", port);
+    return true;
 }
 
-void Node::listenForConnections() {
+void Node::acceptConnections() {
     while (running) {
-        // Accept a connection (this blocks until someone connects)
-        int peerSocket = accept(serverSocket, nullptr, nullptr);
+        sockaddr_in peerAddr;
+        socklen_t addrLen = sizeof(peerAddr);
+        int peerSocket = accept4(serverSocket, (sockaddr*)&peerAddr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
 
         if (peerSocket < 0) {
+            // EAGAIN means the backlog is drained; anything else is transient
+            break;
+        }
+
+        char host[INET_ADDRSTRLEN] = "";
+        inet_ntop(AF_INET, &peerAddr.sin_addr, host, sizeof(host));
+
+        if (peers.isBanned(host) || !peers.canAcceptInbound()) {
+            LOG_RATE_LIMITED(Info, Peers, 10, "Refused peer (banned or inbound slots full)").kv("host", host);
+            close(peerSocket);
             continue;
         }
 
-        std::cout << "Peer connected!" << std::endl;
+        PeerId peer = nextPeerId++;
+        LOG_INFO(Net, "Peer connected").kv("peer", peer).kv("host", host).kv("inbound", true);
+
+        addConnection(peerSocket, peer, host, ntohs(peerAddr.sin_port), true);
+    }
+}
+
+void Node::addConnection(int fd, PeerId peer, const std::string& host, int remotePort, bool inbound) {
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    Connection conn;
+    conn.id = peer;
+    conn.fd = fd;
 
-        // Add to our list of peers
-        peerSockets.push_back(peerSocket);
+    if (!loop.add(fd, EPOLLIN | EPOLLRDHUP, [this, peer](uint32_t events) { onPeerEvent(peer, events); })) {
+        close(fd);
+        return;
+    }
+
+    connections.emplace(peer, std::move(conn));
+    fdToPeer[fd] = peer;
+    peerCount = connections.size();
+    peers.addPeer(peer, host, remotePort, inbound);
 
-        // Handle this peer in another thread
-        std::thread(&Node::handlePeer, this, peerSocket).detach();
+    if (trace.isOpen()) {
+        trace.record(TraceRecord::CONNECT, peer, host + " " + std::to_string(remotePort) + " " + (inbound ? "1" : "0"));
     }
+
+    workers.push(peer, [this, peer]() { peerConnected(peer); });
 }
 
 void Node::stop() {
-    running = false;
+    if (!running.exchange(false)) {
+        return; // Never started or already stopped
+    }
+
+    // Stop the I/O thread first so no new work is produced
+    loop.stop();
+    if (ioThread.joinable()) {
+        ioThread.join();
+    }
+
+    // Let in-flight messages finish
+    workers.shutdown();
 
     // Close server socket
     if (serverSocket >= 0) {
         close(serverSocket);
+        serverSocket = -1;
+    }
+
+    // Close all peer connections (the I/O thread is gone, so this is safe)
+    for (auto& entry : connections) {
+        close(entry.second.fd);
+    }
+    connections.clear();
+    fdToPeer.clear();
+    peerCount = 0;
+    for (auto& entry : dials) {
+        close(entry.first);
+        peers.releaseOutbound();
     }
+    dials.clear();
 
-    // Close all peer connections
-    for (int sock : peerSockets) {
-        close(sock);
+    if (!addressBookFile.empty()) {
+        peers.saveAddresses(addressBookFile);
     }
+    trace.close();
 
-    // Wait for listener thread to finish
-    if (listenerThread.joinable()) {
-        listenerThread.join();
+    if (metricsServer) {
+        metricsServer->stop();
+        metricsServer.reset();
+    }
+    if (rpcServer) {
+        rpcServer->stop();
+        rpcServer.reset();
     }
 
-    std::cout << "Node stopped" << std::endl;
+    LOG_INFO(Net, "Node stopped").kv("port", port);
 }
 
 bool Node::connectToPeer(const std::string& address, int port) {
-    // 1. Create socket
-    int peerSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (peers.isBanned(address)) {
+        LOG_INFO(Peers, "Not connecting to banned peer").kv("host", address);
+        return false;
+    }
+    // Held until the dial ends, so concurrent dials can't overshoot the limit
+    if (!peers.reserveOutbound()) {
+        LOG_DEBUG(Peers, "Outbound peer limit reached").kv("host", address).kv("port", port);
+        return false;
+    }
 
-    // 2. Setup peer address
+    // 1. Setup peer address
     sockaddr_in peerAddr;
     peerAddr.sin_family = AF_INET;
     peerAddr.sin_port = htons(port);
 
     // Convert address string to binary
     if (inet_pton(AF_INET, address.c_str(), &peerAddr.sin_addr) <= 0) {
-        std::cout << "Invalid address: " << address << std::endl;
+        LOG_WARN(Net, "Invalid address").kv("host", address);
+        peers.releaseOutbound();
         return false;
     }
 
-    // 3. Connect to peer
-    if (connect(peerSocket, (sockaddr*)&peerAddr, sizeof(peerAddr)) < 0) {
-        std::cout << "Connection to peer failed: " << address << ":" << port << std::endl;
+    // 2. Start connecting without waiting for the handshake
+    int peerSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (peerSocket < 0 || (connect(peerSocket, (sockaddr*)&peerAddr, sizeof(peerAddr)) < 0 && errno != EINPROGRESS)) {
+        LOG_INFO(Net, "Connection to peer failed").kv("host", address).kv("port", port).kv("error", strerror(errno));
+        if (peerSocket >= 0) {
+            close(peerSocket);
+        }
+        peers.connectFailed(address, port, std::chrono::steady_clock::now());
+        peers.releaseOutbound();
         return false;
     }
 
-    std::cout << "Connected to peer: " << address << ":" << port << std::endl;
+    // 3. The I/O thread finishes it once the socket turns writable
+    loop.post([this, peerSocket, address, port]() { addDial(peerSocket, address, port); });
+    return true;
+}
 
-    // 4. Add to peer list
-    peerSockets.push_back(peerSocket);
+void Node::addDial(int fd, const std::string& host, int remotePort) {
+    dials[fd] = Dial { host, remotePort, std::chrono::steady_clock::now() + CONNECT_TIMEOUT };
+    if (!loop.add(fd, EPOLLOUT, [this, fd](uint32_t) { finishDial(fd); })) {
+        abandonDial(fd, "Couldn't watch dial");
+    }
+}
 
-    // 5. Handle this peer in another thread
-    std::thread(&Node::handlePeer, this, peerSocket).detach();
+void Node::finishDial(int fd) {
+    auto it = dials.find(fd);
+    if (it == dials.end()) {
+        return;
+    }
 
-    // 6. Sync chains immediately
-    syncWithPeer(peerSocket);
+    // Writable means the handshake ended; SO_ERROR says how
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        abandonDial(fd, "Connection to peer failed");
+        return;
+    }
 
-    return true;
+    Dial dial = std::move(it->second);
+    dials.erase(it);
+    loop.remove(fd);
+    peers.connectSucceeded(dial.host, dial.port);
+
+    PeerId peer = nextPeerId++;
+    LOG_INFO(Net, "Connected to peer").kv("peer", peer).kv("host", dial.host).kv("port", dial.port);
+    addConnection(fd, peer, dial.host, dial.port, false);
+    peers.releaseOutbound(); // addPeer() counts it now
+
+    // Sync chains immediately (queued behind peerConnected)
+    workers.push(peer, [this, peer]() { syncWithPeer(peer); });
 }
 
-void Node::handlePeer(int peerSocket) {
-    char buffer[4096];
+void Node::expireDials() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<int> expired;
+    for (const auto& entry : dials) {
+        if (now >= entry.second.deadline) {
+            expired.push_back(entry.first);
+        }
+    }
+    for (int fd : expired) {
+        abandonDial(fd, "Connection to peer timed out");
+    }
+}
 
-    while (running) {
-        // Clear buffer
-        memset(buffer, 0, sizeof(buffer));
+void Node::abandonDial(int fd, const char* reason) {
+    auto it = dials.find(fd);
+    if (it == dials.end()) {
+        return;
+    }
+    LOG_INFO(Net, reason).kv("host", it->second.host).kv("port", it->second.port);
+    loop.remove(fd);
+    close(fd);
+    peers.connectFailed(it->second.host, it->second.port, std::chrono::steady_clock::now());
+    peers.releaseOutbound();
+    dials.erase(it);
+}
 
-        // Receive message
-        int bytesRead = recv(peerSocket, buffer, sizeof(buffer) - 1, 0);
+void Node::onPeerEvent(PeerId peer, uint32_t events) {
+    auto it = connections.find(peer);
+    if (it == connections.end()) {
+        return;
+    }
+    Connection& conn = it->second;
+
+    bool hangup = events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+    if (((events & EPOLLIN) && !conn.workersFull) || hangup) {
+        if (!readFromPeer(conn, hangup)) {
+            LOG_INFO(Net, "Peer disconnected").kv("peer", peer);
+            closeConnection(peer);
+            return;
+        }
+    }
 
-        if (bytesRead <= 0) {
-            // Peer disconnected
-            std::cout << "Peer disconnected" << std::endl;
-            close(peerSocket);
-            
-            // Remove from peerSockets vector
-            for (size_t i = 0; i < peerSockets.size(); i++) {
-                if (peerSockets[i] == peerSocket) {
-                    peerSockets.erase(peerSockets.begin() + i);
-                    break;
-                }
-            }
-    
-            break;
+    if (events & EPOLLOUT) {
+        if (!flushPeer(conn)) {
+            closeConnection(peer);
         }
+    }
+}
+
+bool Node::readFromPeer(Connection& conn, bool hangup) {
+    TRACE_SPAN("recv");
+    char buffer[16384];
 
-        std::string message(buffer);
-        std::cout << "Received: " << message << std::endl;
+    while (!conn.workersFull || hangup) {
+        ssize_t bytesRead = recv(conn.fd, buffer, sizeof(buffer), 0);
 
-        // Parse message type
-        // Simple parsing: look for "type":"XXX"
+        if (bytesRead > 0) {
+            conn.inbound.append(buffer, bytesRead);
+            bytesReceived.fetch_add(bytesRead, std::memory_order_relaxed);
+            dispatchMessages(conn);
 
-        if (message.find("\"type\":\"GET_CHAIN\"") != std::string::npos) {
-            // Peer wants our chain
-            sendChain(peerSocket);
+            // Checked as it arrives, so an endless message is never buffered
+            // whole; what is left is a partial message plus, while the
+            // worker is backlogged, the messages waiting for it
+            if (conn.inbound.size() > MAX_MESSAGE_SIZE) {
+                LOG_WARN(Net, "Peer sent an oversized message, disconnecting").kv("peer", conn.id).kv("bytes", conn.inbound.size());
+                return false;
+            }
+            continue;
         }
-        else if (message.find("\"type\":\"CHAIN\"") != std::string::npos) {
-            // Peer sent us their chain
-            receiveChain(message, peerSocket);
+        if (bytesRead == 0) {
+            return false; // Orderly shutdown by peer
         }
-        else if (message.find("\"type\":\"NEW_BLOCK\"") != std::string::npos) {
-            // Peer mined a new block
-            receiveBlock(message);
+        if (errno == EINTR) {
+            continue;
         }
-        else if (message.find("\"type\":\"GET_LENGTH\"") != std::string::npos) {
-            // Peer wants to know our chain length
-            sendLength(peerSocket);
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
         }
-        else if (message.find("\"type\":\"LENGTH\"") != std::string::npos) {
-            // Extract the length value from JSON
-            size_t pos = message.find("\"value\":") + 8;
-            size_t end = message.find_first_of(",}", pos);
-            int peerLength = std::stoi(message.substr(pos, end - pos));
-            
-            std::cout << "Peer has chain length: " << peerLength << std::endl;
-            
-            // Compare to our chain length
-            chainMutex.lock();
-            int ourLength = blockchain.getChain().size();
-            chainMutex.unlock();
-            
-            std::cout << "Our chain length: " << ourLength << std::endl;
-            
-            // If their chain is longer, request it
-            if (peerLength > ourLength) {
-                std::cout << "Peer has longer chain! Requesting..." << std::endl;
-                std::string request = "{\"type\":\"GET_CHAIN\"}";
-                send(peerSocket, request.c_str(), request.length(), 0);
+        return false;
+    }
+
+    return true;
+}
+
+void Node::dispatchMessages(Connection& conn) {
+    // Messages are newline-delimited; only bytes not searched yet are
+    size_t start = 0;
+    size_t newline;
+    while (!conn.workersFull && (newline = conn.inbound.find('\n', std::max(start, conn.scanned))) != std::string::npos) {
+        if (newline > start) {
+            PeerId peer = conn.id;
+            std::string message = conn.inbound.substr(start, newline - start);
+            std::string traced = trace.isOpen() ? message : std::string(); // Recorded once it is queued
+            if (!workers.trySubmit(peer, [this, peer, message = std::move(message)]() { handlePeerMessage(peer, message); })) {
+                // Leave it and the rest in inbound until the worker catches up
+                conn.workersFull = true;
+                LOG_RATE_LIMITED(Debug, Net, 10, "Worker queue full, pausing reads").kv("peer", peer);
+                updateInterest(conn);
+                break;
+            }
+            if (!traced.empty()) {
+                trace.record(TraceRecord::MESSAGE, peer, traced);
             }
         }
+        start = newline + 1;
     }
+    conn.inbound.erase(0, start);
+    conn.scanned = conn.workersFull ? 0 : conn.inbound.size();
 }
 
-void Node::sendChain(int peerSocket) {
-    chainMutex.lock();
+void Node::resumeReads() {
+    for (auto& entry : connections) {
+        Connection& conn = entry.second;
+        if (!conn.workersFull) {
+            continue;
+        }
+        conn.workersFull = false;
+        dispatchMessages(conn);
+        if (!conn.workersFull) {
+            updateInterest(conn); // Bytes still waiting in the socket fire EPOLLIN again
+        }
+    }
+}
+
+bool Node::flushPeer(Connection& conn) {
+    TRACE_SPAN("send");
+    conn.flushScheduled = false;
+
+    while (true) {
+        pumpStream(conn);
+        if (conn.sendQueue.empty()) {
+            break;
+        }
 
-    // Serialize blockchain to JSON
-    std::string chainJson = blockchain.toJSON();
+        // Gather as many queued frames as one call takes
+        iovec iov[MAX_WRITE_BATCH];
+        int count = 0;
+        for (auto it = conn.sendQueue.begin(); it != conn.sendQueue.end() && count < MAX_WRITE_BATCH; ++it) {
+            size_t skip = (count == 0) ? conn.sendOffset : 0;
+            iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+            iov[count].iov_len = (*it)->size() - skip;
+            count++;
+        }
 
-    // Create message
-    std::string message = "{\"type\":\"CHAIN\",\"data\":" + chainJson + "}";
+        // sendmsg is writev plus MSG_NOSIGNAL, so a dead peer can't SIGPIPE us
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
 
-    chainMutex.unlock();
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
 
-    // Send
-    send(peerSocket, message.c_str(), message.length(), 0);
+        bytesSent.fetch_add(n, std::memory_order_relaxed);
+        conn.queuedBytes -= n;
+
+        // Release every frame that went out completely
+        size_t left = n;
+        while (left > 0) {
+            size_t remaining = conn.sendQueue.front()->size() - conn.sendOffset;
+            if (left >= remaining) {
+                left -= remaining;
+                conn.sendQueue.pop_front();
+                conn.sendOffset = 0;
+            } else {
+                conn.sendOffset += left;
+                left = 0;
+            }
+        }
+    }
+
+    updateInterest(conn);
+    return true;
 }
 
+bool Node::queueFrame(Connection& conn, const MessageBuffer& frame) {
+    // Nothing may overtake a stream in progress
+    if (conn.stream || !conn.backlog.empty()) {
+        conn.backlog.emplace_back(frame, nullptr);
+    } else {
+        conn.sendQueue.push_back(frame);
+    }
+    conn.queuedBytes += frame->size();
 
-void Node::receiveChain(const std::string& message, int peerSocket) {
-    // Parse chain JSON to Blockchain object
-    size_t pos = message.find("\"data\":") + 7;
-    size_t end = message.find_last_of("}");
-    std::string chainJson = message.substr(pos, end - pos);
+    if (conn.queuedBytes > MAX_SEND_QUEUE) {
+        LOG_WARN(Net, "Peer send queue overflowed, disconnecting").kv("peer", conn.id).kv("queued", conn.queuedBytes);
+        return false;
+    }
 
-    std::vector<Block> loadedBlocks;
-    size_t blockStart = 0;
-    int braceCount = 0;
+    scheduleFlush(conn);
+    updateInterest(conn);
+    return true;
+}
 
-    for (size_t i = 0; i < chainJson.length(); i++) {
-        char c = chainJson[i];
+void Node::queueStream(Connection& conn, ChunkSource source) {
+    if (conn.stream || !conn.backlog.empty()) {
+        conn.backlog.emplace_back(nullptr, std::move(source));
+    } else {
+        conn.stream = std::move(source);
+    }
 
-        if (c == '{') {
-            if (braceCount == 0) {
-                blockStart = i;
-            }
-            braceCount++;
+    scheduleFlush(conn);
+    updateInterest(conn);
+}
+
+void Node::pumpStream(Connection& conn) {
+    while (conn.stream) {
+        size_t unsent = 0;
+        for (const MessageBuffer& frame : conn.sendQueue) {
+            unsent += frame->size();
+        }
+        if (unsent - conn.sendOffset >= STREAM_CHUNK_SIZE) {
+            return; // Enough to keep the socket busy
         }
-        else if (c == '}') {
-            braceCount--;
 
-            if (braceCount == 0) {
-                std::string blockJson = chainJson.substr(blockStart, i - blockStart + 1);
+        std::string chunk;
+        chunk.reserve(STREAM_CHUNK_SIZE + STREAM_CHUNK_SIZE / 4);
+        bool more = conn.stream(chunk);
+        if (!chunk.empty()) {
+            conn.queuedBytes += chunk.size();
+            conn.sendQueue.push_back(std::make_shared<const std::string>(std::move(chunk)));
+        }
+        if (more) {
+            continue;
+        }
 
-                Block block = Block::fromJSON(blockJson);
-                loadedBlocks.push_back(block);
+        // Done; release what queued up behind it, up to the next stream
+        conn.stream = nullptr;
+        while (!conn.stream && !conn.backlog.empty()) {
+            auto& next = conn.backlog.front();
+            if (next.first) {
+                conn.sendQueue.push_back(std::move(next.first)); // Already in queuedBytes
+            } else {
+                conn.stream = std::move(next.second);
             }
+            conn.backlog.pop_front();
         }
     }
+}
 
-    // Check if loaded chain is longer and valid
-    chainMutex.lock();
-    if (loadedBlocks.size() > blockchain.getChain().size()) {
-        if (blockchain.isValidChain(loadedBlocks)) {
-            blockchain.replaceChain(loadedBlocks);
-            std::cout << "Replaced our chain with peer's longer valid chain!" << std::endl;
-        } else {
-            std::cout << "Received chain is invalid!" << std::endl;
+void Node::scheduleFlush(Connection& conn) {
+    // Write once per loop iteration, so frames queued together go out in one call
+    if (!conn.flushScheduled) {
+        conn.flushScheduled = true;
+        if (dirtyPeers.empty()) {
+            loop.post([this]() { flushDirtyPeers(); });
         }
-    } else {
-        std::cout << "Received chain is not longer than our current chain." << std::endl;
+        dirtyPeers.push_back(conn.id);
     }
-    chainMutex.unlock();
 }
 
-void Node::receiveBlock(const std::string& message) {
-    // Extract block JSON
-    // Parse to Block object
-    // Add to our chain if valid
+void Node::flushDirtyPeers() {
+    std::vector<PeerId> peers;
+    peers.swap(dirtyPeers);
 
-    size_t pos = message.find("\"data\":") + 7;
-    size_t end = pos;
-    int braceCount = 0;
-
-    for (size_t i = pos; i < message.length(); i++) {
-        if (message[i] == '{') braceCount++;
-        if (message[i] == '}') {
-            braceCount--;
-            if (braceCount == 0) {
-                end = i + 1;
-                break;
-            }
+    for (PeerId peer : peers) {
+        auto it = connections.find(peer);
+        if (it != connections.end() && !flushPeer(it->second)) {
+            closeConnection(peer);
         }
     }
+}
+
+void Node::updateInterest(Connection& conn) {
+    // Watermarks: stop reading requests from a peer that isn't draining its replies
+    if (!conn.congested && conn.queuedBytes > SEND_HIGH_WATERMARK) {
+        conn.congested = true;
+        conn.congestedSince = std::chrono::steady_clock::now();
+    } else if (conn.congested && conn.queuedBytes <= SEND_LOW_WATERMARK) {
+        conn.congested = false;
+    }
 
-    std::string blockJson = message.substr(pos, end - pos);
+    // Only ask for EPOLLOUT while there is something left to write
+    bool needWrite = !conn.sendQueue.empty() || static_cast<bool>(conn.stream);
 
-    Block block = Block::fromJSON(blockJson);
+    uint32_t events = EPOLLRDHUP;
+    if (!conn.congested && !conn.workersFull) {
+        events |= EPOLLIN;
+    }
+    if (needWrite) {
+        events |= EPOLLOUT;
+    }
 
-    if (block.index == blockchain.getChain().size()) {
-        if (block.previousHash == blockchain.getChain()[block.index - 1].hash) {
-            std::string target = "";
-            for (int i = 0; i < blockchain.getDifficulty(); i++) {
-                target += "0";
-            }
-            if (block.hash.substr(0, blockchain.getDifficulty()) == target) {
-                if (block.hash == block.calculateHash()) {
-                    chainMutex.lock();
-                    blockchain.addExistingBlock(block);
-                    chainMutex.unlock();
+    conn.wantWrite = needWrite;
+    loop.modify(conn.fd, events);
+}
 
-                    std::cout << "Added a new block from peer!" << std::endl;
-                }
-            }
+void Node::checkSendQueues() {
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<PeerId> stalled;
+    for (auto& entry : connections) {
+        const Connection& conn = entry.second;
+        if (conn.congested && now - conn.congestedSince > SEND_STALL_TIMEOUT) {
+            stalled.push_back(entry.first);
         }
     }
+
+    for (PeerId peer : stalled) {
+        LOG_WARN(Net, "Peer stopped reading, disconnecting").kv("peer", peer).kv("queued", connections[peer].queuedBytes);
+        closeConnection(peer);
+    }
 }
 
-void Node::sendLength(int peerSocket) {
-    chainMutex.lock();
-    int length = blockchain.getChain().size();
-    chainMutex.unlock();
+void Node::closeConnection(PeerId peer) {
+    auto it = connections.find(peer);
+    if (it == connections.end()) {
+        return;
+    }
 
-    std::string message = "{\"type\":\"LENGTH\",\"value\":" + std::to_string(length) + "}";
-    send(peerSocket, message.c_str(), message.length(), 0);
+    loop.remove(it->second.fd);
+    close(it->second.fd);
+    fdToPeer.erase(it->second.fd);
+    connections.erase(it);
+    peerCount = connections.size();
+    peers.removePeer(peer);
+
+    if (trace.isOpen()) {
+        trace.record(TraceRecord::DISCONNECT, peer, "");
+    }
+
+    workers.push(peer, [this, peer]() { peerDisconnected(peer); });
 }
 
-void Node::syncWithPeer(int peerSocket) {
-    // 1. Ask peer for their chain length
-    std::string request = "{\"type\":\"GET_LENGTH\"}";
-    send(peerSocket, request.c_str(), request.length(), 0);
-    
-    // 2. Wait for response and compare
-    // (This is simplified - in reality you'd need async handling)
-    
-    // 3. If their chain is longer, request full chain
-    request = "{\"type\":\"GET_CHAIN\"}";
-    send(peerSocket, request.c_str(), request.length(), 0);
+MessageBuffer Node::makeFrame(std::string message) {
+    message += '\n';
+    return std::make_shared<const std::string>(std::move(message));
 }
 
-void Node::broadcastMessage(const std::string& message) {
-    // Lock to safely read peerSockets
-    std::lock_guard<std::mutex> lock(peersMutex);
+void Node::sendToPeer(PeerId peer, std::string message) {
+    sendToPeer(peer, makeFrame(std::move(message)));
+}
+
+void Node::sendToPeer(PeerId peer, const MessageBuffer& frame) {
+    if (replaying) {
+        return; // Nobody is listening
+    }
+
+    loop.post([this, peer, frame]() {
+        auto it = connections.find(peer);
+        if (it == connections.end()) {
+            return; // Peer went away
+        }
 
-    for (int sock : peerSockets) {
-        if (sock >= 0) {
-            send(sock, message.c_str(), message.length(), 0);
+        if (!queueFrame(it->second, frame)) {
+            closeConnection(peer);
         }
+    });
+}
+
+void Node::streamToPeer(PeerId peer, ChunkSource source) {
+    if (replaying) {
+        return; // Nobody is listening
     }
 
-    std::cout << "Broadcasting to " << peerSockets.size() << " peers" << std::endl;
+    loop.post([this, peer, source = std::move(source)]() mutable {
+        auto it = connections.find(peer);
+        if (it != connections.end()) {
+            queueStream(it->second, std::move(source));
+        }
+    });
 }
 
-void Node::mineAndBroadcast(std::vector<Transaction> transactions) {
-    std::cout << "Mining new block with " << transactions.size() << " transactions..." << std::endl;
-    
-    chainMutex.lock();
+void Node::handlePeerMessage(PeerId peer, const std::string& message) {
+    NodeMetrics& metrics = nodeMetrics();
+    metrics.messagesReceived.inc();
+    ScopedTimer timer(metrics.handleSeconds);
+    TRACE_SPAN_ARG("handlePeerMessage", "bytes", message.size());
+
+    // Dispatch on the message type
+    std::string type = messageType(message);
+    LOG_DEBUG(Net, "Received").kv("peer", peer).kv("type", type).kv("bytes", message.size());
+    LOG_TRACE(Net, "Message body").kv("peer", peer).kv("body", message);
+
+    // A light client has no bodies, mempool or proofs to serve, and never
+    // asks for any
+    if (lightClient && (type == "GET_BLOCKS" || type == "BLOCKS" || type == "GET_CHAIN" || type == "CHAIN" ||
+                        type == "INV" || type == "GET_TX" || type == "TX" || type == "GETBLOCKTXN" ||
+                        type == "BLOCKTXN" || type == "GET_PROOFS")) {
+        return;
+    }
 
-    blockchain.addBlock(transactions);
-    Block& newBlock = blockchain.getChain().back();
-    std::string blockJson = newBlock.toJSON();
+    if (type == "PING") {
+        // Keepalive; echo the nonce straight back
+        sendToPeer(peer, "{\"type\":\"PONG\",\"nonce\":" + std::to_string(extractNumber(message, "nonce")) + "}");
+    }
+    else if (type == "PONG") {
+        // Answer to our PING; updates the peer's latency
+        peers.pongReceived(peer, static_cast<uint64_t>(extractNumber(message, "nonce")), std::chrono::steady_clock::now());
+    }
+    else if (type == "VERSION") {
+        // Peer introduced itself: where it listens and how far its chain goes
+        receiveVersion(peer, message);
+    }
+    else if (type == "GET_HEADERS") {
+        // Peer wants headers after our common ancestor
+        sendHeaders(peer, message);
+    }
+    else if (type == "HEADERS") {
+        // Peer answered our GET_HEADERS
+        receiveHeaders(peer, message);
+    }
+    else if (type == "GET_BLOCKS") {
+        // Peer wants a range of block bodies
+        sendBlocks(peer, message);
+    }
+    else if (type == "BLOCKS") {
+        // Peer answered our GET_BLOCKS
+        receiveBlocks(peer, message);
+    }
+    else if (type == "INV") {
+        // Peer announced transactions
+        receiveInventory(peer, message);
+    }
+    else if (type == "GET_TX") {
+        // Peer wants transaction bodies
+        sendTransactions(peer, message);
+    }
+    else if (type == "TX") {
+        // Peer sent transaction bodies
+        receiveTransactions(peer, message);
+    }
+    else if (type == "CMPCTBLOCK") {
+        // Peer relayed a block as header + short IDs
+        receiveCompactBlock(peer, message);
+    }
+    else if (type == "GETBLOCKTXN") {
+        // Peer couldn't rebuild one of our compact blocks
+        sendBlockTransactions(peer, message);
+    }
+    else if (type == "BLOCKTXN") {
+        // Peer sent the transactions we were missing
+        receiveBlockTransactions(peer, message);
+    }
+    else if (type == "GET_CHAIN") {
+        // Peer wants our chain
+        sendChain(peer);
+    }
+    else if (type == "CHAIN") {
+        // Peer sent us their chain
+        receiveChain(message, peer);
+    }
+    else if (type == "NEW_BLOCK") {
+        // Peer mined a new block
+        receiveBlock(message, peer);
+    }
+    else if (type == "GET_PROOFS") {
+        // Light client wants Merkle proofs
+        sendProofs(peer, message);
+    }
+    else if (type == "PROOFS") {
+        // Peer answered our GET_PROOFS
+        receiveProofs(peer, message);
+    }
+    else if (type == "GET_LENGTH") {
+        // Peer wants to know our chain length
+        sendLength(peer);
+    }
+    else if (type == "LENGTH") {
+        // Extract the length value from JSON
+        int peerLength = static_cast<int>(extractNumber(message, "value"));
+        peers.updateHeight(peer, peerLength - 1);
+
+        // Compare to our chain length
+        int ourLength = static_cast<int>(blockchain.getChainLength());
+
+        LOG_DEBUG(Sync, "Peer chain length").kv("peer", peer).kv("theirs", peerLength).kv("ours", ourLength);
+
+        // If their chain is longer, sync the missing part
+        if (peerLength > ourLength) {
+            LOG_INFO(Sync, "Peer has longer chain, syncing").kv("peer", peer).kv("theirs", peerLength).kv("ours", ourLength);
+            syncWithPeer(peer);
+        }
+    }
+}
+
+void Node::sendChain(PeerId peer) {
+    // The I/O thread serializes a chunk whenever the socket drains, from a
+    // snapshot so writers aren't held up and later blocks don't slip in
+    ChainSnapshot chain = blockchain.snapshot();
+    size_t next = 0;
+
+    streamToPeer(peer, [chain, next](std::string& out) mutable {
+        JsonWriter json(out);
+        if (next == 0) {
+            json.raw("{\"type\":\"CHAIN\",\"data\":[");
+        }
+        while (next < chain->size() && json.size() < STREAM_CHUNK_SIZE) {
+            if (next > 0) {
+                json.raw(',');
+            }
+            (*chain)[next].writeJSON(json);
+            next++;
+        }
+        if (next < chain->size()) {
+            return true;
+        }
+        json.raw("]}\n");
+        return false;
+    });
+}
+
+
+void Node::receiveChain(const std::string& message, PeerId peer) {
+    TRACE_SPAN("receiveChain");
+    // Parse chain JSON to Blockchain object
+    std::vector<Block> loadedBlocks;
+    Block::fromJSONArray(message, "data", loadedBlocks);
+
+    // Check if loaded chain is longer and valid
+    ChainSnapshot replaced; // Our chain after adopting theirs
+    bool invalid = false;
 
+    lockChain(chainMutex);
+    ChainSnapshot ours = blockchain.snapshot();
+
+    // Find where the two chains part ways; past it, the one with more work wins
+    size_t common = 0;
+    while (common < ours->size() && common < loadedBlocks.size() && (*ours)[common].hash == loadedBlocks[common].hash) {
+        common++;
+    }
+    bool moreWork = Blockchain::chainWork(loadedBlocks, common, loadedBlocks.size()) >
+        Blockchain::chainWork(*ours, common, ours->size());
+    if (moreWork) {
+        bool valid;
+        {
+            ScopedTimer timer(nodeMetrics().validationSeconds);
+            valid = blockchain.isValidChain(loadedBlocks);
+        }
+        if (valid) {
+            blockchain.replaceChain(std::move(loadedBlocks));
+            replaced = blockchain.snapshot();
+            LOG_INFO(Chain, "Replaced our chain with peer's valid chain of more work").kv("peer", peer)
+                .kv("height", replaced->tip().index).kv("disconnected", ours->size() - common);
+        } else {
+            LOG_WARN(Chain, "Received chain is invalid").kv("peer", peer);
+            invalid = true;
+        }
+    } else {
+        LOG_DEBUG(Chain, "Received chain has no more work than ours").kv("peer", peer).kv("blocks", loadedBlocks.size());
+    }
     chainMutex.unlock();
 
-    std::string message = "{\"type\":\"NEW_BLOCK\",\"data\":" + blockJson + "}";
-    broadcastMessage(message);
+    if (invalid) {
+        nodeMetrics().blocksRejected.inc();
+        penalize(peer, 50, "invalid chain");
+        return;
+    }
+    if (replaced) {
+        nodeMetrics().blocksReceived.inc(replaced->size() - common);
+        updateMempool(*ours, *replaced, common);
+    }
+}
 
+void Node::receiveBlock(const std::string& message, PeerId peer) {
+    // Parse the block straight out of the message
+    std::string_view blockJson = extractObject(message, "data");
+    if (blockJson.empty()) {
+        return;
+    }
 
-    std::cout << "Block mined and broadcast!" << std::endl;
+    connectNewBlock(Block::fromJSON(blockJson), peer);
 }
 
-void Node::requestChainFromPeer(int peerSocket) {
-    std::string message = "{\"type\":\"GET_CHAIN\"}";
-    send(peerSocket, message.c_str(), message.length(), 0);
-    std::cout << "Requested chain from peer" << std::endl;
+void Node::connectNewBlock(Block block, PeerId peer) {
+    TRACE_SPAN_ARG("connectNewBlock", "height", block.index);
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        inventoryOf(peer).insert(block.hash); // Never send it back
+    }
+
+    std::shared_ptr<const Block> added; // Shared with the chain once connected
+    bool behind = false;
+    bool invalid = false;
+
+    lockChain(chainMutex);
+    ChainSnapshot chain = blockchain.snapshot();
+    int ourLength = static_cast<int>(chain->size());
+    if (block.index == ourLength) {
+        if (block.previousHash == chain->tip().hash) {
+            bool valid;
+            {
+                ScopedTimer timer(nodeMetrics().validationSeconds);
+                TRACE_SPAN("validate block");
+                valid = block.bits == blockchain.nextBits(*chain) && hashMeetsBits(block.hash, block.bits) &&
+                    blockchain.timestampAllowed(*chain, block.timestamp) &&
+                    block.hash == block.calculateHash() &&
+                    block.merkleRoot == block.calculateMerkleRoot() &&
+                    // Headers alone hold no balances to check spends against
+                    (lightClient ? blockchain.validateReward(block) : blockchain.validateSpends(*chain, block)) &&
+                    blockchain.verifySignatures(block);
+            }
+            if (valid) {
+                // A light client checked the body but only keeps the header
+                added = std::make_shared<const Block>(lightClient ? Block::fromHeader(block.getHeader()) : std::move(block));
+                blockchain.addExistingBlock(added);
+            } else {
+                invalid = true;
+            }
+        } else {
+            behind = true; // Peer is on a fork we haven't seen
+        }
+    } else if (block.index > ourLength) {
+        behind = true; // We missed blocks
+    }
+    chainMutex.unlock();
+
+    if (invalid) {
+        nodeMetrics().blocksRejected.inc();
+        penalize(peer, 100, "invalid block");
+        return;
+    }
+
+    if (added) {
+        peers.updateHeight(peer, added->index);
+        nodeMetrics().blocksReceived.inc();
+        mempool.removeForBlock(*added);
+        LOG_INFO(Chain, "Added block from peer").kv("peer", peer).kv("height", added->index).kv("hash", added->hash);
+        relayBlock(*added, peer);
+        return;
+    }
+    peers.updateHeight(peer, block.index);
+    if (behind) {
+        LOG_INFO(Sync, "Block doesn't fit our tip, syncing").kv("peer", peer).kv("height", block.index);
+        syncWithPeer(peer);
+    }
 }
 
+void Node::relayBlock(const Block& block, PeerId origin) {
+    TRACE_SPAN_ARG("relayBlock", "height", block.index);
+    if (lightClient) {
+        return; // No bodies to relay; full peers spread the block
+    }
+    std::vector<PeerId> relayOrder = peers.rankedPeers();
+    if (relayOrder.empty() || (relayOrder.size() == 1 && relayOrder[0] == origin)) {
+        return; // Nobody to tell
+    }
+
+    // Work shared by every peer's message
+    std::vector<std::string> txids = Transaction::calculateHashes(block.transactions);
+    std::vector<std::string> shortIds;
+    shortIds.reserve(txids.size());
+    for (const std::string& txid : txids) {
+        shortIds.push_back(shortTxId(block.hash, txid));
+    }
+    std::string prefix;
+    {
+        JsonWriter json(prefix);
+        json.raw("{\"type\":\"CMPCTBLOCK\",\"header\":");
+        block.getHeader().writeJSON(json);
+        json.raw(",\"txcount\":").number(block.transactions.size());
+    }
+    MessageBuffer fullFrame; // Fallback shared by every peer, built on first use
+
+    std::vector<std::pair<PeerId, MessageBuffer>> frames;
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        // Fastest peers first, so the block spreads from them
+        for (PeerId peer : relayOrder) {
+            auto it = peerInventory.find(peer);
+            if (it == peerInventory.end() || peer == origin || !it->second.insert(block.hash)) {
+                continue; // Gone, or they already have this block
+            }
+            SeenFilter& known = it->second;
+
+            // Prefill the reward and anything this peer never saw announced
+            std::vector<size_t> prefilled;
+            std::string compact;
+            compact.reserve(prefix.size() + 24 * txids.size() + 64);
+            JsonWriter json(compact);
+            json.raw(prefix).raw(",\"shortids\":[");
+            bool first = true;
+            for (size_t i = 0; i < txids.size(); i++) {
+                bool prefill = (block.transactions[i].sender == "SYSTEM") || !known.contains(txids[i]);
+                known.insert(txids[i]);
+
+                if (prefill) {
+                    prefilled.push_back(i);
+                } else {
+                    if (!first) {
+                        json.raw(',');
+                    }
+                    json.string(shortIds[i]);
+                    first = false;
+                }
+            }
+            json.raw("],\"prefilled\":[");
+            for (size_t i = 0; i < prefilled.size(); i++) {
+                if (i > 0) {
+                    json.raw(',');
+                }
+                json.raw("{\"index\":").number(prefilled[i]).raw(",\"tx\":");
+                block.transactions[prefilled[i]].writeJSON(json);
+                json.raw('}');
+            }
+            json.raw("]}");
+
+            // When the peer is missing most of the block, the plain block is smaller
+            if (!fullFrame) {
+                std::string full;
+                full.reserve(block.estimateJSONSize() + 64);
+                JsonWriter json(full);
+                json.raw("{\"type\":\"NEW_BLOCK\",\"data\":");
+                block.writeJSON(json);
+                json.raw('}');
+                fullFrame = makeFrame(std::move(full));
+            }
+            if (compact.size() < fullFrame->size()) {
+                frames.emplace_back(peer, makeFrame(std::move(compact)));
+            } else {
+                frames.emplace_back(peer, fullFrame);
+            }
+        }
+    }
+
+    for (auto& frame : frames) {
+        sendToPeer(frame.first, frame.second);
+    }
+}
+
+void Node::receiveCompactBlock(PeerId peer, const std::string& message) {
+    TRACE_SPAN("receiveCompactBlock");
+    PendingBlock pending;
+    pending.header = BlockHeader::fromJSON(extractObject(message, "header"));
+    pending.peer = peer;
+    const BlockHeader& header = pending.header;
+
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        inventoryOf(peer).insert(header.hash);
+        if (pendingBlocks.count(header.hash)) {
+            return; // Already rebuilding this one
+        }
+    }
+
+    // Cheap checks before touching the mempool
+    // (whether bits is the right target depends on where the block goes)
+    if (header.hash != header.calculateHash() || !hashMeetsBits(header.hash, header.bits)) {
+        LOG_WARN(Relay, "Compact block with an invalid header").kv("peer", peer).kv("height", header.index);
+        nodeMetrics().blocksRejected.inc();
+        penalize(peer, 100, "invalid compact block header");
+        return;
+    }
+    peers.updateHeight(peer, header.index);
+
+    ChainSnapshot chain = blockchain.snapshot();
+    int ourLength = static_cast<int>(chain->size());
+    bool fits = (header.index == ourLength && header.previousHash == chain->tip().hash);
+    bool known = (header.index >= 0 && header.index < ourLength && (*chain)[header.index].hash == header.hash);
+
+    if (known) {
+        return;
+    }
+    if (!fits) {
+        if (header.index >= ourLength) {
+            syncWithPeer(peer); // Behind or on another branch
+        }
+        return;
+    }
+    if (header.bits != blockchain.nextBits(*chain)) {
+        LOG_WARN(Relay, "Compact block with the wrong target").kv("peer", peer).kv("height", header.index)
+            .kv("bits", header.bits);
+        nodeMetrics().blocksRejected.inc();
+        penalize(peer, 100, "wrong target");
+        return;
+    }
+    if (lightClient) {
+        connectHeader(header, peer); // The header is all we keep
+        return;
+    }
+
+    long txCount = extractNumber(message, "txcount");
+    if (txCount <= 0 || txCount > 1000000) {
+        return;
+    }
+    pending.slots.resize(txCount);
+
+    // 1. Transactions the sender expected us to be missing
+    for (std::string_view prefilled : extractObjects(message, "prefilled")) {
+        long index = extractNumber(prefilled, "index");
+        if (index < 0 || index >= txCount) {
+            return;
+        }
+        pending.slots[index] = Transaction::fromJSON(extractObject(prefilled, "tx"));
+    }
+
+    // 2. Everything else from our mempool, matched by short ID
+    std::unordered_map<std::string, Transaction> byShortId;
+    std::set<std::string> collisions;
+    std::vector<Transaction> candidates = mempool.getTransactions();
+    std::vector<std::string> candidateIds = Transaction::calculateHashes(candidates);
+    for (size_t i = 0; i < candidates.size(); i++) {
+        std::string shortId = shortTxId(header.hash, candidateIds[i]);
+        if (!byShortId.emplace(shortId, std::move(candidates[i])).second) {
+            collisions.insert(shortId);
+        }
+    }
+
+    std::vector<std::string> shortIds = extractStrings(message, "shortids");
+    size_t next = 0;
+    for (size_t i = 0; i < pending.slots.size(); i++) {
+        if (pending.slots[i]) {
+            continue;
+        }
+        if (next >= shortIds.size()) {
+            return; // Malformed: not enough short IDs
+        }
+
+        const std::string& shortId = shortIds[next++];
+        auto match = byShortId.find(shortId);
+        if (match != byShortId.end() && !collisions.count(shortId)) {
+            pending.slots[i] = match->second;
+        } else {
+            pending.missing.push_back(i);
+        }
+    }
+
+    if (pending.missing.empty()) {
+        completeCompactBlock(std::move(pending));
+        return;
+    }
+
+    // 3. Ask only for the gaps
+    std::string request = "{\"type\":\"GETBLOCKTXN\",\"blockhash\":\"" + header.hash +
+        "\",\"indexes\":" + toJSONArray(pending.missing) + "}";
+    LOG_DEBUG(Relay, "Compact block missing transactions, requesting them").kv("peer", peer)
+        .kv("height", header.index).kv("missing", pending.missing.size()).kv("transactions", pending.slots.size());
+
+    pending.requestedAt = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        pendingBlocks.emplace(header.hash, std::move(pending));
+    }
+    sendToPeer(peer, request);
+}
+
+void Node::sendBlockTransactions(PeerId peer, const std::string& message) {
+    std::string blockHash = extractString(message, "blockhash");
+    if (blockHash.empty()) {
+        return;
+    }
+
+    // Peer input: a malformed index drops the whole request
+    std::vector<size_t> indexes;
+    if (!jsonIndexes(message, "indexes", indexes)) {
+        LOG_RATE_LIMITED(Debug, Relay, 1, "Dropping malformed GETBLOCKTXN").kv("peer", peer);
+        return;
+    }
+
+    std::string reply = "{\"type\":\"BLOCKTXN\",\"blockhash\":\"" + blockHash + "\",\"data\":[";
+
+    ChainSnapshot chain = blockchain.snapshot();
+    int blockIndex = chain->findBlockIndex(blockHash);
+    if (blockIndex >= 0) {
+        const std::vector<Transaction>& txs = (*chain)[blockIndex].transactions;
+        for (size_t i = 0; i < indexes.size(); i++) {
+            if (indexes[i] >= txs.size()) {
+                LOG_RATE_LIMITED(Debug, Relay, 1, "Dropping GETBLOCKTXN with an index out of range").kv("peer", peer)
+                    .kv("index", indexes[i]).kv("transactions", txs.size());
+                return;
+            }
+            if (reply.back() != '[') {
+                reply += ",";
+            }
+            reply += txs[indexes[i]].toJSON();
+        }
+    }
+
+    if (blockIndex < 0) {
+        return; // Reorged away; the peer will sync instead
+    }
+
+    reply += "]}";
+    sendToPeer(peer, reply);
+}
+
+void Node::receiveBlockTransactions(PeerId peer, const std::string& message) {
+    std::string blockHash = extractString(message, "blockhash");
+    if (blockHash.empty()) {
+        return;
+    }
+
+    PendingBlock pending;
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        auto it = pendingBlocks.find(blockHash);
+        if (it == pendingBlocks.end() || it->second.peer != peer) {
+            return;
+        }
+        pending = std::move(it->second);
+        pendingBlocks.erase(it);
+    }
+
+    std::pmr::vector<std::string_view> txJsons = extractObjects(message, "data");
+    if (txJsons.size() != pending.missing.size()) {
+        LOG_INFO(Relay, "Wrong number of block transactions, syncing instead").kv("peer", peer);
+        syncWithPeer(peer);
+        return;
+    }
+
+    for (size_t i = 0; i < txJsons.size(); i++) {
+        pending.slots[pending.missing[i]] = Transaction::fromJSON(txJsons[i]);
+    }
+    completeCompactBlock(std::move(pending));
+}
+
+void Node::completeCompactBlock(PendingBlock pending) {
+    TRACE_SPAN_ARG("completeCompactBlock", "height", pending.header.index);
+    std::vector<Transaction> txs;
+    txs.reserve(pending.slots.size());
+    for (std::optional<Transaction>& slot : pending.slots) {
+        txs.push_back(std::move(*slot));
+    }
+
+    const BlockHeader& header = pending.header;
+    Block block(header.index, header.previousHash, std::move(txs));
+    block.timestamp = header.timestamp;
+    block.bits = header.bits;
+    block.nonce = header.nonce;
+    block.hash = header.hash;
+
+    // A short ID collision would give us the wrong transaction
+    if (block.merkleRoot != header.merkleRoot) {
+        LOG_INFO(Relay, "Compact block didn't rebuild cleanly, syncing instead").kv("peer", pending.peer).kv("height", header.index);
+        syncWithPeer(pending.peer);
+        return;
+    }
+
+    connectNewBlock(std::move(block), pending.peer);
+}
+
+void Node::sendLength(PeerId peer) {
+    int length = static_cast<int>(blockchain.getChainLength());
+
+    std::string message = "{\"type\":\"LENGTH\",\"value\":" + std::to_string(length) + "}";
+    sendToPeer(peer, message);
+}
+
+void Node::sendProofs(PeerId peer, const std::string& message) {
+    TRACE_SPAN("sendProofs");
+    long id = extractNumber(message, "id");
+    std::string txid = extractString(message, "txid");
+    std::string address = extractString(message, "address");
+
+    std::string reply;
+    JsonWriter json(reply);
+    json.raw("{\"type\":\"PROOFS\",\"id\":").number(id).raw(",\"proofs\":[");
+
+    // Newest first: recent payments are the ones asked about most
+    ChainSnapshot chain = blockchain.snapshot();
+    size_t count = 0;
+    bool done = txid.empty() && address.empty();
+    std::vector<std::string> leaves;
+    for (size_t height = chain->size(); height-- > 0 && !done;) {
+        const Block& block = (*chain)[height];
+        leaves.clear();
+        for (size_t i = 0; i < block.transactions.size() && !done; i++) {
+            const Transaction& tx = block.transactions[i];
+            // Address queries only hash blocks they have a match in
+            if (txid.empty() && tx.sender != address && tx.receiver != address) {
+                continue;
+            }
+            if (leaves.empty()) {
+                leaves = Transaction::calculateHashes(block.transactions);
+            }
+            if (!txid.empty() && leaves[i] != txid) {
+                continue;
+            }
+
+            if (count > 0) {
+                json.raw(',');
+            }
+            json.raw("{\"height\":").number(height);
+            json.raw(",\"index\":").number(i);
+            json.raw(",\"block\":").string(block.hash);
+            json.raw(",\"branch\":[");
+            std::vector<std::string> branch = merkleBranch(leaves, i);
+            for (size_t b = 0; b < branch.size(); b++) {
+                if (b > 0) {
+                    json.raw(',');
+                }
+                json.string(branch[b]);
+            }
+            json.raw("],\"tx\":");
+            tx.writeJSON(json);
+            json.raw('}');
+
+            count++;
+            done = !txid.empty() || count >= MAX_PROOFS_PER_MESSAGE;
+        }
+    }
+    json.raw("]}");
+
+    LOG_DEBUG(Net, "Sending proofs").kv("peer", peer).kv("proofs", count);
+    sendToPeer(peer, std::move(reply));
+}
+
+void Node::receiveProofs(PeerId peer, const std::string& message) {
+    uint64_t id = static_cast<uint64_t>(extractNumber(message, "id"));
+    std::shared_ptr<std::promise<std::string>> waiting;
+    {
+        std::lock_guard<std::mutex> lock(proofMutex);
+        auto it = proofRequests.find(id);
+        if (it == proofRequests.end() || it->second.first != peer) {
+            return; // Not something we asked this peer for, or we gave up
+        }
+        waiting = std::move(it->second.second);
+        proofRequests.erase(it);
+    }
+    waiting->set_value(message);
+}
+
+bool Node::fetchProofs(const std::string& query, const std::function<bool(const Transaction&)>& matches,
+                       std::vector<ProvenTransaction>& proven, std::string* reason) {
+    auto fail = [reason](const char* why) {
+        if (reason) {
+            *reason = why;
+        }
+        return false;
+    };
+
+    std::optional<PeerId> peer = peers.bestPeer(0);
+    if (!peer) {
+        return fail("no full peer to ask");
+    }
+
+    uint64_t id;
+    auto waiting = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> reply = waiting->get_future();
+    {
+        std::lock_guard<std::mutex> lock(proofMutex);
+        id = nextProofRequest++;
+        proofRequests[id] = { *peer, waiting };
+    }
+    sendToPeer(*peer, "{\"type\":\"GET_PROOFS\",\"id\":" + std::to_string(id) + "," + query + "}");
+
+    if (reply.wait_for(PROOF_TIMEOUT) != std::future_status::ready) {
+        std::lock_guard<std::mutex> lock(proofMutex);
+        proofRequests.erase(id);
+        return fail("no reply from peer");
+    }
+    std::string message = reply.get();
+
+    // Each branch must lead from the transaction's hash to the merkleRoot of
+    // a header we hold. Proofs for blocks we don't have (past our tip, or
+    // on the peer's side of a fork) are left out rather than trusted.
+    ChainSnapshot chain = blockchain.snapshot();
+    for (std::string_view proof : extractObjects(message, "proofs")) {
+        long height = extractNumber(proof, "height");
+        long index = extractNumber(proof, "index");
+        if (height < 0 || height >= static_cast<long>(chain->size()) ||
+            (*chain)[height].hash != extractString(proof, "block")) {
+            continue;
+        }
+
+        Transaction tx = Transaction::fromJSON(extractObject(proof, "tx"));
+        std::vector<std::string> branch = extractStrings(proof, "branch");
+        if (index < 0 || !matches(tx) ||
+            merkleRootFromBranch(tx.calculateHash(), index, branch) != (*chain)[height].merkleRoot) {
+            proven.clear();
+            penalize(*peer, 100, "bad proof");
+            return fail("peer sent a bad proof");
+        }
+        proven.push_back({ std::move(tx), static_cast<int>(height), (*chain)[height].hash });
+    }
+    return true;
+}
+
+bool Node::proveTransaction(const std::string& txid, std::vector<ProvenTransaction>& proven, std::string* reason) {
+    return fetchProofs("\"txid\":\"" + txid + "\"",
+                       [&txid](const Transaction& tx) { return tx.calculateHash() == txid; }, proven, reason);
+}
+
+bool Node::proveAddress(const std::string& address, std::vector<ProvenTransaction>& proven, std::string* reason) {
+    return fetchProofs("\"address\":\"" + address + "\"",
+                       [&address](const Transaction& tx) { return tx.sender == address || tx.receiver == address; },
+                       proven, reason);
+}
+
+bool Node::provenBalance(const std::string& address, double& balance, std::string* reason) {
+    std::vector<ProvenTransaction> proven;
+    if (!proveAddress(address, proven, reason)) {
+        return false;
+    }
+    balance = 0;
+    for (const ProvenTransaction& entry : proven) {
+        if (entry.tx.receiver == address) {
+            balance += entry.tx.amount;
+        }
+        if (entry.tx.sender == address) {
+            balance -= entry.tx.amount;
+        }
+    }
+    return true;
+}
+
+void Node::syncWithPeer(PeerId peer) {
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (sync.active) {
+        return; // One sync at a time; the next NEW_BLOCK retriggers if needed
+    }
+
+    // Take headers from the fastest peer that is at least as far ahead
+    std::optional<PeerManager::PeerInfo> trigger = peers.getPeer(peer);
+    if (trigger && trigger->bestHeight >= 0) {
+        std::optional<PeerId> fastest = peers.bestPeer(trigger->bestHeight);
+        if (fastest) {
+            peer = *fastest;
+        }
+    }
+
+    resetSync();
+    sync.active = true;
+    sync.peer = peer;
+    sync.lastProgress = std::chrono::steady_clock::now();
+
+    // 1. Ask for headers after the best block we have in common
+    std::vector<std::string> locator = blockchain.snapshot()->getLocator();
+
+    std::string request = "{\"type\":\"GET_HEADERS\",\"locator\":" + toJSONArray(locator) + "}";
+    sendToPeer(peer, request);
+
+    // 2. receiveHeaders() validates them and requests bodies in batches
+    // 3. receiveBlocks() connects the bodies
+}
+
+void Node::sendHeaders(PeerId peer, const std::string& message) {
+    std::vector<std::string> locator = extractStrings(message, "locator");
+
+    // One snapshot, so the headers are guaranteed to follow the fork point
+    ChainSnapshot chain = blockchain.snapshot();
+    int forkIndex = chain->findForkPoint(locator);
+    std::vector<BlockHeader> headers = chain->getHeaders(forkIndex + 1, MAX_HEADERS_PER_MESSAGE);
+
+    std::string reply;
+    reply.reserve(64 + 300 * headers.size());
+    JsonWriter json(reply);
+    json.raw("{\"type\":\"HEADERS\",\"data\":[");
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (i > 0) {
+            json.raw(',');
+        }
+        headers[i].writeJSON(json);
+    }
+    json.raw("]}");
+
+    sendToPeer(peer, std::move(reply));
+}
+
+void Node::receiveHeaders(PeerId peer, const std::string& message) {
+    std::vector<BlockHeader> headers;
+    for (std::string_view headerJson : extractObjects(message, "data")) {
+        headers.push_back(BlockHeader::fromJSON(headerJson));
+    }
+
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (!sync.active || sync.peer != peer) {
+        return; // Not something we asked for
+    }
+
+    if (!headers.empty()) {
+        // Work out which block the new headers must build on
+        std::string anchorHash;
+        if (sync.headers.empty()) {
+            sync.forkIndex = headers[0].index - 1;
+
+            ChainSnapshot chain = blockchain.snapshot();
+            if (sync.forkIndex < 0) {
+                anchorHash = "0"; // Different genesis; the whole chain is up for replacement
+            } else if (sync.forkIndex < static_cast<int>(chain->size())) {
+                anchorHash = (*chain)[sync.forkIndex].hash;
+            }
+        } else {
+            anchorHash = sync.headers.back().hash;
+        }
+
+        if (anchorHash.empty() || !blockchain.isValidHeaderChain(headers, anchorHash, sync.headers)) {
+            LOG_WARN(Sync, "Invalid header chain").kv("peer", peer).kv("headers", headers.size());
+            if (!anchorHash.empty()) {
+                penalize(peer, 100, "invalid headers");
+            }
+            resetSync();
+            return;
+        }
+        peers.updateHeight(peer, headers.back().index);
+
+        sync.headers.insert(sync.headers.end(), headers.begin(), headers.end());
+        sync.lastProgress = std::chrono::steady_clock::now();
+
+        // A full batch means there are probably more
+        if (headers.size() == MAX_HEADERS_PER_MESSAGE) {
+            std::vector<std::string> locator { sync.headers.back().hash };
+            sendToPeer(peer, "{\"type\":\"GET_HEADERS\",\"locator\":" + toJSONArray(locator) + "}");
+            return;
+        }
+    }
+
+    // Header chain complete: only fetch bodies if it has more work than
+    // our blocks past the fork
+    ChainSnapshot chain = blockchain.snapshot();
+    sync.extendsTip = (sync.forkIndex == static_cast<int>(chain->size()) - 1);
+
+    if (sync.headers.empty() || !moreWorkThanOurs(*chain)) {
+        LOG_INFO(Sync, "Peer's chain has no more work than ours, sync finished").kv("peer", peer);
+        resetSync();
+        return;
+    }
+
+    if (lightClient) {
+        adoptHeaders(); // Headers are all we keep
+        return;
+    }
+
+    // Spread the bodies over every full peer we know, fastest first
+    downloader.start(sync.headers);
+    for (PeerId p : peers.rankedPeers()) {
+        std::optional<PeerManager::PeerInfo> info = peers.getPeer(p);
+        if (info && !info->light) {
+            downloader.addPeer(p);
+        }
+    }
+    rankDownloadPeers();
+
+    LOG_INFO(Sync, "Validated headers, downloading blocks").kv("headers", sync.headers.size())
+        .kv("peers", downloader.getPeerCount());
+    dispatchBlockRequests();
+}
+
+void Node::sendBlocks(PeerId peer, const std::string& message) {
+    long from = extractNumber(message, "from");
+    long count = extractNumber(message, "count");
+    if (from < 0 || count <= 0) {
+        return;
+    }
+
+    // Cap the batch so one request can't make us serialize the whole chain
+    size_t maxCount = std::min(static_cast<size_t>(count), 4 * BLOCKS_PER_REQUEST);
+
+    // The requester pins the first block's hash; if we are on another
+    // branch at that height, an empty reply says we don't have its blocks
+    std::string firstHash = extractString(message, "hash");
+    ChainSnapshot chain = blockchain.snapshot();
+    size_t first = static_cast<size_t>(from);
+    size_t last = first; // Serialized straight from the snapshot, no copies
+    if (firstHash.empty() || (first < chain->size() && (*chain)[first].hash == firstHash)) {
+        last = std::min(chain->size(), first + maxCount);
+    }
+
+    size_t size = 64;
+    for (size_t i = first; i < last; i++) {
+        size += (*chain)[i].estimateJSONSize() + 1;
+    }
+    std::string reply;
+    reply.reserve(size);
+    JsonWriter json(reply);
+    json.raw("{\"type\":\"BLOCKS\",\"from\":").number(from).raw(",\"data\":[");
+    for (size_t i = first; i < last; i++) {
+        if (i > first) {
+            json.raw(',');
+        }
+        (*chain)[i].writeJSON(json);
+    }
+    json.raw("]}");
+
+    sendToPeer(peer, std::move(reply));
+}
+
+void Node::receiveBlocks(PeerId peer, const std::string& message) {
+    TRACE_SPAN("receiveBlocks");
+    long from = extractNumber(message, "from");
+
+    // Parse, hash and verify signatures before taking the lock so replies
+    // from different peers are checked in parallel on their own workers
+    std::vector<Block> blocks;
+    bool wellFormed = Block::fromJSONArray(message, "data", blocks);
+    for (Block& block : blocks) {
+        if (!wellFormed || block.merkleRoot != block.calculateMerkleRoot()) {
+            wellFormed = false;
+            break;
+        }
+        block.hash = block.calculateHash();
+    }
+    wellFormed = wellFormed && blockchain.verifySignatures(blocks);
+    if (from < 0 && !blocks.empty()) {
+        from = blocks.front().index;
+    }
+
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (!downloader.isActive()) {
+        return; // Not something we asked for
+    }
+
+    if (!wellFormed || !downloader.receive(peer, static_cast<int>(from), std::move(blocks))) {
+        // Usually an honest peer on another branch; just stop asking it
+        LOG_INFO(Sync, "Blocks don't match the synced headers, dropping peer from download").kv("peer", peer).kv("from", from);
+        downloader.removePeer(peer);
+    }
+
+    if (!connectReadyBlocks()) {
+        return;
+    }
+
+    if (downloader.isComplete()) {
+        finishSync();
+        return;
+    }
+
+    dispatchBlockRequests();
+}
+
+void Node::dispatchBlockRequests() {
+    for (const BlockDownloader::Request& request : downloader.schedule(std::chrono::steady_clock::now())) {
+        const BlockHeader& first = sync.headers[request.from - (sync.forkIndex + 1)];
+        std::string message = "{\"type\":\"GET_BLOCKS\",\"from\":" + std::to_string(request.from) +
+            ",\"count\":" + std::to_string(request.count) + ",\"hash\":\"" + first.hash + "\"}";
+        sendToPeer(request.peer, message);
+    }
+}
+
+bool Node::connectReadyBlocks() {
+    std::vector<Block> ready = downloader.takeReady();
+    if (ready.empty()) {
+        return true;
+    }
+    sync.lastProgress = std::chrono::steady_clock::now();
+
+    if (!sync.extendsTip) {
+        sync.bodies.insert(sync.bodies.end(), std::make_move_iterator(ready.begin()),
+                           std::make_move_iterator(ready.end()));
+        return true;
+    }
+
+    // Bodies match the validated header chain, so the run links up; it only has to fit our tip.
+    // The whole run is published as one new chain state.
+    lockChain(chainMutex);
+    const Block& first = ready.front();
+    ChainSnapshot chain = blockchain.snapshot();
+    bool connects = (first.index == chain->tip().index + 1 && first.previousHash == chain->tip().hash);
+    bool valid = !connects || blockchain.validateSpends(*chain, ready);
+    size_t count = ready.size();
+    size_t firstIndex = chain->size();
+    if (connects && valid) {
+        blockchain.addExistingBlocks(std::move(ready)); // Mempool reads them back from the new state
+        chain = blockchain.snapshot();
+    }
+    chainMutex.unlock();
+
+    if (!valid) {
+        // Proof-of-work matched, so the header chain itself is bad
+        LOG_WARN(Sync, "Synced blocks spend what their senders don't have, abandoning sync").kv("peer", sync.peer)
+            .kv("from", firstIndex);
+        nodeMetrics().blocksRejected.inc(count);
+        penalize(sync.peer, 100, "invalid synced blocks");
+        resetSync();
+        return false;
+    }
+    if (!connects) {
+        // Our tip moved underneath us (e.g. we mined); start over
+        LOG_INFO(Sync, "Chain changed during sync, restarting");
+        resetSync();
+        return false;
+    }
+
+    nodeMetrics().blocksReceived.inc(count);
+    for (size_t i = firstIndex; i < firstIndex + count; i++) {
+        mempool.removeForBlock((*chain)[i]);
+    }
+    return true;
+}
+
+void Node::finishSync() {
+    TRACE_SPAN("finishSync");
+    // A reorg is applied in one step once all bodies are here. Only the
+    // bodies are checked and moved in; the prefix stays shared with ours.
+    if (!sync.extendsTip) {
+        lockChain(chainMutex);
+        ChainSnapshot chain = blockchain.snapshot();
+        size_t fork = static_cast<size_t>(sync.forkIndex + 1);
+        size_t bodies = sync.bodies.size();
+
+        ChainSnapshot replaced;
+        if (moreWorkThanOurs(*chain) && blockchain.isValidFork(*chain, fork, sync.bodies) &&
+            blockchain.replaceFrom(*chain, fork, std::move(sync.bodies))) {
+            replaced = blockchain.snapshot();
+            LOG_INFO(Chain, "Reorganized onto synced chain").kv("height", replaced->tip().index)
+                .kv("disconnected", chain->size() - fork);
+        } else {
+            LOG_INFO(Sync, "Synced chain is no longer better than ours, discarding");
+        }
+        chainMutex.unlock();
+
+        if (replaced) {
+            nodeMetrics().blocksReceived.inc(bodies);
+            updateMempool(*chain, *replaced, fork);
+        }
+    }
+
+    LOG_INFO(Sync, "Sync finished").kv("height", sync.headers.back().index).kv("peers", downloader.getPeerCount())
+        .kv("stalled", downloader.getStallCount());
+    PeerId source = sync.peer;
+    resetSync();
+
+    // Announce our new tip; neighbours that only saw the losing branch
+    // would otherwise never hear about this one
+    ChainSnapshot chain = blockchain.snapshot();
+    relayBlock(chain->tip(), source);
+}
+
+bool Node::moreWorkThanOurs(const ChainState& chain) const {
+    size_t fork = static_cast<size_t>(sync.forkIndex + 1);
+    return Blockchain::chainWork(sync.headers, 0, sync.headers.size()) >
+        Blockchain::chainWork(chain, std::min(fork, chain.size()), chain.size());
+}
+
+void Node::adoptHeaders() {
+    std::vector<Block> headerBlocks;
+    headerBlocks.reserve(sync.headers.size());
+    for (const BlockHeader& header : sync.headers) {
+        headerBlocks.push_back(Block::fromHeader(header));
+    }
+
+    lockChain(chainMutex);
+    ChainSnapshot chain = blockchain.snapshot();
+    bool forkStillOurs = sync.forkIndex < 0 || (sync.forkIndex < static_cast<int>(chain->size()) &&
+        (*chain)[sync.forkIndex].hash == sync.headers.front().previousHash);
+    // On our tip or not, the headers go after the prefix we share
+    bool adopted = forkStillOurs && moreWorkThanOurs(*chain) &&
+        blockchain.replaceFrom(*chain, static_cast<size_t>(sync.forkIndex + 1), std::move(headerBlocks));
+    chainMutex.unlock();
+
+    if (adopted) {
+        nodeMetrics().blocksReceived.inc(sync.headers.size());
+        LOG_INFO(Sync, "Synced headers").kv("peer", sync.peer).kv("height", sync.headers.back().index);
+    } else {
+        LOG_INFO(Sync, "Synced headers are no longer better than ours, discarding");
+    }
+    resetSync();
+}
+
+void Node::connectHeader(const BlockHeader& header, PeerId peer) {
+    // Checked against the tip already, but it may have moved since
+    bool added = false;
+    lockChain(chainMutex);
+    ChainSnapshot chain = blockchain.snapshot();
+    if (header.index == static_cast<int>(chain->size()) && header.previousHash == chain->tip().hash &&
+        header.bits == blockchain.nextBits(*chain) && blockchain.timestampAllowed(*chain, header.timestamp)) {
+        blockchain.addExistingBlock(std::make_shared<const Block>(Block::fromHeader(header)));
+        added = true;
+    }
+    chainMutex.unlock();
+
+    if (added) {
+        peers.updateHeight(peer, header.index);
+        nodeMetrics().blocksReceived.inc();
+        LOG_INFO(Chain, "Added header from peer").kv("peer", peer).kv("height", header.index).kv("hash", header.hash);
+    }
+}
+
+void Node::onSyncTick() {
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (!sync.active) {
+        return;
+    }
+
+    if (downloader.isActive()) {
+        if (downloader.isStuck()) {
+            LOG_WARN(Sync, "No peer can serve the remaining blocks, abandoning sync");
+            resetSync();
+            return;
+        }
+        rankDownloadPeers(); // Latencies move as PONGs come in
+        dispatchBlockRequests(); // Also reassigns stalled ranges
+    }
+    else if (std::chrono::steady_clock::now() - sync.lastProgress > SYNC_STALL_TIMEOUT) {
+        LOG_WARN(Sync, "Header sync stalled, giving up on peer").kv("peer", sync.peer);
+        resetSync();
+    }
+}
+
+void Node::receiveVersion(PeerId peer, const std::string& message) {
+    long listenPort = extractNumber(message, "port");
+    long height = extractNumber(message, "height");
+
+    peers.setListenPort(peer, static_cast<int>(listenPort));
+    peers.updateHeight(peer, static_cast<int>(height));
+
+    // A light client has no bodies to sync from
+    if (extractNumber(message, "light") == 1) {
+        peers.setLight(peer);
+        std::lock_guard<std::mutex> lock(syncMutex);
+        if (downloader.isActive()) {
+            downloader.removePeer(peer);
+        }
+        return;
+    }
+
+    // Catch up straight away if they are ahead
+    if (height >= static_cast<long>(blockchain.getChainLength())) {
+        syncWithPeer(peer);
+    }
+}
+
+void Node::maintainPeers() {
+    auto now = std::chrono::steady_clock::now();
+
+    // Keepalive, and a latency sample for ranking
+    for (const auto& ping : peers.pingsDue(now)) {
+        sendToPeer(ping.first, "{\"type\":\"PING\",\"nonce\":" + std::to_string(ping.second) + "}");
+    }
+
+    for (PeerId peer : peers.timedOut(now)) {
+        LOG_INFO(Peers, "Peer stopped answering PINGs, disconnecting").kv("peer", peer);
+        disconnectPeer(peer);
+    }
+
+    // Top up outbound connections from the address book
+    if (running) {
+        for (const PeerManager::Address& address : peers.addressesToDial(2, port, now)) {
+            connectToPeer(address.host, address.port);
+        }
+    }
+}
+
+void Node::penalize(PeerId peer, int score, const std::string& reason) {
+    if (peers.misbehaving(peer, score, reason)) {
+        disconnectPeer(peer);
+    }
+}
+
+void Node::disconnectPeer(PeerId peer) {
+    if (replaying) {
+        return;
+    }
+    loop.post([this, peer]() { closeConnection(peer); });
+}
+
+void Node::rankDownloadPeers() {
+    std::vector<PeerId> ranked = peers.rankedPeers();
+    for (size_t i = 0; i < ranked.size(); i++) {
+        downloader.setPeerRank(ranked[i], i);
+    }
+}
+
+void Node::setAddressBook(const std::string& filename) {
+    addressBookFile = filename;
+}
+
+bool Node::startMetrics(int metricsPort) {
+    auto server = std::make_unique<HttpServer>(metricsPort, [this](const HttpServer::Request& request) {
+        HttpServer::Response response;
+        if (request.path != "/metrics" && request.path != "/trace") {
+            response.status = 404;
+            response.body = "not found\n";
+        } else if (request.method != "GET") {
+            response.status = 405;
+            response.body = "GET only\n";
+        } else if (request.path == "/trace") {
+            // Chrome trace_event JSON; empty unless built with TRACING=1
+            response.contentType = "application/json";
+            response.body = Tracer::instance().toJSON();
+        } else {
+            response.contentType = "text/plain; version=0.0.4; charset=utf-8";
+            response.body = renderMetrics();
+        }
+        return response;
+    });
+
+    if (!server->start()) {
+        return false;
+    }
+    metricsServer = std::move(server);
+    LOG_INFO(Http, "Serving metrics").kv("url", "http://127.0.0.1:" + std::to_string(metricsPort) + "/metrics");
+    return true;
+}
+
+std::string Node::renderMetrics() {
+    std::string out = Metrics::instance().render();
+
+    ChainSnapshot chain = blockchain.snapshot();
+    Metrics::writeSample(out, "node_chain_height", "gauge", "Index of our best block", chain->tip().index);
+    Metrics::writeSample(out, "node_mempool_transactions", "gauge", "Transactions waiting to be mined", mempool.size());
+    Metrics::writeSample(out, "node_peers", "gauge", "Connected peers", peers.getInboundCount(), "direction=\"inbound\"");
+    Metrics::writeSample(out, "node_peers", "gauge", "", peers.getOutboundCount(), "direction=\"outbound\"");
+    Metrics::writeSample(out, "node_bytes_received_total", "counter", "Bytes read from peer sockets", bytesReceived);
+    Metrics::writeSample(out, "node_bytes_sent_total", "counter", "Bytes written to peer sockets", bytesSent);
+
+    // Send queues belong to the I/O thread; ask it for a copy
+    if (running && !loop.isInLoopThread()) {
+        auto depths = std::make_shared<std::promise<std::vector<std::pair<PeerId, size_t>>>>();
+        std::future<std::vector<std::pair<PeerId, size_t>>> result = depths->get_future();
+        loop.post([this, depths]() {
+            std::vector<std::pair<PeerId, size_t>> queued;
+            for (const auto& entry : connections) {
+                queued.emplace_back(entry.first, entry.second.queuedBytes);
+            }
+            depths->set_value(std::move(queued));
+        });
+
+        if (result.wait_for(std::chrono::seconds(1)) == std::future_status::ready) {
+            std::vector<std::pair<PeerId, size_t>> queued = result.get();
+            std::sort(queued.begin(), queued.end());
+            for (size_t i = 0; i < queued.size(); i++) {
+                Metrics::writeSample(out, "node_peer_send_queue_bytes", "gauge",
+                                     i == 0 ? "Unwritten bytes queued for each peer" : "",
+                                     queued[i].second, "peer=\"" + std::to_string(queued[i].first) + "\"");
+            }
+        }
+    }
+
+    return out;
+}
+
+bool Node::startRpc(int rpcPort) {
+    auto server = std::make_unique<RpcServer>(loop, rpcPort);
+
+    server->addMethod("getchaininfo", [this](const RpcParams&) {
+        ChainSnapshot chain = blockchain.snapshot();
+        return RpcReply::ok("{\"height\":" + std::to_string(chain->tip().index) +
+            ",\"bestblockhash\":\"" + chain->tip().hash + "\"" +
+            ",\"difficulty\":" + std::to_string(bitsDifficulty(chain->tip().bits)) +
+            ",\"bits\":" + std::to_string(chain->tip().bits) +
+            ",\"nextbits\":" + std::to_string(blockchain.nextBits(*chain)) +
+            ",\"mempool\":" + std::to_string(mempool.size()) +
+            ",\"peers\":" + std::to_string(peerCount.load()) + "}");
+    });
+
+    server->addMethod("getblock", [this](const RpcParams& params) {
+        long height;
+        if (!params.getInt(0, "height", height)) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Expected a block height");
+        }
+        ChainSnapshot chain = blockchain.snapshot();
+        if (height < 0 || height >= static_cast<long>(chain->size())) {
+            return RpcReply::error(RpcServer::NOT_FOUND, "Block not found");
+        }
+        return RpcReply::ok((*chain)[height].toJSON());
+    });
+
+    server->addMethod("getblockbyhash", [this](const RpcParams& params) {
+        std::string hash;
+        if (!params.getString(0, "hash", hash)) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Expected a block hash");
+        }
+        ChainSnapshot chain = blockchain.snapshot();
+        int index = chain->findBlockIndex(hash);
+        if (index < 0) {
+            return RpcReply::error(RpcServer::NOT_FOUND, "Block not found");
+        }
+        return RpcReply::ok((*chain)[index].toJSON());
+    });
+
+    server->addMethod("getbalance", [this](const RpcParams& params) {
+        std::string address;
+        if (!params.getString(0, "address", address)) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Expected an address");
+        }
+        char balance[32];
+        if (!lightClient) {
+            std::snprintf(balance, sizeof(balance), "%.8g", blockchain.getBalance(address));
+            return RpcReply::ok(balance);
+        }
+
+        // Sum the address's transactions, each proven against our headers
+        if (address.find_first_of("\"\\") != std::string::npos) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Addresses can't contain quotes or backslashes");
+        }
+        double total;
+        std::string reason;
+        if (!provenBalance(address, total, &reason)) {
+            return RpcReply::error(RpcServer::NOT_CONNECTED, "Couldn't prove balance: " + reason);
+        }
+        std::snprintf(balance, sizeof(balance), "%.8g", total);
+        return RpcReply::ok(balance);
+    });
+
+    server->addMethod("gettransaction", [this](const RpcParams& params) {
+        std::string txid;
+        if (!params.getString(0, "txid", txid)) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Expected a txid");
+        }
+
+        // A light client has the transaction proven by a full peer
+        if (lightClient) {
+            if (txid.find_first_of("\"\\") != std::string::npos) {
+                return RpcReply::error(RpcServer::INVALID_PARAMS, "Malformed txid");
+            }
+            std::vector<ProvenTransaction> proven;
+            std::string reason;
+            if (!proveTransaction(txid, proven, &reason)) {
+                return RpcReply::error(RpcServer::NOT_CONNECTED, "Couldn't prove transaction: " + reason);
+            }
+            if (proven.empty()) {
+                return RpcReply::error(RpcServer::NOT_FOUND, "Transaction not found");
+            }
+            size_t length = blockchain.getChainLength();
+            return RpcReply::ok("{\"tx\":" + proven[0].tx.toJSON() + ",\"block\":\"" + proven[0].blockHash +
+                "\",\"confirmations\":" + std::to_string(length - proven[0].height) + "}");
+        }
+
+        Transaction pending("", "", 0);
+        if (mempool.get(txid, pending)) {
+            return RpcReply::ok("{\"tx\":" + pending.toJSON() + ",\"block\":null,\"confirmations\":0}");
+        }
+
+        // Recent transactions are the ones asked about most; search from the tip
+        ChainSnapshot chain = blockchain.snapshot();
+        for (size_t i = chain->size(); i-- > 0;) {
+            for (const Transaction& tx : (*chain)[i].transactions) {
+                if (tx.calculateHash() == txid) {
+                    return RpcReply::ok("{\"tx\":" + tx.toJSON() + ",\"block\":\"" + (*chain)[i].hash +
+                        "\",\"confirmations\":" + std::to_string(chain->size() - i) + "}");
+                }
+            }
+        }
+        return RpcReply::error(RpcServer::NOT_FOUND, "Transaction not found");
+    });
+
+    server->addMethod("submittransaction", [this](const RpcParams& params) {
+        std::string key;
+        std::string receiver;
+        double amount;
+        if (!params.getString(0, "key", key) || !params.getString(1, "receiver", receiver) ||
+            !params.getDouble(2, "amount", amount)) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Expected key, receiver and amount");
+        }
+
+        if (!Transaction::isPlainAddress(receiver)) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Addresses can't contain quotes, backslashes or control characters");
+        }
+
+        // The sender is whoever the key belongs to
+        KeyPair keys;
+        if (!keyPairFromPrivateKey(key, keys)) {
+            return RpcReply::error(RpcServer::INVALID_PARAMS, "Key must be a private key of 64 hex characters");
+        }
+        Transaction tx(keys.address, receiver, amount);
+        tx.sign(keys.privateKey);
+        std::string reason;
+        if (!submitTransaction(tx, &reason)) {
+            return RpcReply::error(RpcServer::REJECTED, "Transaction rejected: " + reason);
+        }
+        return RpcReply::ok("{\"txid\":\"" + tx.calculateHash() + "\"}");
+    });
+
+    server->addMethod("getnewkey", [](const RpcParams&) {
+        KeyPair keys = generateKeyPair();
+        if (keys.address.empty()) {
+            return RpcReply::error(RpcServer::INTERNAL_ERROR, "Key generation failed");
+        }
+        return RpcReply::ok("{\"address\":\"" + keys.address + "\",\"key\":\"" + keys.privateKey + "\"}");
+    });
+
+    server->addMethod("getmempool", [this](const RpcParams&) {
+        std::vector<std::string> txids = mempool.getTxids();
+        std::string json = "{\"size\":" + std::to_string(txids.size()) + ",\"txids\":[";
+        for (size_t i = 0; i < txids.size(); i++) {
+            json += (i == 0 ? "\"" : ",\"") + txids[i] + "\"";
+        }
+        return RpcReply::ok(json + "]}");
+    });
+
+    if (!server->start()) {
+        return false;
+    }
+    rpcServer = std::move(server);
+    LOG_INFO(Http, "Serving JSON-RPC").kv("url", "http://127.0.0.1:" + std::to_string(rpcPort) + "/");
+    return true;
+}
+
+bool Node::startTrace(const std::string& filename) {
+    if (!trace.open(filename)) {
+        LOG_ERROR(Net, "Could not open trace file").kv("file", filename);
+        return false;
+    }
+    LOG_INFO(Net, "Recording peer traffic").kv("file", filename);
+    return true;
+}
+
+void Node::stopTrace() {
+    trace.close();
+}
+
+Node::ReplayStats Node::replayTrace(const std::string& filename, bool realTime) {
+    ReplayStats stats;
+
+    TraceReader reader;
+    if (running) {
+        LOG_ERROR(Net, "Can't replay a trace into a running node");
+        return stats;
+    }
+    if (!reader.open(filename)) {
+        LOG_ERROR(Net, "Could not read trace file").kv("file", filename);
+        return stats;
+    }
+    stats.loaded = true;
+
+    // Handlers still queue replies; this makes them vanish
+    replaying = true;
+
+    auto start = std::chrono::steady_clock::now();
+    TraceRecord record;
+
+    while (reader.next(record)) {
+        if (realTime) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(record.micros));
+        }
+        stats.traceSeconds = record.micros / 1e6;
+
+        if (record.kind == TraceRecord::CONNECT) {
+            std::istringstream fields(record.payload);
+            std::string host;
+            int remotePort = 0;
+            int inbound = 1;
+            fields >> host >> remotePort >> inbound;
+
+            peers.addPeer(record.peer, host, remotePort, inbound != 0);
+            peerConnected(record.peer);
+            if (!inbound) {
+                syncWithPeer(record.peer); // connectToPeer() does this for outbound peers
+            }
+        }
+        else if (record.kind == TraceRecord::DISCONNECT) {
+            peers.removePeer(record.peer);
+            peerDisconnected(record.peer);
+        }
+        else {
+            auto before = std::chrono::steady_clock::now();
+            handlePeerMessage(record.peer, record.payload);
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+
+            ReplayStats::TypeStats& type = stats.byType[messageType(record.payload)];
+            type.count++;
+            type.bytes += record.payload.size();
+            type.seconds += elapsed;
+
+            stats.messages++;
+            stats.bytes += record.payload.size();
+            stats.busySeconds += elapsed;
+        }
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    replaying = false;
+    return stats;
+}
+
+void Node::peerConnected(PeerId peer) {
+    // Introduce ourselves: the port to dial us back on and our height
+    sendToPeer(peer, "{\"type\":\"VERSION\",\"port\":" + std::to_string(port) +
+        ",\"height\":" + std::to_string(static_cast<long>(blockchain.getChainLength()) - 1) +
+        (lightClient ? ",\"light\":1}" : "}"));
+
+    {
+        std::lock_guard<std::mutex> lock(syncMutex);
+        if (downloader.isActive()) {
+            downloader.addPeer(peer);
+            rankDownloadPeers();
+            dispatchBlockRequests();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        inventoryOf(peer);
+    }
+
+    // Let the newcomer fill its mempool from ours
+    std::vector<std::string> txids = mempool.getTxids(MAX_INV_PER_MESSAGE);
+    if (!txids.empty()) {
+        announceTransactions(txids, 0);
+    }
+}
+
+SeenFilter& Node::inventoryOf(PeerId peer) {
+    return peerInventory.try_emplace(peer, PEER_INVENTORY_CAPACITY).first->second;
+}
+
+void Node::peerDisconnected(PeerId peer) {
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        peerInventory.erase(peer);
+    }
+
+    std::lock_guard<std::mutex> lock(syncMutex);
+    if (downloader.isActive()) {
+        downloader.removePeer(peer);
+        dispatchBlockRequests();
+    }
+    else if (sync.active && sync.peer == peer) {
+        resetSync(); // Lost our header source
+    }
+}
+
+void Node::resetSync() {
+    sync = SyncState();
+    downloader.reset();
+}
+
+void Node::broadcastMessage(const MessageBuffer& frame) {
+    if (replaying) {
+        return;
+    }
+
+    // Peer state belongs to the I/O thread, so fan out there. Every peer
+    // queues the same buffer; nothing is copied per peer.
+    loop.post([this, frame]() {
+        std::vector<PeerId> failed;
+
+        for (auto& entry : connections) {
+            if (!queueFrame(entry.second, frame)) {
+                failed.push_back(entry.first);
+            }
+        }
+
+        for (PeerId peer : failed) {
+            closeConnection(peer);
+        }
+    });
+
+    LOG_DEBUG(Relay, "Broadcasting").kv("peers", peerCount.load());
+}
+
+void Node::mineAndBroadcast(std::vector<Transaction> transactions) {
+    TRACE_SPAN("mineAndBroadcast");
+    if (lightClient) {
+        LOG_WARN(Mining, "Light clients don't mine");
+        return;
+    }
+    LOG_INFO(Mining, "Mining new block").kv("transactions", transactions.size());
+    
+    lockChain(chainMutex);
+
+    // addBlock() consumes its copy; ours is for the mempool afterwards
+    blockchain.addBlock(transactions);
+    ChainSnapshot mined = blockchain.snapshot();
+
+    chainMutex.unlock();
+
+    // Everything we tried is done with: mined, or dropped as invalid
+    mempool.remove(transactions);
+
+    relayBlock(mined->tip(), 0);
+
+
+    LOG_INFO(Mining, "Block mined and broadcast").kv("height", blockchain.getChainLength() - 1);
+}
+
+void Node::requestChainFromPeer(PeerId peer) {
+    std::string message = "{\"type\":\"GET_CHAIN\"}";
+    sendToPeer(peer, message);
+    LOG_DEBUG(Sync, "Requested chain from peer").kv("peer", peer);
+}
+
+bool Node::submitTransaction(Transaction tx, std::string* reason) {
+    if (lightClient) {
+        if (reason) {
+            *reason = "light clients keep no balances to check it against";
+        }
+        return false;
+    }
+    std::string txid = tx.calculateHash();
+    if (!acceptTransaction(std::move(tx), txid, reason)) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        seenTxs.insert(txid);
+    }
+
+    announceTransactions({ txid }, 0);
+    return true;
+}
+
+void Node::minePendingTransactions() {
+    if (lightClient) {
+        LOG_WARN(Mining, "Light clients don't mine");
+        return;
+    }
+    std::shared_ptr<const BlockTemplate::Work> work = blockTemplate.current();
+    if (!work) {
+        return;
+    }
+    LOG_INFO(Mining, "Mining new block").kv("transactions", work->transactions.size() - 1);
+
+    // The template is already validated; only the nonce is left to find
+    Block block = work->toBlock(work->header);
+    block.mineBlock(blockchain.getMinerThreads());
+    submitMinedBlock(std::move(block));
+}
+
+bool Node::submitMinedBlock(Block block) {
+    TRACE_SPAN_ARG("submitMinedBlock", "height", block.index);
+    lockChain(chainMutex);
+    ChainSnapshot chain = blockchain.snapshot();
+    if (block.previousHash != chain->tip().hash) {
+        chainMutex.unlock();
+        LOG_INFO(Mining, "Mined block is stale, dropped").kv("height", block.index);
+        return false;
+    }
+    // The template is checked only as the tip moves, so a transaction
+    // confirmed, or outspent, as it entered the mempool can still be in it
+    std::vector<size_t> invalid;
+    if (!blockchain.validateSpends(*chain, block, &invalid)) {
+        chainMutex.unlock();
+        std::vector<std::string> txids;
+        for (size_t i : invalid) {
+            txids.push_back(block.transactions[i].calculateHash());
+        }
+        LOG_WARN(Mining, "Mined block has invalid transactions, dropping them").kv("height", block.index)
+            .kv("count", txids.size());
+        mempool.removeTxids(txids);
+        return false;
+    }
+    auto mined = std::make_shared<const Block>(std::move(block));
+    blockchain.addExistingBlock(mined);
+    chainMutex.unlock();
+
+    static Counter& blocksMined = Metrics::instance().counter("blockchain_blocks_mined_total", "Blocks mined by this process");
+    blocksMined.inc();
+    mempool.removeForBlock(*mined);
+    relayBlock(*mined, 0);
+
+    LOG_INFO(Mining, "Block mined and broadcast").kv("height", mined->index).kv("transactions", mined->transactions.size() - 1);
+    return true;
+}
+
+void Node::receiveInventory(PeerId peer, const std::string& message) {
+    std::vector<std::string> txids = extractStrings(message, "txids");
+    if (txids.size() > MAX_INV_PER_MESSAGE) {
+        txids.resize(MAX_INV_PER_MESSAGE);
+    }
+
+    std::vector<std::string> wanted;
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        SeenFilter& known = inventoryOf(peer);
+
+        for (const std::string& txid : txids) {
+            known.insert(txid); // They have it, never announce it back
+
+            if (seenTxs.contains(txid) || mempool.contains(txid)) {
+                continue;
+            }
+
+            // Someone else is already sending it
+            auto requested = requestedTxs.find(txid);
+            if (requested != requestedTxs.end() && now - requested->second < TX_REQUEST_TIMEOUT) {
+                continue;
+            }
+
+            requestedTxs[txid] = now;
+            wanted.push_back(txid);
+        }
+    }
+
+    if (!wanted.empty()) {
+        sendToPeer(peer, "{\"type\":\"GET_TX\",\"txids\":" + toJSONArray(wanted) + "}");
+    }
+}
+
+void Node::sendTransactions(PeerId peer, const std::string& message) {
+    std::vector<std::string> txids = extractStrings(message, "txids");
+    if (txids.size() > MAX_INV_PER_MESSAGE) {
+        txids.resize(MAX_INV_PER_MESSAGE);
+    }
+
+    std::string reply = "{\"type\":\"TX\",\"data\":[";
+    bool first = true;
+    for (const std::string& txid : txids) {
+        Transaction tx("", "", 0);
+        if (!mempool.get(txid, tx)) {
+            continue; // Mined or evicted since we announced it
+        }
+        if (!first) {
+            reply += ",";
+        }
+        reply += tx.toJSON();
+        first = false;
+    }
+    reply += "]}";
+
+    if (!first) {
+        sendToPeer(peer, reply);
+    }
+}
+
+void Node::receiveTransactions(PeerId peer, const std::string& message) {
+    std::vector<std::string> accepted;
+
+    // Parse them all, then hash them as one batch
+    std::vector<Transaction> txs;
+    for (std::string_view txJson : extractObjects(message, "data")) {
+        txs.push_back(Transaction::fromJSON(txJson));
+    }
+    std::vector<std::string> txids = Transaction::calculateHashes(txs);
+
+    for (size_t i = 0; i < txs.size(); i++) {
+        Transaction& tx = txs[i];
+        std::string& txid = txids[i];
+
+        {
+            std::lock_guard<std::mutex> lock(relayMutex);
+            requestedTxs.erase(txid);
+            inventoryOf(peer).insert(txid);
+            if (!seenTxs.insert(txid)) {
+                continue; // Already handled this one
+            }
+        }
+
+        if (acceptTransaction(std::move(tx), txid)) {
+            accepted.push_back(std::move(txid));
+        }
+    }
+
+    if (!accepted.empty()) {
+        announceTransactions(accepted, peer);
+    }
+}
+
+bool Node::acceptTransaction(Transaction tx, const std::string& txid, std::string* reason) {
+    NodeMetrics& metrics = nodeMetrics();
+    auto reject = [reason](Counter& counter, const char* why) {
+        counter.inc();
+        if (reason != nullptr) {
+            *reason = why;
+        }
+        return false;
+    };
+
+    // Only blocks may create coins; anything we relay must reach peers
+    // as it left the sender
+    if (tx.sender == "SYSTEM" || tx.amount <= 0 || !Transaction::isPlainAddress(tx.receiver)) {
+        return reject(metrics.txRejectedInvalid, "invalid");
+    }
+    // Cached once it passes, so validateTransaction() below and the block
+    // that mines it don't verify it again
+    if (!blockchain.verifySignature(tx, txid)) {
+        return reject(metrics.txRejectedSignature, "bad signature");
+    }
+    // A replay of one already mined
+    if (blockchain.isConfirmed(tx)) {
+        return reject(metrics.txRejectedDuplicate, "already confirmed");
+    }
+    // Whatever the sender's waiting transactions spend is spoken for
+    std::string sender = tx.sender;
+    double amount = tx.amount;
+    double balance = blockchain.getBalance(sender);
+    if (amount > balance) {
+        return reject(metrics.txRejectedBalance, "insufficient balance");
+    }
+    if (!mempool.add(std::move(tx), txid, balance)) {
+        // add() refuses duplicates, overspends and anything past a full pool
+        if (mempool.contains(txid)) {
+            return reject(metrics.txRejectedDuplicate, "duplicate");
+        }
+        if (mempool.pendingSpend(sender) + amount > balance) {
+            return reject(metrics.txRejectedBalance, "insufficient balance");
+        }
+        return reject(metrics.txRejectedFull, "mempool full");
+    }
+
+    metrics.txAccepted.inc();
+    return true;
+}
+
+void Node::announceTransactions(const std::vector<std::string>& txids, PeerId origin) {
+    std::vector<PeerId> relayOrder = peers.rankedPeers();
+
+    std::vector<std::pair<PeerId, std::vector<std::string>>> announcements;
+    {
+        std::lock_guard<std::mutex> lock(relayMutex);
+        for (PeerId peer : relayOrder) {
+            auto it = peerInventory.find(peer);
+            if (it == peerInventory.end() || peer == origin) {
+                continue;
+            }
+
+            std::vector<std::string> fresh;
+            for (const std::string& txid : txids) {
+                if (it->second.insert(txid)) {
+                    fresh.push_back(txid);
+                }
+            }
+            if (!fresh.empty()) {
+                announcements.emplace_back(peer, std::move(fresh));
+            }
+        }
+    }
+
+    for (auto& announcement : announcements) {
+        sendToPeer(announcement.first, "{\"type\":\"INV\",\"txids\":" + toJSONArray(announcement.second) + "}");
+    }
+}
+
+void Node::expireRelayRequests() {
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(relayMutex);
+    for (auto it = requestedTxs.begin(); it != requestedTxs.end();) {
+        if (now - it->second > TX_REQUEST_TIMEOUT) {
+            it = requestedTxs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = pendingBlocks.begin(); it != pendingBlocks.end();) {
+        if (now - it->second.requestedAt > BLOCK_TXN_TIMEOUT) {
+            it = pendingBlocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Node::updateMempool(const ChainState& before, const ChainState& after, size_t fork) {
+    // Transactions from blocks we dropped are pending again
+    for (size_t i = fork; i < before.size(); i++) {
+        for (const Transaction& tx : before[i].transactions) {
+            if (tx.sender != "SYSTEM") {
+                mempool.add(tx);
+            }
+        }
+    }
+
+    for (size_t i = fork; i < after.size(); i++) {
+        mempool.removeForBlock(after[i]);
+    }
+}
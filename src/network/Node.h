@@ -7,77 +7,570 @@
 // - Send messages to peers (new blocks, chain requests, etc.)
 // - Receive messages from peers
 // - Run in the background using threads
+//
+// Outbound data:
+// - Every message is framed once into an immutable, ref-counted buffer;
+//   a broadcast queues the same buffer on every peer
+// - Each peer has its own queue, flushed with scatter writes of many
+//   buffers at once; a slow peer only ever delays itself
+// - Very large messages (a whole chain) are streamed instead: the I/O
+//   thread serializes the next STREAM_CHUNK_SIZE bytes from a snapshot
+//   whenever the socket has drained, so no full copy is ever built
+// - Above SEND_HIGH_WATERMARK queued bytes we stop reading from the peer
+//   until it drains below SEND_LOW_WATERMARK; a peer that stays above the
+//   high watermark for SEND_STALL_TIMEOUT is disconnected
+//
+// Threading model:
+// - One I/O thread runs an epoll EventLoop that accepts, reads and writes
+//   every peer socket without blocking
+// - Complete messages are handed to a bounded ThreadPool for parsing and
+//   validation; all messages from one peer go to the same worker so they
+//   are processed in order
+// - Peer state lives on the I/O thread; other threads reach it via post()
+//
+// Metrics:
+// - Hot paths update the process-wide registry in Metrics.h without locks
+// - startMetrics() serves it, plus this node's height, mempool, peers,
+//   send queues and traffic, at http://127.0.0.1:<port>/metrics
+// - Builds with TRACING=1 also time each stage of a block's trip through
+//   the node (see Tracer.h); /trace on the same port dumps the spans
+//
+// JSON-RPC:
+// - startRpc() serves chain queries and transaction submission to local
+//   clients from the I/O loop (see RpcServer.h); reads use chain snapshots
+//   and never take chainMutex
+//
+// Light clients:
+// - setLightClient() makes a node keep headers only: it syncs and checks
+//   the header chain, takes new blocks as headers, and serves no bodies,
+//   transactions or proofs
+// - Payments are checked with Merkle proofs instead: GET_PROOFS asks a
+//   full peer for the branches linking a transaction (or an address's
+//   transactions) to a block's merkleRoot, which the light client checks
+//   against the header it already has
+//
+// Tracing:
+// - startTrace() records every inbound message, connect and disconnect
+//   with its arrival time to a file (see MessageTrace.h)
+// - replayTrace() feeds such a file into a node that was never started,
+//   on the calling thread, with all outbound traffic dropped, so real
+//   traffic can be reprocessed repeatably and timed
 
 #ifndef NODE_H
 #define NODE_H
 
 #include "Blockchain.h"
+#include "BlockDownloader.h"
+#include "BlockTemplate.h"
+#include "EventLoop.h"
+#include "HttpServer.h"
+#include "Mempool.h"
+#include "MessageTrace.h"
+#include "PeerManager.h"
+#include "PeerId.h"
+#include "RpcServer.h"
+#include "SeenFilter.h"
+#include "ThreadPool.h"
 #include <string>
 #include <vector>
 #include <thread> // For background threads
 #include <mutex> // For thread-safe blockchain access
-#include <atomic> // For the running blag
+#include <atomic> // For the running flag
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
+// A framed message shared by every peer it is queued on
+using MessageBuffer = std::shared_ptr<const std::string>;
+
+// Produces a long frame piece by piece: appends the next chunk to out and
+// returns false once the frame (newline included) is complete
+using ChunkSource = std::function<bool(std::string& out)>;
 
 class Node {
     private:
+        // Per-connection state, owned by the I/O thread
+        struct Connection {
+            PeerId id;
+            int fd;
+            std::string inbound; // Bytes received but not yet framed
+            std::deque<MessageBuffer> sendQueue; // Frames not yet fully written
+            size_t sendOffset = 0; // Bytes of sendQueue.front() already written
+            size_t queuedBytes = 0; // Unwritten bytes across sendQueue and backlog
+            ChunkSource stream; // Frame being produced as the socket drains
+            std::deque<std::pair<MessageBuffer, ChunkSource>> backlog; // Queued behind stream, in order
+            bool wantWrite = false; // EPOLLOUT currently armed
+            bool flushScheduled = false; // Already listed in dirtyPeers
+            bool congested = false; // Over the high watermark, reads paused
+            bool workersFull = false; // Our worker queue for it was full: reads paused, messages left in inbound
+            size_t scanned = 0; // Bytes of inbound already searched for a newline
+            std::chrono::steady_clock::time_point congestedSince;
+        };
+
+        // Headers-first sync progress. Headers come from one peer; bodies
+        // are spread over every peer by the downloader.
+        struct SyncState {
+            bool active = false;
+            PeerId peer = 0; // Peer we take headers from
+            int forkIndex = -1; // Last block we share with the peer
+            std::vector<BlockHeader> headers; // Validated headers after forkIndex
+            bool extendsTip = false; // Bodies connect directly onto our tip
+            std::vector<Block> bodies; // Bodies held back until a reorg can be applied
+            std::chrono::steady_clock::time_point lastProgress; // For header timeouts
+        };
+
+        // An outbound connect() still waiting for the TCP handshake
+        struct Dial {
+            std::string host;
+            int port;
+            std::chrono::steady_clock::time_point deadline; // Given up on after CONNECT_TIMEOUT
+        };
+
+        // A compact block waiting for the transactions we couldn't fill in
+        struct PendingBlock {
+            BlockHeader header;
+            PeerId peer;
+            std::vector<std::optional<Transaction>> slots; // One per transaction
+            std::vector<size_t> missing; // Indexes we asked for
+            std::chrono::steady_clock::time_point requestedAt;
+        };
+
         Blockchain blockchain;
         int port; // Port this node listens on
         int serverSocket; // Socket for accepting connections
-        std::vector<int> peerSockets; // Connected peers
-        std::thread listenerThread; // Background thread for listening
-        std::mutex chainMutex; // Protect blockchain from concurrent access
-        std::mutex peersMutex;  // Protect peerSockets vector
-        bool running; // Is node running?
-    
+        EventLoop loop; // Reactor for all sockets
+        ThreadPool workers; // Message parsing and validation
+        std::thread ioThread; // Runs loop
+        std::unordered_map<PeerId, Connection> connections; // I/O thread only
+        std::unordered_map<int, PeerId> fdToPeer; // I/O thread only
+        std::unordered_map<int, Dial> dials; // By socket; I/O thread only
+        std::vector<PeerId> dirtyPeers; // Peers with frames queued since the last flush (I/O thread)
+        std::atomic<PeerId> nextPeerId;
+        std::atomic<size_t> peerCount; // Mirror of connections.size() for other threads
+        std::mutex chainMutex; // Serializes check-then-write chain updates; readers use snapshots
+        SyncState sync;
+        BlockDownloader downloader; // Parallel body download
+        std::mutex syncMutex; // Protects sync and downloader
+        PeerManager peers; // Per-peer state, limits, keepalive and the address book
+        std::string addressBookFile; // Where the address book lives ("" = not persisted)
+        Mempool mempool; // Transactions waiting to be mined
+        BlockTemplate blockTemplate; // Next block to mine, fed by mempool
+        SeenFilter seenTxs; // Txids we already received, so relays don't loop
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> requestedTxs; // Outstanding GET_TX
+        std::unordered_map<PeerId, SeenFilter> peerInventory; // Txids each peer already has
+        std::unordered_map<std::string, PendingBlock> pendingBlocks; // By block hash
+        std::mutex relayMutex; // Protects seenTxs, requestedTxs, peerInventory and pendingBlocks
+        std::atomic<uint64_t> bytesSent; // Everything written to peer sockets
+        std::atomic<uint64_t> bytesReceived; // Everything read from peer sockets
+        std::atomic<bool> running; // Is node running?
+        TraceWriter trace; // Inbound traffic recording (when open)
+        std::atomic<bool> replaying; // Replaying a trace: outbound traffic is dropped
+        std::unique_ptr<HttpServer> metricsServer; // Serves /metrics (when started)
+        std::unique_ptr<RpcServer> rpcServer; // JSON-RPC on the I/O loop (when started)
+        bool lightClient = false; // Headers only (set before start())
+        std::unordered_map<uint64_t, std::pair<PeerId, std::shared_ptr<std::promise<std::string>>>> proofRequests; // Outstanding GET_PROOFS by id
+        uint64_t nextProofRequest = 1;
+        std::mutex proofMutex; // Protects proofRequests and nextProofRequest
+
     public:
+        // A transaction shown by its Merkle branch to be in one of our blocks
+        struct ProvenTransaction {
+            Transaction tx;
+            int height;
+            std::string blockHash;
+        };
+
+        // What replayTrace() measured
+        struct ReplayStats {
+            // Totals for one message type
+            struct TypeStats {
+                uint64_t count = 0;
+                uint64_t bytes = 0;
+                double seconds = 0.0; // Spent handling them
+            };
+
+            bool loaded = false; // The trace could be opened
+            uint64_t messages = 0;
+            uint64_t bytes = 0;
+            double seconds = 0.0; // Wall time of the whole replay
+            double busySeconds = 0.0; // Time spent handling messages
+            double traceSeconds = 0.0; // Time span covered by the trace
+            std::map<std::string, TypeStats> byType;
+        };
+
+        // Max size of one framed message
+        static constexpr size_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+        // Queued bytes at which we stop reading from a peer
+        static constexpr size_t SEND_HIGH_WATERMARK = 4 * 1024 * 1024;
+
+        // Queued bytes at which we start reading again
+        static constexpr size_t SEND_LOW_WATERMARK = 1024 * 1024;
+
+        // Queued bytes at which a peer is dropped immediately
+        static constexpr size_t MAX_SEND_QUEUE = 2 * MAX_MESSAGE_SIZE;
+
+        // How often peers paused on a full worker queue are retried
+        static constexpr std::chrono::milliseconds WORKER_RETRY_INTERVAL { 10 };
+
+        // How long a peer may stay above the high watermark
+        static constexpr std::chrono::milliseconds SEND_STALL_TIMEOUT { 30000 };
+
+        // Buffers handed to one scatter write
+        static constexpr int MAX_WRITE_BATCH = 64;
+
+        // Bytes a streamed message is produced in at a time
+        static constexpr size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
+        // Most headers returned for one GET_HEADERS
+        static constexpr size_t MAX_HEADERS_PER_MESSAGE = 2000;
+
+        // Bodies requested per GET_BLOCKS
+        static constexpr size_t BLOCKS_PER_REQUEST = 128;
+
+        // GET_BLOCKS requests outstanding per peer during sync
+        static constexpr size_t MAX_BLOCK_REQUESTS_PER_PEER = 4;
+
+        // How far past the next connectable block the download may run
+        static constexpr size_t DOWNLOAD_WINDOW = 4096;
+
+        // A GET_BLOCKS (or header reply) older than this counts as stalled
+        static constexpr std::chrono::milliseconds SYNC_STALL_TIMEOUT { 5000 };
+
+        // Most txids announced or requested per INV / GET_TX
+        static constexpr size_t MAX_INV_PER_MESSAGE = 5000;
+
+        // Hashes remembered per generation of a peer's inventory: a full INV,
+        // or about 700 KB per peer at most
+        static constexpr size_t PEER_INVENTORY_CAPACITY = MAX_INV_PER_MESSAGE;
+
+        // How long before a GET_TX nobody answered may go to another peer
+        static constexpr std::chrono::milliseconds TX_REQUEST_TIMEOUT { 2000 };
+
+        // How long a compact block may wait for its missing transactions
+        static constexpr std::chrono::milliseconds BLOCK_TXN_TIMEOUT { 10000 };
+
+        // Most proofs returned for one GET_PROOFS
+        static constexpr size_t MAX_PROOFS_PER_MESSAGE = 1000;
+
+        // How long a light client waits for a PROOFS reply
+        static constexpr std::chrono::milliseconds PROOF_TIMEOUT { 5000 };
+
+        // How long a dial waits for the TCP handshake
+        static constexpr std::chrono::milliseconds CONNECT_TIMEOUT { 5000 };
+
         // Constructor
-        Node(int port, int difficulty, double miningReward);
+        Node(int port, int difficulty, double miningReward, size_t workerThreads = 2);
 
         // Destructor
         ~Node();
 
-        // Start the node (begin listening for connections)
-        void start();
+        // Start the node (begin listening for connections); false if the
+        // port couldn't be bound
+        bool start();
 
         // Stop the node
         void stop();
 
-        // Connect to another node
+        // Start dialing another node without waiting for the handshake; the
+        // I/O thread finishes the connection. False if it couldn't be
+        // started (banned, no outbound slot, bad address, refused).
         bool connectToPeer(const std::string& address, int port);
 
         // Mine a new block and broadcast it
         void mineAndBroadcast(std::vector<Transaction> transactions);
 
+        // Validate a local transaction, add it to the mempool (moving it
+        // in) and announce it; on rejection, reason (if given) says why
+        bool submitTransaction(Transaction tx, std::string* reason = nullptr);
+
+        // Mine the block template (everything in the mempool) and
+        // broadcast the block
+        void minePendingTransactions();
+
+        // Connect and broadcast a block mined on our block template; false
+        // if our tip moved on first, or if it carries transactions that
+        // can't follow the tip (those leave the mempool)
+        bool submitMinedBlock(Block block);
+
+        // Transactions waiting to be mined
+        Mempool& getMempool() { return mempool; }
+
+        // The next block to mine, kept current (see BlockTemplate.h)
+        BlockTemplate& getBlockTemplate() { return blockTemplate; }
+
         // Get blockchain (for printing/testing)
         Blockchain& getBlockchain();
 
+        // Number of connected peers
+        size_t getPeerCount() const { return peerCount; }
+
+        // Per-peer state, connection limits and the address book
+        PeerManager& getPeerManager() { return peers; }
+
+        // Load the address book from this file on start() and save it on stop()
+        void setAddressBook(const std::string& filename);
+
+        // Traffic totals across all peers
+        uint64_t getBytesSent() const { return bytesSent; }
+        uint64_t getBytesReceived() const { return bytesReceived; }
+
+        // Serve /metrics and /trace on 127.0.0.1:metricsPort until stop()
+        bool startMetrics(int metricsPort);
+
+        // Process-wide metrics plus this node's state, in Prometheus text format
+        std::string renderMetrics();
+
+        // Serve JSON-RPC on 127.0.0.1:rpcPort until stop() (after start())
+        bool startRpc(int rpcPort);
+
+        // Keep headers only (call before start() and before loading a chain)
+        void setLightClient(bool light) { lightClient = light; }
+        bool isLightClient() const { return lightClient; }
+
+        // Light client: have a full peer prove the transaction with this
+        // txid and check the proof against our headers. Blocks for up to
+        // PROOF_TIMEOUT, so not for the node's own threads. False (with
+        // reason) if no full peer answered or a proof is bad; proven is
+        // left empty if the peer doesn't know the transaction.
+        bool proveTransaction(const std::string& txid, std::vector<ProvenTransaction>& proven,
+                              std::string* reason = nullptr);
+
+        // The same for every transaction to or from address (newest first,
+        // at most MAX_PROOFS_PER_MESSAGE). Each one is proven; that none
+        // were left out rests on the peer.
+        bool proveAddress(const std::string& address, std::vector<ProvenTransaction>& proven,
+                          std::string* reason = nullptr);
+
+        // Balance of address summed over proveAddress()'s transactions
+        bool provenBalance(const std::string& address, double& balance, std::string* reason = nullptr);
+
+        // Record inbound traffic to a trace file until stopTrace()
+        bool startTrace(const std::string& filename);
+        void stopTrace();
+
+        // Process a recorded trace as if its peers were connected. The node
+        // must not be started. realTime keeps the recorded gaps between
+        // messages; otherwise they are handled back to back.
+        ReplayStats replayTrace(const std::string& filename, bool realTime = false);
+
     private:
-        // Background thread that listens for connections
-        void listenForConnections();
+        // Accept every pending connection on the listening socket
+        void acceptConnections();
+
+        // Register a connected, non-blocking socket with the loop (I/O thread)
+        void addConnection(int fd, PeerId peer, const std::string& host, int remotePort, bool inbound);
+
+        // Watch a socket with a connect() in progress (I/O thread)
+        void addDial(int fd, const std::string& host, int remotePort);
+
+        // The dial's socket became writable: register the connection if
+        // the handshake succeeded (I/O thread)
+        void finishDial(int fd);
+
+        // Give up on dials past their deadline (I/O thread)
+        void expireDials();
 
-        // Handle an individual peer connection
-        void handlePeer(int peerSocket);
+        // Close a dial's socket, note the failure and free its outbound slot (I/O thread)
+        void abandonDial(int fd, const char* reason);
 
-        // Broadcast a message to all connected peers
-        void broadcastMessage(const std::string& message);
+        // React to readiness on a peer socket (I/O thread)
+        void onPeerEvent(PeerId peer, uint32_t events);
+
+        // Drain the socket and hand complete messages to the workers; while
+        // the peer's worker is backlogged only a hangup is read (I/O thread)
+        bool readFromPeer(Connection& conn, bool hangup);
+
+        // Hand every complete message in conn.inbound to the peer's worker,
+        // pausing reads if its queue fills up (I/O thread)
+        void dispatchMessages(Connection& conn);
+
+        // Retry peers paused by dispatchMessages() (I/O thread)
+        void resumeReads();
+
+        // Write as much queued output as the socket accepts (I/O thread)
+        bool flushPeer(Connection& conn);
+
+        // Append a frame to a peer's queue and schedule a flush (I/O thread)
+        bool queueFrame(Connection& conn, const MessageBuffer& frame);
+
+        // Queue a streamed frame behind everything already queued (I/O thread)
+        void queueStream(Connection& conn, ChunkSource source);
+
+        // Keep about one chunk of the active stream queued, moving on to
+        // the backlog once it ends (I/O thread)
+        void pumpStream(Connection& conn);
+
+        // Schedule a flush for this loop iteration (I/O thread)
+        void scheduleFlush(Connection& conn);
+
+        // Flush every peer that had frames queued (I/O thread)
+        void flushDirtyPeers();
+
+        // Apply watermarks and re-arm epoll interest (I/O thread)
+        void updateInterest(Connection& conn);
+
+        // Drop peers stuck above the high watermark (I/O thread)
+        void checkSendQueues();
+
+        // Drop a connection and close its socket (I/O thread)
+        void closeConnection(PeerId peer);
+
+        // Drop a connection from any thread
+        void disconnectPeer(PeerId peer);
+
+        // Handle one complete message from a peer (worker thread)
+        void handlePeerMessage(PeerId peer, const std::string& message);
+
+        // Frame a message into a shareable buffer
+        static MessageBuffer makeFrame(std::string message);
+
+        // Queue a message for one peer (any thread)
+        void sendToPeer(PeerId peer, std::string message);
+        void sendToPeer(PeerId peer, const MessageBuffer& frame);
+
+        // Queue a streamed message for one peer (any thread)
+        void streamToPeer(PeerId peer, ChunkSource source);
+
+        // Broadcast one shared frame to all connected peers
+        void broadcastMessage(const MessageBuffer& frame);
 
         // Request chain from peer
-        void requestChainFromPeer(int peerSocket);
+        void requestChainFromPeer(PeerId peer);
+
+        // Start a headers-first sync with a peer (adopt its chain if it
+        // has more work)
+        void syncWithPeer(PeerId peer);
+
+        // Answer GET_HEADERS with the headers after the best locator match
+        void sendHeaders(PeerId peer, const std::string& message);
+
+        // Validate a HEADERS batch and continue the sync
+        void receiveHeaders(PeerId peer, const std::string& message);
+
+        // Answer GET_BLOCKS with a range of full blocks
+        void sendBlocks(PeerId peer, const std::string& message);
+
+        // Check a BLOCKS batch against the synced headers and connect it
+        void receiveBlocks(PeerId peer, const std::string& message);
+
+        // Send whatever GET_BLOCKS the downloader wants (syncMutex held)
+        void dispatchBlockRequests();
+
+        // Connect or stage bodies that arrived in order (syncMutex held)
+        bool connectReadyBlocks();
+
+        // Apply a downloaded reorg and end the sync (syncMutex held)
+        void finishSync();
 
-        // Sync with peer (adopt longer chain)
-        void syncWithPeer(int peerSocket);
+        // Periodic stall detection and rescheduling (worker thread)
+        void onSyncTick();
 
-        // Send our chain to a peer
-        void sendChain(int peerSocket);
+        // Let the sync logic know a peer came or went (worker thread)
+        void peerConnected(PeerId peer);
+        void peerDisconnected(PeerId peer);
+
+        // Forget the current sync (syncMutex held)
+        void resetSync();
+
+        // Prefer low-latency peers for body downloads (syncMutex held)
+        void rankDownloadPeers();
+
+        // VERSION: note the peer's listening port and height
+        void receiveVersion(PeerId peer, const std::string& message);
+
+        // Pings, dead-peer detection and outbound top-up (worker thread)
+        void maintainPeers();
+
+        // Raise a peer's misbehavior score; drop it at the ban threshold
+        void penalize(PeerId peer, int score, const std::string& reason);
+
+        // INV: request the announced transactions we don't have yet
+        void receiveInventory(PeerId peer, const std::string& message);
+
+        // GET_TX: send the requested mempool transactions
+        void sendTransactions(PeerId peer, const std::string& message);
+
+        // TX: accept new transactions and relay their txids
+        void receiveTransactions(PeerId peer, const std::string& message);
+
+        // Check a transaction (whose hash is txid) against the chain and
+        // move it into the mempool; on rejection, reason (if given) says why
+        bool acceptTransaction(Transaction tx, const std::string& txid, std::string* reason = nullptr);
+
+        // INV these txids to every peer not known to have them
+        void announceTransactions(const std::vector<std::string>& txids, PeerId origin);
+
+        // Forget GET_TX and GETBLOCKTXN requests nobody answered (worker thread)
+        void expireRelayRequests();
+
+        // Keep the mempool in step with the chain after the blocks past fork
+        // changed from before's to after's
+        void updateMempool(const ChainState& before, const ChainState& after, size_t fork);
+
+        // Stream our chain to a peer
+        void sendChain(PeerId peer);
 
         // Receive chain from a peer
-        void receiveChain(const std::string& message, int peerSocket);
+        void receiveChain(const std::string& message, PeerId peer);
 
         // Receive a new block from a peer
-        void receiveBlock(const std::string& message);
+        void receiveBlock(const std::string& message, PeerId peer);
+
+        // Connect a block announced by a peer and relay it on (or sync if it
+        // doesn't fit our tip)
+        void connectNewBlock(Block block, PeerId peer);
+
+        // What a peer is known to have, created on first use (relayMutex held)
+        SeenFilter& inventoryOf(PeerId peer);
+
+        // Send a new block to every peer that doesn't have it as a compact
+        // block, prefilled with the transactions each peer is likely missing
+        void relayBlock(const Block& block, PeerId origin);
+
+        // CMPCTBLOCK: rebuild the block from our mempool, ask for the gaps
+        void receiveCompactBlock(PeerId peer, const std::string& message);
+
+        // GETBLOCKTXN: send the requested transactions of one of our blocks
+        void sendBlockTransactions(PeerId peer, const std::string& message);
+
+        // BLOCKTXN: fill the gaps of a pending compact block
+        void receiveBlockTransactions(PeerId peer, const std::string& message);
+
+        // Turn a fully filled compact block into a Block and connect it
+        void completeCompactBlock(PendingBlock pending);
 
         // Send our chain length to a peer
-        void sendLength(int peerSocket);
+        void sendLength(PeerId peer);
+
+        // GET_PROOFS: Merkle proofs for a txid or for an address's transactions
+        void sendProofs(PeerId peer, const std::string& message);
+
+        // PROOFS: hand the reply to the request waiting for it
+        void receiveProofs(PeerId peer, const std::string& message);
+
+        // Send GET_PROOFS with this query to a full peer, wait for the
+        // reply and check each proof (and that matches() holds for its
+        // transaction); see proveTransaction()
+        bool fetchProofs(const std::string& query, const std::function<bool(const Transaction&)>& matches,
+                         std::vector<ProvenTransaction>& proven, std::string* reason);
+
+        // Light client: take the synced headers as our chain if it beats
+        // ours (syncMutex held)
+        void adoptHeaders();
+
+        // Do the synced headers carry more work than chain's blocks past
+        // the fork point? (syncMutex held)
+        bool moreWorkThanOurs(const ChainState& chain) const;
+
+        // Light client: connect a validated header that should fit our tip
+        void connectHeader(const BlockHeader& header, PeerId peer);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,9 @@
+#ifndef PEERID_H
+#define PEERID_H
+
+#include <cstdint>
+
+// Identifies a peer connection (never reused, unlike socket fds)
+using PeerId = uint64_t;
+
+#endif
@@ -0,0 +1,379 @@
+#include "PeerManager.h"
+#include "Logger.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    // Loopback peers are never banned: on a test network everyone shares 127.0.0.1
+    bool isLoopback(const std::string& host) {
+        return host.compare(0, 4, "127.") == 0;
+    }
+}
+
+PeerManager::PeerManager(size_t maxInbound, size_t maxOutbound)
+    : maxInbound(maxInbound), maxOutbound(maxOutbound), inboundCount(0), outboundCount(0), dialingCount(0), nextNonce(1) {
+}
+
+void PeerManager::setLimits(size_t inbound, size_t outbound) {
+    std::lock_guard<std::mutex> lock(mutex);
+    maxInbound = inbound;
+    maxOutbound = outbound;
+}
+
+bool PeerManager::canAcceptInbound() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return inboundCount < maxInbound;
+}
+
+bool PeerManager::canConnectOutbound() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return outboundCount + dialingCount < maxOutbound;
+}
+
+bool PeerManager::reserveOutbound() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (outboundCount + dialingCount >= maxOutbound) {
+        return false;
+    }
+    dialingCount++;
+    return true;
+}
+
+void PeerManager::releaseOutbound() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dialingCount > 0) {
+        dialingCount--;
+    }
+}
+
+bool PeerManager::isBanned(const std::string& host) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = bannedHosts.find(host);
+    return it != bannedHosts.end() && it->second > std::time(nullptr);
+}
+
+void PeerManager::addPeer(PeerId peer, const std::string& host, int port, bool inbound) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    PeerInfo info;
+    info.id = peer;
+    info.host = host;
+    info.port = inbound ? 0 : port; // An inbound peer's source port isn't dialable
+    info.inbound = inbound;
+
+    if (peers.emplace(peer, info).second) {
+        (inbound ? inboundCount : outboundCount)++;
+    }
+}
+
+void PeerManager::removePeer(PeerId peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it == peers.end()) {
+        return;
+    }
+
+    (it->second.inbound ? inboundCount : outboundCount)--;
+    peers.erase(it);
+}
+
+void PeerManager::setListenPort(PeerId peer, int port) {
+    if (port <= 0 || port > 65535) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it == peers.end()) {
+        return;
+    }
+
+    it->second.port = port;
+
+    Address& address = addresses[addressKey(it->second.host, port)];
+    address.host = it->second.host;
+    address.port = port;
+    address.lastSeen = std::time(nullptr);
+}
+
+void PeerManager::updateHeight(PeerId peer, int height) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it != peers.end() && height > it->second.bestHeight) {
+        it->second.bestHeight = height;
+    }
+}
+
+void PeerManager::setLight(PeerId peer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it != peers.end()) {
+        it->second.light = true;
+    }
+}
+
+std::vector<std::pair<PeerId, uint64_t>> PeerManager::pingsDue(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<std::pair<PeerId, uint64_t>> due;
+    for (auto& entry : peers) {
+        PeerInfo& info = entry.second;
+        if (info.pingNonce != 0) {
+            continue; // Still waiting for the last one
+        }
+
+        // Measure new peers straight away so ranking has something to go on
+        bool neverPinged = (info.latencyMs < 0);
+        if (neverPinged || now - info.pingSentAt >= PING_INTERVAL) {
+            info.pingNonce = nextNonce++;
+            info.pingSentAt = now;
+            due.emplace_back(entry.first, info.pingNonce);
+        }
+    }
+    return due;
+}
+
+bool PeerManager::pongReceived(PeerId peer, uint64_t nonce, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it == peers.end() || nonce == 0 || it->second.pingNonce != nonce) {
+        return false;
+    }
+
+    PeerInfo& info = it->second;
+    double sample = std::chrono::duration<double, std::milli>(now - info.pingSentAt).count();
+
+    // Smooth out one-off spikes; the first sample is taken as is
+    info.latencyMs = (info.latencyMs < 0) ? sample : 0.8 * info.latencyMs + 0.2 * sample;
+    info.pingNonce = 0;
+    return true;
+}
+
+std::vector<PeerId> PeerManager::timedOut(Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<PeerId> dead;
+    for (const auto& entry : peers) {
+        const PeerInfo& info = entry.second;
+        if (info.pingNonce != 0 && now - info.pingSentAt > PING_TIMEOUT) {
+            dead.push_back(entry.first);
+        }
+    }
+    return dead;
+}
+
+bool PeerManager::misbehaving(PeerId peer, int score, const std::string& reason) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it == peers.end()) {
+        return false;
+    }
+
+    PeerInfo& info = it->second;
+    int before = info.misbehavior;
+    info.misbehavior += score;
+    LOG_WARN(Peers, "Peer misbehaving").kv("peer", peer).kv("host", info.host).kv("reason", reason)
+        .kv("score", info.misbehavior);
+
+    if (before >= BAN_THRESHOLD || info.misbehavior < BAN_THRESHOLD) {
+        return false; // Below the threshold, or already being dropped
+    }
+
+    if (!isLoopback(info.host)) {
+        std::time_t until = std::time(nullptr) + BAN_DURATION.count();
+        bannedHosts[info.host] = until;
+        for (auto& address : addresses) {
+            if (address.second.host == info.host) {
+                address.second.bannedUntil = until;
+            }
+        }
+        LOG_WARN(Peers, "Banned host").kv("host", info.host).kv("seconds", BAN_DURATION.count());
+    }
+    return true;
+}
+
+std::vector<PeerId> PeerManager::rankedPeers() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<const PeerInfo*> sorted;
+    for (const auto& entry : peers) {
+        sorted.push_back(&entry.second);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const PeerInfo* a, const PeerInfo* b) {
+        bool aKnown = a->latencyMs >= 0;
+        bool bKnown = b->latencyMs >= 0;
+        if (aKnown != bKnown) {
+            return aKnown;
+        }
+        if (aKnown && a->latencyMs != b->latencyMs) {
+            return a->latencyMs < b->latencyMs;
+        }
+        return a->id < b->id;
+    });
+
+    std::vector<PeerId> ranked;
+    for (const PeerInfo* info : sorted) {
+        ranked.push_back(info->id);
+    }
+    return ranked;
+}
+
+std::optional<PeerId> PeerManager::bestPeer(int minHeight) const {
+    std::optional<PeerId> best;
+    for (PeerId peer : rankedPeers()) {
+        std::optional<PeerInfo> info = getPeer(peer);
+        if (info && !info->light && info->bestHeight >= minHeight) {
+            best = peer;
+            break;
+        }
+    }
+    return best;
+}
+
+std::optional<PeerManager::PeerInfo> PeerManager::getPeer(PeerId peer) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it == peers.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::vector<PeerManager::PeerInfo> PeerManager::getPeers() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<PeerInfo> result;
+    for (const auto& entry : peers) {
+        result.push_back(entry.second);
+    }
+    std::sort(result.begin(), result.end(), [](const PeerInfo& a, const PeerInfo& b) { return a.id < b.id; });
+    return result;
+}
+
+size_t PeerManager::getInboundCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return inboundCount;
+}
+
+size_t PeerManager::getOutboundCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return outboundCount;
+}
+
+void PeerManager::addAddress(const std::string& host, int port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Address& address = addresses[addressKey(host, port)];
+    address.host = host;
+    address.port = port;
+}
+
+void PeerManager::connectSucceeded(const std::string& host, int port) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Address& address = addresses[addressKey(host, port)];
+    address.host = host;
+    address.port = port;
+    address.lastSeen = std::time(nullptr);
+    address.failures = 0;
+}
+
+void PeerManager::connectFailed(const std::string& host, int port, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = addresses.find(addressKey(host, port));
+    if (it == addresses.end()) {
+        return; // Only track addresses we already know
+    }
+
+    // Exponential backoff: 5s, 10s, 20s ... capped at 10 minutes
+    Address& address = it->second;
+    address.failures++;
+    long delay = 5L << std::min(address.failures - 1, 7);
+    address.nextAttempt = now + std::chrono::seconds(std::min(delay, 600L));
+}
+
+std::vector<PeerManager::Address> PeerManager::addressesToDial(size_t maxCount, int ownPort, Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<Address> result;
+    std::time_t wallNow = std::time(nullptr);
+
+    for (auto& entry : addresses) {
+        if (result.size() >= maxCount || outboundCount + dialingCount + result.size() >= maxOutbound) {
+            break;
+        }
+
+        Address& address = entry.second;
+        if (isLoopback(address.host) && address.port == ownPort) {
+            continue; // That's us
+        }
+        if (address.bannedUntil > wallNow || now < address.nextAttempt) {
+            continue;
+        }
+        if (isConnected(address.host, address.port)) {
+            continue;
+        }
+
+        // Don't hand the same address out again while this attempt runs
+        address.nextAttempt = now + std::chrono::seconds(5);
+        result.push_back(address);
+    }
+    return result;
+}
+
+size_t PeerManager::getAddressCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return addresses.size();
+}
+
+bool PeerManager::saveAddresses(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : addresses) {
+        const Address& address = entry.second;
+        file << address.host << " " << address.port << " " << address.lastSeen << " "
+             << address.failures << " " << address.bannedUntil << "\n";
+    }
+    return true;
+}
+
+bool PeerManager::loadAddresses(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        Address address;
+        if (!(fields >> address.host >> address.port)) {
+            continue; // Skip malformed lines
+        }
+        fields >> address.lastSeen >> address.failures >> address.bannedUntil;
+
+        if (address.bannedUntil > std::time(nullptr)) {
+            bannedHosts[address.host] = std::max(bannedHosts[address.host], address.bannedUntil);
+        }
+        addresses[addressKey(address.host, address.port)] = address;
+    }
+    return true;
+}
+
+std::string PeerManager::addressKey(const std::string& host, int port) {
+    return host + ":" + std::to_string(port);
+}
+
+bool PeerManager::isConnected(const std::string& host, int port) const {
+    for (const auto& entry : peers) {
+        if (entry.second.host == host && entry.second.port == port) {
+            return true;
+        }
+    }
+    return false;
+}
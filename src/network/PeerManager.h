@@ -0,0 +1,174 @@
+// Tracks who we are connected to and who we could connect to.
+//
+// For every connected peer it keeps the remote address, the best height
+// the peer has shown us, a smoothed ping latency and a misbehavior score.
+// It enforces separate inbound and outbound connection limits, decides
+// when each peer is due a PING and when a missing PONG means the peer is
+// dead, and ranks peers by latency so sync and relay can favour the
+// fastest ones.
+//
+// The address book remembers peers we managed to reach (and the listening
+// ports inbound peers advertise), survives restarts through a small text
+// file, and hands out addresses to dial when we are short of outbound
+// connections, backing off on addresses that keep failing.
+//
+// Thread-safe; the mutex is a leaf lock, so it may be taken while holding
+// any of Node's locks.
+
+#ifndef PEERMANAGER_H
+#define PEERMANAGER_H
+
+#include "PeerId.h"
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class PeerManager {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // What we know about one connected peer
+        struct PeerInfo {
+            PeerId id = 0;
+            std::string host; // Remote IP
+            int port = 0; // Listening port (0 until an inbound peer tells us)
+            bool inbound = false;
+            int bestHeight = -1; // Highest block index the peer has shown us
+            bool light = false; // Light client: has headers only, serves no bodies or proofs
+            double latencyMs = -1.0; // Smoothed PING round trip (-1 until measured)
+            int misbehavior = 0; // Reaches BAN_THRESHOLD -> disconnect
+            uint64_t pingNonce = 0; // Outstanding PING (0 if none)
+            Clock::time_point pingSentAt;
+        };
+
+        // A dialable address
+        struct Address {
+            std::string host;
+            int port = 0;
+            std::time_t lastSeen = 0; // Wall clock, so it means something after a restart
+            int failures = 0; // Consecutive failed connects
+            std::time_t bannedUntil = 0;
+            Clock::time_point nextAttempt; // Backoff; not persisted
+        };
+
+        // Send a PING this often
+        static constexpr std::chrono::milliseconds PING_INTERVAL { 30000 };
+
+        // Disconnect when a PING goes unanswered this long
+        static constexpr std::chrono::milliseconds PING_TIMEOUT { 60000 };
+
+        // Misbehavior score at which a peer is dropped and banned
+        static constexpr int BAN_THRESHOLD = 100;
+
+        // How long a ban lasts
+        static constexpr std::chrono::seconds BAN_DURATION { 24 * 60 * 60 };
+
+        // Constructor
+        PeerManager(size_t maxInbound = 125, size_t maxOutbound = 8);
+
+        // Change the connection limits
+        void setLimits(size_t maxInbound, size_t maxOutbound);
+
+        // Is there room for another inbound / outbound peer? Dials in
+        // progress count against the outbound limit.
+        bool canAcceptInbound() const;
+        bool canConnectOutbound() const;
+
+        // Hold an outbound slot for a dial in progress; false if none is
+        // free. releaseOutbound() gives it back once the dial fails, or once
+        // addPeer() has counted the connection.
+        bool reserveOutbound();
+        void releaseOutbound();
+
+        // Is this host banned right now?
+        bool isBanned(const std::string& host) const;
+
+        // A connection was established / closed
+        void addPeer(PeerId peer, const std::string& host, int port, bool inbound);
+        void removePeer(PeerId peer);
+
+        // The peer told us its listening port (VERSION); remembers it as dialable
+        void setListenPort(PeerId peer, int port);
+
+        // The peer has shown it has blocks up to this index
+        void updateHeight(PeerId peer, int height);
+
+        // The peer said it is a light client (VERSION)
+        void setLight(PeerId peer);
+
+        // Peers due a PING, with the nonce to send each
+        std::vector<std::pair<PeerId, uint64_t>> pingsDue(Clock::time_point now);
+
+        // A PONG arrived; false if it doesn't answer our outstanding PING
+        bool pongReceived(PeerId peer, uint64_t nonce, Clock::time_point now);
+
+        // Peers whose PING went unanswered for PING_TIMEOUT
+        std::vector<PeerId> timedOut(Clock::time_point now) const;
+
+        // Add to a peer's misbehavior score. Returns true once it reaches
+        // BAN_THRESHOLD; the peer's address is then banned (loopback
+        // addresses are only disconnected, so local test networks survive).
+        bool misbehaving(PeerId peer, int score, const std::string& reason);
+
+        // Connected peers, lowest latency first (unmeasured peers last)
+        std::vector<PeerId> rankedPeers() const;
+
+        // Lowest-latency full peer known to have at least minHeight (nullopt
+        // if none)
+        std::optional<PeerId> bestPeer(int minHeight) const;
+
+        // Copy out one peer's state
+        std::optional<PeerInfo> getPeer(PeerId peer) const;
+
+        // Copy out every connected peer
+        std::vector<PeerInfo> getPeers() const;
+
+        // Number of connected peers by direction
+        size_t getInboundCount() const;
+        size_t getOutboundCount() const;
+
+        // Remember an address as dialable
+        void addAddress(const std::string& host, int port);
+
+        // Record the outcome of dialing an address
+        void connectSucceeded(const std::string& host, int port);
+        void connectFailed(const std::string& host, int port, Clock::time_point now);
+
+        // Up to maxCount addresses worth dialing now: not connected, not
+        // banned, not our own, and past their backoff
+        std::vector<Address> addressesToDial(size_t maxCount, int ownPort, Clock::time_point now);
+
+        // Number of addresses in the book
+        size_t getAddressCount() const;
+
+        // Persist / restore the address book ("host port lastSeen failures bannedUntil" per line)
+        bool saveAddresses(const std::string& filename) const;
+        bool loadAddresses(const std::string& filename);
+
+    private:
+        // Book key for an address
+        static std::string addressKey(const std::string& host, int port);
+
+        // Is there a connected peer at this address? (mutex held)
+        bool isConnected(const std::string& host, int port) const;
+
+        size_t maxInbound;
+        size_t maxOutbound;
+        size_t inboundCount;
+        size_t outboundCount;
+        size_t dialingCount; // Outbound slots held by reserveOutbound()
+        uint64_t nextNonce;
+        std::unordered_map<PeerId, PeerInfo> peers;
+        std::map<std::string, Address> addresses; // By "host:port"
+        std::map<std::string, std::time_t> bannedHosts; // Host -> ban expiry
+        mutable std::mutex mutex;
+};
+
+#endif
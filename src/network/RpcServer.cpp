@@ -0,0 +1,652 @@
+#include "RpcServer.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const size_t NPOS = std::string::npos;
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == NPOS) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+size_t skipSpace(const std::string& json, size_t pos) {
+    while (pos < json.size() && std::isspace(static_cast<unsigned char>(json[pos]))) {
+        pos++;
+    }
+    return pos;
+}
+
+// One past the JSON value starting at pos (NPOS if it doesn't end)
+size_t valueEnd(const std::string& json, size_t pos) {
+    pos = skipSpace(json, pos);
+    if (pos >= json.size()) {
+        return NPOS;
+    }
+
+    char c = json[pos];
+    if (c == '"') {
+        for (size_t i = pos + 1; i < json.size(); i++) {
+            if (json[i] == '\\') {
+                i++;
+            } else if (json[i] == '"') {
+                return i + 1;
+            }
+        }
+        return NPOS;
+    }
+
+    if (c == '{' || c == '[') {
+        // Balance brackets, stepping over strings whole
+        int depth = 0;
+        for (size_t i = pos; i < json.size(); i++) {
+            char d = json[i];
+            if (d == '"') {
+                size_t end = valueEnd(json, i);
+                if (end == NPOS) {
+                    return NPOS;
+                }
+                i = end - 1;
+            } else if (d == '{' || d == '[') {
+                depth++;
+            } else if ((d == '}' || d == ']') && --depth == 0) {
+                return i + 1;
+            }
+        }
+        return NPOS;
+    }
+
+    // Number, true, false or null
+    size_t end = pos;
+    while (end < json.size() && (std::isalnum(static_cast<unsigned char>(json[end])) ||
+                                 json[end] == '-' || json[end] == '+' || json[end] == '.')) {
+        end++;
+    }
+    return end == pos ? NPOS : end;
+}
+
+// Raw elements of a top-level JSON array
+bool splitArray(const std::string& json, std::vector<std::string>& out) {
+    std::string text = trim(json);
+    if (text.size() < 2 || text.front() != '[' || text.back() != ']') {
+        return false;
+    }
+
+    size_t pos = skipSpace(text, 1);
+    if (pos == text.size() - 1) {
+        return true; // []
+    }
+    while (true) {
+        size_t end = valueEnd(text, pos);
+        if (end == NPOS || end > text.size() - 1) {
+            return false;
+        }
+        out.push_back(trim(text.substr(pos, end - pos)));
+
+        pos = skipSpace(text, end);
+        if (pos == text.size() - 1) {
+            return true;
+        }
+        if (text[pos] != ',') {
+            return false;
+        }
+        pos++;
+    }
+}
+
+// The value of a JSON string literal, escapes resolved
+bool unquote(const std::string& raw, std::string& out) {
+    if (raw.size() < 2 || raw.front() != '"' || raw.back() != '"') {
+        return false;
+    }
+
+    out.clear();
+    for (size_t i = 1; i + 1 < raw.size(); i++) {
+        char c = raw[i];
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (++i + 1 >= raw.size()) {
+            return false;
+        }
+        switch (raw[i]) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                if (i + 5 >= raw.size()) {
+                    return false;
+                }
+                char* end;
+                std::string hex = raw.substr(i + 1, 4);
+                unsigned long code = std::strtoul(hex.c_str(), &end, 16);
+                if (end != hex.c_str() + 4) {
+                    return false;
+                }
+                // UTF-8 encode (BMP only; surrogate pairs are kept as-is)
+                if (code < 0x80) {
+                    out += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    out += static_cast<char>(0xC0 | (code >> 6));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                } else {
+                    out += static_cast<char>(0xE0 | (code >> 12));
+                    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                i += 4;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Members of a top-level JSON object, values left raw
+bool parseObject(const std::string& json, std::map<std::string, std::string>& out) {
+    std::string text = trim(json);
+    if (text.size() < 2 || text.front() != '{' || text.back() != '}') {
+        return false;
+    }
+
+    size_t pos = skipSpace(text, 1);
+    if (pos == text.size() - 1) {
+        return true; // {}
+    }
+    while (true) {
+        size_t keyEnd = valueEnd(text, pos);
+        std::string key;
+        if (keyEnd == NPOS || !unquote(text.substr(pos, keyEnd - pos), key)) {
+            return false;
+        }
+        pos = skipSpace(text, keyEnd);
+        if (pos >= text.size() || text[pos] != ':') {
+            return false;
+        }
+
+        pos = skipSpace(text, pos + 1);
+        size_t end = valueEnd(text, pos);
+        if (end == NPOS || end > text.size() - 1) {
+            return false;
+        }
+        out[key] = trim(text.substr(pos, end - pos));
+
+        pos = skipSpace(text, end);
+        if (pos == text.size() - 1) {
+            return true;
+        }
+        if (text[pos] != ',') {
+            return false;
+        }
+        pos = skipSpace(text, pos + 1);
+    }
+}
+
+std::string errorResponse(const std::string& id, int code, const std::string& message) {
+    return "{\"jsonrpc\":\"2.0\",\"id\":" + id + ",\"error\":{\"code\":" + std::to_string(code) +
+        ",\"message\":" + RpcServer::quote(message) + "}}";
+}
+
+const char* reasonPhrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        default: return "Error";
+    }
+}
+
+// Lower-cased value of a header, "" if absent
+std::string headerValue(const std::string& headers, const std::string& name) {
+    std::string lower = headers;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    size_t pos = lower.find("\r\n" + name + ":");
+    if (pos == NPOS) {
+        return "";
+    }
+    pos += name.size() + 3;
+    return trim(lower.substr(pos, lower.find("\r\n", pos) - pos));
+}
+
+} // namespace
+
+bool RpcParams::parse(const std::string& json) {
+    std::string text = trim(json);
+    if (!text.empty() && text[0] == '[') {
+        return splitArray(text, positional);
+    }
+    return parseObject(text, named);
+}
+
+std::string RpcParams::raw(size_t index, const std::string& name) const {
+    if (index < positional.size()) {
+        return positional[index];
+    }
+    auto it = named.find(name);
+    return it == named.end() ? "" : it->second;
+}
+
+bool RpcParams::getString(size_t index, const std::string& name, std::string& out) const {
+    return unquote(raw(index, name), out);
+}
+
+bool RpcParams::getInt(size_t index, const std::string& name, long& out) const {
+    std::string text = raw(index, name);
+    char* end;
+    out = std::strtol(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0';
+}
+
+bool RpcParams::getDouble(size_t index, const std::string& name, double& out) const {
+    std::string text = raw(index, name);
+    char* end;
+    out = std::strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+RpcReply RpcReply::ok(std::string json) {
+    RpcReply reply;
+    reply.result = std::move(json);
+    return reply;
+}
+
+RpcReply RpcReply::error(int code, std::string message) {
+    RpcReply reply;
+    reply.errorCode = code;
+    reply.errorMessage = std::move(message);
+    return reply;
+}
+
+// One request in flight per client, so with a queue this deep submit()
+// never blocks the loop
+RpcServer::RpcServer(EventLoop& loop, int port, size_t workerThreads)
+    : loop(loop), port(port), listenFd(-1), running(false),
+      workers(workerThreads, MAX_CONNECTIONS), nextId(1) {
+}
+
+RpcServer::~RpcServer() {
+    stop();
+}
+
+void RpcServer::addMethod(const std::string& name, Method method) {
+    methods[name] = std::move(method);
+}
+
+bool RpcServer::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    // Local clients only
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+        LOG_ERROR(Http, "RPC server failed to bind").kv("port", port).kv("error", strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    running = true;
+
+    // Sockets belong to the loop thread
+    loop.post([this]() {
+        loop.add(listenFd, EPOLLIN, [this](uint32_t) { acceptClients(); });
+        loop.runEvery(std::chrono::seconds(5), [this]() { closeIdle(); });
+    });
+    return true;
+}
+
+void RpcServer::stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+
+    // Replies still being computed are posted to a loop that won't run them
+    workers.shutdown();
+
+    close(listenFd);
+    listenFd = -1;
+    for (auto& entry : connections) {
+        close(entry.second.fd);
+    }
+    connections.clear();
+}
+
+std::string RpcServer::quote(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += "\"";
+    return out;
+}
+
+std::string RpcServer::handle(const std::string& body) const {
+    std::string text = trim(body);
+    if (text.empty() || text[0] != '[') {
+        return handleCall(text);
+    }
+
+    std::vector<std::string> calls;
+    if (!splitArray(text, calls)) {
+        return errorResponse("null", PARSE_ERROR, "Parse error");
+    }
+    if (calls.empty()) {
+        return errorResponse("null", INVALID_REQUEST, "Empty batch");
+    }
+    if (calls.size() > MAX_BATCH) {
+        return errorResponse("null", INVALID_REQUEST, "Batch too large");
+    }
+
+    std::string out = "[";
+    for (const std::string& call : calls) {
+        std::string response = handleCall(call);
+        if (response.empty()) {
+            continue; // Notification
+        }
+        if (out.size() > 1) {
+            out += ",";
+        }
+        out += response;
+    }
+    return out.size() == 1 ? "" : out + "]";
+}
+
+std::string RpcServer::handleCall(const std::string& json) const {
+    static Counter& requests = Metrics::instance().counter("rpc_requests_total", "JSON-RPC calls answered");
+    static Counter& errors = Metrics::instance().counter("rpc_errors_total", "JSON-RPC calls that returned an error");
+    static Histogram& seconds = Metrics::instance().histogram("rpc_request_seconds", "Time to run one JSON-RPC call");
+    requests.inc();
+
+    std::map<std::string, std::string> fields;
+    if (!parseObject(json, fields)) {
+        errors.inc();
+        bool object = !json.empty() && json[0] == '{';
+        return errorResponse("null", object ? PARSE_ERROR : INVALID_REQUEST, object ? "Parse error" : "Invalid request");
+    }
+
+    auto idField = fields.find("id");
+    bool notification = (idField == fields.end());
+    std::string id = notification ? "null" : idField->second;
+
+    std::string name;
+    RpcParams params;
+    RpcReply reply;
+    auto paramsField = fields.find("params");
+    if (!unquote(fields["method"], name)) {
+        reply = RpcReply::error(INVALID_REQUEST, "Invalid request");
+    } else if (paramsField != fields.end() && !params.parse(paramsField->second)) {
+        reply = RpcReply::error(INVALID_PARAMS, "Invalid params");
+    } else {
+        auto method = methods.find(name);
+        if (method == methods.end()) {
+            reply = RpcReply::error(METHOD_NOT_FOUND, "Method not found: " + name);
+        } else {
+            ScopedTimer timer(seconds);
+            reply = method->second(params);
+        }
+    }
+
+    if (reply.errorCode != 0) {
+        errors.inc();
+    }
+    if (notification) {
+        return "";
+    }
+    if (reply.errorCode != 0) {
+        return errorResponse(id, reply.errorCode, reply.errorMessage);
+    }
+    return "{\"jsonrpc\":\"2.0\",\"id\":" + id + ",\"result\":" + reply.result + "}";
+}
+
+void RpcServer::acceptClients() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return; // EAGAIN: accepted everything pending
+        }
+        if (connections.size() >= MAX_CONNECTIONS) {
+            LOG_RATE_LIMITED(Warn, Http, 1, "RPC connection limit reached").kv("limit", MAX_CONNECTIONS);
+            close(fd);
+            continue;
+        }
+
+        uint64_t id = nextId++;
+        Connection& conn = connections[id];
+        conn.fd = fd;
+        conn.lastActive = Clock::now();
+        loop.add(fd, EPOLLIN, [this, id](uint32_t events) { onClientEvent(id, events); });
+    }
+}
+
+void RpcServer::onClientEvent(uint64_t id, uint32_t events) {
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        return;
+    }
+    Connection& conn = it->second;
+    conn.lastActive = Clock::now();
+
+    if (events & EPOLLOUT) {
+        if (!flush(conn, id)) {
+            return;
+        }
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        char buffer[16384];
+        while (true) {
+            ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                conn.inbound.append(buffer, n);
+                if (conn.inbound.size() > 2 * MAX_REQUEST_SIZE) {
+                    closeClient(id); // Pipelining far ahead of our answers
+                    return;
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            closeClient(id); // Closed or failed
+            return;
+        }
+    }
+
+    processNext(id);
+}
+
+void RpcServer::processNext(uint64_t id) {
+    while (true) {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection& conn = it->second;
+        if (conn.busy || conn.closeAfterWrite) {
+            return; // Answers go out in order
+        }
+
+        // 1. Request line and headers
+        size_t headerEnd = conn.inbound.find("\r\n\r\n");
+        if (headerEnd == NPOS) {
+            if (conn.inbound.size() > MAX_REQUEST_SIZE) {
+                respond(id, 413, "", false);
+            }
+            return;
+        }
+
+        size_t lineEnd = conn.inbound.find("\r\n");
+        std::string line = conn.inbound.substr(0, lineEnd);
+        size_t space1 = line.find(' ');
+        size_t space2 = line.find(' ', space1 + 1);
+        if (space1 == NPOS || space2 == NPOS) {
+            respond(id, 400, "", false);
+            return;
+        }
+        std::string method = line.substr(0, space1);
+        std::string version = line.substr(space2 + 1);
+
+        std::string headers = conn.inbound.substr(lineEnd, headerEnd - lineEnd + 2);
+        std::string connection = headerValue(headers, "connection");
+        bool keepAlive = (version == "HTTP/1.1") ? connection != "close" : connection == "keep-alive";
+
+        // 2. Body
+        size_t contentLength = std::strtoul(headerValue(headers, "content-length").c_str(), nullptr, 10);
+        if (contentLength > MAX_REQUEST_SIZE) {
+            respond(id, 413, "", false);
+            return;
+        }
+        size_t requestEnd = headerEnd + 4 + contentLength;
+        if (conn.inbound.size() < requestEnd) {
+            return; // Wait for the rest
+        }
+        std::string body = conn.inbound.substr(headerEnd + 4, contentLength);
+        conn.inbound.erase(0, requestEnd);
+
+        if (method != "POST") {
+            respond(id, 405, "", keepAlive);
+            continue;
+        }
+
+        // 3. Run it on a worker; the reply comes back through the loop
+        conn.busy = true;
+        workers.submit(id, [this, id, keepAlive, body = std::move(body)]() {
+            std::string response = handle(body);
+            loop.post([this, id, keepAlive, response = std::move(response)]() {
+                auto it = connections.find(id);
+                if (it == connections.end()) {
+                    return; // Client went away
+                }
+                it->second.busy = false;
+                respond(id, response.empty() ? 204 : 200, response, keepAlive);
+                processNext(id);
+            });
+        });
+        return;
+    }
+}
+
+void RpcServer::respond(uint64_t id, int status, const std::string& body, bool keepAlive) {
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        return;
+    }
+    Connection& conn = it->second;
+
+    conn.outbound += "HTTP/1.1 " + std::to_string(status) + " " + reasonPhrase(status) + "\r\n";
+    if (status != 204) {
+        conn.outbound += "Content-Type: application/json\r\n";
+        conn.outbound += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    conn.outbound += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    conn.outbound += body;
+    conn.closeAfterWrite = !keepAlive;
+    flush(conn, id);
+}
+
+bool RpcServer::flush(Connection& conn, uint64_t id) {
+    while (!conn.outbound.empty()) {
+        ssize_t n = send(conn.fd, conn.outbound.data(), conn.outbound.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.outbound.erase(0, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!conn.wantWrite) {
+                conn.wantWrite = true;
+                loop.modify(conn.fd, EPOLLIN | EPOLLOUT); // Finish when writable
+            }
+            return true;
+        }
+        closeClient(id);
+        return false;
+    }
+
+    if (conn.closeAfterWrite) {
+        closeClient(id);
+        return false;
+    }
+    if (conn.wantWrite) {
+        conn.wantWrite = false;
+        loop.modify(conn.fd, EPOLLIN);
+    }
+    return true;
+}
+
+void RpcServer::closeIdle() {
+    Clock::time_point cutoff = Clock::now() - IDLE_TIMEOUT;
+    std::vector<uint64_t> idle;
+    for (const auto& entry : connections) {
+        if (!entry.second.busy && entry.second.lastActive < cutoff) {
+            idle.push_back(entry.first);
+        }
+    }
+    for (uint64_t id : idle) {
+        closeClient(id);
+    }
+}
+
+void RpcServer::closeClient(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        return;
+    }
+    loop.remove(it->second.fd);
+    close(it->second.fd);
+    connections.erase(it);
+}
@@ -0,0 +1,153 @@
+// JSON-RPC 2.0 over HTTP for local clients.
+//
+// Sockets are served on the node's EventLoop: accepting, reading and
+// writing never block and never need a thread per client. Each complete
+// request body is handed to a small pool of RPC workers (separate from the
+// peer message workers, so RPC load never queues ahead of blocks). The
+// reply is posted back to the loop.
+//
+// - HTTP/1.1 keep-alive and pipelining: a connection has at most one
+//   request in flight, and answers go out in order
+// - Batches: a JSON array of requests gets an array of responses
+//   (notifications, i.e. requests without an id, get none)
+// - Limits: MAX_CONNECTIONS clients, MAX_REQUEST_SIZE per request,
+//   MAX_BATCH calls per batch; idle connections close after IDLE_TIMEOUT
+//
+// Binds to 127.0.0.1 only.
+
+#ifndef RPCSERVER_H
+#define RPCSERVER_H
+
+#include "EventLoop.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Parameters of one call, by position ([...]) or by name ({...})
+class RpcParams {
+    public:
+        // Parse the raw "params" value; false if it isn't an array or object
+        bool parse(const std::string& json);
+
+        // Raw JSON of a parameter ("" if absent); name is used for {...}
+        std::string raw(size_t index, const std::string& name) const;
+
+        // Typed access; false if absent or the wrong type
+        bool getString(size_t index, const std::string& name, std::string& out) const;
+        bool getInt(size_t index, const std::string& name, long& out) const;
+        bool getDouble(size_t index, const std::string& name, double& out) const;
+
+    private:
+        std::vector<std::string> positional;
+        std::map<std::string, std::string> named;
+};
+
+// What a method returns: a JSON result or an error
+struct RpcReply {
+    std::string result; // JSON text
+    int errorCode = 0; // Non-zero for errors
+    std::string errorMessage;
+
+    static RpcReply ok(std::string json);
+    static RpcReply error(int code, std::string message);
+};
+
+class RpcServer {
+    public:
+        using Method = std::function<RpcReply(const RpcParams& params)>;
+        using Clock = std::chrono::steady_clock;
+
+        // JSON-RPC error codes
+        static constexpr int PARSE_ERROR = -32700;
+        static constexpr int INVALID_REQUEST = -32600;
+        static constexpr int METHOD_NOT_FOUND = -32601;
+        static constexpr int INVALID_PARAMS = -32602;
+        static constexpr int INTERNAL_ERROR = -32603;
+        static constexpr int NOT_FOUND = -5; // Unknown block, transaction, ...
+        static constexpr int REJECTED = -26; // Submission refused
+        static constexpr int NOT_CONNECTED = -9; // No peer could answer (light clients)
+
+        static constexpr size_t MAX_CONNECTIONS = 64;
+        static constexpr size_t MAX_REQUEST_SIZE = 1024 * 1024;
+        static constexpr size_t MAX_BATCH = 1000;
+        static constexpr std::chrono::seconds IDLE_TIMEOUT { 30 };
+
+        // Constructor: serve on loop, run methods on this many workers
+        RpcServer(EventLoop& loop, int port, size_t workerThreads = 2);
+
+        // Destructor (stops the server)
+        ~RpcServer();
+
+        RpcServer(const RpcServer&) = delete;
+        RpcServer& operator=(const RpcServer&) = delete;
+
+        // Register a method (before start())
+        void addMethod(const std::string& name, Method method);
+
+        // Bind and listen, then join the loop; false if the port is unavailable
+        bool start();
+
+        // Close every socket and join the workers (once the loop has stopped)
+        void stop();
+
+        // Answer one HTTP body: a request or a batch ("" when nothing is owed)
+        std::string handle(const std::string& body) const;
+
+        // Port we listen on
+        int getPort() const { return port; }
+
+        // A JSON string literal for text (quotes and escapes)
+        static std::string quote(const std::string& text);
+
+    private:
+        struct Connection {
+            int fd;
+            std::string inbound; // Unparsed bytes
+            std::string outbound; // Unsent response bytes
+            bool busy = false; // A request is with the workers
+            bool closeAfterWrite = false;
+            bool wantWrite = false; // Registered for EPOLLOUT
+            Clock::time_point lastActive;
+        };
+
+        // Answer one request object ("" for a notification)
+        std::string handleCall(const std::string& json) const;
+
+        // Accept every pending client (loop thread)
+        void acceptClients();
+
+        // Socket readiness for one client (loop thread)
+        void onClientEvent(uint64_t id, uint32_t events);
+
+        // Start on the next buffered request if the client is idle (loop thread)
+        void processNext(uint64_t id);
+
+        // Queue an HTTP response and write what we can (loop thread)
+        void respond(uint64_t id, int status, const std::string& body, bool keepAlive);
+
+        // Write queued bytes; false if the client was closed (loop thread)
+        bool flush(Connection& conn, uint64_t id);
+
+        // Close clients idle longer than IDLE_TIMEOUT (loop thread)
+        void closeIdle();
+
+        // Forget a client and close its socket (loop thread)
+        void closeClient(uint64_t id);
+
+        EventLoop& loop;
+        int port;
+        int listenFd;
+        bool running;
+        ThreadPool workers;
+        std::map<std::string, Method> methods; // Read-only once started
+        std::unordered_map<uint64_t, Connection> connections; // Loop thread only
+        uint64_t nextId;
+};
+
+#endif
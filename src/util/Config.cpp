@@ -0,0 +1,229 @@
+#include "Config.h"
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+// Whole-string integer, or false
+bool parseInt(const std::string& text, long& value) {
+    try {
+        size_t used;
+        value = std::stol(text, &used);
+        return used == text.size();
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+bool parseBool(const std::string& text, bool& value) {
+    if (text == "true" || text == "1" || text == "yes") {
+        value = true;
+        return true;
+    }
+    if (text == "false" || text == "0" || text == "no") {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+bool isFlagWithoutValue(const std::string& key) {
+    return key == "daemon" || key == "light" || key == "help";
+}
+
+} // namespace
+
+bool Config::parseArgs(int argc, char* argv[], std::string& error) {
+    // 1. Collect --key value / --key=value pairs
+    std::vector<std::pair<std::string, std::string>> flags;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h") {
+            arg = "--help";
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            error = "unexpected argument: " + arg;
+            return false;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value;
+        size_t equals = key.find('=');
+        if (equals != std::string::npos) {
+            value = key.substr(equals + 1);
+            key = key.substr(0, equals);
+        } else if (isFlagWithoutValue(key)) {
+            value = "true";
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        } else {
+            error = "missing value for --" + key;
+            return false;
+        }
+        flags.emplace_back(key, value);
+    }
+
+    // 2. The config file first, so flags override it
+    for (const auto& flag : flags) {
+        if (flag.first == "config" && !loadFile(flag.second, error)) {
+            return false;
+        }
+    }
+
+    // 3. Then the flags themselves
+    for (const auto& flag : flags) {
+        if (flag.first != "config" && !set(flag.first, flag.second, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Config::loadFile(const std::string& filename, std::string& error) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        error = "can't open config file " + filename;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            error = filename + ":" + std::to_string(lineNumber) + ": expected key = value";
+            return false;
+        }
+        if (!set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)), error)) {
+            error = filename + ":" + std::to_string(lineNumber) + ": " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Config::set(const std::string& rawKey, const std::string& value, std::string& error) {
+    std::string key = rawKey;
+    for (char& c : key) {
+        if (c == '-') {
+            c = '_';
+        }
+    }
+
+    long number = 0;
+    bool ok = true;
+    if (key == "port") {
+        ok = parseInt(value, number) && number > 0 && number < 65536;
+        port = static_cast<int>(number);
+    } else if (key == "difficulty") {
+        ok = parseInt(value, number) && number >= 0 && number <= 64;
+        difficulty = static_cast<int>(number);
+    } else if (key == "block_time") {
+        ok = parseInt(value, number) && number >= 0 && number <= 86400;
+        blockTime = static_cast<int>(number);
+    } else if (key == "retarget_interval") {
+        ok = parseInt(value, number) && (number == 0 || (number >= 3 && number <= 100000));
+        retargetInterval = static_cast<int>(number);
+    } else if (key == "reward") {
+        try {
+            size_t used;
+            reward = std::stod(value, &used);
+            ok = used == value.size() && reward >= 0;
+        } catch (const std::exception&) {
+            ok = false;
+        }
+    } else if (key == "seed" || key == "seeds") {
+        std::stringstream entries(value);
+        std::string entry;
+        std::string host;
+        int seedPort;
+        while (ok && std::getline(entries, entry, ',')) {
+            entry = trim(entry);
+            ok = parseAddress(entry, host, seedPort);
+            seeds.push_back(entry);
+        }
+    } else if (key == "datadir" || key == "data_dir") {
+        ok = !value.empty();
+        dataDir = value;
+    } else if (key == "miner_threads") {
+        ok = parseInt(value, number) && number >= 0 && number <= 256;
+        minerThreads = static_cast<unsigned>(number);
+    } else if (key == "verify_threads") {
+        ok = parseInt(value, number) && number >= 0 && number <= 256;
+        verifyThreads = static_cast<unsigned>(number);
+    } else if (key == "log_level") {
+        logLevel = value;
+    } else if (key == "metrics_port") {
+        ok = parseInt(value, number) && number >= 0 && number < 65536;
+        metricsPort = static_cast<int>(number);
+    } else if (key == "rpc_port") {
+        ok = parseInt(value, number) && number >= 0 && number < 65536;
+        rpcPort = static_cast<int>(number);
+    } else if (key == "daemon") {
+        ok = parseBool(value, daemon);
+    } else if (key == "light") {
+        ok = parseBool(value, light);
+    } else if (key == "help") {
+        ok = parseBool(value, help);
+    } else {
+        error = "unknown setting: " + rawKey;
+        return false;
+    }
+
+    if (!ok) {
+        error = "bad value for " + rawKey + ": " + value;
+    }
+    return ok;
+}
+
+bool Config::parseAddress(const std::string& address, std::string& host, int& port) {
+    size_t colon = address.rfind(':');
+    long number = 0;
+    if (colon == std::string::npos || colon == 0 || !parseInt(address.substr(colon + 1), number) ||
+        number <= 0 || number >= 65536) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    port = static_cast<int>(number);
+    return true;
+}
+
+std::string Config::usage() {
+    return
+        "Usage: blockchain [options]\n"
+        "\n"
+        "With no options, asks for port, difficulty and reward and shows the menu.\n"
+        "\n"
+        "  --daemon              Run headless until SIGTERM/SIGINT\n"
+        "  --light               Light client: sync headers only, check payments with proofs\n"
+        "  --config FILE         Read settings from FILE (key = value lines)\n"
+        "  --port N              Listen port (default 8080)\n"
+        "  --difficulty N        Mining difficulty in leading hex zeros (default 3)\n"
+        "  --block-time N        Seconds between blocks that retargeting aims for\n"
+        "  --retarget-interval N Retarget every N blocks, at least 3 (default 0, fixed difficulty)\n"
+        "  --reward X            Mining reward (default 50)\n"
+        "  --seed HOST:PORT      Peer to connect to at startup (repeatable)\n"
+        "  --datadir DIR         Chain and address book for daemon mode (default data)\n"
+        "  --miner-threads N     Mine pending transactions on N threads (default 0, off)\n"
+        "  --verify-threads N    Check block signatures on N threads (default 0, one per core)\n"
+        "  --log-level SPEC      e.g. debug or net=debug,mining=warn\n"
+        "  --metrics-port N      Metrics/trace HTTP port (default port + 1000, 0 = off)\n"
+        "  --rpc-port N          JSON-RPC port (default port + 2000, 0 = off)\n"
+        "  --help                Show this help\n";
+}
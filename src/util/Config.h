@@ -0,0 +1,66 @@
+// Node settings from the command line and an optional config file.
+//
+// Every setting has a flag and a config file key of the same name
+// (dashes in flags, underscores or dashes in the file):
+//
+//     --port 8080          port = 8080
+//     --seed host:port     seed = host:port        (repeatable, or comma separated)
+//     --datadir DIR        datadir = DIR
+//     --miner-threads N    miner_threads = N       (0 = don't mine)
+//     --verify-threads N   verify_threads = N      (0 = one per core)
+//     --log-level SPEC     log_level = net=debug   (see Logger.h)
+//     --metrics-port N     metrics_port = N        (0 = off)
+//     --rpc-port N         rpc_port = N            (0 = off)
+//     --light              light = true            (headers only)
+//     --block-time N       block_time = N          (seconds; with retarget_interval)
+//     --retarget-interval N retarget_interval = N  (0 = fixed difficulty)
+//
+// The file is "key = value" lines; '#' starts a comment. Flags given on
+// the command line override the file named by --config, whatever their
+// order.
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+
+struct Config {
+    int port = 8080;
+    int difficulty = 3;
+    int blockTime = 0; // Seconds between blocks retargeting aims for
+    int retargetInterval = 0; // Blocks between retargets (0 = fixed difficulty)
+    double reward = 50;
+    std::vector<std::string> seeds; // "host:port"
+    std::string dataDir = "data"; // Chain and address book (daemon mode)
+    unsigned minerThreads = 0;
+    unsigned verifyThreads = 0; // Signature verify threads (0 = one per core)
+    std::string logLevel; // Empty: keep BLOCKCHAIN_LOG / the default
+    int metricsPort = -1; // -1: port + 1000
+    int rpcPort = -1; // -1: port + 2000
+    bool daemon = false;
+    bool light = false; // Headers only; payments checked with Merkle proofs
+    bool help = false;
+
+    // Apply argv (and the --config file it names); false with error set
+    // on anything unknown or malformed
+    bool parseArgs(int argc, char* argv[], std::string& error);
+
+    // Apply a config file
+    bool loadFile(const std::string& filename, std::string& error);
+
+    // Apply one setting by name
+    bool set(const std::string& key, const std::string& value, std::string& error);
+
+    // Ports after applying their defaults; 0 when disabled
+    int resolvedMetricsPort() const { return metricsPort < 0 ? port + 1000 : metricsPort; }
+    int resolvedRpcPort() const { return rpcPort < 0 ? port + 2000 : rpcPort; }
+
+    // Split "host:port"; false if it isn't one
+    static bool parseAddress(const std::string& address, std::string& host, int& port);
+
+    // --help text
+    static std::string usage();
+};
+
+#endif
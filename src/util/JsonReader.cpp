@@ -0,0 +1,152 @@
+#include "JsonReader.h"
+
+namespace {
+
+// Index of the quote closing the string that opens at pos, or npos
+size_t closingQuote(std::string_view json, size_t pos) {
+    return json.find('"', pos + 1);
+}
+
+}
+
+size_t findJsonField(std::string_view json, std::string_view key, size_t from) {
+    // Match "key": without building the pattern
+    size_t pos = from;
+    while ((pos = json.find(key, pos)) != std::string_view::npos) {
+        size_t end = pos + key.size();
+        if (pos > 0 && json[pos - 1] == '"' && end + 1 < json.size() && json[end] == '"' && json[end + 1] == ':') {
+            return end + 2;
+        }
+        pos = end;
+    }
+    return std::string_view::npos;
+}
+
+std::string_view jsonString(std::string_view json, std::string_view key) {
+    size_t pos = findJsonField(json, key);
+    if (pos == std::string_view::npos || pos >= json.size() || json[pos] != '"') {
+        return {};
+    }
+    pos++;
+    size_t end = json.find('"', pos);
+    if (end == std::string_view::npos) {
+        return {};
+    }
+    return json.substr(pos, end - pos);
+}
+
+bool jsonIndexes(std::string_view json, std::string_view key, std::vector<size_t>& values) {
+    size_t pos = findJsonField(json, key);
+    if (pos == std::string_view::npos || pos >= json.size() || json[pos] != '[') {
+        return false;
+    }
+
+    const char* it = json.data() + pos + 1;
+    const char* end = json.data() + json.size();
+    if (it < end && *it == ']') {
+        return true; // Empty
+    }
+    while (it < end) {
+        size_t value;
+        auto result = std::from_chars(it, end, value);
+        if (result.ec != std::errc()) {
+            return false;
+        }
+        values.push_back(value);
+        it = result.ptr;
+        if (it < end && *it == ']') {
+            return true;
+        }
+        if (it >= end || *it != ',') {
+            return false;
+        }
+        it++;
+    }
+    return false;
+}
+
+std::string_view jsonObject(std::string_view json, std::string_view key) {
+    size_t pos = findJsonField(json, key);
+    if (pos == std::string_view::npos || pos >= json.size() || json[pos] != '{') {
+        return {};
+    }
+
+    int braceCount = 0;
+    for (size_t i = pos; i < json.size(); i++) {
+        char c = json[i];
+        if (c == '"') {
+            i = closingQuote(json, i);
+            if (i == std::string_view::npos) {
+                return {};
+            }
+        } else if (c == '{') {
+            braceCount++;
+        } else if (c == '}') {
+            braceCount--;
+            if (braceCount == 0) {
+                return json.substr(pos, i - pos + 1);
+            }
+        }
+    }
+    return {};
+}
+
+bool jsonStrings(std::string_view json, std::string_view key, std::vector<std::string_view>& values) {
+    size_t pos = findJsonField(json, key);
+    if (pos == std::string_view::npos || pos >= json.size() || json[pos] != '[') {
+        return false;
+    }
+
+    pos++;
+    if (pos < json.size() && json[pos] == ']') {
+        return true; // Empty
+    }
+    while (pos < json.size() && json[pos] == '"') {
+        size_t close = closingQuote(json, pos);
+        if (close == std::string_view::npos) {
+            return false;
+        }
+        values.push_back(json.substr(pos + 1, close - pos - 1));
+        pos = close + 1;
+        if (pos < json.size() && json[pos] == ']') {
+            return true;
+        }
+        if (pos >= json.size() || json[pos] != ',') {
+            return false;
+        }
+        pos++;
+    }
+    return false;
+}
+
+bool jsonObjects(std::string_view json, std::string_view key, std::pmr::vector<std::string_view>& objects) {
+    size_t pos = key.empty() ? json.find('[') : findJsonField(json, key);
+    if (pos == std::string_view::npos || pos >= json.size() || json[pos] != '[') {
+        return false;
+    }
+
+    size_t objectStart = 0;
+    int braceCount = 0;
+    for (size_t i = pos + 1; i < json.size(); i++) {
+        char c = json[i];
+        if (c == '"') {
+            i = closingQuote(json, i);
+            if (i == std::string_view::npos) {
+                return false;
+            }
+        } else if (c == '{') {
+            if (braceCount == 0) {
+                objectStart = i;
+            }
+            braceCount++;
+        } else if (c == '}') {
+            braceCount--;
+            if (braceCount == 0) {
+                objects.push_back(json.substr(objectStart, i - objectStart + 1));
+            }
+        } else if (c == ']' && braceCount == 0) {
+            return true; // End of the array
+        }
+    }
+    return false;
+}
@@ -0,0 +1,57 @@
+// Reads fields out of the flat JSON the protocol uses, without copying.
+//
+// Everything here returns views into the text it was given (or parses
+// numbers in place with std::from_chars), so decoding a block allocates
+// only the strings and vectors the Block itself keeps. Like JsonWriter,
+// it assumes strings hold no escaped quotes; anything else may appear in
+// them, so the scanners that match brackets step over string contents.
+//
+// Splitting an array into its objects needs somewhere to put the spans;
+// callers decoding many blocks at once hand in a std::pmr vector backed by
+// a per-batch monotonic buffer, so the index for a whole batch is a few
+// pointer bumps and is released in one go.
+
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <charconv>
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// Position just past "key": in json (first match at or after from), or npos
+size_t findJsonField(std::string_view json, std::string_view key, size_t from = 0);
+
+// Text of "key":"..." without the quotes ("" if absent)
+std::string_view jsonString(std::string_view json, std::string_view key);
+
+// Number after "key":; false (value untouched) if absent or malformed
+template <typename T>
+bool jsonNumber(std::string_view json, std::string_view key, T& value) {
+    size_t pos = findJsonField(json, key);
+    if (pos == std::string_view::npos) {
+        return false;
+    }
+    auto result = std::from_chars(json.data() + pos, json.data() + json.size(), value);
+    return result.ec == std::errc();
+}
+
+// Appends the numbers of the array after "key":[ to values; false if there
+// is no such array or any element is not a plain non-negative integer
+bool jsonIndexes(std::string_view json, std::string_view key, std::vector<size_t>& values);
+
+// The object that follows "key":{, as a view into json ("" if absent or
+// cut short)
+std::string_view jsonObject(std::string_view json, std::string_view key);
+
+// Appends the strings of the array after "key":[ to values; false if there
+// is no such array or it holds anything but strings
+bool jsonStrings(std::string_view json, std::string_view key, std::vector<std::string_view>& values);
+
+// Appends the top-level objects of the array after "key":[ (or of the
+// first array in json if key is empty) to objects; false if there is no
+// such array or it is cut short
+bool jsonObjects(std::string_view json, std::string_view key, std::pmr::vector<std::string_view>& objects);
+
+#endif
@@ -0,0 +1,18 @@
+#include "JsonWriter.h"
+#include <cstdio>
+
+JsonWriter& JsonWriter::fixed(double value, int precision) {
+    // Doubles can have up to 309 integer digits; values too wide for the
+    // stack buffer fall back to snprintf
+    char digits[128];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision);
+    if (result.ec == std::errc()) {
+        out.append(digits, result.ptr);
+        return *this;
+    }
+
+    std::string wide(400 + precision, '\0');
+    int length = std::snprintf(&wide[0], wide.size(), "%.*f", precision, value);
+    out.append(wide.data(), length > 0 ? length : 0);
+    return *this;
+}
@@ -0,0 +1,92 @@
+// Appends JSON straight into a caller-owned std::string.
+//
+// toJSON() used to build every field as a temporary string and concatenate
+// them, which for a large chain meant millions of small allocations. A
+// writer appends in place instead: the caller reserves (or reuses) one
+// buffer, numbers are formatted with std::to_chars on the stack, and
+// nothing else is allocated.
+//
+//     std::string out;
+//     out.reserve(4096);
+//     JsonWriter json(out);
+//     json.raw('{').key("index").number(block.index).raw(',')...
+//
+// Strings are written without escaping, matching the rest of the protocol:
+// hashes, addresses and message types never contain quotes or backslashes.
+//
+// Callers streaming a large document (e.g. a whole chain) write one piece,
+// hand the buffer off once it passes a chunk size, then clear() it and go
+// on; the buffer's capacity is reused.
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class JsonWriter {
+    public:
+        // Constructor: append to out
+        explicit JsonWriter(std::string& out) : out(out) {}
+
+        // Text as is
+        JsonWriter& raw(std::string_view text) {
+            out.append(text);
+            return *this;
+        }
+        JsonWriter& raw(char c) {
+            out.push_back(c);
+            return *this;
+        }
+
+        // "text"
+        JsonWriter& string(std::string_view text) {
+            out.push_back('"');
+            out.append(text);
+            out.push_back('"');
+            return *this;
+        }
+
+        // "name":
+        JsonWriter& key(std::string_view name) {
+            string(name);
+            out.push_back(':');
+            return *this;
+        }
+
+        // Integers
+        JsonWriter& number(long long value) { return integer(value); }
+        JsonWriter& number(unsigned long long value) { return integer(value); }
+        JsonWriter& number(int value) { return integer(value); }
+        JsonWriter& number(long value) { return integer(value); }
+        JsonWriter& number(unsigned value) { return integer(value); }
+        JsonWriter& number(unsigned long value) { return integer(value); }
+
+        // A double with fixed decimals; precision 6 gives exactly what
+        // std::to_string(double) (i.e. "%f") does
+        JsonWriter& fixed(double value, int precision = 6);
+
+        // Bytes written so far
+        size_t size() const { return out.size(); }
+
+        // Forget what was written, keeping the capacity
+        void clear() { out.clear(); }
+
+        // The underlying buffer
+        std::string& buffer() { return out; }
+
+    private:
+        template <typename T>
+        JsonWriter& integer(T value) {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            out.append(digits, result.ptr);
+            return *this;
+        }
+
+        std::string& out;
+};
+
+#endif
@@ -0,0 +1,297 @@
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+namespace {
+
+const char* LEVEL_NAMES[] = { "trace", "debug", "info", "warn", "error", "off" };
+const char* SUBSYSTEM_NAMES[] = { "chain", "mining", "net", "sync", "relay", "peers", "http" };
+
+// Lines written per fwrite when the writer catches up on a backlog
+const size_t WRITE_BATCH = 256;
+
+// Pick up BLOCKCHAIN_LOG before main() runs
+struct EnvironmentLevels {
+    EnvironmentLevels() {
+        const char* spec = std::getenv("BLOCKCHAIN_LOG");
+        if (spec != nullptr && !Logger::configure(spec)) {
+            std::fprintf(stderr, "Ignoring malformed BLOCKCHAIN_LOG=%s\n", spec);
+        }
+    }
+} environmentLevels;
+
+bool parseLevel(const std::string& name, LogLevel& level) {
+    for (size_t i = 0; i <= static_cast<size_t>(LogLevel::Off); i++) {
+        if (name == LEVEL_NAMES[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// "2026-01-31 12:34:56.789"
+void appendTimestamp(std::string& out) {
+    auto now = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    int millis = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+
+    std::tm local;
+    localtime_r(&seconds, &local);
+    char buffer[32];
+    size_t length = std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+    std::snprintf(buffer + length, sizeof(buffer) - length, ".%03d", millis);
+    out += buffer;
+}
+
+} // namespace
+
+static_assert(static_cast<size_t>(LogSubsystem::Count) == sizeof(SUBSYSTEM_NAMES) / sizeof(SUBSYSTEM_NAMES[0]),
+              "every subsystem needs a name and a starting level");
+
+std::atomic<uint8_t> Logger::levels[static_cast<size_t>(LogSubsystem::Count)] = {
+    { static_cast<uint8_t>(LogLevel::Info) }, { static_cast<uint8_t>(LogLevel::Info) },
+    { static_cast<uint8_t>(LogLevel::Info) }, { static_cast<uint8_t>(LogLevel::Info) },
+    { static_cast<uint8_t>(LogLevel::Info) }, { static_cast<uint8_t>(LogLevel::Info) },
+    { static_cast<uint8_t>(LogLevel::Info) },
+};
+
+bool RateLimiter::allow() {
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // First caller in a new second opens a fresh window
+    int64_t window = windowStart.load(std::memory_order_relaxed);
+    if (window != second && windowStart.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        used.store(0, std::memory_order_relaxed);
+    }
+
+    if (used.fetch_add(1, std::memory_order_relaxed) < perSecond) {
+        return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : ring(new Slot[RING_SIZE]), enqueuePos(0), dequeuePos(0), accepted(0), written(0), dropped(0), stopping(false) {
+    for (size_t i = 0; i < RING_SIZE; i++) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer = std::thread(&Logger::writeLoop, this);
+}
+
+Logger::~Logger() {
+    stopping = true;
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+void Logger::setLevel(LogSubsystem subsystem, LogLevel level) {
+    levels[static_cast<size_t>(subsystem)].store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+}
+
+void Logger::setLevel(LogLevel level) {
+    for (auto& subsystemLevel : levels) {
+        subsystemLevel.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
+}
+
+bool Logger::configure(const std::string& spec) {
+    bool ok = true;
+    std::stringstream entries(spec);
+    std::string entry;
+
+    while (std::getline(entries, entry, ',')) {
+        size_t equals = entry.find('=');
+        LogLevel level;
+
+        if (equals == std::string::npos) {
+            // A bare level applies to everything
+            if (parseLevel(entry, level)) {
+                setLevel(level);
+            } else {
+                ok = false;
+            }
+            continue;
+        }
+
+        std::string name = entry.substr(0, equals);
+        bool known = false;
+        if (parseLevel(entry.substr(equals + 1), level)) {
+            for (size_t i = 0; i < static_cast<size_t>(LogSubsystem::Count); i++) {
+                if (name == SUBSYSTEM_NAMES[i]) {
+                    setLevel(static_cast<LogSubsystem>(i), level);
+                    known = true;
+                }
+            }
+        }
+        ok = ok && known;
+    }
+    return ok;
+}
+
+const char* Logger::levelName(LogLevel level) {
+    return LEVEL_NAMES[static_cast<size_t>(level)];
+}
+
+const char* Logger::subsystemName(LogSubsystem subsystem) {
+    return SUBSYSTEM_NAMES[static_cast<size_t>(subsystem)];
+}
+
+void Logger::submit(std::string line) {
+    // Bounded MPSC queue: claim a slot by advancing enqueuePos, fill it,
+    // then publish it by bumping its sequence
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = ring[pos & (RING_SIZE - 1)];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.line = std::move(line);
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                accepted.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed); // Full; the writer is behind
+            return;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::pop(std::string& line) {
+    Slot& slot = ring[dequeuePos & (RING_SIZE - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+        return false;
+    }
+
+    line = std::move(slot.line);
+    slot.line.clear();
+    slot.sequence.store(dequeuePos + RING_SIZE, std::memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+void Logger::writeLoop() {
+    std::string batch;
+    std::string line;
+
+    while (true) {
+        size_t lines = 0;
+        while (lines < WRITE_BATCH && pop(line)) {
+            batch += line;
+            batch += '\n';
+            lines++;
+        }
+
+        if (lines > 0) {
+            std::fwrite(batch.data(), 1, batch.size(), stdout);
+            std::fflush(stdout);
+            batch.clear();
+            written.fetch_add(lines, std::memory_order_release);
+            continue;
+        }
+
+        if (stopping) {
+            break; // Drained
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+void Logger::flush() {
+    uint64_t target = accepted.load(std::memory_order_relaxed);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (written.load(std::memory_order_acquire) < target && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+LogLine::LogLine(LogLevel level, LogSubsystem subsystem, const char* message) {
+    start(level, subsystem, message);
+}
+
+LogLine::LogLine(LogLevel level, LogSubsystem subsystem, const char* message, RateLimiter& limiter) {
+    if (!limiter.allow()) {
+        suppressed = true;
+        return;
+    }
+    start(level, subsystem, message);
+
+    uint64_t skipped = limiter.takeSuppressed();
+    if (skipped > 0) {
+        kv("suppressed", skipped);
+    }
+}
+
+LogLine::~LogLine() {
+    if (!suppressed) {
+        Logger::instance().submit(std::move(text));
+    }
+}
+
+void LogLine::start(LogLevel level, LogSubsystem subsystem, const char* message) {
+    text.reserve(128);
+    appendTimestamp(text);
+
+    // Fixed-width level and subsystem columns
+    char columns[32];
+    std::snprintf(columns, sizeof(columns), " %-5s %-6s ", Logger::levelName(level), Logger::subsystemName(subsystem));
+    text += columns;
+    text += message;
+}
+
+LogLine& LogLine::kv(const char* key, const std::string& value) {
+    if (suppressed) {
+        return *this;
+    }
+
+    text += ' ';
+    text += key;
+    text += '=';
+
+    bool quote = value.empty() || value.find_first_of(" =\"") != std::string::npos;
+    if (!quote) {
+        text += value;
+        return *this;
+    }
+
+    text += '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            text += '\\';
+        }
+        text += c;
+    }
+    text += '"';
+    return *this;
+}
+
+void LogLine::appendDouble(const char* key, double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%g", value);
+    kv(key, std::string(buffer));
+}
+
+void LogLine::appendSigned(const char* key, long long value) {
+    kv(key, std::to_string(value));
+}
+
+void LogLine::appendUnsigned(const char* key, unsigned long long value) {
+    kv(key, std::to_string(value));
+}
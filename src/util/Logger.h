@@ -0,0 +1,193 @@
+// Leveled, structured, asynchronous logging.
+//
+// Each line carries a level, a subsystem, a message and optional key=value
+// fields:
+//
+//     LOG_INFO(Net, "Peer connected").kv("peer", id).kv("host", host);
+//
+// A call site first checks the subsystem's level with one relaxed atomic
+// load; when that filters the line out, nothing else is evaluated, fields
+// included. Lines that pass are formatted on the calling thread and pushed
+// into a fixed-size lock-free ring buffer; a background thread drains it
+// to stdout in batches. When the ring is full lines are dropped (and
+// counted) rather than blocking the caller.
+//
+// LOG_RATE_LIMITED(level, subsystem, perSecond, message) additionally
+// caps one call site at perSecond lines; the next line that gets through
+// reports how many were suppressed.
+//
+// Levels start at INFO and can be set per subsystem, in code or through
+// the BLOCKCHAIN_LOG environment variable, e.g. "debug" or
+// "net=debug,mining=warn".
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+enum class LogLevel : uint8_t {
+    Trace,
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+enum class LogSubsystem : uint8_t {
+    Chain, // Blockchain state and validation
+    Mining,
+    Net, // Sockets and message dispatch
+    Sync, // Headers-first sync and body download
+    Relay, // Transaction and block relay
+    Peers, // Peer management
+    Http,
+    Count
+};
+
+// Caps how often one call site logs (see LOG_RATE_LIMITED)
+class RateLimiter {
+    public:
+        explicit RateLimiter(uint32_t perSecond) : perSecond(perSecond) {}
+
+        // May a line go out now?
+        bool allow();
+
+        // Lines refused since the last call
+        uint64_t takeSuppressed() { return suppressed.exchange(0, std::memory_order_relaxed); }
+
+    private:
+        uint32_t perSecond;
+        std::atomic<int64_t> windowStart { 0 }; // Second the current window began
+        std::atomic<uint32_t> used { 0 }; // Lines let through in this window
+        std::atomic<uint64_t> suppressed { 0 };
+};
+
+class Logger {
+    public:
+        // Lines the ring holds (a power of two)
+        static constexpr size_t RING_SIZE = 8192;
+
+        // The process-wide logger; starts the writer thread on first use
+        static Logger& instance();
+
+        // Would a line at this level for this subsystem be written?
+        static bool enabled(LogSubsystem subsystem, LogLevel level) {
+            return static_cast<uint8_t>(level) >= levels[static_cast<size_t>(subsystem)].load(std::memory_order_relaxed);
+        }
+
+        // Set the level of one subsystem, or of all of them
+        static void setLevel(LogSubsystem subsystem, LogLevel level);
+        static void setLevel(LogLevel level);
+
+        // Apply "level" or "subsystem=level,..."; false if anything didn't parse
+        static bool configure(const std::string& spec);
+
+        // Names as they appear in output and in configure()
+        static const char* levelName(LogLevel level);
+        static const char* subsystemName(LogSubsystem subsystem);
+
+        // Queue one formatted line (without newline); never blocks
+        void submit(std::string line);
+
+        // Wait until everything queued so far has been written
+        void flush();
+
+        // Lines lost because the ring was full
+        uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    private:
+        struct Slot {
+            std::atomic<size_t> sequence;
+            std::string line;
+        };
+
+        Logger();
+        ~Logger();
+
+        // Background writer: drain the ring, write, sleep when idle
+        void writeLoop();
+
+        // Take the next line if one is ready (writer thread only)
+        bool pop(std::string& line);
+
+        static std::atomic<uint8_t> levels[static_cast<size_t>(LogSubsystem::Count)];
+
+        std::unique_ptr<Slot[]> ring;
+        alignas(64) std::atomic<size_t> enqueuePos;
+        alignas(64) size_t dequeuePos; // Writer thread only
+        std::atomic<uint64_t> accepted; // Lines that made it into the ring
+        std::atomic<uint64_t> written; // Lines the writer finished with
+        std::atomic<uint64_t> dropped;
+        std::atomic<bool> stopping;
+        std::thread writer;
+};
+
+// One log line being built; queued when it goes out of scope
+class LogLine {
+    public:
+        LogLine(LogLevel level, LogSubsystem subsystem, const char* message);
+        LogLine(LogLevel level, LogSubsystem subsystem, const char* message, RateLimiter& limiter);
+        ~LogLine();
+
+        LogLine(const LogLine&) = delete;
+        LogLine& operator=(const LogLine&) = delete;
+
+        // Append key=value (quoted when the value has spaces)
+        LogLine& kv(const char* key, const std::string& value);
+        LogLine& kv(const char* key, const char* value) { return kv(key, std::string(value)); }
+
+        template <typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+        LogLine& kv(const char* key, T value) {
+            if (suppressed) {
+                return *this;
+            }
+            if constexpr (std::is_same<T, bool>::value) {
+                return kv(key, value ? "true" : "false");
+            } else if constexpr (std::is_floating_point<T>::value) {
+                appendDouble(key, value);
+            } else if constexpr (std::is_signed<T>::value) {
+                appendSigned(key, value);
+            } else {
+                appendUnsigned(key, value);
+            }
+            return *this;
+        }
+
+    private:
+        void start(LogLevel level, LogSubsystem subsystem, const char* message);
+        void appendDouble(const char* key, double value);
+        void appendSigned(const char* key, long long value);
+        void appendUnsigned(const char* key, unsigned long long value);
+
+        std::string text;
+        bool suppressed = false; // Rate limited: build nothing, queue nothing
+};
+
+// Swallows the LogLine so the macros below form one expression
+struct LogVoidify {
+    void operator&(const LogLine&) {}
+};
+
+#define LOG_AT(level, subsystem, message) \
+    !Logger::enabled(LogSubsystem::subsystem, LogLevel::level) ? (void)0 \
+        : LogVoidify() & LogLine(LogLevel::level, LogSubsystem::subsystem, message)
+
+#define LOG_TRACE(subsystem, message) LOG_AT(Trace, subsystem, message)
+#define LOG_DEBUG(subsystem, message) LOG_AT(Debug, subsystem, message)
+#define LOG_INFO(subsystem, message) LOG_AT(Info, subsystem, message)
+#define LOG_WARN(subsystem, message) LOG_AT(Warn, subsystem, message)
+#define LOG_ERROR(subsystem, message) LOG_AT(Error, subsystem, message)
+
+#define LOG_RATE_LIMITED(level, subsystem, perSecond, message) \
+    !Logger::enabled(LogSubsystem::subsystem, LogLevel::level) ? (void)0 \
+        : LogVoidify() & LogLine(LogLevel::level, LogSubsystem::subsystem, message, \
+                                 []() -> RateLimiter& { static RateLimiter limiter(perSecond); return limiter; }())
+
+#endif
@@ -0,0 +1,175 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+    // Lock-free add for atomic<double> (fetch_add on doubles is C++20)
+    void atomicAdd(std::atomic<double>& target, double delta) {
+        double current = target.load(std::memory_order_relaxed);
+        while (!target.compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Whole numbers (counters, sizes) print exactly; the rest to 10 digits
+    std::string formatValue(double value) {
+        if (std::isinf(value)) {
+            return value > 0 ? "+Inf" : "-Inf";
+        }
+        char buffer[32];
+        if (value == std::floor(value) && std::fabs(value) < 9007199254740992.0) {
+            std::snprintf(buffer, sizeof(buffer), "%.0f", value);
+        } else {
+            std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+        }
+        return buffer;
+    }
+}
+
+void Counter::inc(uint64_t n) {
+    shards[Metrics::shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Gauge::add(double delta) {
+    atomicAdd(value_, delta);
+}
+
+Histogram::Histogram(std::vector<double> bounds) : bounds(std::move(bounds)) {
+    std::sort(this->bounds.begin(), this->bounds.end());
+    for (Shard& shard : shards) {
+        shard.counts.reset(new std::atomic<uint64_t>[this->bounds.size() + 1]);
+        for (size_t i = 0; i <= this->bounds.size(); i++) {
+            shard.counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Histogram::observe(double v) {
+    // First bucket whose upper bound holds v; past the end means +Inf
+    size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin();
+    Shard& shard = shards[Metrics::shardIndex()];
+    shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    atomicAdd(shard.sum, v);
+}
+
+std::vector<uint64_t> Histogram::bucketCounts() const {
+    std::vector<uint64_t> counts(bounds.size() + 1, 0);
+    for (const Shard& shard : shards) {
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+        }
+    }
+    return counts;
+}
+
+double Histogram::sum() const {
+    double total = 0.0;
+    for (const Shard& shard : shards) {
+        total += shard.sum.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[name];
+    if (!entry.counter) {
+        entry.help = help;
+        entry.type = "counter";
+        entry.counter = std::make_unique<Counter>();
+    }
+    return *entry.counter;
+}
+
+Gauge& Metrics::gauge(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[name];
+    if (!entry.gauge) {
+        entry.help = help;
+        entry.type = "gauge";
+        entry.gauge = std::make_unique<Gauge>();
+    }
+    return *entry.gauge;
+}
+
+Histogram& Metrics::histogram(const std::string& name, const std::string& help, std::vector<double> bounds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[name];
+    if (!entry.histogram) {
+        entry.help = help;
+        entry.type = "histogram";
+        entry.histogram = std::make_unique<Histogram>(std::move(bounds));
+    }
+    return *entry.histogram;
+}
+
+std::string Metrics::render() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::string out;
+    for (const auto& item : entries) {
+        const std::string& name = item.first;
+        const Entry& entry = item.second;
+
+        if (entry.counter) {
+            writeSample(out, name, entry.type, entry.help, static_cast<double>(entry.counter->value()));
+        }
+        else if (entry.gauge) {
+            writeSample(out, name, entry.type, entry.help, entry.gauge->value());
+        }
+        else if (entry.histogram) {
+            out += "# HELP " + name + " " + entry.help + "\n";
+            out += "# TYPE " + name + " histogram\n";
+
+            // Buckets are cumulative in the exposition format
+            const std::vector<double>& bounds = entry.histogram->getBounds();
+            std::vector<uint64_t> counts = entry.histogram->bucketCounts();
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < counts.size(); i++) {
+                cumulative += counts[i];
+                std::string le = (i < bounds.size()) ? formatValue(bounds[i]) : "+Inf";
+                out += name + "_bucket{le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+            }
+            out += name + "_sum " + formatValue(entry.histogram->sum()) + "\n";
+            out += name + "_count " + std::to_string(cumulative) + "\n";
+        }
+    }
+    return out;
+}
+
+std::vector<double> Metrics::latencyBuckets() {
+    return { 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0, 10.0 };
+}
+
+void Metrics::writeSample(std::string& out, const std::string& name, const std::string& type,
+                          const std::string& help, double value, const std::string& labels) {
+    if (!help.empty()) {
+        out += "# HELP " + name + " " + help + "\n";
+        out += "# TYPE " + name + " " + type + "\n";
+    }
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " " + formatValue(value) + "\n";
+}
+
+size_t Metrics::shardIndex() {
+    // Threads are dealt shards round-robin the first time they update anything
+    static std::atomic<size_t> nextShard { 0 };
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+    return shard;
+}
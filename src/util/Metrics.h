@@ -0,0 +1,147 @@
+// Process-wide metrics: counters, gauges and histograms, rendered in the
+// Prometheus text exposition format.
+//
+// Updates never lock. Counters and histograms are split into cache-line
+// sized shards and each thread always updates the same shard, so threads
+// hammering one metric don't fight over a cache line; a scrape adds the
+// shards up. Registration and rendering take the registry mutex, so hot
+// paths look their metrics up once and keep the reference:
+//
+//     static Counter& hashes = Metrics::instance().counter("name", "help");
+//     hashes.inc();
+//
+// Metric objects live as long as the process.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Shards per counter / histogram
+constexpr size_t METRIC_SHARDS = 16;
+
+// Monotonically increasing count
+class Counter {
+    public:
+        // Add n
+        void inc(uint64_t n = 1);
+
+        // Sum over all shards
+        uint64_t value() const;
+
+    private:
+        struct alignas(64) Shard {
+            std::atomic<uint64_t> value { 0 };
+        };
+
+        Shard shards[METRIC_SHARDS];
+};
+
+// A value that can go up and down
+class Gauge {
+    public:
+        void set(double v) { value_.store(v, std::memory_order_relaxed); }
+        void add(double delta);
+        double value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value_ { 0.0 };
+};
+
+// Distribution of observed values over fixed bucket upper bounds
+class Histogram {
+    public:
+        // Constructor: ascending upper bounds (an implicit +Inf bucket follows)
+        explicit Histogram(std::vector<double> bounds);
+
+        // Record one value
+        void observe(double v);
+
+        // Upper bounds, without +Inf
+        const std::vector<double>& getBounds() const { return bounds; }
+
+        // Per-bucket (non-cumulative) counts, the last one being +Inf
+        std::vector<uint64_t> bucketCounts() const;
+
+        // Sum of all observed values
+        double sum() const;
+
+    private:
+        struct alignas(64) Shard {
+            std::unique_ptr<std::atomic<uint64_t>[]> counts;
+            std::atomic<double> sum { 0.0 };
+        };
+
+        std::vector<double> bounds;
+        Shard shards[METRIC_SHARDS];
+};
+
+// Times a scope into a histogram, in seconds
+class ScopedTimer {
+    public:
+        explicit ScopedTimer(Histogram& histogram)
+            : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+
+        ~ScopedTimer() {
+            histogram.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Histogram& histogram;
+        std::chrono::steady_clock::time_point start;
+};
+
+class Metrics {
+    public:
+        // The process-wide registry
+        static Metrics& instance();
+
+        // Find or create a metric. Asking again for the same name returns
+        // the same object.
+        Counter& counter(const std::string& name, const std::string& help);
+        Gauge& gauge(const std::string& name, const std::string& help);
+        Histogram& histogram(const std::string& name, const std::string& help,
+                             std::vector<double> bounds = latencyBuckets());
+
+        // Every registered metric in text exposition format
+        std::string render() const;
+
+        // 10us .. 10s, for latencies in seconds
+        static std::vector<double> latencyBuckets();
+
+        // Append one sample in exposition format (for values owned
+        // elsewhere, e.g. per-node gauges). help/type lines are written only
+        // when help is non-empty, so labelled series can share them.
+        static void writeSample(std::string& out, const std::string& name, const std::string& type,
+                                const std::string& help, double value, const std::string& labels = "");
+
+        // Shard the calling thread updates
+        static size_t shardIndex();
+
+    private:
+        struct Entry {
+            std::string help;
+            std::string type; // "counter", "gauge" or "histogram"
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Gauge> gauge;
+            std::unique_ptr<Histogram> histogram;
+        };
+
+        Metrics() = default;
+
+        std::map<std::string, Entry> entries; // By name, so output is sorted
+        mutable std::mutex mutex; // Registration and rendering only
+};
+
+#endif
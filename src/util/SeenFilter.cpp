@@ -0,0 +1,68 @@
+#include "SeenFilter.h"
+#include <string_view>
+
+namespace {
+    // Value of a lowercase hex digit, or -1
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+}
+
+SeenFilter::SeenFilter(size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {
+}
+
+size_t SeenFilter::DigestHash::operator()(const Digest& digest) const {
+    return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(digest.data()), digest.size()));
+}
+
+bool SeenFilter::decode(const std::string& hash, Digest& digest) {
+    if (hash.size() != 2 * digest.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < digest.size(); i++) {
+        int high = hexValue(hash[2 * i]);
+        int low = hexValue(hash[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        digest[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    return true;
+}
+
+bool SeenFilter::insert(const std::string& hash) {
+    Digest digest;
+    if (!decode(hash, digest)) {
+        return true;
+    }
+    if (containsDigest(digest)) {
+        return false;
+    }
+
+    if (current.size() >= capacity) {
+        previous.swap(current);
+        current.clear();
+    }
+    current.insert(digest);
+    return true;
+}
+
+bool SeenFilter::contains(const std::string& hash) const {
+    Digest digest;
+    return decode(hash, digest) && containsDigest(digest);
+}
+
+bool SeenFilter::containsDigest(const Digest& digest) const {
+    return current.count(digest) > 0 || previous.count(digest) > 0;
+}
+
+void SeenFilter::clear() {
+    current.clear();
+    previous.clear();
+}
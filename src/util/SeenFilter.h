@@ -0,0 +1,56 @@
+// Remembers recently seen hashes with bounded memory.
+//
+// Two generations of hash sets: inserts go into the current one, and when
+// it fills up the previous generation is thrown away and the current one
+// takes its place. Anything inserted within the last `capacity` inserts is
+// always remembered; older entries are forgotten in bulk.
+//
+// Hashes are SHA-256 digests in lowercase hex, kept as their 32 raw bytes
+// (about a third of the memory of the string). Anything else is never
+// remembered: insert() returns true and contains() false, so a malformed
+// id can cost repeated work but never skip any.
+//
+// Not thread-safe.
+
+#ifndef SEENFILTER_H
+#define SEENFILTER_H
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+
+class SeenFilter {
+    public:
+        // Constructor
+        explicit SeenFilter(size_t capacity = 50000);
+
+        // Record a hash; true if it was not already known
+        bool insert(const std::string& hash);
+
+        // Has this hash been seen recently?
+        bool contains(const std::string& hash) const;
+
+        // Forget everything
+        void clear();
+
+    private:
+        using Digest = std::array<unsigned char, 32>;
+
+        // Hashes the digest bytes, as std::hash does the hex string
+        struct DigestHash {
+            size_t operator()(const Digest& digest) const;
+        };
+
+        // Decode a lowercase hex SHA-256; false if hash isn't one
+        static bool decode(const std::string& hash, Digest& digest);
+
+        // Is the digest in either generation?
+        bool containsDigest(const Digest& digest) const;
+
+        size_t capacity; // Entries per generation
+        std::unordered_set<Digest, DigestHash> current;
+        std::unordered_set<Digest, DigestHash> previous;
+};
+
+#endif
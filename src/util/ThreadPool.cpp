@@ -0,0 +1,123 @@
+#include "ThreadPool.h"
+#include "Tracer.h"
+
+ThreadPool::ThreadPool(size_t threads, size_t queueCapacity)
+    : capacity(queueCapacity == 0 ? 1 : queueCapacity), nextWorker(0), stopping(false) {
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+
+    // Start threads only once every worker exists
+    for (auto& worker : workers) {
+        Worker* w = worker.get();
+        w->thread = std::thread([this, w]() { workerLoop(*w); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+void ThreadPool::submit(size_t key, std::function<void()> task) {
+    Worker& worker = *workers[key % workers.size()];
+
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    worker.notFull.wait(lock, [&]() { return worker.tasks.size() < capacity || stopping; });
+    if (stopping) {
+        return; // Pool is shutting down, drop the task
+    }
+
+    worker.tasks.push_back(std::move(task));
+    lock.unlock();
+    worker.notEmpty.notify_one();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    submit(nextKey(), std::move(task));
+}
+
+bool ThreadPool::trySubmit(size_t key, std::function<void()> task) {
+    Worker& worker = *workers[key % workers.size()];
+
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    if (stopping) {
+        return true; // Dropped, as submit() would
+    }
+    if (worker.tasks.size() >= capacity) {
+        return false;
+    }
+
+    worker.tasks.push_back(std::move(task));
+    lock.unlock();
+    worker.notEmpty.notify_one();
+    return true;
+}
+
+bool ThreadPool::trySubmit(std::function<void()> task) {
+    return trySubmit(nextKey(), std::move(task));
+}
+
+void ThreadPool::push(size_t key, std::function<void()> task) {
+    Worker& worker = *workers[key % workers.size()];
+
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    if (stopping) {
+        return;
+    }
+
+    worker.tasks.push_back(std::move(task));
+    lock.unlock();
+    worker.notEmpty.notify_one();
+}
+
+size_t ThreadPool::nextKey() {
+    std::lock_guard<std::mutex> lock(shutdownMutex);
+    return nextWorker++;
+}
+
+void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(shutdownMutex);
+        if (stopping.exchange(true)) {
+            return;
+        }
+    }
+
+    // Wake everyone up so the workers can drain and exit
+    for (auto& worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->notEmpty.notify_all();
+        worker->notFull.notify_all();
+    }
+
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void ThreadPool::workerLoop(Worker& worker) {
+    TRACE_THREAD_NAME("worker");
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.notEmpty.wait(lock, [&]() { return !worker.tasks.empty() || stopping; });
+
+            if (worker.tasks.empty()) {
+                return; // Stopping and nothing left to do
+            }
+
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        worker.notFull.notify_one();
+
+        task();
+    }
+}
@@ -0,0 +1,79 @@
+// A fixed-size pool of worker threads with bounded queues.
+//
+// Each worker owns its own queue. Tasks submitted with the same key always
+// land on the same worker, so work for one peer runs in order while
+// different peers are processed in parallel. When a queue is full, submit()
+// blocks the caller. An event loop must never wait like that, so it uses
+// trySubmit() and stops reading from a peer whose queue is full, or push()
+// for the rare task that can be neither dropped nor delayed.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    public:
+        // Constructor: number of workers and max queued tasks per worker
+        ThreadPool(size_t threads, size_t queueCapacity);
+
+        // Destructor (drains and joins)
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Queue a task on the worker owning this key (blocks while full)
+        void submit(size_t key, std::function<void()> task);
+
+        // Queue a task on the next worker in round-robin order
+        void submit(std::function<void()> task);
+
+        // Queue a task on the worker owning this key unless its queue is
+        // full; false (and the task dropped) if it is
+        bool trySubmit(size_t key, std::function<void()> task);
+
+        // The same, round-robin
+        bool trySubmit(std::function<void()> task);
+
+        // Queue a task on the worker owning this key even past capacity
+        // (never blocks)
+        void push(size_t key, std::function<void()> task);
+
+        // Finish queued tasks and join all workers
+        void shutdown();
+
+        // Number of worker threads
+        size_t size() const { return workers.size(); }
+
+    private:
+        struct Worker {
+            std::thread thread;
+            std::mutex mutex;
+            std::condition_variable notEmpty;
+            std::condition_variable notFull;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        // Worker main loop
+        void workerLoop(Worker& worker);
+
+        // Next key in round-robin order
+        size_t nextKey();
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        size_t capacity; // Max queued tasks per worker
+        size_t nextWorker; // Round-robin cursor
+        std::mutex shutdownMutex;
+        std::atomic<bool> stopping;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "Tracer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+    const std::chrono::steady_clock::time_point TRACE_EPOCH = std::chrono::steady_clock::now();
+
+    // Chrome wants microseconds; keep the nanoseconds as decimals
+    void appendMicros(std::string& out, uint64_t nanos) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%llu.%03llu", static_cast<unsigned long long>(nanos / 1000),
+                      static_cast<unsigned long long>(nanos % 1000));
+        out += buffer;
+    }
+}
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+uint64_t Tracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - TRACE_EPOCH).count();
+}
+
+Tracer::ThreadBuffer& Tracer::localBuffer() {
+    thread_local ThreadBuffer* local = nullptr;
+    if (local == nullptr) {
+        static std::atomic<uint32_t> nextTid { 1 };
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->tid = nextTid.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(buffer);
+        local = buffer.get();
+    }
+    return *local;
+}
+
+void Tracer::record(const TraceEvent& event) {
+    ThreadBuffer& buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+
+    if (buffer.events.size() < EVENTS_PER_THREAD) {
+        buffer.events.push_back(event);
+        return;
+    }
+    buffer.events[buffer.next] = event;
+    buffer.next = (buffer.next + 1) % EVENTS_PER_THREAD;
+}
+
+void Tracer::setThreadName(const char* name) {
+    ThreadBuffer& buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.name = name;
+}
+
+std::string Tracer::toJSON() {
+    std::vector<std::shared_ptr<ThreadBuffer>> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads = buffers;
+    }
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    out += "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"blockchain\"}}";
+
+    for (const auto& thread : threads) {
+        std::lock_guard<std::mutex> lock(thread->mutex);
+        std::string tid = std::to_string(thread->tid);
+
+        if (!thread->name.empty()) {
+            out += ",{\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"name\":\"thread_name\",\"args\":{\"name\":\"" +
+                thread->name + "\"}}";
+        }
+
+        // Complete ("X") events; names are string literals and need no escaping
+        for (const TraceEvent& event : thread->events) {
+            out += ",{\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + ",\"name\":\"";
+            out += event.name;
+            out += "\",\"ts\":";
+            appendMicros(out, event.start);
+            out += ",\"dur\":";
+            appendMicros(out, event.duration);
+            if (event.argName != nullptr) {
+                out += ",\"args\":{\"";
+                out += event.argName;
+                out += "\":" + std::to_string(event.arg) + "}";
+            }
+            out += "}";
+        }
+    }
+
+    out += "]}\n";
+    return out;
+}
+
+bool Tracer::writeFile(const std::string& filename) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << toJSON();
+    return static_cast<bool>(file);
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& thread : buffers) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        thread->events.clear();
+        thread->next = 0;
+    }
+}
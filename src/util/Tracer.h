@@ -0,0 +1,115 @@
+// Scoped trace spans, exported in the Chrome trace_event format.
+//
+// A span times the enclosing scope:
+//
+//     TRACE_SPAN("Block::fromJSON");
+//     TRACE_SPAN_ARG("connectNewBlock", "height", block.index);
+//
+// When the scope ends the span is appended to a buffer owned by the current
+// thread. Only a dump reads other threads' buffers, so recording never
+// contends with other threads. Each buffer keeps the most recent
+// EVENTS_PER_THREAD spans. Tracer::toJSON() renders every thread's spans as
+// one trace that chrome://tracing or Perfetto can open.
+//
+// Spans are only compiled in when BLOCKCHAIN_TRACING is defined
+// (make TRACING=1). Otherwise the macros expand to nothing and their
+// arguments are never evaluated.
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One finished span
+struct TraceEvent {
+    const char* name; // String literal
+    const char* argName; // Optional numeric argument, nullptr if none
+    uint64_t arg;
+    uint64_t start; // Nanoseconds since the tracer started
+    uint64_t duration;
+};
+
+class Tracer {
+    public:
+        // Spans kept per thread before the oldest are overwritten
+        static constexpr size_t EVENTS_PER_THREAD = 65536;
+
+        // The process-wide tracer
+        static Tracer& instance();
+
+        // Nanoseconds since the tracer started
+        static uint64_t now();
+
+        // Append a finished span to this thread's buffer
+        void record(const TraceEvent& event);
+
+        // Label this thread in the trace (e.g. "io", "worker")
+        void setThreadName(const char* name);
+
+        // Every thread's spans as Chrome trace_event JSON
+        std::string toJSON();
+
+        // Write toJSON() to a file
+        bool writeFile(const std::string& filename);
+
+        // Forget all recorded spans
+        void clear();
+
+    private:
+        struct ThreadBuffer {
+            std::mutex mutex; // Only contended while dumping
+            uint32_t tid;
+            std::string name;
+            std::vector<TraceEvent> events; // Ring once full
+            size_t next = 0; // Slot the next span goes to once full
+        };
+
+        Tracer() = default;
+
+        // This thread's buffer, registered on first use
+        ThreadBuffer& localBuffer();
+
+        std::mutex mutex; // Guards buffers
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers; // Outlive their threads
+};
+
+// Records the enclosing scope as one span
+class TraceSpan {
+    public:
+        explicit TraceSpan(const char* name, const char* argName = nullptr, uint64_t arg = 0)
+            : name(name), argName(argName), arg(arg), start(Tracer::now()) {}
+
+        ~TraceSpan() {
+            Tracer::instance().record({ name, argName, arg, start, Tracer::now() - start });
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    private:
+        const char* name;
+        const char* argName;
+        uint64_t arg;
+        uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef BLOCKCHAIN_TRACING
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_SPAN_ARG(name, argName, value) \
+    TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, argName, static_cast<uint64_t>(value))
+#define TRACE_THREAD_NAME(name) Tracer::instance().setThreadName(name)
+#else
+#define TRACE_SPAN(name) ((void)0)
+#define TRACE_SPAN_ARG(name, argName, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif